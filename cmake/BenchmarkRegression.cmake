@@ -0,0 +1,61 @@
+# Targets capturing a performance baseline from the benchmark executables, and comparing later runs against it:
+#
+#   benchmark_baseline - run the benchmarks and store the results in VBZ_BENCHMARK_BASELINE.
+#   benchmark_compare  - run the benchmarks again, print the change against the baseline and fail
+#                        if any benchmark lost more than VBZ_BENCHMARK_FAIL_THRESHOLD percent throughput.
+
+find_package(Python3 COMPONENTS Interpreter)
+if (NOT Python3_Interpreter_FOUND)
+    message(STATUS "Python not found - benchmark regression targets disabled")
+    return()
+endif()
+
+set(VBZ_BENCHMARK_BASELINE "${CMAKE_BINARY_DIR}/benchmark_baseline.json"
+    CACHE FILEPATH "Baseline results written by benchmark_baseline, and compared against by benchmark_compare")
+set(VBZ_BENCHMARK_NOISE_THRESHOLD "5"
+    CACHE STRING "Throughput change (percent) treated as noise by benchmark_compare")
+set(VBZ_BENCHMARK_FAIL_THRESHOLD "10"
+    CACHE STRING "Throughput loss (percent) which fails benchmark_compare")
+set(VBZ_BENCHMARK_ARGS "--benchmark_repetitions=3;--benchmark_report_aggregates_only=true"
+    CACHE STRING "Extra arguments passed to the benchmark executables")
+
+set(_benchmark_targets)
+foreach(_target vbz_perf_test vbz_hdf_perf_test)
+    if (TARGET ${_target})
+        list(APPEND _benchmark_targets ${_target})
+    endif()
+endforeach()
+
+set(_benchmark_executables)
+foreach(_target ${_benchmark_targets})
+    list(APPEND _benchmark_executables $<TARGET_FILE:${_target}>)
+endforeach()
+
+set(_benchmark_script "${HDF_PLUGIN_SOURCE_DIR}/python/benchmark/benchmark_regression.py")
+
+add_custom_target(benchmark_baseline
+    COMMAND ${Python3_EXECUTABLE} ${_benchmark_script} capture
+        --output ${VBZ_BENCHMARK_BASELINE}
+        "--benchmark-args=${VBZ_BENCHMARK_ARGS}"
+        ${_benchmark_executables}
+    DEPENDS ${_benchmark_targets}
+    WORKING_DIRECTORY ${CMAKE_SOURCE_DIR}
+    COMMENT "Capturing benchmark baseline"
+    USES_TERMINAL
+    VERBATIM
+)
+
+add_custom_target(benchmark_compare
+    COMMAND ${Python3_EXECUTABLE} ${_benchmark_script} compare
+        --baseline ${VBZ_BENCHMARK_BASELINE}
+        --output ${CMAKE_BINARY_DIR}/benchmark_current.json
+        --noise-threshold ${VBZ_BENCHMARK_NOISE_THRESHOLD}
+        --fail-threshold ${VBZ_BENCHMARK_FAIL_THRESHOLD}
+        "--benchmark-args=${VBZ_BENCHMARK_ARGS}"
+        ${_benchmark_executables}
+    DEPENDS ${_benchmark_targets}
+    WORKING_DIRECTORY ${CMAKE_SOURCE_DIR}
+    COMMENT "Comparing benchmarks against ${VBZ_BENCHMARK_BASELINE}"
+    USES_TERMINAL
+    VERBATIM
+)
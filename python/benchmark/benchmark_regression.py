@@ -0,0 +1,197 @@
+"""Capture google benchmark baselines, and compare later runs against them.
+
+Used by the benchmark_baseline and benchmark_compare cmake targets:
+
+    benchmark_regression.py capture --output baseline.json -- vbz_perf_test vbz_hdf_perf_test
+    benchmark_regression.py compare --baseline baseline.json -- vbz_perf_test vbz_hdf_perf_test
+
+Benchmarks are compared by throughput (bytes, then items per second, falling back to the
+inverse of real time). Changes within the noise threshold are reported as unchanged, and the
+comparison fails if any benchmark loses more throughput than the fail threshold.
+
+Benchmarks reporting memory counters (see allocation_benchmark in vbz_perf.cpp) are also
+compared by them, and the comparison fails if any grows by more than the fail threshold.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def run_benchmarks(executables, benchmark_args):
+    """Run each benchmark executable, returning the combined benchmark results."""
+    results = []
+    for executable in executables:
+        name = os.path.basename(executable)
+        with tempfile.TemporaryDirectory() as temp_dir:
+            output = os.path.join(temp_dir, "results.json")
+            command = [
+                executable,
+                "--benchmark_format=json",
+                "--benchmark_out=%s" % output,
+                "--benchmark_out_format=json",
+            ] + benchmark_args
+            print("Running %s" % " ".join(command), flush=True)
+            subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+            if not os.path.exists(output) or os.path.getsize(output) == 0:
+                # Nothing matched the benchmark filter.
+                print("No benchmarks run by %s" % name)
+                continue
+            with open(output) as f:
+                report = json.load(f)
+
+        for benchmark in report["benchmarks"]:
+            benchmark["executable"] = name
+            results.append(benchmark)
+    return {"benchmarks": results}
+
+
+def throughput(benchmark):
+    """Find a throughput measure for a benchmark result - higher is better."""
+    for counter in ("bytes_per_second", "items_per_second"):
+        if benchmark.get(counter):
+            return float(benchmark[counter])
+    if benchmark.get("real_time"):
+        return 1.0 / float(benchmark["real_time"])
+    return None
+
+
+# Counters where lower is better, compared alongside throughput.
+MEMORY_COUNTERS = ("allocations_per_call", "peak_live_bytes")
+
+
+def summarise(report, measure=throughput):
+    """Map each benchmark to a measure, preferring the median when repetitions were run."""
+    plain = {}
+    medians = {}
+    for benchmark in report["benchmarks"]:
+        if benchmark.get("error_occurred"):
+            continue
+        key = "%s/%s" % (benchmark["executable"], benchmark.get("run_name", benchmark["name"]))
+        value = measure(benchmark)
+        if value is None:
+            continue
+
+        if benchmark.get("run_type") == "aggregate":
+            if benchmark.get("aggregate_name") == "median":
+                medians[key] = value
+        elif key not in plain:
+            plain[key] = value
+
+    plain.update(medians)
+    return plain
+
+
+def compare_memory(baseline, current, fail_threshold):
+    """Print the memory counters which changed, returning the names of those that grew too much."""
+    regressions = []
+    for counter in MEMORY_COUNTERS:
+        measure = lambda benchmark: benchmark.get(counter)
+        baseline_values = summarise(baseline, measure)
+        current_values = summarise(current, measure)
+        for name in sorted(set(baseline_values) & set(current_values)):
+            before = baseline_values[name]
+            after = current_values[name]
+            if after == before:
+                continue
+            # A benchmark which didn't allocate at all regresses on any allocation.
+            limit = before * (1 + fail_threshold / 100)
+            status = "REGRESSION" if after > limit else "~"
+            if after > limit:
+                regressions.append("%s %s" % (name, counter))
+            print("%s %s: %.4g -> %.4g  %s" % (name, counter, before, after, status))
+    return regressions
+
+
+def compare(baseline, current, noise_threshold, fail_threshold):
+    """Print a delta table of current against baseline, returning the regressed benchmark names."""
+    baseline_values = summarise(baseline)
+    current_values = summarise(current)
+
+    names = sorted(set(baseline_values) | set(current_values))
+    width = max([len(name) for name in names] + [len("Benchmark")])
+    print("%-*s %14s %14s %9s  %s" % (width, "Benchmark", "Baseline", "Current", "Delta", "Status"))
+
+    regressions = []
+    for name in names:
+        if name not in current_values:
+            print("%-*s %14.4g %14s %9s  %s" % (width, name, baseline_values[name], "-", "-", "missing"))
+            continue
+        if name not in baseline_values:
+            print("%-*s %14s %14.4g %9s  %s" % (width, name, "-", current_values[name], "-", "new"))
+            continue
+
+        before = baseline_values[name]
+        after = current_values[name]
+        delta = (after - before) / before * 100
+        if delta < -fail_threshold:
+            status = "REGRESSION"
+            regressions.append(name)
+        elif delta < -noise_threshold:
+            status = "slower"
+        elif delta > noise_threshold:
+            status = "faster"
+        else:
+            status = "~"
+        print("%-*s %14.4g %14.4g %+8.1f%%  %s" % (width, name, before, after, delta, status))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    capture_parser = subparsers.add_parser("capture", help="Run benchmarks and store the results as a baseline")
+    capture_parser.add_argument("--output", required=True, help="Baseline file to write")
+
+    compare_parser = subparsers.add_parser("compare", help="Run benchmarks and compare against a baseline")
+    compare_parser.add_argument("--baseline", required=True, help="Baseline file from a previous capture")
+    compare_parser.add_argument("--output", help="Optionally store the current results")
+    compare_parser.add_argument("--noise-threshold", type=float, default=5.0,
+                                help="Throughput change (percent) considered noise")
+    compare_parser.add_argument("--fail-threshold", type=float, default=10.0,
+                                help="Throughput loss (percent) considered a regression")
+
+    for sub in (capture_parser, compare_parser):
+        sub.add_argument("--benchmark-args", default="",
+                         help="Extra (semicolon separated) arguments passed to each benchmark")
+        sub.add_argument("executables", nargs="+", help="Benchmark executables to run")
+
+    args = parser.parse_args()
+    benchmark_args = [arg for arg in args.benchmark_args.split(";") if arg]
+
+    if args.command == "compare" and not os.path.exists(args.baseline):
+        print("No baseline at %s, run the benchmark_baseline target first" % args.baseline)
+        return 1
+
+    current = run_benchmarks(args.executables, benchmark_args)
+
+    if args.command == "capture":
+        with open(args.output, "w") as f:
+            json.dump(current, f, indent=2)
+        print("Stored baseline of %d results in %s" % (len(current["benchmarks"]), args.output))
+        return 0
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(current, f, indent=2)
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    regressions = compare(baseline, current, args.noise_threshold, args.fail_threshold)
+    regressions += compare_memory(baseline, current, args.fail_threshold)
+    if regressions:
+        print("%d benchmark(s) regressed by more than %g%%:" % (len(regressions), args.fail_threshold))
+        for name in regressions:
+            print("  %s" % name)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -9,6 +9,9 @@ import numpy as np
 from _vbz import ffi, lib
 
 
+FLOAT32_VERSION = 0x100
+
+
 def compression_options(zigzag, size, zlevel=1, version=0):
     options = ffi.new("CompressionOptions *")
     options.integer_size = size
@@ -18,11 +21,18 @@ def compression_options(zigzag, size, zlevel=1, version=0):
     return options
 
 
+def default_options(dtype):
+    dtype = np.dtype(dtype)
+    if dtype == np.float32:
+        return compression_options(False, dtype.itemsize, version=FLOAT32_VERSION)
+    zigzag = np.issubdtype(dtype, np.signedinteger)
+    return compression_options(zigzag, dtype.itemsize)
+
+
 def compress(data, options=None):
 
     if options is None:
-        zigzag = np.issubdtype(data.dtype, np.signedinteger)
-        options = compression_options(zigzag, data.dtype.itemsize)
+        options = default_options(data.dtype)
 
     output_size = lib.vbz_max_compressed_size(len(data) * options.integer_size, options)
     output = np.empty(output_size, dtype=np.uint8)
@@ -47,11 +57,7 @@ def compress(data, options=None):
 def decompress(data, dtype, options=None):
 
     if options is None:
-        zigzag = np.issubdtype(dtype, np.signedinteger)
-        try:
-            options = compression_options(zigzag, dtype.itemsize)
-        except TypeError:
-            options = compression_options(zigzag, dtype().itemsize)
+        options = default_options(dtype)
 
     uncompressed_size = lib.vbz_decompressed_size(
         ffi.cast("void const *", ffi.from_buffer(data)), len(data), options
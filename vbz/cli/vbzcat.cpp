@@ -0,0 +1,761 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+# include <fcntl.h>
+# include <io.h>
+#endif
+
+#include "vbz.h"
+#include "vbz_async_pool.h"
+
+// vbzcat compresses raw signal streams into a block container, so files and pipes of any length can be
+// compressed with the blocks spread over a thread pool, and decompressed back.
+//
+// A stream is a StreamHeader, then each block compressed by vbz_compress_checksummed preceded by its
+// compressed size (little endian uint32), ending with a zero size. Blocks are independent and verified
+// by their checksums as they are decompressed.
+
+namespace {
+
+constexpr char stream_magic[4] = { 'V', 'B', 'Z', 'S' };
+constexpr std::uint32_t stream_format_version = 1;
+constexpr std::size_t max_block_size = 1u << 30;
+
+struct StreamHeader
+{
+    char magic[4];
+    std::uint32_t format_version;
+    std::uint32_t block_size;
+    std::uint32_t integer_size;
+    std::uint32_t zstd_compression_level;
+    std::uint32_t vbz_version;
+    std::uint32_t perform_delta_zig_zag;
+};
+
+struct Arguments
+{
+    std::string command;
+    std::string input = "-";
+    std::string output = "-";
+    CompressionOptions options{ true, 2, 1, VBZ_DEFAULT_VERSION };
+    std::size_t block_size = 1 << 20;
+    std::size_t thread_count = 0;
+    bool quiet = false;
+    // Whether -z and -v were given, transcoding keeps the stream's own level and version otherwise.
+    bool zstd_level_set = false;
+    bool vbz_version_set = false;
+};
+
+void print_usage(char const* program)
+{
+    std::cerr
+        << "Usage: " << program << " <compress|decompress|transcode|test|info> [options] [input]\n"
+        << "\n"
+        << "Reads [input] (or stdin, also given as -) and writes to stdout unless -o is given.\n"
+        << "transcode recompresses a stream with the zstd level given by -z and the vbz version given by -v,\n"
+        << "only rerunning zstd unless the vbz version changes.\n"
+        << "\n"
+        << "Options:\n"
+        << "  -o <file>             Output file\n"
+        << "  -i <1|2|4>            Integer size in bytes (default 2)\n"
+        << "  -z <level>            zstd compression level, 0 to disable zstd (default 1)\n"
+        << "  -v <version>          vbz version (default " << VBZ_DEFAULT_VERSION << ", the newest)\n"
+        << "  --no-delta            Don't apply delta zig zag encoding\n"
+        << "  --float32             Compress float32 samples (implies -i 4 -v " << VBZ_FLOAT32_VERSION << ")\n"
+        << "  -b <bytes>            Block size (default 1MB)\n"
+        << "  -t <threads>          Compression threads (default one per core)\n"
+        << "  -q                    Don't report throughput and ratio\n";
+}
+
+bool parse_arguments(int argc, char** argv, Arguments& arguments)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+    arguments.command = argv[1];
+
+    bool input_set = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string const argument = argv[i];
+        auto const value = [&](unsigned long& result) {
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            char* end = nullptr;
+            result = std::strtoul(argv[++i], &end, 10);
+            return *end == '\0';
+        };
+
+        unsigned long number = 0;
+        if (argument == "-o" && i + 1 < argc)
+        {
+            arguments.output = argv[++i];
+        }
+        else if (argument == "-i" && value(number))
+        {
+            arguments.options.integer_size = (unsigned int)number;
+        }
+        else if (argument == "-z" && value(number))
+        {
+            arguments.options.zstd_compression_level = (unsigned int)number;
+            arguments.zstd_level_set = true;
+        }
+        else if (argument == "-v" && value(number))
+        {
+            arguments.options.vbz_version = (unsigned int)number;
+            arguments.vbz_version_set = true;
+        }
+        else if (argument == "--no-delta")
+        {
+            arguments.options.perform_delta_zig_zag = false;
+        }
+        else if (argument == "--float32")
+        {
+            arguments.options.vbz_version = VBZ_FLOAT32_VERSION;
+            arguments.options.integer_size = 4;
+            arguments.vbz_version_set = true;
+        }
+        else if (argument == "-b" && value(number) && number != 0)
+        {
+            arguments.block_size = number;
+        }
+        else if (argument == "-t" && value(number))
+        {
+            arguments.thread_count = number;
+        }
+        else if (argument == "-q")
+        {
+            arguments.quiet = true;
+        }
+        else if ((argument == "-" || argument[0] != '-') && !input_set)
+        {
+            arguments.input = argument;
+            input_set = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Blocks hold whole integers, and must have a size vbz can describe.
+    auto const integer_size = std::max<std::size_t>(arguments.options.integer_size, 1);
+    arguments.block_size = std::min(arguments.block_size, max_block_size);
+    arguments.block_size = std::max(arguments.block_size / integer_size * integer_size, integer_size);
+    return true;
+}
+
+using File = std::unique_ptr<std::FILE, int (*)(std::FILE*)>;
+
+int dont_close(std::FILE*) { return 0; }
+
+File open_file(std::string const& path, char const* mode, std::FILE* standard)
+{
+    if (path == "-")
+    {
+#if defined(_WIN32)
+        _setmode(_fileno(standard), _O_BINARY);
+#endif
+        return File(standard, &dont_close);
+    }
+    return File(std::fopen(path.c_str(), mode), &std::fclose);
+}
+
+// Read as much of [size] as the stream holds, returning the amount read.
+std::size_t read_fully(std::FILE* file, void* data, std::size_t size)
+{
+    return std::fread(data, 1, size, file);
+}
+
+bool read_uint32(std::FILE* file, std::uint32_t& value)
+{
+    unsigned char bytes[4];
+    if (read_fully(file, bytes, sizeof(bytes)) != sizeof(bytes))
+    {
+        return false;
+    }
+    value = std::uint32_t(bytes[0]) | std::uint32_t(bytes[1]) << 8 | std::uint32_t(bytes[2]) << 16
+        | std::uint32_t(bytes[3]) << 24;
+    return true;
+}
+
+bool write_uint32(std::FILE* file, std::uint32_t value)
+{
+    unsigned char const bytes[4] = {
+        (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+    };
+    return std::fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+}
+
+bool write_header(std::FILE* file, Arguments const& arguments)
+{
+    std::uint32_t const fields[] = {
+        stream_format_version,
+        std::uint32_t(arguments.block_size),
+        arguments.options.integer_size,
+        arguments.options.zstd_compression_level,
+        arguments.options.vbz_version,
+        arguments.options.perform_delta_zig_zag ? 1u : 0u,
+    };
+    if (std::fwrite(stream_magic, 1, sizeof(stream_magic), file) != sizeof(stream_magic))
+    {
+        return false;
+    }
+    for (auto field : fields)
+    {
+        if (!write_uint32(file, field))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_header(std::FILE* file, StreamHeader& header)
+{
+    if (read_fully(file, header.magic, sizeof(header.magic)) != sizeof(header.magic)
+        || std::memcmp(header.magic, stream_magic, sizeof(stream_magic)) != 0)
+    {
+        return false;
+    }
+    std::uint32_t* const fields[] = {
+        &header.format_version, &header.block_size, &header.integer_size, &header.zstd_compression_level,
+        &header.vbz_version, &header.perform_delta_zig_zag,
+    };
+    for (auto field : fields)
+    {
+        if (!read_uint32(file, *field))
+        {
+            return false;
+        }
+    }
+    return header.format_version == stream_format_version && header.block_size != 0 && header.block_size <= max_block_size;
+}
+
+CompressionOptions header_options(StreamHeader const& header)
+{
+    return CompressionOptions{
+        header.perform_delta_zig_zag != 0,
+        header.integer_size,
+        header.zstd_compression_level,
+        header.vbz_version,
+    };
+}
+
+// A block being (de)compressed on the pool, the slots are reused in order so output stays in order.
+struct BlockSlot
+{
+    std::vector<char> input;
+    std::size_t input_size = 0;
+    std::vector<char> output;
+    VbzAsyncJob job;
+    bool in_flight = false;
+    bool done = false;
+};
+
+// Runs blocks on a pool, keeping up to two per thread in flight, and hands back their results in the
+// order they were submitted.
+class BlockPipeline
+{
+public:
+    BlockPipeline(std::size_t thread_count, VbzAsyncJob::Function function, CompressionOptions const& options)
+    : m_pool(thread_count)
+    , m_slots(2 * m_pool.worker_count())
+    , m_function(function)
+    , m_options(options)
+    {
+    }
+
+    // Converts blocks written with [source_options] to [options] with [run], which finds the pipeline
+    // in the job's context.
+    BlockPipeline(
+        std::size_t thread_count,
+        VbzAsyncJob::Run run,
+        CompressionOptions const& options,
+        CompressionOptions const& source_options)
+    : m_pool(thread_count)
+    , m_slots(2 * m_pool.worker_count())
+    , m_run(run)
+    , m_options(options)
+    , m_source_options(source_options)
+    {
+    }
+
+    ~BlockPipeline()
+    {
+        for (std::size_t i = 0; i < m_slots.size(); ++i)
+        {
+            wait(m_slots[i]);
+        }
+    }
+
+    // Find the next slot to fill, first passing the result of the block it held (if any) to [consume].
+    template <typename Consume>
+    BlockSlot* next_slot(Consume&& consume)
+    {
+        auto& slot = m_slots[m_next++ % m_slots.size()];
+        if (slot.in_flight)
+        {
+            wait(slot);
+            slot.in_flight = false;
+            if (!consume(slot))
+            {
+                return nullptr;
+            }
+        }
+        return &slot;
+    }
+
+    // Run the block of [input_size] bytes in [slot], writing up to [output_capacity] bytes.
+    void submit(BlockSlot& slot, std::size_t output_capacity)
+    {
+        slot.output.resize(output_capacity);
+        slot.job = VbzAsyncJob{};
+        slot.job.function = m_function;
+        slot.job.run = m_run;
+        slot.job.source = slot.input.data();
+        slot.job.source_size = vbz_size_t(slot.input_size);
+        slot.job.destination = slot.output.data();
+        slot.job.destination_capacity = vbz_size_t(slot.output.size());
+        slot.job.options = m_options;
+        slot.job.complete = &BlockPipeline::complete;
+        slot.job.context = this;
+        slot.done = false;
+        slot.in_flight = true;
+        m_pool.submit(slot.job);
+    }
+
+    // Pass the results of every block still in flight to [consume], in order.
+    template <typename Consume>
+    bool finish(Consume&& consume)
+    {
+        for (std::size_t i = 0; i < m_slots.size(); ++i)
+        {
+            auto& slot = m_slots[m_next++ % m_slots.size()];
+            if (slot.in_flight)
+            {
+                wait(slot);
+                slot.in_flight = false;
+                if (!consume(slot))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    CompressionOptions const& source_options() const { return m_source_options; }
+
+private:
+    static void complete(VbzAsyncJob& job)
+    {
+        auto const pipeline = static_cast<BlockPipeline*>(job.context);
+        std::lock_guard<std::mutex> lock(pipeline->m_mutex);
+        for (auto& slot : pipeline->m_slots)
+        {
+            if (&slot.job == &job)
+            {
+                slot.done = true;
+            }
+        }
+        pipeline->m_completed.notify_all();
+    }
+
+    void wait(BlockSlot& slot)
+    {
+        if (!slot.in_flight)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_completed.wait(lock, [&] { return slot.done; });
+    }
+
+    VbzAsyncPool m_pool;
+    std::vector<BlockSlot> m_slots;
+    std::size_t m_next = 0;
+    VbzAsyncJob::Function m_function = nullptr;
+    VbzAsyncJob::Run m_run = nullptr;
+    CompressionOptions m_options;
+    CompressionOptions m_source_options{};
+    std::mutex m_mutex;
+    std::condition_variable m_completed;
+};
+
+struct Totals
+{
+    std::uint64_t decompressed_bytes = 0;
+    std::uint64_t compressed_bytes = 0;
+    std::uint64_t block_count = 0;
+};
+
+bool report_error(char const* message, vbz_size_t result = 0)
+{
+    std::cerr << "vbzcat: " << message;
+    if (vbz_is_error(result))
+    {
+        std::cerr << " (" << vbz_error_string(result) << ")";
+    }
+    std::cerr << std::endl;
+    return false;
+}
+
+bool compress_stream(std::FILE* input, std::FILE* output, Arguments const& arguments, Totals& totals)
+{
+    auto const capacity = vbz_max_checksummed_compressed_size(vbz_size_t(arguments.block_size), &arguments.options);
+    if (vbz_is_error(capacity))
+    {
+        return report_error("invalid compression options", capacity);
+    }
+    if (!write_header(output, arguments))
+    {
+        return report_error("failed to write the output");
+    }
+
+    BlockPipeline pipeline(arguments.thread_count, &vbz_compress_checksummed, arguments.options);
+    auto const write_block = [&](BlockSlot& slot) {
+        auto const size = slot.job.result;
+        if (vbz_is_error(size))
+        {
+            return report_error("failed to compress a block", size);
+        }
+        if (!write_uint32(output, size) || std::fwrite(slot.output.data(), 1, size, output) != size)
+        {
+            return report_error("failed to write the output");
+        }
+        totals.compressed_bytes += size + 4;
+        ++totals.block_count;
+        return true;
+    };
+
+    for (;;)
+    {
+        auto const slot = pipeline.next_slot(write_block);
+        if (!slot)
+        {
+            return false;
+        }
+        slot->input.resize(arguments.block_size);
+        auto const size = read_fully(input, slot->input.data(), arguments.block_size);
+        if (size == 0)
+        {
+            break;
+        }
+        // Without integer encoding (integer size 0) any number of bytes can be compressed.
+        if (arguments.options.integer_size != 0 && size % arguments.options.integer_size != 0)
+        {
+            return report_error("the input ends part way through an integer");
+        }
+        slot->input_size = size;
+        totals.decompressed_bytes += size;
+        pipeline.submit(*slot, capacity);
+    }
+    if (std::ferror(input))
+    {
+        return report_error("failed to read the input");
+    }
+
+    return pipeline.finish(write_block) && write_uint32(output, 0);
+}
+
+// Decompress a stream, writing the data to [output] if it isn't null.
+bool decompress_stream(std::FILE* input, std::FILE* output, Arguments const& arguments, Totals& totals)
+{
+    StreamHeader header;
+    if (!read_header(input, header))
+    {
+        return report_error("the input is not a vbzcat stream");
+    }
+    auto const options = header_options(header);
+    auto const max_compressed_size = vbz_max_checksummed_compressed_size(header.block_size, &options);
+    if (vbz_is_error(max_compressed_size))
+    {
+        return report_error("the stream's options are invalid", max_compressed_size);
+    }
+
+    BlockPipeline pipeline(arguments.thread_count, &vbz_decompress_checksummed, options);
+    auto const write_block = [&](BlockSlot& slot) {
+        auto const size = slot.job.result;
+        if (vbz_is_error(size))
+        {
+            return report_error("failed to decompress a block", size);
+        }
+        if (output && std::fwrite(slot.output.data(), 1, size, output) != size)
+        {
+            return report_error("failed to write the output");
+        }
+        totals.decompressed_bytes += size;
+        ++totals.block_count;
+        return true;
+    };
+
+    for (;;)
+    {
+        std::uint32_t size = 0;
+        if (!read_uint32(input, size))
+        {
+            return report_error("the stream is truncated");
+        }
+        if (size == 0)
+        {
+            break;
+        }
+        if (size > max_compressed_size)
+        {
+            return report_error("the stream is corrupt");
+        }
+
+        auto const slot = pipeline.next_slot(write_block);
+        if (!slot)
+        {
+            return false;
+        }
+        slot->input.resize(std::max<std::size_t>(slot->input.size(), size));
+        slot->input_size = size;
+        if (read_fully(input, slot->input.data(), size) != size)
+        {
+            return report_error("the stream is truncated");
+        }
+        totals.compressed_bytes += size + 4;
+        pipeline.submit(*slot, header.block_size);
+    }
+
+    return pipeline.finish(write_block);
+}
+
+vbz_size_t transcode_block(VbzAsyncJob& job)
+{
+    auto const pipeline = static_cast<BlockPipeline const*>(job.context);
+    return vbz_transcode_checksummed(job.source, job.source_size, job.destination, job.destination_capacity,
+        &pipeline->source_options(), &job.options);
+}
+
+// Recompress a stream's blocks with the zstd level and vbz version in [arguments], keeping its block size.
+bool transcode_stream(std::FILE* input, std::FILE* output, Arguments const& arguments, Totals& totals)
+{
+    StreamHeader header;
+    if (!read_header(input, header))
+    {
+        return report_error("the input is not a vbzcat stream");
+    }
+    auto const source_options = header_options(header);
+    auto const max_compressed_size = vbz_max_checksummed_compressed_size(header.block_size, &source_options);
+    if (vbz_is_error(max_compressed_size))
+    {
+        return report_error("the stream's options are invalid", max_compressed_size);
+    }
+
+    Arguments transcoded = arguments;
+    transcoded.block_size = header.block_size;
+    transcoded.options = source_options;
+    if (arguments.zstd_level_set)
+    {
+        transcoded.options.zstd_compression_level = arguments.options.zstd_compression_level;
+    }
+    if (arguments.vbz_version_set)
+    {
+        transcoded.options.vbz_version = arguments.options.vbz_version;
+    }
+    auto const capacity = vbz_max_checksummed_compressed_size(header.block_size, &transcoded.options);
+    if (vbz_is_error(capacity))
+    {
+        return report_error("invalid compression options", capacity);
+    }
+    if (!write_header(output, transcoded))
+    {
+        return report_error("failed to write the output");
+    }
+
+    BlockPipeline pipeline(arguments.thread_count, &transcode_block, transcoded.options, source_options);
+    auto const write_block = [&](BlockSlot& slot) {
+        auto const size = slot.job.result;
+        if (vbz_is_error(size))
+        {
+            return report_error("failed to transcode a block", size);
+        }
+        if (!write_uint32(output, size) || std::fwrite(slot.output.data(), 1, size, output) != size)
+        {
+            return report_error("failed to write the output");
+        }
+        totals.compressed_bytes += size + 4;
+        ++totals.block_count;
+        return true;
+    };
+
+    for (;;)
+    {
+        std::uint32_t size = 0;
+        if (!read_uint32(input, size))
+        {
+            return report_error("the stream is truncated");
+        }
+        if (size == 0)
+        {
+            break;
+        }
+        if (size > max_compressed_size)
+        {
+            return report_error("the stream is corrupt");
+        }
+
+        auto const slot = pipeline.next_slot(write_block);
+        if (!slot)
+        {
+            return false;
+        }
+        slot->input.resize(std::max<std::size_t>(slot->input.size(), size));
+        slot->input_size = size;
+        if (read_fully(input, slot->input.data(), size) != size)
+        {
+            return report_error("the stream is truncated");
+        }
+        auto const decompressed_size = vbz_decompressed_size(slot->input.data(), size, &source_options);
+        if (vbz_is_error(decompressed_size))
+        {
+            return report_error("the stream is corrupt", decompressed_size);
+        }
+        totals.decompressed_bytes += decompressed_size;
+        pipeline.submit(*slot, capacity);
+    }
+
+    return pipeline.finish(write_block) && write_uint32(output, 0);
+}
+
+// Describe a stream, reading the block sizes without decompressing.
+bool describe_stream(std::FILE* input, Totals& totals)
+{
+    StreamHeader header;
+    if (!read_header(input, header))
+    {
+        return report_error("the input is not a vbzcat stream");
+    }
+    auto const options = header_options(header);
+
+    std::vector<char> block;
+    for (;;)
+    {
+        std::uint32_t size = 0;
+        if (!read_uint32(input, size))
+        {
+            return report_error("the stream is truncated");
+        }
+        if (size == 0)
+        {
+            break;
+        }
+        block.resize(size);
+        if (read_fully(input, block.data(), size) != size)
+        {
+            return report_error("the stream is truncated");
+        }
+        auto const decompressed_size = vbz_decompressed_size(block.data(), size, &options);
+        if (vbz_is_error(decompressed_size))
+        {
+            return report_error("the stream is corrupt", decompressed_size);
+        }
+        totals.compressed_bytes += size + 4;
+        totals.decompressed_bytes += decompressed_size;
+        ++totals.block_count;
+    }
+
+    std::cout
+        << "block size:             " << header.block_size << "\n"
+        << "integer size:           " << header.integer_size << "\n"
+        << "delta zig zag:          " << (header.perform_delta_zig_zag ? "yes" : "no") << "\n"
+        << "zstd compression level: " << header.zstd_compression_level << "\n"
+        << "vbz version:            " << header.vbz_version << "\n"
+        << "data type:              " << (header.vbz_version == VBZ_FLOAT32_VERSION ? "float32" : "integer") << "\n"
+        << "blocks:                 " << totals.block_count << "\n"
+        << "decompressed size:      " << totals.decompressed_bytes << "\n"
+        << "compressed size:        " << totals.compressed_bytes << "\n";
+    return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Arguments arguments;
+    if (!parse_arguments(argc, argv, arguments))
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    auto input = open_file(arguments.input, "rb", stdin);
+    if (!input)
+    {
+        std::cerr << "vbzcat: failed to open " << arguments.input << std::endl;
+        return 1;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    Totals totals;
+    bool succeeded = false;
+    if (arguments.command == "info")
+    {
+        succeeded = describe_stream(input.get(), totals);
+        arguments.quiet = true;
+    }
+    else if (arguments.command == "test")
+    {
+        succeeded = decompress_stream(input.get(), nullptr, arguments, totals);
+    }
+    else if (arguments.command == "compress" || arguments.command == "decompress" || arguments.command == "transcode")
+    {
+        auto output = open_file(arguments.output, "wb", stdout);
+        if (!output)
+        {
+            std::cerr << "vbzcat: failed to open " << arguments.output << std::endl;
+            return 1;
+        }
+        if (arguments.command == "compress")
+        {
+            succeeded = compress_stream(input.get(), output.get(), arguments, totals);
+        }
+        else if (arguments.command == "transcode")
+        {
+            succeeded = transcode_stream(input.get(), output.get(), arguments, totals);
+        }
+        else
+        {
+            succeeded = decompress_stream(input.get(), output.get(), arguments, totals);
+        }
+        succeeded = std::fflush(output.get()) == 0 && succeeded;
+    }
+    else
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if (succeeded && !arguments.quiet)
+    {
+        auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "vbzcat: " << totals.decompressed_bytes << " bytes <-> " << totals.compressed_bytes
+                  << " bytes in " << totals.block_count << " blocks, ratio "
+                  << double(totals.decompressed_bytes) / double(std::max<std::uint64_t>(totals.compressed_bytes, 1))
+                  << ", " << double(totals.decompressed_bytes) / 1e6 / std::max(seconds, 1e-9) << " MB/s"
+                  << std::endl;
+    }
+    if (succeeded && arguments.command == "test")
+    {
+        std::cerr << "vbzcat: " << arguments.input << ": OK" << std::endl;
+    }
+    return succeeded ? 0 : 1;
+}
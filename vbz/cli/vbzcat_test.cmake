@@ -0,0 +1,63 @@
+# Round trips each file in INPUT_DIR through vbzcat, checking every output byte for byte:
+#
+#   cmake -DVBZCAT=<vbzcat> -DINPUT_DIR=<dir> -DWORK_DIR=<dir> -P vbzcat_test.cmake
+#
+# Small blocks on several threads keep many blocks in flight through the pipeline.
+
+function(run_vbzcat)
+    execute_process(
+        COMMAND ${VBZCAT} ${ARGN}
+        RESULT_VARIABLE result
+        ERROR_VARIABLE error
+    )
+    if (NOT result EQUAL 0)
+        string(REPLACE ";" " " arguments "${ARGN}")
+        message(FATAL_ERROR "vbzcat ${arguments} failed (${result}):\n${error}")
+    endif()
+endfunction()
+
+function(check_same expected actual)
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${expected} ${actual}
+        RESULT_VARIABLE result
+    )
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${actual} differs from ${expected}")
+    endif()
+endfunction()
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+file(GLOB inputs ${INPUT_DIR}/*)
+if (NOT inputs)
+    message(FATAL_ERROR "No test data in ${INPUT_DIR}")
+endif()
+
+foreach(input ${inputs})
+    get_filename_component(name ${input} NAME)
+    set(stream ${WORK_DIR}/${name}.vbz)
+    set(options -q -b 65536 -t 4)
+
+    run_vbzcat(compress ${options} -o ${stream} ${input})
+    run_vbzcat(test ${options} ${stream})
+    run_vbzcat(decompress ${options} -o ${WORK_DIR}/${name} ${stream})
+    check_same(${input} ${WORK_DIR}/${name})
+
+    # Only rerunning zstd, then also reencoding the integers with another vbz version.
+    run_vbzcat(transcode ${options} -z 5 -o ${stream}.z5 ${stream})
+    run_vbzcat(transcode ${options} -v 0 -o ${stream}.v0 ${stream}.z5)
+    foreach(transcoded ${stream}.z5 ${stream}.v0)
+        run_vbzcat(test ${options} ${transcoded})
+        run_vbzcat(decompress ${options} -o ${transcoded}.out ${transcoded})
+        check_same(${input} ${transcoded}.out)
+    endforeach()
+
+    # zstd alone, without integer encoding.
+    run_vbzcat(compress ${options} -i 0 -o ${stream}.i0 ${input})
+    run_vbzcat(test ${options} ${stream}.i0)
+    run_vbzcat(decompress ${options} -o ${stream}.i0.out ${stream}.i0)
+    check_same(${input} ${stream}.i0.out)
+endforeach()
+
+file(REMOVE_RECURSE ${WORK_DIR})
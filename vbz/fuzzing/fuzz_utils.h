@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+// Enable debug log messages.
+#define DEBUG_LOGGING 0
+
+template <bool ShouldLog = DEBUG_LOGGING, typename... Args>
+void debug_log(Args&&... args)
+{
+    if (ShouldLog) {
+        (std::cout << ... << std::forward<Args>(args)) << std::endl;
+    }
+}
+
+#define REQUIRE(x, ...) \
+    if (!(x)) { \
+        debug_log<true>("Check on line ", __LINE__, " failed: " #x, __VA_ARGS__); \
+        std::abort(); \
+    }
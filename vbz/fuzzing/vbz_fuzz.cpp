@@ -1,3 +1,5 @@
+#include "fuzz_utils.h"
+
 #include <limits>
 #include <vbz.h>
 
@@ -10,9 +12,6 @@
 #include <utility>
 #include <vector>
 
-// Enable debug log messages.
-#define DEBUG_LOGGING 0
-
 // Speed up the decompress tests, at the cost of potentially missing out of bounds reads/writes.
 // Only seems to impact sanitizers on macOS.
 #ifdef __APPLE__
@@ -23,20 +22,6 @@
 
 namespace {
 
-template <bool ShouldLog = DEBUG_LOGGING, typename... Args>
-void debug_log(Args&&... args)
-{
-    if (ShouldLog) {
-        (std::cout << ... << std::forward<Args>(args)) << std::endl;
-    }
-}
-
-#define REQUIRE(x, ...) \
-    if (!(x)) { \
-        debug_log<true>("Check on line ", __LINE__, " failed: " #x, __VA_ARGS__); \
-        std::abort(); \
-    }
-
 // For fatal errors
 #define REQUIRE_NO_VBZ_ERROR(x) \
     do { \
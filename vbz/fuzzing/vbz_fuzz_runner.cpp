@@ -1,4 +1,9 @@
-#include "vbz_fuzz.cpp"
+// The fuzz target to run, runners for other targets define this to their own source.
+#ifndef VBZ_FUZZ_TARGET
+#define VBZ_FUZZ_TARGET "vbz_fuzz.cpp"
+#endif
+#include VBZ_FUZZ_TARGET
+
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
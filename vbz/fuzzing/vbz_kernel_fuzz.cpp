@@ -0,0 +1,134 @@
+#include "fuzz_utils.h"
+
+#include "v0/vbz_streamvbyte.h"
+#include "v0/vbz_streamvbyte_impl.h"
+
+#include <gsl/gsl-lite.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+// Differential fuzzing of every streamvbyte kernel available on the platform (see StreamVByteKernelsV0).
+//
+// Each kernel must produce bit identical compressed output, decode to identical output, and reject
+// corrupt streams with the same error as the generic kernel.
+
+namespace {
+
+// Limit the destination sizes tried when decoding arbitrary data.
+constexpr std::size_t max_guess_element_count = 4096;
+
+template <typename Kernels, typename Fn>
+void for_each_kernel(Fn&& fn)
+{
+    std::apply([&](auto... kernels) { (fn(kernels), ...); }, Kernels{});
+}
+
+template <typename T, bool UseZigZag>
+void run_kernel_compress_test(const uint8_t* data, std::size_t size)
+{
+    using Kernels = typename StreamVByteKernelsV0<T, UseZigZag>::Kernels;
+    using Reference = std::tuple_element_t<0, Kernels>;
+
+    // Copy to an aligned buffer of whole integers.
+    std::vector<T> input(size / sizeof(T));
+    std::memcpy(input.data(), data, input.size() * sizeof(T));
+    auto const input_bytes = gsl::make_span(input).template as_span<char const>();
+
+    auto const max_size = vbz_max_streamvbyte_compressed_size_v0(sizeof(T), vbz_size_t(input_bytes.size()));
+    std::vector<char> expected(max_size);
+    auto const expected_size = Reference::compress(input_bytes, gsl::make_span(expected));
+    REQUIRE(expected_size <= max_size, "expected_size=", expected_size, ", max_size=", max_size);
+    expected.resize(expected_size);
+
+    for_each_kernel<Kernels>([&](auto kernel)
+    {
+        using Kernel = decltype(kernel);
+        debug_log("compress: kernel=", Kernel::name(), ", integer_size=", sizeof(T), ", zig_zag=", UseZigZag);
+
+        std::vector<char> compressed(max_size);
+        auto const compressed_size = Kernel::compress(input_bytes, gsl::make_span(compressed));
+        REQUIRE(compressed_size == expected_size, "kernel=", Kernel::name(), ", compressed_size=", compressed_size, ", expected_size=", expected_size);
+        compressed.resize(compressed_size);
+        REQUIRE(compressed == expected, "kernel=", Kernel::name());
+
+        std::vector<T> decompressed(input.size());
+        auto const decompressed_size = Kernel::decompress(
+            gsl::make_span(expected),
+            gsl::make_span(decompressed).template as_span<char>()
+        );
+        REQUIRE(decompressed_size == input_bytes.size(), "kernel=", Kernel::name(), ", decompressed_size=", decompressed_size);
+        REQUIRE(decompressed == input, "kernel=", Kernel::name());
+    });
+}
+
+template <typename T, bool UseZigZag>
+void run_kernel_decompress_test(const uint8_t* data, std::size_t size)
+{
+    using Kernels = typename StreamVByteKernelsV0<T, UseZigZag>::Kernels;
+    using Reference = std::tuple_element_t<0, Kernels>;
+
+    // Not all platforms have container bounds checking so copy to a vector of the exact size.
+    std::vector<char> const source(data, data + size);
+
+    // Each integer needs at least a quarter byte key and a byte of data.
+    auto const max_element_count = std::min(size * 4 / 5, max_guess_element_count);
+    for (std::size_t element_count = 0; element_count <= max_element_count; ++element_count)
+    {
+        std::vector<T> expected(element_count);
+        auto const expected_size = Reference::decompress(
+            gsl::make_span(source),
+            gsl::make_span(expected).template as_span<char>()
+        );
+
+        for_each_kernel<Kernels>([&](auto kernel)
+        {
+            using Kernel = decltype(kernel);
+            debug_log("decompress: kernel=", Kernel::name(), ", integer_size=", sizeof(T), ", zig_zag=", UseZigZag, ", element_count=", element_count);
+
+            std::vector<T> decompressed(element_count);
+            auto const decompressed_size = Kernel::decompress(
+                gsl::make_span(source),
+                gsl::make_span(decompressed).template as_span<char>()
+            );
+            REQUIRE(decompressed_size == expected_size, "kernel=", Kernel::name(), ", decompressed_size=", decompressed_size, ", expected_size=", expected_size);
+            if (!vbz_is_error(decompressed_size))
+            {
+                REQUIRE(decompressed == expected, "kernel=", Kernel::name());
+            }
+        });
+    }
+}
+
+template <typename T, bool UseZigZag>
+void run_kernel_tests(const uint8_t* data, std::size_t size)
+{
+    run_kernel_compress_test<T, UseZigZag>(data, size);
+    run_kernel_decompress_test<T, UseZigZag>(data, size);
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    // Skip sizes that are too big.
+    if (size > std::numeric_limits<vbz_size_t>::max()) {
+        return 0;
+    }
+
+    debug_log("Begin with ", size, " bytes");
+
+    run_kernel_tests<std::int8_t, true>(data, size);
+    run_kernel_tests<std::int8_t, false>(data, size);
+    run_kernel_tests<std::int16_t, true>(data, size);
+    run_kernel_tests<std::int16_t, false>(data, size);
+    run_kernel_tests<std::int32_t, true>(data, size);
+    run_kernel_tests<std::int32_t, false>(data, size);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+
+#if defined(__has_feature)
+# if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || __has_feature(thread_sanitizer)
+#  define VBZ_SANITIZED_ALLOCATOR 1
+# endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+# define VBZ_SANITIZED_ALLOCATOR 1
+#endif
+
+#if defined(__GLIBC__) && !defined(VBZ_SANITIZED_ALLOCATOR)
+# define VBZ_ALLOCATION_COUNTING 1
+#endif
+
+namespace {
+
+std::atomic<bool> counting{ false };
+std::atomic<std::size_t> allocations{ 0 };
+std::atomic<std::size_t> allocated_bytes{ 0 };
+// Signed, as blocks allocated before counting began may be freed while counting.
+std::atomic<std::ptrdiff_t> live_bytes{ 0 };
+std::atomic<std::ptrdiff_t> peak_live_bytes{ 0 };
+
+}
+
+#if defined(VBZ_ALLOCATION_COUNTING)
+
+#include <cerrno>
+#include <cstring>
+#include <malloc.h>
+
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* data, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* data);
+}
+
+namespace {
+
+void count_allocation(void* data)
+{
+    if (!data || !counting.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    auto const size = malloc_usable_size(data);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    auto const live = live_bytes.fetch_add(std::ptrdiff_t(size), std::memory_order_relaxed) + std::ptrdiff_t(size);
+    auto peak = peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+void count_free(void* data)
+{
+    if (data && counting.load(std::memory_order_relaxed))
+    {
+        live_bytes.fetch_sub(std::ptrdiff_t(malloc_usable_size(data)), std::memory_order_relaxed);
+    }
+}
+
+}
+
+extern "C" {
+
+void* malloc(std::size_t size)
+{
+    auto data = __libc_malloc(size);
+    count_allocation(data);
+    return data;
+}
+
+void* calloc(std::size_t count, std::size_t size)
+{
+    auto data = __libc_calloc(count, size);
+    count_allocation(data);
+    return data;
+}
+
+void* realloc(void* data, std::size_t size)
+{
+    count_free(data);
+    auto result = __libc_realloc(data, size);
+    // A failed realloc leaves the original block allocated.
+    count_allocation(result ? result : (size ? data : nullptr));
+    return result;
+}
+
+void free(void* data)
+{
+    count_free(data);
+    __libc_free(data);
+}
+
+void* memalign(std::size_t alignment, std::size_t size)
+{
+    auto data = __libc_memalign(alignment, size);
+    count_allocation(data);
+    return data;
+}
+
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** result, std::size_t alignment, std::size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    auto data = memalign(alignment, size);
+    if (!data && size)
+    {
+        return ENOMEM;
+    }
+    *result = data;
+    return 0;
+}
+
+}
+
+bool AllocationCounter::available()
+{
+    return true;
+}
+
+#else
+
+bool AllocationCounter::available()
+{
+    return false;
+}
+
+#endif
+
+AllocationCounter::AllocationCounter()
+{
+    begin_call();
+    counting.store(true);
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    counting.store(false);
+}
+
+void AllocationCounter::begin_call()
+{
+    allocations.store(0, std::memory_order_relaxed);
+    allocated_bytes.store(0, std::memory_order_relaxed);
+    live_bytes.store(0, std::memory_order_relaxed);
+    peak_live_bytes.store(0, std::memory_order_relaxed);
+}
+
+AllocationCounter::Counts AllocationCounter::end_call() const
+{
+    return Counts{
+        allocations.load(std::memory_order_relaxed),
+        allocated_bytes.load(std::memory_order_relaxed),
+        std::size_t(peak_live_bytes.load(std::memory_order_relaxed)),
+    };
+}
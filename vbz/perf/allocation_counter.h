@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// Allocations made through malloc (and so operator new) while an AllocationCounter is counting.
+//
+// malloc, free and friends are replaced in the benchmark executable, so allocations made inside zstd
+// are seen as well as vbz's own. Sizes are the usable sizes of the blocks, as reported by the allocator.
+// Counting needs glibc, and is unavailable when a sanitizer replaces the allocator itself.
+class AllocationCounter
+{
+public:
+    struct Counts
+    {
+        std::size_t allocations;
+        std::size_t allocated_bytes;
+        // Most bytes live at once, above those live when the call began.
+        std::size_t peak_live_bytes;
+    };
+
+    static bool available();
+
+    // Start counting, one counter may count at a time.
+    AllocationCounter();
+    ~AllocationCounter();
+
+    AllocationCounter(AllocationCounter const&) = delete;
+    AllocationCounter& operator=(AllocationCounter const&) = delete;
+
+    // Start counting a call, from zero.
+    void begin_call();
+    // The counts since begin_call.
+    Counts end_call() const;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+/// \brief Log-linear histogram of latencies, in the style of HdrHistogram.
+///
+/// Values are recorded into buckets covering successive powers of two, each split into
+/// linear sub buckets. This gives a constant relative precision (better than 1%) over the
+/// full range of uint64 values, with constant time recording and fixed memory use.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 8;
+    static constexpr std::uint64_t sub_bucket_count = std::uint64_t(1) << sub_bucket_bits;
+    static constexpr std::uint64_t sub_bucket_half_count = sub_bucket_count / 2;
+
+    LatencyHistogram()
+    : m_counts(index_for(std::numeric_limits<std::uint64_t>::max()) + 1)
+    {
+    }
+
+    void record(std::uint64_t value)
+    {
+        m_counts[index_for(value)] += 1;
+        m_total_count += 1;
+        m_total += double(value);
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    std::uint64_t count() const { return m_total_count; }
+    std::uint64_t min() const { return m_total_count ? m_min : 0; }
+    std::uint64_t max() const { return m_max; }
+    double mean() const { return m_total_count ? m_total / m_total_count : 0.0; }
+
+    /// \brief Find the value [percentile] percent of recorded values are less than or equal to.
+    /// \note Reported as the highest value equivalent to the recorded one (within the histogram precision).
+    std::uint64_t value_at_percentile(double percentile) const
+    {
+        if (m_total_count == 0)
+        {
+            return 0;
+        }
+
+        auto const target = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(percentile / 100 * m_total_count)));
+        std::uint64_t cumulative = 0;
+        for (std::size_t index = 0; index < m_counts.size(); ++index)
+        {
+            cumulative += m_counts[index];
+            if (cumulative >= target)
+            {
+                return std::min(highest_equivalent_value(index), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    /// \brief Print the percentile distribution of recorded values, scaled by [value_scale].
+    void print_percentiles(std::ostream& out, double value_scale) const
+    {
+        static const double percentiles[] = {
+            0, 50, 75, 90, 95, 99, 99.5, 99.9, 99.95, 99.99, 99.999, 100
+        };
+
+        out << std::setw(14) << "Value" << std::setw(12) << "Percentile"
+            << std::setw(12) << "TotalCount" << std::setw(14) << "1/(1-P)" << "\n";
+        for (auto percentile : percentiles)
+        {
+            auto const value = percentile == 0 ? min() : value_at_percentile(percentile);
+            auto const total_count = std::uint64_t(std::ceil(percentile / 100 * m_total_count));
+
+            out << std::setw(14) << std::fixed << std::setprecision(3) << value / value_scale
+                << std::setw(12) << std::setprecision(6) << percentile / 100
+                << std::setw(12) << total_count;
+            if (percentile < 100)
+            {
+                out << std::setw(14) << std::setprecision(2) << 1 / (1 - percentile / 100);
+            }
+            out << "\n";
+        }
+        out << "#[Mean = " << std::setprecision(3) << mean() / value_scale
+            << ", Max = " << max() / value_scale
+            << ", Total count = " << count() << "]\n";
+    }
+
+private:
+    static unsigned bit_length(std::uint64_t value)
+    {
+        unsigned length = 0;
+        while (length < 64 && (value >> length) != 0)
+        {
+            ++length;
+        }
+        return length;
+    }
+
+    // Values below sub_bucket_count are recorded exactly, above that each power of two
+    // range maps onto sub_bucket_half_count linear sub buckets.
+    static std::size_t index_for(std::uint64_t value)
+    {
+        auto const length = bit_length(value);
+        if (length <= sub_bucket_bits)
+        {
+            return std::size_t(value);
+        }
+
+        auto const shift = length - sub_bucket_bits;
+        auto const sub_bucket = (value >> shift) - sub_bucket_half_count;
+        return std::size_t(sub_bucket_count + (shift - 1) * sub_bucket_half_count + sub_bucket);
+    }
+
+    static std::uint64_t highest_equivalent_value(std::size_t index)
+    {
+        if (index < sub_bucket_count)
+        {
+            return index;
+        }
+
+        auto const shift = unsigned((index - sub_bucket_count) / sub_bucket_half_count) + 1;
+        auto const sub_bucket = (index - sub_bucket_count) % sub_bucket_half_count + sub_bucket_half_count;
+        return ((std::uint64_t(sub_bucket) + 1) << shift) - 1;
+    }
+
+    std::vector<std::uint64_t> m_counts;
+    std::uint64_t m_total_count = 0;
+    double m_total = 0;
+    std::uint64_t m_min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t m_max = 0;
+};
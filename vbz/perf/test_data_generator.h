@@ -4,6 +4,7 @@
 
 #include <gsl/gsl-lite.hpp>
 
+#include <algorithm>
 #include <numeric>
 #include <random>
 
@@ -72,3 +73,123 @@ private:
         return results;
     }
 };
+
+// Generator for a single long read, to be split into chunks of any size.
+//
+// test_data is only ~15k samples long, so noise is added to each repeat of it. Otherwise zstd
+// matches whole repeats inside large chunks, flattering larger chunk sizes.
+template <typename T>
+struct LongSignalGenerator
+{
+    static const std::size_t byte_target = 16 * 1024 * 1024; // 16 mb, more than most LLC shares
+
+    static std::vector<T> const& generate()
+    {
+        static auto const generated_signal = do_generation(5);
+        return generated_signal;
+    }
+
+private:
+    static std::vector<T> do_generation(unsigned int seed)
+    {
+        std::default_random_engine rand(seed);
+        std::uniform_int_distribution<int> noise_dist(-4, 4);
+
+        std::vector<T> signal(byte_target / sizeof(T));
+        std::size_t idx = 0;
+        for (auto& e : signal)
+        {
+            e = (T)(test_data[idx] + noise_dist(rand));
+            idx = (idx + 1) % test_data.size();
+        }
+
+        return signal;
+    }
+};
+
+// Generator for a row group of many short reads, cut from LongSignalGenerator's signal.
+template <typename T>
+struct ShortReadGenerator
+{
+    static const std::size_t read_count = 1000;
+
+    static std::vector<std::vector<T>> generate(std::size_t& max_element_count)
+    {
+        std::default_random_engine rand(5);
+        std::uniform_int_distribution<std::size_t> length_dist(1000, 8000);
+
+        auto const& signal = LongSignalGenerator<T>::generate();
+        std::vector<std::vector<T>> results;
+        std::size_t offset = 0;
+        max_element_count = 0;
+        for (std::size_t i = 0; i < read_count; ++i)
+        {
+            auto const length = length_dist(rand);
+            offset = offset + length > signal.size() ? 0 : offset;
+            results.emplace_back(signal.begin() + offset, signal.begin() + offset + length);
+            max_element_count = std::max(max_element_count, length);
+            offset += length;
+        }
+
+        return results;
+    }
+};
+
+// Generator for SignalGenerator's reads converted to picoamps, as floats.
+//
+// The offset and scale are typical calibration values, so the floats carry the full mantissa noise of real data.
+struct CalibratedSignalGenerator
+{
+    static std::vector<std::vector<float>> generate(std::size_t& max_element_count)
+    {
+        auto const offset = 10.0f;
+        auto const scale = 0.1755f;
+
+        std::vector<std::vector<float>> results;
+        for (auto const& read : SignalGenerator<std::int16_t>::generate(max_element_count))
+        {
+            std::vector<float> calibrated(read.size());
+            std::transform(read.begin(), read.end(), calibrated.begin(), [&](std::int16_t sample)
+            {
+                return (sample + offset) * scale;
+            });
+            results.push_back(std::move(calibrated));
+        }
+
+        return results;
+    }
+};
+
+// Generator for a sparse event mask, mostly zeros with short bursts of events.
+struct SparseMaskGenerator
+{
+    static const std::size_t byte_target = 16 * 1024 * 1024; // 16 mb
+    static const std::size_t burst_count = 20000;
+
+    static std::vector<std::uint8_t> const& generate()
+    {
+        static auto const generated_mask = do_generation(5);
+        return generated_mask;
+    }
+
+private:
+    static std::vector<std::uint8_t> do_generation(unsigned int seed)
+    {
+        std::default_random_engine rand(seed);
+        std::uniform_int_distribution<std::size_t> position_dist(0, byte_target - 64);
+        std::uniform_int_distribution<std::size_t> length_dist(1, 64);
+        std::uniform_int_distribution<int> event_dist(1, 3);
+
+        std::vector<std::uint8_t> mask(byte_target);
+        for (std::size_t burst = 0; burst < burst_count; ++burst)
+        {
+            auto const position = position_dist(rand);
+            auto const length = length_dist(rand);
+            for (std::size_t i = position; i < position + length; ++i)
+            {
+                mask[i] = std::uint8_t(event_dist(rand));
+            }
+        }
+        return mask;
+    }
+};
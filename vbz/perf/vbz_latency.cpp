@@ -0,0 +1,373 @@
+#include "vbz.h"
+#include "latency_histogram.h"
+#include "test_data_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+# include <sys/resource.h>
+#endif
+
+// Per call latency of vbz_compress/vbz_decompress over acquisition sized chunks.
+//
+// google benchmark (see vbz_perf.cpp) reports mean throughput, this reports the latency distribution
+// of individual calls, in two modes:
+//
+//   warm - buffers are reused, and the caches hold the working set, as in a busy acquisition loop.
+//   cold - caches are evicted and destinations are newly malloced before every call, as seen by the
+//          first call after idle. The allocator can hand back memory freed by the previous call (small
+//          chunks usually are), so the minor page faults taken per call are reported alongside.
+
+namespace {
+
+struct free_delete
+{
+    void operator()(void* x) { free(x); }
+};
+
+struct HarnessOptions
+{
+    std::size_t iterations = 1000;
+    bool warm = true;
+    bool cold = true;
+    bool distribution = false;
+    std::chrono::microseconds idle{0};
+    unsigned zstd_level = 1;
+    std::vector<std::size_t> chunk_sizes{ 4000, 16000, 64000, 256000 };
+    std::string signal_path = "test_data/reads_test_dat/reads_30.dat";
+};
+
+// Number of distinct chunks cycled through by the timed calls.
+constexpr std::size_t chunk_pool_size = 64;
+
+// Large enough to evict the last level cache on current hardware.
+constexpr std::size_t eviction_buffer_size = 64 * 1024 * 1024;
+
+// Minor page faults taken by the process so far, or 0 where this isn't available.
+std::uint64_t minor_page_faults()
+{
+#ifndef _WIN32
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return std::uint64_t(usage.ru_minflt);
+    }
+#endif
+    return 0;
+}
+
+void evict_caches()
+{
+    static std::vector<char> eviction_buffer(eviction_buffer_size);
+    static char counter = 0;
+    counter += 1;
+    for (std::size_t i = 0; i < eviction_buffer.size(); i += 64)
+    {
+        eviction_buffer[i] += counter;
+    }
+}
+
+// Load recorded signal if available, otherwise fall back to the built in test data.
+// Returns an empty signal if there is no data to load.
+std::vector<std::int16_t> load_signal(std::string const& path, std::size_t min_size)
+{
+    std::vector<std::int16_t> signal;
+    std::ifstream ifs(path, std::ios::binary);
+    if (ifs.is_open())
+    {
+        std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        signal.resize(bytes.size() / sizeof(std::int16_t));
+        std::memcpy(signal.data(), bytes.data(), signal.size() * sizeof(std::int16_t));
+    }
+    else
+    {
+        std::cerr << "Unable to open " << path << ", using built in test data" << std::endl;
+        signal.assign(test_data.begin(), test_data.end());
+    }
+
+    if (signal.empty())
+    {
+        return signal;
+    }
+
+    // Tile the signal out to cover the largest chunk.
+    auto const original_size = signal.size();
+    if (original_size < min_size * 2)
+    {
+        signal.resize(min_size * 2);
+        for (std::size_t i = original_size; i < signal.size(); ++i)
+        {
+            signal[i] = signal[i - original_size];
+        }
+    }
+    return signal;
+}
+
+// Select each chunk from a different position in the signal, so calls don't repeatedly see the same data.
+std::vector<gsl::span<std::int16_t const>> make_chunks(
+    std::vector<std::int16_t> const& signal,
+    std::size_t chunk_size,
+    std::size_t count)
+{
+    std::vector<gsl::span<std::int16_t const>> chunks;
+    auto const positions = signal.size() - chunk_size;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto const offset = (i * 7919 * 61) % positions;
+        chunks.push_back(gsl::make_span(signal).subspan(offset, chunk_size));
+    }
+    return chunks;
+}
+
+// Exit if a timed call failed, its timing would be meaningless.
+void check_result(vbz_size_t result, char const* operation)
+{
+    if (vbz_is_error(result))
+    {
+        std::cerr << "Failed to " << operation << ": " << vbz_error_string(result) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+template <typename Fn>
+std::uint64_t time_call(Fn&& fn)
+{
+    auto const begin = std::chrono::steady_clock::now();
+    fn();
+    auto const end = std::chrono::steady_clock::now();
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+}
+
+void print_summary_header()
+{
+    std::cout << std::left << std::setw(12) << "operation" << std::setw(6) << "mode"
+        << std::right << std::setw(10) << "chunk" << std::setw(8) << "calls"
+        << std::setw(10) << "min" << std::setw(10) << "p50" << std::setw(10) << "p90"
+        << std::setw(10) << "p99" << std::setw(10) << "p999" << std::setw(10) << "max"
+        << std::setw(10) << "faults" << "   (us, faults per call)" << std::endl;
+}
+
+void print_summary(
+    char const* operation,
+    char const* mode,
+    std::size_t chunk_size,
+    LatencyHistogram const& histogram,
+    std::uint64_t page_faults,
+    HarnessOptions const& options)
+{
+    double const us = 1000.0;
+    std::cout << std::left << std::setw(12) << operation << std::setw(6) << mode
+        << std::right << std::setw(10) << chunk_size << std::setw(8) << histogram.count()
+        << std::fixed << std::setprecision(1)
+        << std::setw(10) << histogram.min() / us
+        << std::setw(10) << histogram.value_at_percentile(50) / us
+        << std::setw(10) << histogram.value_at_percentile(90) / us
+        << std::setw(10) << histogram.value_at_percentile(99) / us
+        << std::setw(10) << histogram.value_at_percentile(99.9) / us
+        << std::setw(10) << histogram.max() / us
+        << std::setw(10) << double(page_faults) / double(std::max<std::uint64_t>(histogram.count(), 1))
+        << std::endl;
+
+    if (options.distribution)
+    {
+        histogram.print_percentiles(std::cout, us);
+        std::cout << std::endl;
+    }
+}
+
+void run_chunk_size(std::vector<std::int16_t> const& signal, std::size_t chunk_size, HarnessOptions const& options)
+{
+    CompressionOptions vbz_options{
+        true,
+        sizeof(std::int16_t),
+        options.zstd_level,
+        VBZ_DEFAULT_VERSION
+    };
+
+    auto const chunks = make_chunks(signal, chunk_size, std::min(options.iterations, chunk_pool_size));
+    auto const chunk_bytes = vbz_size_t(chunk_size * sizeof(std::int16_t));
+    auto const max_compressed_size = vbz_max_compressed_size(chunk_bytes, &vbz_options);
+
+    // Compress every chunk up front, as input to the decompression timings.
+    std::vector<std::vector<char>> compressed_chunks;
+    for (auto const& chunk : chunks)
+    {
+        std::vector<char> compressed(max_compressed_size);
+        auto const compressed_size = vbz_compress(chunk.data(), chunk_bytes, compressed.data(), max_compressed_size, &vbz_options);
+        check_result(compressed_size, "compress");
+        compressed.resize(compressed_size);
+        compressed_chunks.push_back(std::move(compressed));
+    }
+
+    if (options.warm)
+    {
+        std::vector<char> compress_dest(max_compressed_size);
+        std::vector<char> decompress_dest(chunk_bytes);
+
+        LatencyHistogram compress_histogram;
+        LatencyHistogram decompress_histogram;
+        std::uint64_t compress_faults = 0;
+        std::uint64_t decompress_faults = 0;
+        for (std::size_t call = 0; call < options.iterations; ++call)
+        {
+            auto const i = call % chunks.size();
+            vbz_size_t result = 0;
+            auto faults = minor_page_faults();
+            compress_histogram.record(time_call([&] {
+                result = vbz_compress(chunks[i].data(), chunk_bytes, compress_dest.data(), max_compressed_size, &vbz_options);
+            }));
+            compress_faults += minor_page_faults() - faults;
+            check_result(result, "compress");
+
+            faults = minor_page_faults();
+            decompress_histogram.record(time_call([&] {
+                result = vbz_decompress(compressed_chunks[i].data(), vbz_size_t(compressed_chunks[i].size()),
+                    decompress_dest.data(), chunk_bytes, &vbz_options);
+            }));
+            decompress_faults += minor_page_faults() - faults;
+            check_result(result, "decompress");
+        }
+        print_summary("compress", "warm", chunk_size, compress_histogram, compress_faults, options);
+        print_summary("decompress", "warm", chunk_size, decompress_histogram, decompress_faults, options);
+    }
+
+    if (options.cold)
+    {
+        LatencyHistogram compress_histogram;
+        LatencyHistogram decompress_histogram;
+        std::uint64_t compress_faults = 0;
+        std::uint64_t decompress_faults = 0;
+        for (std::size_t call = 0; call < options.iterations; ++call)
+        {
+            auto const i = call % chunks.size();
+            vbz_size_t result = 0;
+            evict_caches();
+            std::this_thread::sleep_for(options.idle);
+            std::unique_ptr<void, free_delete> compress_dest(malloc(max_compressed_size));
+            auto faults = minor_page_faults();
+            compress_histogram.record(time_call([&] {
+                result = vbz_compress(chunks[i].data(), chunk_bytes, compress_dest.get(), max_compressed_size, &vbz_options);
+            }));
+            compress_faults += minor_page_faults() - faults;
+            check_result(result, "compress");
+
+            evict_caches();
+            std::this_thread::sleep_for(options.idle);
+            std::unique_ptr<void, free_delete> decompress_dest(malloc(chunk_bytes));
+            faults = minor_page_faults();
+            decompress_histogram.record(time_call([&] {
+                result = vbz_decompress(compressed_chunks[i].data(), vbz_size_t(compressed_chunks[i].size()),
+                    decompress_dest.get(), chunk_bytes, &vbz_options);
+            }));
+            decompress_faults += minor_page_faults() - faults;
+            check_result(result, "decompress");
+        }
+        print_summary("compress", "cold", chunk_size, compress_histogram, compress_faults, options);
+        print_summary("decompress", "cold", chunk_size, decompress_histogram, decompress_faults, options);
+    }
+}
+
+std::vector<std::size_t> parse_sizes(std::string const& list)
+{
+    std::vector<std::size_t> sizes;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        sizes.push_back(std::stoul(item));
+    }
+    return sizes;
+}
+
+void print_usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [options]\n"
+        << "  --iterations=N        Calls timed per chunk size and mode (default 1000)\n"
+        << "  --mode=warm|cold|both Cache state before each call (default both)\n"
+        << "  --chunk-sizes=A,B,... Chunk sizes in samples (default 4000,16000,64000,256000)\n"
+        << "  --zstd-level=N        zstd level to compress with (default 1)\n"
+        << "  --idle-us=N           Sleep before each cold call (default 0)\n"
+        << "  --signal=PATH         Raw int16 signal to chunk (default test_data/reads_test_dat/reads_30.dat)\n"
+        << "  --distribution        Print the full percentile distribution of each histogram\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    HarnessOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        auto const value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--iterations=", 0) == 0)
+        {
+            options.iterations = std::stoul(value);
+        }
+        else if (arg.rfind("--mode=", 0) == 0)
+        {
+            options.warm = value == "warm" || value == "both";
+            options.cold = value == "cold" || value == "both";
+        }
+        else if (arg.rfind("--chunk-sizes=", 0) == 0)
+        {
+            options.chunk_sizes = parse_sizes(value);
+        }
+        else if (arg.rfind("--zstd-level=", 0) == 0)
+        {
+            options.zstd_level = unsigned(std::stoul(value));
+        }
+        else if (arg.rfind("--idle-us=", 0) == 0)
+        {
+            options.idle = std::chrono::microseconds(std::stoul(value));
+        }
+        else if (arg.rfind("--signal=", 0) == 0)
+        {
+            options.signal_path = value;
+        }
+        else if (arg == "--distribution")
+        {
+            options.distribution = true;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.chunk_sizes.empty() || options.iterations == 0)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto const max_chunk_size = *std::max_element(options.chunk_sizes.begin(), options.chunk_sizes.end());
+    auto const signal = load_signal(options.signal_path, max_chunk_size);
+    if (signal.empty())
+    {
+        std::cerr << "No signal to compress in " << options.signal_path << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    print_summary_header();
+    for (auto chunk_size : options.chunk_sizes)
+    {
+        run_chunk_size(signal, chunk_size, options);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,51 @@
 #include "vbz.h"
+#include "vbz_chunk_reader.h"
+#include "vbz_crc32c.h"
+#include "vbz_trace.h"
+#include "allocation_counter.h"
 #include "test_data_generator.h"
 
+#if defined(VBZ_ENABLE_SERVER)
+# include "vbz_server.h"
+#endif
+
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/resource.h>
+# include <unistd.h>
+#endif
+
+// Minor page faults taken by the process so far, or 0 where this isn't available.
+double minor_page_faults()
+{
+#ifndef _WIN32
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return double(usage.ru_minflt);
+    }
+#endif
+    return 0;
+}
+
+// Arena for state.range(0)'s VBZ_SCRATCH_ARENA_* page mode, or no arena for a negative range.
+std::unique_ptr<VbzScratchArena, decltype(&vbz_free_scratch_arena)> make_benchmark_arena(benchmark::State const& state)
+{
+    auto arena = state.range(0) < 0 ? nullptr : vbz_create_scratch_arena((unsigned int)state.range(0));
+    return { arena, &vbz_free_scratch_arena };
+}
+
 template <typename VbzOptions, typename Generator>
 void streamvbyte_compress_benchmark(benchmark::State& state)
 {
@@ -15,7 +58,7 @@ void streamvbyte_compress_benchmark(benchmark::State& state)
         VbzOptions::UseZigZag,
         int_size,
         VbzOptions::ZstdLevel,
-        VBZ_DEFAULT_VERSION
+        VbzOptions::Version
     };
     
     std::vector<char> dest_buffer(vbz_max_compressed_size(vbz_size_t(max_element_count * int_size), &options));
@@ -57,7 +100,8 @@ void streamvbyte_decompress_benchmark(benchmark::State& state)
     CompressionOptions options{
         VbzOptions::UseZigZag,
         int_size,
-        VbzOptions::ZstdLevel
+        VbzOptions::ZstdLevel,
+        VbzOptions::Version
     };
     
     std::vector<char> compressed_buffer(vbz_max_compressed_size(vbz_size_t(max_element_count * int_size), &options));
@@ -102,74 +146,1320 @@ void streamvbyte_decompress_benchmark(benchmark::State& state)
     state.SetBytesProcessed(state.iterations() * item_count * int_size);
 }
 
-template <typename _IntType>
-struct VbzNoZStd
+template <typename VbzOptions, typename Generator>
+void streamvbyte_estimate_benchmark(benchmark::State& state)
 {
-    using IntType = _IntType;
-    static const std::size_t UseZigZag = 1;
-    static const std::size_t ZstdLevel = 0;
-};
+    std::size_t max_element_count = 0;
+    auto input_value_list = Generator::generate(max_element_count);
 
-template <typename _IntType>
-struct VbzZStd
+    auto const int_size = sizeof(typename VbzOptions::IntType);
+    
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    // Compress everything once up front, to report the accuracy of the estimate alongside its cost.
+    // Note SignalGenerator repeats test_data, which zstd matches across - the estimate models entropy
+    // coding only (real signal has no such long range repetition) so overshoots on that data.
+    std::vector<char> dest_buffer(vbz_max_compressed_size(vbz_size_t(max_element_count * int_size), &options));
+    std::size_t compressed_bytes = 0;
+    std::size_t estimated_bytes = 0;
+    for (auto const& input_values : input_value_list)
+    {
+        auto const input_byte_count = vbz_size_t(input_values.size() * sizeof(input_values[0]));
+        compressed_bytes += vbz_compress(
+            input_values.data(),
+            input_byte_count,
+            dest_buffer.data(),
+            vbz_size_t(dest_buffer.size()),
+            &options);
+        estimated_bytes += vbz_estimate_compressed_size(input_values.data(), input_byte_count, &options);
+    }
+
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (auto const& input_values : input_value_list)
+        {
+            auto const input_byte_count = input_values.size() * sizeof(input_values[0]);
+            item_count += input_values.size();
+
+            auto estimated_size = vbz_estimate_compressed_size(
+                input_values.data(),
+                vbz_size_t(input_byte_count),
+                &options);
+
+            benchmark::DoNotOptimize(estimated_size);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * int_size);
+    state.counters["estimate_ratio"] = double(estimated_bytes) / compressed_bytes;
+}
+
+// Split one long read into chunks of state.range(0) raw bytes, to find the chunk size that best fits
+// the cache hierarchy. The chunks are compressed into a single chunk sized buffer, as a writer would.
+template <typename VbzOptions>
+void streamvbyte_chunk_sweep_compress_benchmark(benchmark::State& state)
 {
-    using IntType = _IntType;
-    static const std::size_t UseZigZag = 1;
-    static const std::size_t ZstdLevel = 1;
-};
+    using IntType = typename VbzOptions::IntType;
+    auto const& signal = LongSignalGenerator<IntType>::generate();
 
-template <typename CompressionOptions>
-void compress_sequence(benchmark::State& state)
+    auto const int_size = sizeof(IntType);
+    auto const chunk_element_count = std::size_t(state.range(0)) / int_size;
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<char> dest_buffer(vbz_max_compressed_size(vbz_size_t(chunk_element_count * int_size), &options));
+
+    for (auto _ : state)
+    {
+        for (std::size_t offset = 0; offset < signal.size(); offset += chunk_element_count)
+        {
+            auto const element_count = std::min(chunk_element_count, signal.size() - offset);
+
+            auto bytes_used = vbz_compress(
+                signal.data() + offset,
+                vbz_size_t(element_count * int_size),
+                dest_buffer.data(),
+                vbz_size_t(dest_buffer.size()),
+                &options);
+
+            benchmark::DoNotOptimize(bytes_used);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * signal.size());
+    state.SetBytesProcessed(state.iterations() * signal.size() * int_size);
+}
+
+// Decompress one long read stored as chunks of state.range(0) raw bytes. Each chunk is decoded into
+// the same chunk sized buffer, as a reader consuming the read chunk by chunk would.
+template <typename VbzOptions>
+void streamvbyte_chunk_sweep_decompress_benchmark(benchmark::State& state)
 {
-    streamvbyte_compress_benchmark<CompressionOptions, SequenceGenerator<typename CompressionOptions::IntType>>(state);
+    using IntType = typename VbzOptions::IntType;
+    auto const& signal = LongSignalGenerator<IntType>::generate();
+
+    auto const int_size = sizeof(IntType);
+    auto const chunk_element_count = std::size_t(state.range(0)) / int_size;
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<std::vector<char>> compressed_chunks;
+    std::size_t compressed_bytes = 0;
+    for (std::size_t offset = 0; offset < signal.size(); offset += chunk_element_count)
+    {
+        auto const input_byte_count = vbz_size_t(std::min(chunk_element_count, signal.size() - offset) * int_size);
+        std::vector<char> chunk(vbz_max_compressed_size(input_byte_count, &options));
+        auto compressed_used_bytes = vbz_compress(
+            signal.data() + offset,
+            input_byte_count,
+            chunk.data(),
+            vbz_size_t(chunk.size()),
+            &options);
+        chunk.resize(compressed_used_bytes);
+        compressed_bytes += chunk.size();
+        compressed_chunks.push_back(std::move(chunk));
+    }
+
+    std::vector<char> dest_buffer(chunk_element_count * int_size);
+
+    for (auto _ : state)
+    {
+        for (auto const& chunk : compressed_chunks)
+        {
+            auto bytes_expanded_to = vbz_decompress(
+                chunk.data(),
+                vbz_size_t(chunk.size()),
+                dest_buffer.data(),
+                vbz_size_t(dest_buffer.size()),
+                &options);
+
+            benchmark::DoNotOptimize(bytes_expanded_to);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * signal.size());
+    state.SetBytesProcessed(state.iterations() * signal.size() * int_size);
+    state.counters["compression_ratio"] = double(signal.size() * int_size) / compressed_bytes;
 }
 
-template <typename CompressionOptions>
-void compress_random(benchmark::State& state)
+// Allocations made compressing (state.range(1) == 0) or decompressing (1) one chunk of state.range(0) raw bytes.
+// peak_live_bytes is the most memory held at once by any call, peak_per_chunk_byte relates it to the chunk size.
+template <typename VbzOptions>
+void allocation_benchmark(benchmark::State& state)
 {
-    streamvbyte_compress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+    if (!AllocationCounter::available())
+    {
+        state.SkipWithError("Allocation counting isn't available in this build");
+        return;
+    }
+
+    using IntType = typename VbzOptions::IntType;
+    auto const& signal = LongSignalGenerator<IntType>::generate();
+    auto const chunk_size = vbz_size_t(state.range(0));
+    bool const decompress = state.range(1) != 0;
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        sizeof(IntType),
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<char> compressed(vbz_max_compressed_size(chunk_size, &options));
+    auto const compressed_size = vbz_compress(
+        signal.data(),
+        chunk_size,
+        compressed.data(),
+        vbz_size_t(compressed.size()),
+        &options);
+    std::vector<char> decompressed(chunk_size);
+
+    std::size_t allocations = 0;
+    std::size_t allocated_bytes = 0;
+    std::size_t peak_live_bytes = 0;
+    AllocationCounter counter;
+    for (auto _ : state)
+    {
+        counter.begin_call();
+        auto const result = decompress
+            ? vbz_decompress(compressed.data(), compressed_size, decompressed.data(), chunk_size, &options)
+            : vbz_compress(signal.data(), chunk_size, compressed.data(), vbz_size_t(compressed.size()), &options);
+        auto const counts = counter.end_call();
+        benchmark::DoNotOptimize(result);
+
+        allocations += counts.allocations;
+        allocated_bytes += counts.allocated_bytes;
+        peak_live_bytes = std::max(peak_live_bytes, counts.peak_live_bytes);
+    }
+
+    state.SetBytesProcessed(state.iterations() * chunk_size);
+    state.counters["allocations_per_call"] = benchmark::Counter(double(allocations), benchmark::Counter::kAvgIterations);
+    state.counters["allocated_bytes_per_call"] = benchmark::Counter(double(allocated_bytes), benchmark::Counter::kAvgIterations);
+    state.counters["peak_live_bytes"] = double(peak_live_bytes);
+    state.counters["peak_per_chunk_byte"] = double(peak_live_bytes) / chunk_size;
 }
 
-template <typename CompressionOptions>
-void decompress_sequence(benchmark::State& state)
+// Compress one long read as a single chunk, as when storing concatenated channels, taking the
+// intermediate buffers from a scratch arena with state.range(0)'s page mode (or none, for -1).
+template <typename VbzOptions>
+void arena_compress_benchmark(benchmark::State& state)
 {
-    streamvbyte_decompress_benchmark<CompressionOptions, SequenceGenerator<typename CompressionOptions::IntType>>(state);
+    using IntType = typename VbzOptions::IntType;
+    auto const& signal = LongSignalGenerator<IntType>::generate();
+
+    auto const int_size = sizeof(IntType);
+    auto const input_byte_count = vbz_size_t(signal.size() * int_size);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    auto arena = make_benchmark_arena(state);
+    std::vector<char> dest_buffer(vbz_max_compressed_size(input_byte_count, &options));
+
+    auto const initial_page_faults = minor_page_faults();
+    for (auto _ : state)
+    {
+        auto bytes_used = vbz_compress_with_arena(
+            signal.data(),
+            input_byte_count,
+            dest_buffer.data(),
+            vbz_size_t(dest_buffer.size()),
+            &options,
+            arena.get());
+
+        benchmark::DoNotOptimize(bytes_used);
+    }
+
+    state.SetItemsProcessed(state.iterations() * signal.size());
+    state.SetBytesProcessed(state.iterations() * signal.size() * int_size);
+    state.counters["page_faults"] = benchmark::Counter(minor_page_faults() - initial_page_faults, benchmark::Counter::kAvgIterations);
+    if (arena)
+    {
+        state.counters["page_mode"] = vbz_scratch_arena_page_mode(arena.get());
+    }
 }
 
-template <typename CompressionOptions>
-void decompress_random(benchmark::State& state)
+// Decompress one long read stored as a single chunk, taking the intermediate buffers from a
+// scratch arena with state.range(0)'s page mode (or none, for -1).
+template <typename VbzOptions>
+void arena_decompress_benchmark(benchmark::State& state)
 {
-    streamvbyte_decompress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+    using IntType = typename VbzOptions::IntType;
+    auto const& signal = LongSignalGenerator<IntType>::generate();
+
+    auto const int_size = sizeof(IntType);
+    auto const input_byte_count = vbz_size_t(signal.size() * int_size);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<char> compressed(vbz_max_compressed_size(input_byte_count, &options));
+    compressed.resize(vbz_compress(
+        signal.data(),
+        input_byte_count,
+        compressed.data(),
+        vbz_size_t(compressed.size()),
+        &options));
+
+    auto arena = make_benchmark_arena(state);
+    std::vector<char> dest_buffer(input_byte_count);
+
+    auto const initial_page_faults = minor_page_faults();
+    for (auto _ : state)
+    {
+        auto bytes_expanded_to = vbz_decompress_with_arena(
+            compressed.data(),
+            vbz_size_t(compressed.size()),
+            dest_buffer.data(),
+            vbz_size_t(dest_buffer.size()),
+            &options,
+            arena.get());
+
+        benchmark::DoNotOptimize(bytes_expanded_to);
+    }
+
+    state.SetItemsProcessed(state.iterations() * signal.size());
+    state.SetBytesProcessed(state.iterations() * signal.size() * int_size);
+    state.counters["page_faults"] = benchmark::Counter(minor_page_faults() - initial_page_faults, benchmark::Counter::kAvgIterations);
+    if (arena)
+    {
+        state.counters["page_mode"] = vbz_scratch_arena_page_mode(arena.get());
+    }
 }
 
-BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int32_t>);
-BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int32_t>);
+// Compress a row group of short reads as one batch, reporting the compressed size against
+// compressing each read separately with vbz_compress_sized.
+template <typename VbzOptions>
+void batch_compress_benchmark(benchmark::State& state)
+{
+    using IntType = typename VbzOptions::IntType;
+    std::size_t max_element_count = 0;
+    auto const reads = ShortReadGenerator<IntType>::generate(max_element_count);
 
-BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int32_t>);
-BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int32_t>);
+    auto const int_size = sizeof(IntType);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
 
-BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int32_t>);
-BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int32_t>);
+    std::vector<void const*> sources;
+    std::vector<vbz_size_t> source_sizes;
+    std::size_t item_count = 0;
+    std::size_t separate_bytes = 0;
+    std::vector<char> read_buffer(vbz_max_compressed_size(vbz_size_t(max_element_count * int_size), &options));
+    for (auto const& read : reads)
+    {
+        sources.push_back(read.data());
+        source_sizes.push_back(vbz_size_t(read.size() * int_size));
+        item_count += read.size();
+        separate_bytes += vbz_compress_sized(
+            read.data(),
+            source_sizes.back(),
+            read_buffer.data(),
+            vbz_size_t(read_buffer.size()),
+            &options);
+    }
 
-BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int32_t>);
-BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int8_t>);
-BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int16_t>);
-BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int32_t>);
+    std::vector<char> dest_buffer(vbz_max_batch_compressed_size(source_sizes.data(), vbz_size_t(reads.size()), &options));
+    vbz_size_t batch_bytes = 0;
+    for (auto _ : state)
+    {
+        batch_bytes = vbz_compress_batch(
+            sources.data(),
+            source_sizes.data(),
+            vbz_size_t(reads.size()),
+            dest_buffer.data(),
+            vbz_size_t(dest_buffer.size()),
+            &options);
+
+        benchmark::DoNotOptimize(batch_bytes);
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * int_size);
+    state.counters["batch_ratio"] = double(item_count * int_size) / batch_bytes;
+    state.counters["separate_ratio"] = double(item_count * int_size) / separate_bytes;
+}
+
+// Decompress single reads picked at random from a batch, the batch equivalent of opening one read.
+template <typename VbzOptions>
+void batch_decompress_read_benchmark(benchmark::State& state)
+{
+    using IntType = typename VbzOptions::IntType;
+    std::size_t max_element_count = 0;
+    auto const reads = ShortReadGenerator<IntType>::generate(max_element_count);
+
+    auto const int_size = sizeof(IntType);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<void const*> sources;
+    std::vector<vbz_size_t> source_sizes;
+    for (auto const& read : reads)
+    {
+        sources.push_back(read.data());
+        source_sizes.push_back(vbz_size_t(read.size() * int_size));
+    }
+
+    std::vector<char> batch(vbz_max_batch_compressed_size(source_sizes.data(), vbz_size_t(reads.size()), &options));
+    batch.resize(vbz_compress_batch(
+        sources.data(),
+        source_sizes.data(),
+        vbz_size_t(reads.size()),
+        batch.data(),
+        vbz_size_t(batch.size()),
+        &options));
+
+    std::default_random_engine rand(5);
+    std::uniform_int_distribution<std::uint32_t> read_dist(0, std::uint32_t(reads.size() - 1));
+    std::vector<char> dest_buffer(max_element_count * int_size);
+
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        auto const read_index = read_dist(rand);
+        auto bytes_expanded_to = vbz_decompress_batch_read(
+            batch.data(),
+            vbz_size_t(batch.size()),
+            read_index,
+            dest_buffer.data(),
+            vbz_size_t(dest_buffer.size()),
+            &options);
+        item_count += reads[read_index].size();
+
+        benchmark::DoNotOptimize(bytes_expanded_to);
+    }
+
+    state.SetItemsProcessed(item_count);
+    state.SetBytesProcessed(item_count * int_size);
+}
+
+// Compress with a checksum per block, compare against compress_random for the cost of the checksums.
+template <typename VbzOptions, typename Generator>
+void checksummed_compress_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = Generator::generate(max_element_count);
+
+    auto const int_size = sizeof(typename VbzOptions::IntType);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<char> dest_buffer(vbz_max_checksummed_compressed_size(vbz_size_t(max_element_count * int_size), &options));
+
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (auto const& input_values : input_value_list)
+        {
+            item_count += input_values.size();
+            auto bytes_used = vbz_compress_checksummed(
+                input_values.data(),
+                vbz_size_t(input_values.size() * int_size),
+                dest_buffer.data(),
+                vbz_size_t(dest_buffer.size()),
+                &options);
+
+            benchmark::DoNotOptimize(bytes_used);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * int_size);
+    state.counters["hardware_crc"] = vbz_crc32c_is_hardware_accelerated();
+}
+
+// Decompress and verify each block's checksum, compare against decompress_random for the cost of the checksums.
+template <typename VbzOptions, typename Generator>
+void checksummed_decompress_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = Generator::generate(max_element_count);
+
+    auto const int_size = sizeof(typename VbzOptions::IntType);
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        int_size,
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<std::vector<char>> compressed_list;
+    for (auto const& input_values : input_value_list)
+    {
+        auto const input_byte_count = vbz_size_t(input_values.size() * int_size);
+        std::vector<char> compressed(vbz_max_checksummed_compressed_size(input_byte_count, &options));
+        compressed.resize(vbz_compress_checksummed(
+            input_values.data(),
+            input_byte_count,
+            compressed.data(),
+            vbz_size_t(compressed.size()),
+            &options));
+        compressed_list.push_back(std::move(compressed));
+    }
+
+    std::vector<char> dest_buffer(max_element_count * int_size);
+
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (std::size_t i = 0; i < compressed_list.size(); ++i)
+        {
+            item_count += input_value_list[i].size();
+            auto bytes_expanded_to = vbz_decompress_checksummed(
+                compressed_list[i].data(),
+                vbz_size_t(compressed_list[i].size()),
+                dest_buffer.data(),
+                vbz_size_t(dest_buffer.size()),
+                &options);
+            assert(bytes_expanded_to == input_value_list[i].size() * int_size);
+
+            benchmark::DoNotOptimize(bytes_expanded_to);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * int_size);
+    state.counters["hardware_crc"] = vbz_crc32c_is_hardware_accelerated();
+}
+
+// Recompress the test_data reads, sized, from zstd level state.range(0) to state.range(1).
+// state.range(2) is 1 to use vbz_transcode_sized, 0 to decompress and compress again.
+void transcode_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = SignalGenerator<std::int16_t>::generate(max_element_count);
+
+    CompressionOptions const source_options{ true, sizeof(std::int16_t), (unsigned int)state.range(0), VBZ_DEFAULT_VERSION };
+    CompressionOptions const destination_options{ true, sizeof(std::int16_t), (unsigned int)state.range(1), VBZ_DEFAULT_VERSION };
+
+    std::vector<std::vector<char>> compressed_list;
+    for (auto const& input_values : input_value_list)
+    {
+        auto const input_byte_count = vbz_size_t(input_values.size() * sizeof(input_values[0]));
+        std::vector<char> compressed(vbz_max_compressed_size(input_byte_count, &source_options) + 4);
+        auto const compressed_size = vbz_compress_sized(input_values.data(), input_byte_count, compressed.data(),
+                                                        vbz_size_t(compressed.size()), &source_options);
+        compressed.resize(compressed_size);
+        compressed_list.push_back(std::move(compressed));
+    }
+
+    std::vector<char> original(max_element_count * sizeof(std::int16_t));
+    std::vector<char> dest_buffer(vbz_max_compressed_size(vbz_size_t(original.size()), &destination_options) + 4);
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (std::size_t i = 0; i < compressed_list.size(); ++i)
+        {
+            auto const& compressed = compressed_list[i];
+            item_count += input_value_list[i].size();
+            vbz_size_t bytes_used = 0;
+            if (state.range(2) == 1)
+            {
+                bytes_used = vbz_transcode_sized(compressed.data(), vbz_size_t(compressed.size()), dest_buffer.data(),
+                                                 vbz_size_t(dest_buffer.size()), &source_options, &destination_options);
+            }
+            else
+            {
+                auto const original_size = vbz_decompress_sized(compressed.data(), vbz_size_t(compressed.size()),
+                                                                original.data(), vbz_size_t(original.size()), &source_options);
+                bytes_used = vbz_compress_sized(original.data(), original_size, dest_buffer.data(),
+                                                vbz_size_t(dest_buffer.size()), &destination_options);
+            }
+            assert(!vbz_is_error(bytes_used));
+
+            benchmark::DoNotOptimize(bytes_used);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * sizeof(std::int16_t));
+}
+
+// Join the two halves of each of the test_data reads, compressed with vbz_compress_checksummed.
+// state.range(0) is 1 to use vbz_merge_checksummed, 0 to decompress the halves and compress the read again.
+void merge_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = SignalGenerator<std::int16_t>::generate(max_element_count);
+
+    CompressionOptions const options{ true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION };
+    auto const compress = [&](std::int16_t const* values, std::size_t count) {
+        auto const input_byte_count = vbz_size_t(count * sizeof(std::int16_t));
+        std::vector<char> compressed(vbz_max_checksummed_compressed_size(input_byte_count, &options));
+        auto const compressed_size = vbz_compress_checksummed(values, input_byte_count, compressed.data(),
+                                                              vbz_size_t(compressed.size()), &options);
+        compressed.resize(compressed_size);
+        return compressed;
+    };
+
+    std::vector<std::pair<std::vector<char>, std::vector<char>>> halves_list;
+    for (auto const& input_values : input_value_list)
+    {
+        auto const first_count = input_values.size() / 2;
+        halves_list.emplace_back(
+            compress(input_values.data(), first_count),
+            compress(input_values.data() + first_count, input_values.size() - first_count));
+    }
+
+    std::vector<char> original(max_element_count * sizeof(std::int16_t));
+    std::vector<char> dest_buffer;
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (std::size_t i = 0; i < halves_list.size(); ++i)
+        {
+            auto const& first = halves_list[i].first;
+            auto const& second = halves_list[i].second;
+            item_count += input_value_list[i].size();
+            vbz_size_t bytes_used = 0;
+            if (state.range(0) == 1)
+            {
+                dest_buffer.resize(vbz_max_merged_checksummed_size(vbz_size_t(first.size()), vbz_size_t(second.size())));
+                bytes_used = vbz_merge_checksummed(first.data(), vbz_size_t(first.size()), second.data(),
+                                                   vbz_size_t(second.size()), dest_buffer.data(),
+                                                   vbz_size_t(dest_buffer.size()), &options);
+            }
+            else
+            {
+                auto const first_size = vbz_decompress_checksummed(first.data(), vbz_size_t(first.size()),
+                                                                   original.data(), vbz_size_t(original.size()), &options);
+                auto const second_size = vbz_decompress_checksummed(second.data(), vbz_size_t(second.size()),
+                                                                    original.data() + first_size,
+                                                                    vbz_size_t(original.size() - first_size), &options);
+                dest_buffer.resize(vbz_max_checksummed_compressed_size(first_size + second_size, &options));
+                bytes_used = vbz_compress_checksummed(original.data(), first_size + second_size, dest_buffer.data(),
+                                                      vbz_size_t(dest_buffer.size()), &options);
+            }
+            assert(!vbz_is_error(bytes_used));
+
+            benchmark::DoNotOptimize(bytes_used);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * sizeof(std::int16_t));
+}
+
+// Compress within state.range(0) of the original values, or losslessly for a range of 0.
+vbz_size_t compress_within_bound(
+    benchmark::State const& state,
+    std::vector<std::int16_t> const& input_values,
+    std::vector<char>& dest_buffer,
+    CompressionOptions const& options)
+{
+    auto const input_byte_count = vbz_size_t(input_values.size() * sizeof(input_values[0]));
+    if (state.range(0) == 0)
+    {
+        dest_buffer.resize(vbz_max_compressed_size(input_byte_count, &options));
+        return vbz_compress(input_values.data(), input_byte_count, dest_buffer.data(), vbz_size_t(dest_buffer.size()), &options);
+    }
+    dest_buffer.resize(vbz_max_bounded_error_compressed_size(input_byte_count, &options));
+    return vbz_compress_bounded_error(input_values.data(), input_byte_count, dest_buffer.data(),
+                                      vbz_size_t(dest_buffer.size()), vbz_size_t(state.range(0)), &options);
+}
+
+// Compress the test_data reads with an error bound, compare the compression_ratio against the lossless (0) bound.
+template <typename VbzOptions>
+void bounded_error_compress_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = SignalGenerator<std::int16_t>::generate(max_element_count);
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        sizeof(std::int16_t),
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<char> dest_buffer;
+    std::size_t item_count = 0;
+    std::size_t compressed_bytes = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        compressed_bytes = 0;
+        for (auto const& input_values : input_value_list)
+        {
+            item_count += input_values.size();
+            auto bytes_used = compress_within_bound(state, input_values, dest_buffer, options);
+            compressed_bytes += bytes_used;
+
+            benchmark::DoNotOptimize(bytes_used);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * sizeof(std::int16_t));
+    state.counters["compression_ratio"] = double(item_count * sizeof(std::int16_t)) / double(compressed_bytes);
+}
+
+// Decompress the test_data reads compressed with an error bound, compare against the lossless (0) bound.
+template <typename VbzOptions>
+void bounded_error_decompress_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    auto input_value_list = SignalGenerator<std::int16_t>::generate(max_element_count);
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        sizeof(std::int16_t),
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    std::vector<std::vector<char>> compressed_list;
+    for (auto const& input_values : input_value_list)
+    {
+        std::vector<char> compressed;
+        compressed.resize(compress_within_bound(state, input_values, compressed, options));
+        compressed_list.push_back(std::move(compressed));
+    }
+
+    std::vector<char> dest_buffer(max_element_count * sizeof(std::int16_t));
+
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (std::size_t i = 0; i < compressed_list.size(); ++i)
+        {
+            auto const output_size = vbz_size_t(input_value_list[i].size() * sizeof(std::int16_t));
+            item_count += input_value_list[i].size();
+            auto bytes_expanded_to = state.range(0) == 0
+                ? vbz_decompress(compressed_list[i].data(), vbz_size_t(compressed_list[i].size()),
+                                 dest_buffer.data(), output_size, &options)
+                : vbz_decompress_bounded_error(compressed_list[i].data(), vbz_size_t(compressed_list[i].size()),
+                                               dest_buffer.data(), output_size, &options);
+            assert(bytes_expanded_to == output_size);
+
+            benchmark::DoNotOptimize(bytes_expanded_to);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * sizeof(std::int16_t));
+}
+
+// Frames of an acquisition's interleaved channels, each channel's samples a different part of the long signal.
+constexpr std::size_t acquisition_channel_count = 512;
+constexpr std::size_t acquisition_frame_count = 4096;
+
+std::vector<std::int16_t> generate_acquisition_frames()
+{
+    auto const& signal = LongSignalGenerator<std::int16_t>::generate();
+
+    std::vector<std::int16_t> frames(acquisition_frame_count * acquisition_channel_count);
+    for (std::size_t channel = 0; channel < acquisition_channel_count; ++channel)
+    {
+        for (std::size_t frame = 0; frame < acquisition_frame_count; ++frame)
+        {
+            frames[frame * acquisition_channel_count + channel] = signal[channel * acquisition_frame_count + frame];
+        }
+    }
+    return frames;
+}
+
+// Compress interleaved frames, 0 de-interleaves each channel then compresses it with #vbz_compress,
+// 1 compresses the frames directly with #vbz_compress_interleaved.
+template <typename VbzOptions>
+void interleaved_compress_benchmark(benchmark::State& state)
+{
+    auto const frames = generate_acquisition_frames();
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        sizeof(std::int16_t),
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    auto const channel_size = vbz_size_t(acquisition_frame_count * sizeof(std::int16_t));
+    std::vector<std::int16_t> channel(acquisition_frame_count);
+    std::vector<char> dest_buffer(std::max(
+        vbz_max_compressed_size(channel_size, &options),
+        vbz_max_interleaved_compressed_size(acquisition_frame_count, acquisition_channel_count, &options)));
+
+    std::size_t compressed_bytes = 0;
+    for (auto _ : state)
+    {
+        compressed_bytes = 0;
+        if (state.range(0) == 0)
+        {
+            for (std::size_t c = 0; c < acquisition_channel_count; ++c)
+            {
+                for (std::size_t frame = 0; frame < acquisition_frame_count; ++frame)
+                {
+                    channel[frame] = frames[frame * acquisition_channel_count + c];
+                }
+                compressed_bytes += vbz_compress(channel.data(), channel_size, dest_buffer.data(),
+                                                 vbz_size_t(dest_buffer.size()), &options);
+            }
+        }
+        else
+        {
+            compressed_bytes = vbz_compress_interleaved(frames.data(), acquisition_frame_count, acquisition_channel_count,
+                                                        acquisition_channel_count, dest_buffer.data(),
+                                                        vbz_size_t(dest_buffer.size()), &options);
+        }
+
+        benchmark::DoNotOptimize(compressed_bytes);
+    }
+
+    state.SetItemsProcessed(state.iterations() * frames.size());
+    state.SetBytesProcessed(state.iterations() * frames.size() * sizeof(std::int16_t));
+    state.counters["compression_ratio"] = double(frames.size() * sizeof(std::int16_t)) / double(compressed_bytes);
+}
+
+// Decompress back to interleaved frames, 0 decompresses each channel with #vbz_decompress then re-interleaves it,
+// 1 decompresses the frames directly with #vbz_decompress_interleaved.
+template <typename VbzOptions>
+void interleaved_decompress_benchmark(benchmark::State& state)
+{
+    auto const frames = generate_acquisition_frames();
+
+    CompressionOptions options{
+        VbzOptions::UseZigZag,
+        sizeof(std::int16_t),
+        VbzOptions::ZstdLevel,
+        VBZ_DEFAULT_VERSION
+    };
+
+    auto const channel_size = vbz_size_t(acquisition_frame_count * sizeof(std::int16_t));
+    std::vector<std::int16_t> channel(acquisition_frame_count);
+    std::vector<std::vector<char>> compressed_list;
+    if (state.range(0) == 0)
+    {
+        for (std::size_t c = 0; c < acquisition_channel_count; ++c)
+        {
+            for (std::size_t frame = 0; frame < acquisition_frame_count; ++frame)
+            {
+                channel[frame] = frames[frame * acquisition_channel_count + c];
+            }
+            std::vector<char> compressed(vbz_max_compressed_size(channel_size, &options));
+            compressed.resize(vbz_compress(channel.data(), channel_size, compressed.data(),
+                                           vbz_size_t(compressed.size()), &options));
+            compressed_list.push_back(std::move(compressed));
+        }
+    }
+    else
+    {
+        std::vector<char> compressed(vbz_max_interleaved_compressed_size(acquisition_frame_count, acquisition_channel_count, &options));
+        compressed.resize(vbz_compress_interleaved(frames.data(), acquisition_frame_count, acquisition_channel_count,
+                                                   acquisition_channel_count, compressed.data(),
+                                                   vbz_size_t(compressed.size()), &options));
+        compressed_list.push_back(std::move(compressed));
+    }
+
+    std::vector<std::int16_t> dest_frames(frames.size());
+    for (auto _ : state)
+    {
+        if (state.range(0) == 0)
+        {
+            for (std::size_t c = 0; c < acquisition_channel_count; ++c)
+            {
+                auto bytes_expanded_to = vbz_decompress(compressed_list[c].data(), vbz_size_t(compressed_list[c].size()),
+                                                        channel.data(), channel_size, &options);
+                assert(bytes_expanded_to == channel_size);
+                benchmark::DoNotOptimize(bytes_expanded_to);
+
+                for (std::size_t frame = 0; frame < acquisition_frame_count; ++frame)
+                {
+                    dest_frames[frame * acquisition_channel_count + c] = channel[frame];
+                }
+            }
+        }
+        else
+        {
+            auto bytes_expanded_to = vbz_decompress_interleaved(compressed_list[0].data(), vbz_size_t(compressed_list[0].size()),
+                                                                dest_frames.data(), vbz_size_t(dest_frames.size() * sizeof(std::int16_t)),
+                                                                acquisition_channel_count, &options);
+            assert(bytes_expanded_to == dest_frames.size() * sizeof(std::int16_t));
+            benchmark::DoNotOptimize(bytes_expanded_to);
+        }
+        assert(dest_frames == frames);
+    }
+
+    state.SetItemsProcessed(state.iterations() * frames.size());
+    state.SetBytesProcessed(state.iterations() * frames.size() * sizeof(std::int16_t));
+}
+
+vbz_size_t compress_sparse_mask(
+    benchmark::State const& state,
+    std::vector<std::uint8_t> const& mask,
+    std::vector<char>& dest_buffer,
+    CompressionOptions const& options)
+{
+    auto const input_byte_count = vbz_size_t(mask.size());
+    if (state.range(0) == 0)
+    {
+        dest_buffer.resize(vbz_max_compressed_size(input_byte_count, &options));
+        return vbz_compress(mask.data(), input_byte_count, dest_buffer.data(), vbz_size_t(dest_buffer.size()), &options);
+    }
+    dest_buffer.resize(vbz_max_run_length_compressed_size(input_byte_count, &options));
+    return vbz_compress_run_length(mask.data(), input_byte_count, dest_buffer.data(),
+                                   vbz_size_t(dest_buffer.size()), &options);
+}
+
+// Compress a sparse uint8 mask with v1 encoding, 0 compresses every zero, 1 collapses runs first.
+template <int ZstdLevel>
+void run_length_compress_benchmark(benchmark::State& state)
+{
+    auto const& mask = SparseMaskGenerator::generate();
+    CompressionOptions options{ false, sizeof(std::uint8_t), ZstdLevel, 1 };
+
+    std::vector<char> dest_buffer;
+    vbz_size_t compressed_bytes = 0;
+    for (auto _ : state)
+    {
+        compressed_bytes = compress_sparse_mask(state, mask, dest_buffer, options);
+        benchmark::DoNotOptimize(compressed_bytes);
+    }
+
+    state.SetBytesProcessed(state.iterations() * mask.size());
+    state.counters["compression_ratio"] = double(mask.size()) / double(compressed_bytes);
+}
+
+// Decompress a sparse uint8 mask with v1 encoding, 0 decodes every zero, 1 expands collapsed runs.
+template <int ZstdLevel>
+void run_length_decompress_benchmark(benchmark::State& state)
+{
+    auto const& mask = SparseMaskGenerator::generate();
+    CompressionOptions options{ false, sizeof(std::uint8_t), ZstdLevel, 1 };
+
+    std::vector<char> compressed;
+    compressed.resize(compress_sparse_mask(state, mask, compressed, options));
+
+    std::vector<std::uint8_t> dest_buffer(mask.size());
+    for (auto _ : state)
+    {
+        auto bytes_expanded_to = state.range(0) == 0
+            ? vbz_decompress(compressed.data(), vbz_size_t(compressed.size()),
+                             dest_buffer.data(), vbz_size_t(dest_buffer.size()), &options)
+            : vbz_decompress_run_length(compressed.data(), vbz_size_t(compressed.size()),
+                                        dest_buffer.data(), vbz_size_t(dest_buffer.size()), &options);
+        assert(bytes_expanded_to == mask.size());
+        benchmark::DoNotOptimize(bytes_expanded_to);
+    }
+    assert(dest_buffer == mask);
+
+    state.SetBytesProcessed(state.iterations() * mask.size());
+}
+
+#ifndef _WIN32
+// A temporary file of ShortReadGenerator's reads compressed with vbz_compress_sized, back to back.
+struct ChunkFile
+{
+    ChunkFile()
+    {
+        std::size_t max_element_count = 0;
+        auto const reads = ShortReadGenerator<std::int16_t>::generate(max_element_count);
+        CompressionOptions options{ true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION };
+
+        char path[] = "/tmp/vbz_chunk_reader_XXXXXX";
+        file_descriptor = mkstemp(path);
+        unlink(path);
+
+        std::vector<char> compressed;
+        for (auto const& read : reads)
+        {
+            auto const read_size = vbz_size_t(read.size() * sizeof(std::int16_t));
+            compressed.resize(vbz_max_compressed_size(read_size, &options));
+            compressed.resize(vbz_compress_sized(read.data(), read_size,
+                compressed.data(), vbz_size_t(compressed.size()), &options));
+            chunks.push_back(VbzChunk{ file_descriptor, file_size, vbz_size_t(compressed.size()) });
+            file_size += compressed.size();
+            if (write(file_descriptor, compressed.data(), compressed.size()) != ssize_t(compressed.size()))
+            {
+                std::abort();
+            }
+            decompressed_size += read_size;
+        }
+        fsync(file_descriptor);
+        max_read_size = vbz_size_t(max_element_count * sizeof(std::int16_t));
+    }
+
+    ~ChunkFile()
+    {
+        close(file_descriptor);
+    }
+
+    int file_descriptor = -1;
+    std::uint64_t file_size = 0;
+    std::vector<VbzChunk> chunks;
+    std::size_t decompressed_size = 0;
+    vbz_size_t max_read_size = 0;
+};
+
+struct ChunkDecoder
+{
+    vbz_size_t max_read_size;
+    std::atomic<std::size_t> decompressed_size;
+};
+
+void decode_chunk(std::size_t, void const* data, vbz_size_t size, void* user_data)
+{
+    auto& decoder = *static_cast<ChunkDecoder*>(user_data);
+    CompressionOptions options{ true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION };
+    std::vector<char> read(decoder.max_read_size);
+    auto const read_size = vbz_decompress_sized(data, size, read.data(), vbz_size_t(read.size()), &options);
+    decoder.decompressed_size += read_size;
+}
+
+// state.range(0) is the VBZ_*_CHUNK_READER decoding the chunk file with 4 workers, state.range(1) the
+// queue depth. The file is dropped from the page cache before each iteration (when permitted), so
+// readers are compared on the device, rather than on memory copies.
+void chunk_reader_benchmark(benchmark::State& state)
+{
+    auto const reader = (unsigned int)state.range(0);
+    if (!vbz_chunk_reader_supported(reader))
+    {
+        state.SkipWithError("reader unsupported");
+        return;
+    }
+
+    static ChunkFile const file;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        posix_fadvise(file.file_descriptor, 0, off_t(file.file_size), POSIX_FADV_DONTNEED);
+        ChunkDecoder decoder{ file.max_read_size, { 0 } };
+        state.ResumeTiming();
+
+        auto const result = vbz_read_chunks(reader, file.chunks.data(), vbz_size_t(file.chunks.size()),
+            4, std::size_t(state.range(1)), decode_chunk, &decoder);
+        if (result != file.chunks.size() || decoder.decompressed_size != file.decompressed_size)
+        {
+            state.SkipWithError("chunks not read");
+            return;
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * file.chunks.size());
+    state.SetBytesProcessed(state.iterations() * file.file_size);
+}
+#endif
+
+#if defined(VBZ_ENABLE_SERVER)
+std::string const& server_socket_path()
+{
+    static auto const path = "/tmp/vbz_perf_server_" + std::to_string(getpid()) + ".sock";
+    return path;
+}
+
+// Load test of the compression server: each benchmark thread compresses ShortReadGenerator's reads,
+// in process for state.range(0) == 0, or through its own client of a server with 4 workers for 1.
+// With more threads than workers, clients queue for the server's cores rather than contending for them.
+void server_compress_benchmark(benchmark::State& state)
+{
+    std::size_t max_element_count = 0;
+    static auto const reads = ShortReadGenerator<std::int16_t>::generate(max_element_count);
+    static std::atomic<std::size_t> next_thread{ 0 };
+    static std::unique_ptr<VbzServer, decltype(&vbz_stop_server)> const server(
+        vbz_start_server(server_socket_path().c_str(), 4),
+        &vbz_stop_server);
+
+    CompressionOptions options{ true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION };
+    std::size_t max_read_size = 0;
+    for (auto const& read : reads)
+    {
+        max_read_size = std::max(max_read_size, read.size() * sizeof(std::int16_t));
+    }
+    auto const max_compressed_size = vbz_max_compressed_size(vbz_size_t(max_read_size), &options);
+
+    std::unique_ptr<VbzServerClient, decltype(&vbz_disconnect_server)> client(nullptr, &vbz_disconnect_server);
+    std::vector<char> local_buffer(max_read_size + max_compressed_size);
+    auto buffer = local_buffer.data();
+    if (state.range(0) == 1)
+    {
+        if (!server)
+        {
+            state.SkipWithError("server not started");
+            return;
+        }
+        client.reset(vbz_connect_server(server_socket_path().c_str(), local_buffer.size()));
+        if (!client)
+        {
+            state.SkipWithError("server not reached");
+            return;
+        }
+        buffer = static_cast<char*>(vbz_server_buffer(client.get()));
+    }
+
+    auto read_index = next_thread++ * 97;
+    std::size_t bytes_processed = 0;
+    for (auto _ : state)
+    {
+        auto const& read = reads[read_index++ % reads.size()];
+        auto const read_size = vbz_size_t(read.size() * sizeof(std::int16_t));
+        std::memcpy(buffer, read.data(), read_size);
+
+        auto const compressed_size = client
+            ? vbz_server_compress(client.get(), 0, read_size, max_read_size, max_compressed_size, &options)
+            : vbz_compress_sized(buffer, read_size, buffer + max_read_size, max_compressed_size, &options);
+        if (vbz_is_error(compressed_size))
+        {
+            state.SkipWithError("compression failed");
+            break;
+        }
+        bytes_processed += read_size;
+    }
+
+    state.SetBytesProcessed(bytes_processed);
+}
+#endif
+
+template <typename _IntType>
+struct VbzNoZStd
+{
+    using IntType = _IntType;
+    static const std::size_t UseZigZag = 1;
+    static const std::size_t ZstdLevel = 0;
+    static const unsigned int Version = VBZ_DEFAULT_VERSION;
+};
+
+template <typename _IntType>
+struct VbzZStd
+{
+    using IntType = _IntType;
+    static const std::size_t UseZigZag = 1;
+    static const std::size_t ZstdLevel = 1;
+    static const unsigned int Version = VBZ_DEFAULT_VERSION;
+};
+
+template <std::size_t _ZstdLevel>
+struct VbzFloat32
+{
+    using IntType = float;
+    static const std::size_t UseZigZag = 0;
+    static const std::size_t ZstdLevel = _ZstdLevel;
+    static const unsigned int Version = VBZ_FLOAT32_VERSION;
+};
+
+template <typename CompressionOptions>
+void compress_chunk_sweep(benchmark::State& state)
+{
+    streamvbyte_chunk_sweep_compress_benchmark<CompressionOptions>(state);
+}
+
+template <typename CompressionOptions>
+void decompress_chunk_sweep(benchmark::State& state)
+{
+    streamvbyte_chunk_sweep_decompress_benchmark<CompressionOptions>(state);
+}
+
+template <typename CompressionOptions>
+void compress_sequence(benchmark::State& state)
+{
+    streamvbyte_compress_benchmark<CompressionOptions, SequenceGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void compress_random(benchmark::State& state)
+{
+    streamvbyte_compress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void decompress_sequence(benchmark::State& state)
+{
+    streamvbyte_decompress_benchmark<CompressionOptions, SequenceGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void decompress_random(benchmark::State& state)
+{
+    streamvbyte_decompress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void compress_calibrated(benchmark::State& state)
+{
+    streamvbyte_compress_benchmark<CompressionOptions, CalibratedSignalGenerator>(state);
+}
+
+template <typename CompressionOptions>
+void decompress_calibrated(benchmark::State& state)
+{
+    streamvbyte_decompress_benchmark<CompressionOptions, CalibratedSignalGenerator>(state);
+}
+
+// compress_random with the trace recorder running, compare against compress_random for the cost of tracing.
+template <typename CompressionOptions>
+void compress_random_traced(benchmark::State& state)
+{
+    vbz_start_trace_recorder(1 << 16);
+    streamvbyte_compress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+    vbz_stop_trace_recorder();
+}
+
+template <typename CompressionOptions>
+void compress_random_checksummed(benchmark::State& state)
+{
+    checksummed_compress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void decompress_random_checksummed(benchmark::State& state)
+{
+    checksummed_decompress_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void estimate_sequence(benchmark::State& state)
+{
+    streamvbyte_estimate_benchmark<CompressionOptions, SequenceGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+template <typename CompressionOptions>
+void estimate_random(benchmark::State& state)
+{
+    streamvbyte_estimate_benchmark<CompressionOptions, SignalGenerator<typename CompressionOptions::IntType>>(state);
+}
+
+BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_sequence, VbzZStd<std::int32_t>);
+BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_sequence, VbzNoZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_random, VbzZStd<std::int32_t>);
+BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_random, VbzNoZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(estimate_sequence, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(estimate_sequence, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(estimate_sequence, VbzZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(estimate_random, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(estimate_random, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(estimate_random, VbzZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_sequence, VbzZStd<std::int32_t>);
+BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_sequence, VbzNoZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_random, VbzZStd<std::int32_t>);
+BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int8_t>);
+BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_random, VbzNoZStd<std::int32_t>);
+
+
+// Chunk size sweep from 4KB to 4MB of raw signal, spanning the L1 to LLC sizes of common hosts.
+// See vbz_recommend_chunk_size in vbz_plugin_user_utils.h for the matching chunk size advice.
+BENCHMARK_TEMPLATE(compress_chunk_sweep, VbzZStd<std::int16_t>)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+BENCHMARK_TEMPLATE(compress_chunk_sweep, VbzNoZStd<std::int16_t>)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+BENCHMARK_TEMPLATE(decompress_chunk_sweep, VbzZStd<std::int16_t>)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+BENCHMARK_TEMPLATE(decompress_chunk_sweep, VbzNoZStd<std::int16_t>)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+
+// Allocations per call for compression (0) and decompression (1) of chunks from 4KB to 4MB, benchmark_compare
+// fails if peak_live_bytes grows (see python/benchmark/benchmark_regression.py).
+BENCHMARK_TEMPLATE(allocation_benchmark, VbzZStd<std::int8_t>)->ArgsProduct({ benchmark::CreateRange(4 << 10, 4 << 20, 4), { 0, 1 } });
+BENCHMARK_TEMPLATE(allocation_benchmark, VbzZStd<std::int16_t>)->ArgsProduct({ benchmark::CreateRange(4 << 10, 4 << 20, 4), { 0, 1 } });
+BENCHMARK_TEMPLATE(allocation_benchmark, VbzZStd<std::int32_t>)->ArgsProduct({ benchmark::CreateRange(4 << 10, 4 << 20, 4), { 0, 1 } });
+BENCHMARK_TEMPLATE(allocation_benchmark, VbzNoZStd<std::int16_t>)->ArgsProduct({ benchmark::CreateRange(4 << 10, 4 << 20, 4), { 0, 1 } });
+
+// Calibrated float signal, compare against compress_random/decompress_random of int32 for the cost of storing floats.
+BENCHMARK_TEMPLATE(compress_calibrated, VbzFloat32<1>);
+BENCHMARK_TEMPLATE(compress_calibrated, VbzFloat32<0>);
+BENCHMARK_TEMPLATE(decompress_calibrated, VbzFloat32<1>);
+BENCHMARK_TEMPLATE(decompress_calibrated, VbzFloat32<0>);
+
+BENCHMARK_TEMPLATE(compress_random_traced, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_random_traced, VbzZStd<std::int32_t>);
+
+BENCHMARK_TEMPLATE(compress_random_checksummed, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(compress_random_checksummed, VbzNoZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_random_checksummed, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(decompress_random_checksummed, VbzNoZStd<std::int16_t>);
+
+BENCHMARK(transcode_benchmark)->ArgsProduct({ { 1 }, { 3 }, { 0, 1 } });
+BENCHMARK(transcode_benchmark)->ArgsProduct({ { 19 }, { 1 }, { 0, 1 } });
+BENCHMARK(merge_benchmark)->DenseRange(0, 1);
+
+// -1 runs without an arena, otherwise the argument is the arena's page mode.
+BENCHMARK_TEMPLATE(arena_compress_benchmark, VbzZStd<std::int16_t>)->DenseRange(-1, VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES);
+BENCHMARK_TEMPLATE(arena_decompress_benchmark, VbzZStd<std::int16_t>)->DenseRange(-1, VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES);
+
+// The argument is the error bound in ADC units, 0 compresses losslessly.
+BENCHMARK_TEMPLATE(bounded_error_compress_benchmark, VbzZStd<std::int16_t>)->DenseRange(0, 2);
+BENCHMARK_TEMPLATE(bounded_error_compress_benchmark, VbzNoZStd<std::int16_t>)->DenseRange(0, 2);
+BENCHMARK_TEMPLATE(bounded_error_decompress_benchmark, VbzZStd<std::int16_t>)->DenseRange(0, 2);
+BENCHMARK_TEMPLATE(bounded_error_decompress_benchmark, VbzNoZStd<std::int16_t>)->DenseRange(0, 2);
+
+// 0 de-interleaves (or re-interleaves) each channel around vbz_compress, 1 uses the interleaved format.
+BENCHMARK_TEMPLATE(interleaved_compress_benchmark, VbzZStd<std::int16_t>)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(interleaved_compress_benchmark, VbzNoZStd<std::int16_t>)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(interleaved_decompress_benchmark, VbzZStd<std::int16_t>)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(interleaved_decompress_benchmark, VbzNoZStd<std::int16_t>)->DenseRange(0, 1);
+
+// 0 compresses a sparse mask with plain v1 encoding, 1 collapses its runs first.
+BENCHMARK_TEMPLATE(run_length_compress_benchmark, 1)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(run_length_compress_benchmark, 0)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(run_length_decompress_benchmark, 1)->DenseRange(0, 1);
+BENCHMARK_TEMPLATE(run_length_decompress_benchmark, 0)->DenseRange(0, 1);
+
+BENCHMARK_TEMPLATE(batch_compress_benchmark, VbzZStd<std::int16_t>);
+BENCHMARK_TEMPLATE(batch_decompress_read_benchmark, VbzZStd<std::int16_t>);
+
+#ifndef _WIN32
+BENCHMARK(chunk_reader_benchmark)->ArgsProduct({
+    { VBZ_PREAD_CHUNK_READER, VBZ_MMAP_CHUNK_READER, VBZ_IO_URING_CHUNK_READER },
+    { 4, 32 }
+})->UseRealTime();
+#endif
 
+#if defined(VBZ_ENABLE_SERVER)
+BENCHMARK(server_compress_benchmark)->DenseRange(0, 1)->ThreadRange(1, 16)->UseRealTime();
+#endif
 
 // Run the benchmark
 BENCHMARK_MAIN();
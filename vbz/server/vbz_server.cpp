@@ -0,0 +1,630 @@
+#include "vbz_server.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+# include <condition_variable>
+# include <deque>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+# include <cerrno>
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/mman.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
+# include <unistd.h>
+
+namespace {
+
+// Messages are single SOCK_SEQPACKET packets. A client first sends a ServerHello carrying its memfd,
+// then a ServerRequest per job, each answered by a ServerReply.
+struct ServerHello
+{
+    std::uint64_t buffer_size;
+};
+
+enum ServerOperation : std::uint32_t
+{
+    server_compress = 0,
+    server_decompress = 1,
+};
+
+struct ServerRequest
+{
+    std::uint32_t operation;
+    vbz_size_t source_size;
+    vbz_size_t destination_capacity;
+    std::uint64_t source_offset;
+    std::uint64_t destination_offset;
+    CompressionOptions options;
+};
+
+struct ServerReply
+{
+    vbz_size_t result;
+};
+
+// Only processes of the server's own user are served, others could change buffers as they are decoded.
+bool is_trusted_peer(int socket)
+{
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    return getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0
+        && size == sizeof(credentials)
+        && credentials.uid == geteuid();
+}
+
+bool make_address(char const* socket_path, sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (std::strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    std::strcpy(address.sun_path, socket_path);
+    return true;
+}
+
+// Send or receive a whole packet, retrying interrupted calls.
+bool send_packet(int socket, void const* data, std::size_t size)
+{
+    ssize_t result;
+    do
+    {
+        result = send(socket, data, size, MSG_NOSIGNAL);
+    } while (result < 0 && errno == EINTR);
+    return result == ssize_t(size);
+}
+
+bool receive_packet(int socket, void* data, std::size_t size)
+{
+    ssize_t result;
+    do
+    {
+        result = recv(socket, data, size, 0);
+    } while (result < 0 && errno == EINTR);
+    return result == ssize_t(size);
+}
+
+// A client's connection, shared by the jobs it has in flight so its buffer stays mapped until they finish.
+struct ServerConnection
+{
+    explicit ServerConnection(int socket_) : socket(socket_) {}
+
+    ~ServerConnection()
+    {
+        if (buffer)
+        {
+            munmap(buffer, buffer_size);
+        }
+        close(socket);
+    }
+
+    // Map the buffer passed in a ServerHello, which must be sealed against shrinking so the client can't
+    // truncate it under a running job.
+    bool receive_buffer()
+    {
+        ServerHello hello;
+        iovec data{ &hello, sizeof(hello) };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) != ssize_t(sizeof(hello)))
+        {
+            return false;
+        }
+
+        auto const header = CMSG_FIRSTHDR(&message);
+        if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+        {
+            return false;
+        }
+        int buffer_fd;
+        std::memcpy(&buffer_fd, CMSG_DATA(header), sizeof(buffer_fd));
+
+        struct stat status;
+        auto const seals = fcntl(buffer_fd, F_GET_SEALS);
+        if (seals >= 0
+            && (seals & F_SEAL_SHRINK) != 0
+            && fstat(buffer_fd, &status) == 0
+            && std::uint64_t(status.st_size) == hello.buffer_size
+            && hello.buffer_size != 0)
+        {
+            auto const mapped = mmap(nullptr, hello.buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer_fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                buffer = static_cast<char*>(mapped);
+                buffer_size = hello.buffer_size;
+            }
+        }
+        close(buffer_fd);
+
+        ServerReply const reply{ buffer ? 0 : VBZ_IO_ERROR };
+        return send_packet(socket, &reply, sizeof(reply)) && buffer;
+    }
+
+    bool in_buffer(std::uint64_t offset, std::uint64_t size) const
+    {
+        return offset <= buffer_size && size <= buffer_size - offset;
+    }
+
+    vbz_size_t run(ServerRequest const& request) const
+    {
+        auto const source_end = request.source_offset + request.source_size;
+        auto const destination_end = request.destination_offset + request.destination_capacity;
+        if (!in_buffer(request.source_offset, request.source_size)
+            || !in_buffer(request.destination_offset, request.destination_capacity)
+            || (request.source_offset < destination_end && request.destination_offset < source_end))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+
+        auto const source = buffer + request.source_offset;
+        auto const destination = buffer + request.destination_offset;
+        switch (request.operation)
+        {
+        case server_compress:
+            return vbz_compress_sized(source, request.source_size, destination, request.destination_capacity,
+                                      &request.options);
+        case server_decompress:
+            return vbz_decompress_sized(source, request.source_size, destination, request.destination_capacity,
+                                        &request.options);
+        }
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    int socket;
+    char* buffer = nullptr;
+    std::size_t buffer_size = 0;
+};
+
+struct ServerJob
+{
+    std::shared_ptr<ServerConnection> connection;
+    ServerRequest request;
+};
+
+}
+
+struct VbzServer
+{
+    ~VbzServer()
+    {
+        if (wake_pipe[1] >= 0)
+        {
+            char const stop = 0;
+            while (write(wake_pipe[1], &stop, 1) < 0 && errno == EINTR)
+            {
+            }
+        }
+        if (listener.joinable())
+        {
+            listener.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_pushed.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        for (auto fd : { listen_socket, wake_pipe[0], wake_pipe[1] })
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        if (!socket_path.empty())
+        {
+            unlink(socket_path.c_str());
+        }
+    }
+
+    bool start(char const* path, std::size_t worker_count)
+    {
+        sockaddr_un address;
+        if (!make_address(path, address) || pipe2(wake_pipe, O_CLOEXEC) != 0)
+        {
+            return false;
+        }
+        listen_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (listen_socket < 0)
+        {
+            return false;
+        }
+
+        // Only a stale socket is replaced, never a file which happens to be at the path.
+        struct stat existing;
+        if (lstat(path, &existing) == 0)
+        {
+            if (!S_ISSOCK(existing.st_mode) || unlink(path) != 0)
+            {
+                return false;
+            }
+        }
+        else if (errno != ENOENT)
+        {
+            return false;
+        }
+        if (bind(listen_socket, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0)
+        {
+            return false;
+        }
+        socket_path = path;
+        // Restrict the socket to its owner before connections can be made, clients are also checked
+        // as they are accepted.
+        if (chmod(path, S_IRUSR | S_IWUSR) != 0 || listen(listen_socket, SOMAXCONN) != 0)
+        {
+            return false;
+        }
+
+        if (worker_count == 0)
+        {
+            worker_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back([this] { run_jobs(); });
+        }
+        listener = std::thread([this] { listen_for_jobs(); });
+        return true;
+    }
+
+    // Accept connections and receive their requests on a single thread, queueing the jobs for the workers.
+    void listen_for_jobs()
+    {
+        std::vector<std::shared_ptr<ServerConnection>> connections;
+        std::vector<pollfd> polled;
+        for (;;)
+        {
+            polled.clear();
+            polled.push_back({ wake_pipe[0], POLLIN, 0 });
+            polled.push_back({ listen_socket, POLLIN, 0 });
+            for (auto const& connection : connections)
+            {
+                polled.push_back({ connection->socket, POLLIN, 0 });
+            }
+
+            if (poll(polled.data(), nfds_t(polled.size()), -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            if (polled[0].revents != 0)
+            {
+                return;
+            }
+
+            // Visit the connections polled before accepting new ones, so the indices match.
+            for (std::size_t i = connections.size(); i-- > 0;)
+            {
+                auto const events = polled[i + 2].revents;
+                if (events == 0)
+                {
+                    continue;
+                }
+
+                auto& connection = connections[i];
+                bool keep = (events & POLLIN) != 0;
+                if (keep && !connection->buffer)
+                {
+                    keep = connection->receive_buffer();
+                }
+                else if (keep)
+                {
+                    ServerJob job{ connection, {} };
+                    keep = receive_packet(connection->socket, &job.request, sizeof(job.request));
+                    if (keep)
+                    {
+                        push(std::move(job));
+                    }
+                }
+
+                if (!keep)
+                {
+                    // Jobs still running hold the connection open until they reply.
+                    connections.erase(connections.begin() + std::ptrdiff_t(i));
+                }
+            }
+
+            if (polled[1].revents & POLLIN)
+            {
+                auto const client = accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0 && is_trusted_peer(client))
+                {
+                    connections.push_back(std::make_shared<ServerConnection>(client));
+                }
+                else if (client >= 0)
+                {
+                    close(client);
+                }
+            }
+        }
+    }
+
+    void push(ServerJob job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        job_pushed.notify_one();
+    }
+
+    void run_jobs()
+    {
+        for (;;)
+        {
+            ServerJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_pushed.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            ServerReply const reply{ job.connection->run(job.request) };
+            send_packet(job.connection->socket, &reply, sizeof(reply));
+        }
+    }
+
+    std::string socket_path;
+    int listen_socket = -1;
+    int wake_pipe[2] = { -1, -1 };
+    std::thread listener;
+
+    std::mutex mutex;
+    std::condition_variable job_pushed;
+    std::deque<ServerJob> jobs;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+struct VbzServerClient
+{
+    ~VbzServerClient()
+    {
+        if (buffer)
+        {
+            munmap(buffer, buffer_size);
+        }
+        if (socket >= 0)
+        {
+            close(socket);
+        }
+    }
+
+    bool connect(char const* socket_path, std::size_t size)
+    {
+        sockaddr_un address;
+        if (size == 0 || !make_address(socket_path, address))
+        {
+            return false;
+        }
+        socket = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (socket < 0 || ::connect(socket, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0)
+        {
+            return false;
+        }
+
+        // Seal the buffer's size, the server won't map a buffer which could shrink.
+        auto const buffer_fd = memfd_create("vbz_server_buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (buffer_fd < 0)
+        {
+            return false;
+        }
+        bool shared = false;
+        if (ftruncate(buffer_fd, off_t(size)) == 0
+            && fcntl(buffer_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0)
+        {
+            auto const mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer_fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                buffer = mapped;
+                buffer_size = size;
+                shared = send_buffer(buffer_fd);
+            }
+        }
+        close(buffer_fd);
+
+        ServerReply reply;
+        return shared && receive_packet(socket, &reply, sizeof(reply)) && reply.result == 0;
+    }
+
+    bool send_buffer(int buffer_fd)
+    {
+        ServerHello hello{ buffer_size };
+        iovec data{ &hello, sizeof(hello) };
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        std::memset(control, 0, sizeof(control));
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        auto const header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &buffer_fd, sizeof(buffer_fd));
+
+        ssize_t result;
+        do
+        {
+            result = sendmsg(socket, &message, MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+        return result == ssize_t(sizeof(hello));
+    }
+
+    vbz_size_t run(ServerRequest const& request)
+    {
+        ServerReply reply;
+        if (!send_packet(socket, &request, sizeof(request)) || !receive_packet(socket, &reply, sizeof(reply)))
+        {
+            return VBZ_IO_ERROR;
+        }
+        return reply.result;
+    }
+
+    int socket = -1;
+    void* buffer = nullptr;
+    std::size_t buffer_size = 0;
+};
+
+#else
+
+struct VbzServer {};
+struct VbzServerClient {};
+
+#endif
+
+extern "C" {
+
+VbzServer* vbz_start_server(char const* socket_path, size_t worker_count)
+{
+#if defined(__linux__)
+    std::unique_ptr<VbzServer> server(new VbzServer());
+    if (server->start(socket_path, worker_count))
+    {
+        return server.release();
+    }
+#else
+    (void)socket_path;
+    (void)worker_count;
+#endif
+    return nullptr;
+}
+
+void vbz_stop_server(VbzServer* server)
+{
+    delete server;
+}
+
+VbzServerClient* vbz_connect_server(char const* socket_path, size_t buffer_size)
+{
+#if defined(__linux__)
+    std::unique_ptr<VbzServerClient> client(new VbzServerClient());
+    if (client->connect(socket_path, buffer_size))
+    {
+        return client.release();
+    }
+#else
+    (void)socket_path;
+    (void)buffer_size;
+#endif
+    return nullptr;
+}
+
+void vbz_disconnect_server(VbzServerClient* client)
+{
+    delete client;
+}
+
+void* vbz_server_buffer(VbzServerClient* client)
+{
+#if defined(__linux__)
+    return client->buffer;
+#else
+    (void)client;
+    return nullptr;
+#endif
+}
+
+size_t vbz_server_buffer_size(VbzServerClient const* client)
+{
+#if defined(__linux__)
+    return client->buffer_size;
+#else
+    (void)client;
+    return 0;
+#endif
+}
+
+#if defined(__linux__)
+namespace {
+vbz_size_t run_server_job(
+    VbzServerClient* client,
+    ServerOperation operation,
+    size_t source_offset,
+    vbz_size_t source_size,
+    size_t destination_offset,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    ServerRequest request;
+    std::memset(&request, 0, sizeof(request));
+    request.operation = operation;
+    request.source_size = source_size;
+    request.destination_capacity = destination_capacity;
+    request.source_offset = source_offset;
+    request.destination_offset = destination_offset;
+    request.options = *options;
+    return client->run(request);
+}
+}
+#endif
+
+vbz_size_t vbz_server_compress(
+    VbzServerClient* client,
+    size_t source_offset,
+    vbz_size_t source_size,
+    size_t destination_offset,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+#if defined(__linux__)
+    return run_server_job(client, server_compress, source_offset, source_size,
+                          destination_offset, destination_capacity, options);
+#else
+    (void)client; (void)source_offset; (void)source_size;
+    (void)destination_offset; (void)destination_capacity; (void)options;
+    return VBZ_IO_ERROR;
+#endif
+}
+
+vbz_size_t vbz_server_decompress(
+    VbzServerClient* client,
+    size_t source_offset,
+    vbz_size_t source_size,
+    size_t destination_offset,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+#if defined(__linux__)
+    return run_server_job(client, server_decompress, source_offset, source_size,
+                          destination_offset, destination_capacity, options);
+#else
+    (void)client; (void)source_offset; (void)source_size;
+    (void)destination_offset; (void)destination_capacity; (void)options;
+    return VBZ_IO_ERROR;
+#endif
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "vbz.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Local compression server
+//
+// A server owns one pool of worker threads compressing and decompressing for every client process on
+// the machine, so processes linking vbz don't each contend for cores with their own threads.
+// Clients connect over a Unix domain socket, passing the server a sealed memfd buffer shared between
+// them. Jobs then name regions of the shared buffer, so payloads are never copied through the socket.
+// The socket is only accessible to the user running the server, and connections from other users'
+// processes are refused. Only available on linux, and only built with the VBZ_ENABLE_SERVER cmake option.
+
+/// \brief A server accepting jobs on a Unix domain socket, see #vbz_start_server.
+typedef struct VbzServer VbzServer;
+
+/// \brief A connection to a server, with a buffer shared with it, see #vbz_connect_server.
+typedef struct VbzServerClient VbzServerClient;
+
+/// \brief Start a server listening on [socket_path] (replacing a stale socket there, but no other kind of file).
+/// \param worker_count     The number of threads compressing, or 0 for one per core.
+/// \return The server, to be stopped with #vbz_stop_server, or null if it could not be started.
+VBZ_EXPORT VbzServer* vbz_start_server(char const* socket_path, size_t worker_count);
+
+/// \brief Stop a server started by #vbz_start_server, waiting for running jobs and removing its socket file.
+VBZ_EXPORT void vbz_stop_server(VbzServer* server);
+
+/// \brief Connect to the server listening on [socket_path], sharing a buffer of [buffer_size] bytes with it.
+/// \note A client runs one job at a time, threads submitting jobs concurrently should each connect a client.
+/// \return The client, to be freed with #vbz_disconnect_server, or null if the server could not be reached.
+VBZ_EXPORT VbzServerClient* vbz_connect_server(char const* socket_path, size_t buffer_size);
+
+/// \brief Disconnect and free a client connected by #vbz_connect_server.
+VBZ_EXPORT void vbz_disconnect_server(VbzServerClient* client);
+
+/// \brief Find the buffer shared with the server, jobs read and write regions of it.
+VBZ_EXPORT void* vbz_server_buffer(VbzServerClient* client);
+
+/// \brief Find the size of the buffer shared with the server.
+VBZ_EXPORT size_t vbz_server_buffer_size(VbzServerClient const* client);
+
+/// \brief Compress a region of the shared buffer into another on the server, as #vbz_compress_sized.
+/// \param source_offset            Offset of the data to compress in the shared buffer.
+/// \param source_size              Size of the data to compress.
+/// \param destination_offset       Offset to compress into, the regions must not overlap.
+/// \param destination_capacity     Capacity of the destination region (see #vbz_max_compressed_size).
+/// \param options                  Options controlling compression to apply.
+/// \return The number of bytes written to the destination region, VBZ_IO_ERROR if the server could not be
+///         reached, or another error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_server_compress(
+    VbzServerClient* client,
+    size_t source_offset,
+    vbz_size_t source_size,
+    size_t destination_offset,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Decompress a region of the shared buffer into another on the server, as #vbz_decompress_sized.
+/// \param destination_capacity     Capacity of the destination region (see #vbz_decompressed_size).
+/// \return The number of bytes written to the destination region, VBZ_IO_ERROR if the server could not be
+///         reached, or another error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_server_decompress(
+    VbzServerClient* client,
+    size_t source_offset,
+    vbz_size_t source_size,
+    size_t destination_offset,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,38 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+
+#include <pthread.h>
+
+#include "vbz_server.h"
+
+// Runs a local compression server until interrupted, clients connect with vbz_connect_server.
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <socket path> [worker count]" << std::endl;
+        return 1;
+    }
+    auto const worker_count = argc == 3 ? std::strtoul(argv[2], nullptr, 10) : 0;
+
+    // Block the stop signals before the server starts its threads, so only sigwait sees them.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    auto server = vbz_start_server(argv[1], worker_count);
+    if (!server)
+    {
+        std::cerr << "Failed to start a server on " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "Serving on " << argv[1] << std::endl;
+
+    int signal = 0;
+    sigwait(&stop_signals, &signal);
+    vbz_stop_server(server);
+    return 0;
+}
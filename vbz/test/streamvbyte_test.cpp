@@ -15,32 +15,38 @@ struct StreamVByteFunctions
     using SizeFn = decltype(vbz_max_streamvbyte_compressed_size_v0)*;
     using CompressFn = decltype(vbz_delta_zig_zag_streamvbyte_compress_v0)*;
     using DecompressFn = decltype(vbz_delta_zig_zag_streamvbyte_decompress_v0)*;
+    using StatisticsFn = decltype(vbz_delta_zig_zag_streamvbyte_statistics_v0)*;
     
     StreamVByteFunctions(
         SizeFn _size,
         CompressFn _compress,
-        DecompressFn _decompress
+        DecompressFn _decompress,
+        StatisticsFn _statistics
     )
     : size(_size)
     , compress(_compress)
     , decompress(_decompress)
+    , statistics(_statistics)
     {
     }
 
     SizeFn size;
     CompressFn compress;
     DecompressFn decompress;
+    StatisticsFn statistics;
 };
 
 StreamVByteFunctions const v0_functions{
     vbz_max_streamvbyte_compressed_size_v0,
     vbz_delta_zig_zag_streamvbyte_compress_v0,
-    vbz_delta_zig_zag_streamvbyte_decompress_v0
+    vbz_delta_zig_zag_streamvbyte_decompress_v0,
+    vbz_delta_zig_zag_streamvbyte_statistics_v0
 };
 StreamVByteFunctions const v1_functions{
     vbz_max_streamvbyte_compressed_size_v1,
     vbz_delta_zig_zag_streamvbyte_compress_v1,
-    vbz_delta_zig_zag_streamvbyte_decompress_v1
+    vbz_delta_zig_zag_streamvbyte_decompress_v1,
+    vbz_delta_zig_zag_streamvbyte_statistics_v1
 };
 
 template <typename T>
@@ -93,6 +99,24 @@ void perform_streamvbyte_compression_test(
     {
         CHECK(decompressed == gsl::make_span(data));
     }
+
+    THEN("Statistics match the compressed data")
+    {
+        VbzStreamVByteStatistics statistics = {};
+        auto statistics_byte_count = fns.statistics(
+            data.data(),
+            vbz_size_t(data.size() * sizeof(data[0])),
+            integer_size,
+            use_delta_zig_zag,
+            &statistics
+        );
+
+        CHECK(statistics_byte_count == final_byte_count);
+        CHECK(statistics.integer_count == data.size());
+        CHECK(statistics.key_bytes + statistics.data_bytes == final_byte_count);
+        CHECK(std::accumulate(std::begin(statistics.key_histogram), std::end(statistics.key_histogram), std::uint64_t(0))
+            == statistics.key_bytes);
+    }
 }
 
 template <typename T>
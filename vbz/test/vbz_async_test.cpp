@@ -0,0 +1,274 @@
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "vbz_async.h"
+
+#include "test_data.h"
+
+#include <catch2/catch.hpp>
+
+namespace {
+
+// Counts every allocation in the process, to check awaiting allocates nothing.
+std::atomic<std::size_t> allocation_count{ 0 };
+
+// A coroutine started eagerly, whose completion can be waited for from another thread.
+struct Task
+{
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable done_changed;
+        bool done = false;
+    };
+
+    struct promise_type
+    {
+        State* state = nullptr;
+
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done = true;
+            state->done_changed.notify_all();
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+void run_to_completion(Task task)
+{
+    Task::State state;
+    task.handle.promise().state = &state;
+    task.handle.resume();
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.done_changed.wait(lock, [&] { return state.done; });
+}
+
+// Coroutine lambdas only capture by reference to the closure, so coroutines outliving their full
+// expression take their arguments as parameters instead.
+Task compress_into(
+    vbz_size_t* result,
+    std::span<std::byte const> source,
+    std::span<std::byte> destination,
+    CompressionOptions options,
+    std::stop_token stop_token,
+    VbzAsyncPool& pool)
+{
+    *result = co_await vbz::compress_async(source, destination, options, std::move(stop_token), pool);
+}
+
+std::span<std::byte const> as_bytes(std::vector<std::int16_t> const& data)
+{
+    return std::as_bytes(std::span<std::int16_t const>(data));
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (auto data = std::malloc(size ? size : 1))
+    {
+        return data;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* data) noexcept
+{
+    std::free(data);
+}
+
+void operator delete(void* data, std::size_t) noexcept
+{
+    std::free(data);
+}
+
+SCENARIO("vbz coroutine compression")
+{
+    CompressionOptions const options{true, 2, 1, VBZ_DEFAULT_VERSION};
+    auto const source = as_bytes(test_data);
+
+    GIVEN("A coroutine compressing and decompressing on the default pool")
+    {
+        std::vector<std::byte> compressed(vbz_max_compressed_size(vbz_size_t(source.size()), &options));
+        std::vector<std::int16_t> decompressed(test_data.size());
+        vbz_size_t compressed_size = 0;
+        vbz_size_t decompressed_size = 0;
+
+        run_to_completion([&]() -> Task {
+            compressed_size = co_await vbz::compress_sized_async(source, compressed, options);
+            decompressed_size = co_await vbz::decompress_sized_async(
+                std::span<std::byte const>(compressed.data(), compressed_size),
+                std::as_writable_bytes(std::span<std::int16_t>(decompressed)), options);
+        }());
+
+        THEN("The data round trips, matching the blocking API")
+        {
+            std::vector<std::byte> expected(compressed.size());
+            CHECK(compressed_size == vbz_compress_sized(source.data(), vbz_size_t(source.size()), expected.data(),
+                                                        vbz_size_t(expected.size()), &options));
+            CHECK(std::memcmp(compressed.data(), expected.data(), compressed_size) == 0);
+            CHECK(decompressed_size == source.size());
+            CHECK(decompressed == test_data);
+        }
+    }
+
+    GIVEN("A coroutine awaiting repeatedly")
+    {
+        VbzAsyncPool pool(2);
+        std::vector<std::byte> compressed(vbz_max_compressed_size(vbz_size_t(source.size()), &options));
+        std::vector<std::int16_t> decompressed(test_data.size());
+        std::size_t steady_allocations = 0;
+
+        run_to_completion([&]() -> Task {
+            // The first calls may allocate zstd contexts on the workers.
+            for (int i = 0; i < 4; ++i)
+            {
+                auto const size = co_await vbz::compress_async(source, compressed, options, {}, pool);
+                co_await vbz::decompress_async(std::span<std::byte const>(compressed.data(), size),
+                                               std::as_writable_bytes(std::span<std::int16_t>(decompressed)),
+                                               options, {}, pool);
+            }
+            auto const before = allocation_count.load();
+            for (int i = 0; i < 100; ++i)
+            {
+                co_await vbz::compress_async(source, compressed, options, {}, pool);
+            }
+            steady_allocations = allocation_count.load() - before;
+        }());
+
+        THEN("Awaiting allocates no more than the compression itself")
+        {
+            // vbz_compress allocates its intermediate buffer on each call, the awaits add nothing to that.
+            std::vector<std::byte> blocking(compressed.size());
+            auto const before = allocation_count.load();
+            for (int i = 0; i < 100; ++i)
+            {
+                vbz_compress(source.data(), vbz_size_t(source.size()), blocking.data(), vbz_size_t(blocking.size()),
+                             &options);
+            }
+            CHECK(steady_allocations == allocation_count.load() - before);
+        }
+    }
+
+    GIVEN("A stop requested before awaiting")
+    {
+        std::stop_source stop;
+        stop.request_stop();
+        std::vector<std::byte> compressed(vbz_max_compressed_size(vbz_size_t(source.size()), &options));
+        vbz_size_t result = 0;
+
+        run_to_completion([&]() -> Task {
+            result = co_await vbz::compress_async(source, compressed, options, stop.get_token());
+        }());
+
+        THEN("The await completes as cancelled")
+        {
+            CHECK(result == VBZ_CANCELLED_ERROR);
+        }
+    }
+
+    GIVEN("A job run with its context instead of a vbz function")
+    {
+        VbzAsyncPool pool(1);
+        struct Run
+        {
+            std::mutex mutex;
+            std::condition_variable completed;
+            bool done = false;
+            vbz_size_t offset = 7;
+        } state;
+
+        VbzAsyncJob job{};
+        job.source_size = 5;
+        job.run = [](VbzAsyncJob& job) -> vbz_size_t {
+            return job.source_size + static_cast<Run*>(job.context)->offset;
+        };
+        job.complete = [](VbzAsyncJob& job) {
+            auto& state = *static_cast<Run*>(job.context);
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.done = true;
+            state.completed.notify_all();
+        };
+        job.context = &state;
+        pool.submit(job);
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.completed.wait(lock, [&] { return state.done; });
+        }
+
+        THEN("The job's result comes from run")
+        {
+            CHECK(job.result == 12);
+        }
+    }
+
+    GIVEN("A stop requested while jobs are queued behind a busy worker")
+    {
+        VbzAsyncPool pool(1);
+        std::stop_source stop;
+        std::vector<std::byte> compressed(vbz_max_compressed_size(vbz_size_t(source.size()), &options));
+
+        // Block the only worker until the stop has been requested.
+        std::mutex mutex;
+        std::condition_variable released;
+        bool release = false;
+        VbzAsyncJob blocker{};
+        blocker.function = [](void const*, vbz_size_t, void*, vbz_size_t, CompressionOptions const*) -> vbz_size_t {
+            return 0;
+        };
+        blocker.complete = [](VbzAsyncJob& job) {
+            auto& wait = *static_cast<std::function<void()>*>(job.context);
+            wait();
+        };
+        std::function<void()> wait_for_release = [&] {
+            std::unique_lock<std::mutex> lock(mutex);
+            released.wait(lock, [&] { return release; });
+        };
+        blocker.context = &wait_for_release;
+        pool.submit(blocker);
+
+        std::vector<vbz_size_t> results(8, 0);
+        std::vector<Task::State> states(results.size());
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            auto task = compress_into(&results[i], source, compressed, options, stop.get_token(), pool);
+            task.handle.promise().state = &states[i];
+            task.handle.resume();
+        }
+
+        stop.request_stop();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            release = true;
+        }
+        released.notify_all();
+        for (auto& state : states)
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.done_changed.wait(lock, [&] { return state.done; });
+        }
+
+        THEN("Every queued await completes as cancelled")
+        {
+            CHECK(results == std::vector<vbz_size_t>(results.size(), VBZ_CANCELLED_ERROR));
+        }
+    }
+}
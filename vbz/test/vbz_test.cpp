@@ -1,12 +1,31 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <random>
+#include <string>
+#include <thread>
 
 #include "test_utils.h"
+#include "../perf/allocation_counter.h"
 #include "vbz.h"
+#include "vbz_chunk_reader.h"
+#include "vbz_crc32c.h"
+#include "vbz_float32.h"
+#include "vbz_metrics.h"
+#include "vbz_quantise.h"
+#include "vbz_trace.h"
+
+#if defined(VBZ_ENABLE_SERVER)
+# include "vbz_server.h"
+# include <sys/stat.h>
+#endif
 
 #include "test_data.h"
 
@@ -279,6 +298,2062 @@ SCENARIO("vbz sized compression")
     }
 }
 
+template <typename T>
+void perform_in_place_decompression_test(std::vector<T> const& data, CompressionOptions const& options)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+    auto compressed_size = vbz_compress(data.data(), input_data_size, compressed.data(),
+                                        vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+
+    auto const capacity = vbz_in_place_decompression_capacity(compressed_size, input_data_size, &options);
+    REQUIRE(!vbz_is_error(capacity));
+    CHECK(capacity >= input_data_size);
+    CHECK(capacity >= compressed_size);
+
+    THEN("Data decompresses in place from the end of the buffer")
+    {
+        std::vector<int8_t> buffer(capacity);
+        std::copy(compressed.begin(), compressed.end(), buffer.end() - compressed_size);
+
+        auto decompressed_size = vbz_decompress_in_place(buffer.data(), capacity, compressed_size,
+                                                         input_data_size, &options);
+        REQUIRE(!vbz_is_error(decompressed_size));
+        CHECK(decompressed_size == input_data_size);
+
+        buffer.resize(decompressed_size);
+        CHECK(gsl::make_span(buffer).as_span<T>() == gsl::make_span(data));
+    }
+
+    if (capacity == compressed_size)
+    {
+        // Not possible to place the source in a smaller buffer.
+        return;
+    }
+
+    THEN("Decompressing into a buffer below the required capacity fails")
+    {
+        std::vector<int8_t> buffer(capacity - 1);
+        std::copy(compressed.begin(), compressed.end(), buffer.end() - compressed_size);
+
+        CHECK(vbz_decompress_in_place(buffer.data(), vbz_size_t(buffer.size()), compressed_size,
+                                      input_data_size, &options)
+              == VBZ_DESTINATION_SIZE_ERROR);
+    }
+}
+
+SCENARIO("vbz in place decompression")
+{
+    GIVEN("Test data from a realistic dataset")
+    {
+        WHEN("Compressing with zstd and zig-zag deltas")
+        {
+            CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_in_place_decompression_test(test_data, options);
+        }
+
+        WHEN("Compressing with zig-zag deltas only")
+        {
+            CompressionOptions options{true, sizeof(test_data[0]), 0, VBZ_DEFAULT_VERSION};
+            perform_in_place_decompression_test(test_data, options);
+        }
+
+        WHEN("Compressing with zstd only")
+        {
+            CompressionOptions options{false, 0, 1, VBZ_DEFAULT_VERSION};
+            perform_in_place_decompression_test(test_data, options);
+        }
+
+        WHEN("Compressing with no options")
+        {
+            CompressionOptions options{false, 0, 0, VBZ_DEFAULT_VERSION};
+            perform_in_place_decompression_test(test_data, options);
+        }
+
+        WHEN("Compressing int8 data with version 1")
+        {
+            std::vector<std::int8_t> int8_data(test_data.begin(), test_data.end());
+            CompressionOptions options{true, 1, 1, 1};
+            perform_in_place_decompression_test(int8_data, options);
+        }
+    }
+
+    GIVEN("A block of about 1MB")
+    {
+        std::vector<std::int16_t> data;
+        while (data.size() < 512 * 1024)
+        {
+            data.insert(data.end(), test_data.begin(), test_data.end());
+        }
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+
+        // The most memory held besides the buffer while decompressing in place with [options], and the
+        // compressed size.
+        auto const peak_memory = [&](CompressionOptions const& options) {
+            std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+            auto const compressed_size = vbz_compress(data.data(), input_data_size, compressed.data(),
+                                                      vbz_size_t(compressed.size()), &options);
+            REQUIRE(!vbz_is_error(compressed_size));
+            auto const capacity = vbz_in_place_decompression_capacity(compressed_size, input_data_size, &options);
+            std::vector<int8_t> buffer(capacity);
+            std::copy(compressed.begin(), compressed.begin() + compressed_size, buffer.end() - compressed_size);
+
+            AllocationCounter counter;
+            auto const decompressed_size = vbz_decompress_in_place(buffer.data(), capacity, compressed_size,
+                                                                   input_data_size, &options);
+            auto const counts = counter.end_call();
+            CHECK(decompressed_size == input_data_size);
+            return std::make_pair(counts.peak_live_bytes, std::size_t(compressed_size));
+        };
+
+        if (AllocationCounter::available())
+        {
+            // Allowance for the allocator rounding up blocks.
+            std::size_t const slack = 4096;
+
+            THEN("Only integer encoding holds more than zstd's context, as documented")
+            {
+                CHECK(peak_memory(CompressionOptions{false, 0, 0, VBZ_DEFAULT_VERSION}).first == 0);
+
+                auto const zstd_context = peak_memory(CompressionOptions{false, 0, 1, VBZ_DEFAULT_VERSION}).first;
+                CHECK(zstd_context < input_data_size / 8);
+
+                auto const integers = peak_memory(CompressionOptions{true, 2, 0, VBZ_DEFAULT_VERSION});
+                CHECK(integers.first <= integers.second + slack);
+
+                auto const both = peak_memory(CompressionOptions{true, 2, 1, VBZ_DEFAULT_VERSION});
+                CHECK(both.first <= integers.second + zstd_context + slack);
+            }
+        }
+    }
+}
+
+template <typename T>
+void perform_estimate_test(std::vector<T> const& data, CompressionOptions const& options, double tolerance)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+    auto compressed_size = vbz_compress(data.data(), input_data_size, compressed.data(),
+                                        vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+
+    auto estimated_size = vbz_estimate_compressed_size(data.data(), input_data_size, &options);
+    REQUIRE(!vbz_is_error(estimated_size));
+
+    INFO("Compressed size " << compressed_size);
+    INFO("Estimated size  " << estimated_size);
+    THEN("The estimate is close to the compressed size")
+    {
+        CHECK(estimated_size >= compressed_size * (1 - tolerance));
+        CHECK(estimated_size <= compressed_size * (1 + tolerance));
+    }
+}
+
+template <typename T>
+std::vector<T> load_reads_test_data(std::string const& path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    REQUIRE(ifs.is_open());
+    std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    std::vector<T> data(bytes.size() / sizeof(T));
+    std::copy_n(bytes.begin(), data.size() * sizeof(T), reinterpret_cast<char*>(data.data()));
+    return data;
+}
+
+SCENARIO("vbz compressed size estimate")
+{
+    GIVEN("Test data from a realistic dataset")
+    {
+        WHEN("Estimating without zstd")
+        {
+            CompressionOptions options{true, sizeof(test_data[0]), 0, VBZ_DEFAULT_VERSION};
+            THEN("The estimate is exact for small inputs")
+            {
+                auto const input_data_size = vbz_size_t(1000 * sizeof(test_data[0]));
+                std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+                CHECK(vbz_estimate_compressed_size(test_data.data(), input_data_size, &options)
+                      == vbz_compress(test_data.data(), input_data_size, compressed.data(),
+                                      vbz_size_t(compressed.size()), &options));
+            }
+        }
+
+        WHEN("Estimating with zstd")
+        {
+            CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_estimate_test(test_data, options, 0.15);
+        }
+
+        WHEN("Estimating with zstd only")
+        {
+            CompressionOptions options{false, 0, 1, VBZ_DEFAULT_VERSION};
+            perform_estimate_test(test_data, options, 0.15);
+        }
+    }
+
+    GIVEN("Reads from the test_data directory")
+    {
+        auto const path = GENERATE(as<std::string>{},
+            "test_data/reads_test_dat/reads_10.dat",
+            "test_data/reads_test_dat/reads_20.dat",
+            "test_data/reads_test_dat/reads_30.dat");
+        INFO("Reads " << path);
+        auto const reads = load_reads_test_data<std::int16_t>(path);
+
+        WHEN("Estimating with zstd")
+        {
+            CompressionOptions options{true, sizeof(reads[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_estimate_test(reads, options, 0.1);
+        }
+
+        WHEN("Estimating int8 data with zstd")
+        {
+            std::vector<std::int8_t> int8_reads(reads.size());
+            std::transform(reads.begin(), reads.end(), int8_reads.begin(), [](std::int16_t v) { return std::int8_t(v / 8); });
+            CompressionOptions options{true, sizeof(int8_reads[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_estimate_test(int8_reads, options, 0.1);
+        }
+
+        WHEN("Estimating int32 data with zstd")
+        {
+            std::vector<std::int32_t> int32_reads(reads.begin(), reads.end());
+            CompressionOptions options{true, sizeof(int32_reads[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_estimate_test(int32_reads, options, 0.1);
+        }
+    }
+
+    GIVEN("Sequential data")
+    {
+        std::vector<std::int16_t> sequence(1000 * 1000);
+        std::iota(sequence.begin(), sequence.end(), 0);
+
+        WHEN("Estimating with zstd")
+        {
+            CompressionOptions options{true, sizeof(sequence[0]), 1, VBZ_DEFAULT_VERSION};
+            auto const input_data_size = vbz_size_t(sequence.size() * sizeof(sequence[0]));
+            auto estimated_size = vbz_estimate_compressed_size(sequence.data(), input_data_size, &options);
+            THEN("The estimate reflects the highly compressible data")
+            {
+                REQUIRE(!vbz_is_error(estimated_size));
+                CHECK(estimated_size < input_data_size / 100);
+            }
+        }
+    }
+
+    GIVEN("Invalid options")
+    {
+        std::vector<std::int16_t> data(101);
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+        CompressionOptions bad_integer_size{true, 3, 1, VBZ_DEFAULT_VERSION};
+        CompressionOptions bad_input_size{true, 4, 1, VBZ_DEFAULT_VERSION};
+        CompressionOptions bad_version{true, 2, 1, 100};
+        CHECK(vbz_estimate_compressed_size(data.data(), input_data_size, &bad_integer_size) == VBZ_INTEGER_SIZE_ERROR);
+        CHECK(vbz_estimate_compressed_size(data.data(), input_data_size, &bad_input_size) == VBZ_INPUT_SIZE_ERROR);
+        CHECK(vbz_estimate_compressed_size(data.data(), input_data_size, &bad_version) == VBZ_VERSION_ERROR);
+    }
+}
+
+template <typename T>
+void perform_batch_compression_test(std::vector<std::vector<T>> const& reads, CompressionOptions const& options)
+{
+    std::vector<void const*> sources;
+    std::vector<vbz_size_t> source_sizes;
+    std::vector<T> concatenated;
+    for (auto const& read : reads)
+    {
+        sources.push_back(read.data());
+        source_sizes.push_back(vbz_size_t(read.size() * sizeof(T)));
+        concatenated.insert(concatenated.end(), read.begin(), read.end());
+    }
+
+    auto const max_size = vbz_max_batch_compressed_size(source_sizes.data(), vbz_size_t(reads.size()), &options);
+    REQUIRE(!vbz_is_error(max_size));
+    std::vector<int8_t> batch(max_size);
+    auto batch_size = vbz_compress_batch(sources.data(), source_sizes.data(), vbz_size_t(reads.size()),
+                                         batch.data(), vbz_size_t(batch.size()), &options);
+    REQUIRE(!vbz_is_error(batch_size));
+    batch.resize(batch_size);
+
+    THEN("The batch records each read")
+    {
+        REQUIRE(vbz_batch_read_count(batch.data(), batch_size) == reads.size());
+        for (std::size_t i = 0; i < reads.size(); ++i)
+        {
+            CHECK(vbz_batch_decompressed_size(batch.data(), batch_size, vbz_size_t(i)) == source_sizes[i]);
+        }
+        CHECK(vbz_batch_decompressed_size(batch.data(), batch_size, vbz_size_t(reads.size())) == VBZ_INPUT_SIZE_ERROR);
+    }
+
+    THEN("Each read decompresses individually")
+    {
+        for (std::size_t i = 0; i < reads.size(); ++i)
+        {
+            INFO("Read " << i);
+            std::vector<T> decompressed(reads[i].size());
+            auto decompressed_size = vbz_decompress_batch_read(
+                batch.data(), batch_size, vbz_size_t(i), decompressed.data(),
+                vbz_size_t(decompressed.size() * sizeof(T)), &options);
+            REQUIRE(decompressed_size == source_sizes[i]);
+            CHECK(decompressed == reads[i]);
+        }
+    }
+
+    THEN("The whole batch decompresses at once")
+    {
+        std::vector<T> decompressed(concatenated.size());
+        auto decompressed_size = vbz_decompress_batch(
+            batch.data(), batch_size, decompressed.data(),
+            vbz_size_t(decompressed.size() * sizeof(T)), &options);
+        REQUIRE(decompressed_size == concatenated.size() * sizeof(T));
+        CHECK(decompressed == concatenated);
+    }
+
+    THEN("Short destinations and truncated batches are rejected")
+    {
+        std::vector<T> decompressed(concatenated.size());
+        if (!concatenated.empty())
+        {
+            CHECK(vbz_decompress_batch(batch.data(), batch_size, decompressed.data(),
+                                       vbz_size_t(decompressed.size() * sizeof(T) - 1), &options)
+                  == VBZ_DESTINATION_SIZE_ERROR);
+        }
+        CHECK(vbz_is_error(vbz_decompress_batch(batch.data(), 3, decompressed.data(),
+                                                vbz_size_t(decompressed.size() * sizeof(T)), &options)));
+        if (reads.size() > 1)
+        {
+            auto const last = vbz_size_t(reads.size() - 1);
+            CHECK(vbz_is_error(vbz_decompress_batch_read(batch.data(), batch_size - 4, last, decompressed.data(),
+                                                         vbz_size_t(decompressed.size() * sizeof(T)), &options)));
+        }
+    }
+}
+
+SCENARIO("vbz batch compression")
+{
+    GIVEN("Many short reads from a realistic dataset")
+    {
+        std::default_random_engine rand(5);
+        std::uniform_int_distribution<std::size_t> length_dist(0, 4000);
+        std::vector<std::vector<std::int16_t>> reads(50);
+        std::size_t offset = 0;
+        for (auto& read : reads)
+        {
+            read.resize(length_dist(rand));
+            for (auto& sample : read)
+            {
+                sample = test_data[offset];
+                offset = (offset + 1) % test_data.size();
+            }
+        }
+
+        WHEN("Compressing with zstd and zig-zag deltas")
+        {
+            CompressionOptions options{true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION};
+            perform_batch_compression_test(reads, options);
+        }
+
+        WHEN("Compressing with zig-zag deltas only")
+        {
+            CompressionOptions options{true, sizeof(std::int16_t), 0, VBZ_DEFAULT_VERSION};
+            perform_batch_compression_test(reads, options);
+        }
+
+        WHEN("Compressing with zstd only")
+        {
+            CompressionOptions options{false, 0, 1, VBZ_DEFAULT_VERSION};
+            perform_batch_compression_test(reads, options);
+        }
+
+        WHEN("Compressing with version 1")
+        {
+            CompressionOptions options{true, sizeof(std::int16_t), 1, 1};
+            perform_batch_compression_test(reads, options);
+        }
+
+        WHEN("Compressing the reads separately and as a batch")
+        {
+            CompressionOptions options{true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION};
+            std::size_t separate_size = 0;
+            std::vector<void const*> sources;
+            std::vector<vbz_size_t> source_sizes;
+            for (auto const& read : reads)
+            {
+                auto const read_size = vbz_size_t(read.size() * sizeof(read[0]));
+                std::vector<int8_t> compressed(vbz_max_compressed_size(read_size, &options));
+                separate_size += vbz_compress_sized(read.data(), read_size, compressed.data(),
+                                                    vbz_size_t(compressed.size()), &options);
+                sources.push_back(read.data());
+                source_sizes.push_back(read_size);
+            }
+
+            std::vector<int8_t> batch(vbz_max_batch_compressed_size(source_sizes.data(), vbz_size_t(reads.size()), &options));
+            auto batch_size = vbz_compress_batch(sources.data(), source_sizes.data(), vbz_size_t(reads.size()),
+                                                 batch.data(), vbz_size_t(batch.size()), &options);
+            THEN("The batch is smaller")
+            {
+                REQUIRE(!vbz_is_error(batch_size));
+                CHECK(batch_size < separate_size);
+            }
+        }
+    }
+
+    GIVEN("An empty batch")
+    {
+        std::vector<std::vector<std::int16_t>> reads;
+        CompressionOptions options{true, sizeof(std::int16_t), 1, VBZ_DEFAULT_VERSION};
+        perform_batch_compression_test(reads, options);
+    }
+
+    GIVEN("A zstd only batch with a corrupt entry")
+    {
+        CompressionOptions options{false, 0, 1, VBZ_DEFAULT_VERSION};
+        auto const source = test_data.data();
+        auto const source_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> batch(vbz_max_batch_compressed_size(&source_size, 1, &options));
+        auto batch_size = vbz_compress_batch(reinterpret_cast<void const* const*>(&source), &source_size, 1,
+                                             batch.data(), vbz_size_t(batch.size()), &options);
+        REQUIRE(!vbz_is_error(batch_size));
+        std::vector<std::int16_t> decompressed(test_data.size());
+
+        // The entry's sizes follow the read count: the original size, encoded offset, then encoded size.
+        auto const set_entry = [&](std::size_t field, vbz_size_t value) {
+            std::memcpy(batch.data() + 4 + 4 * field, &value, sizeof(value));
+        };
+
+        THEN("An encoded size differing from the original size is reported as corrupt input")
+        {
+            set_entry(2, source_size - 2);
+            CHECK(vbz_decompress_batch_read(batch.data(), batch_size, 0, decompressed.data(), source_size,
+                                            &options) == VBZ_INPUT_SIZE_ERROR);
+        }
+
+        THEN("A frame larger than the entries is rejected before it is decoded")
+        {
+            set_entry(0, 2);
+            set_entry(2, 2);
+            CHECK(vbz_decompress_batch(batch.data(), batch_size, decompressed.data(), source_size, &options)
+                  == VBZ_INPUT_SIZE_ERROR);
+        }
+    }
+}
+
+template <typename T>
+void perform_checksummed_compression_test(std::vector<T> const& data, CompressionOptions const& options)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_checksummed_compressed_size(input_data_size, &options));
+    auto compressed_size = vbz_compress_checksummed(data.data(), input_data_size, compressed.data(),
+                                                    vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+    REQUIRE(vbz_decompressed_size(compressed.data(), compressed_size, &options) == input_data_size);
+
+    THEN("The data decompresses and verifies")
+    {
+        std::vector<T> decompressed(data.size());
+        auto decompressed_size = vbz_decompress_checksummed(compressed.data(), compressed_size, decompressed.data(),
+                                                            input_data_size, &options);
+        REQUIRE(decompressed_size == input_data_size);
+        CHECK(decompressed == data);
+    }
+
+    THEN("A corrupted checksum is reported")
+    {
+        // The first block's checksum follows the 8 byte header.
+        compressed[8] ^= 0x1;
+        std::vector<T> decompressed(data.size());
+        CHECK(vbz_decompress_checksummed(compressed.data(), compressed_size, decompressed.data(),
+                                         input_data_size, &options) == VBZ_CHECKSUM_ERROR);
+    }
+
+    THEN("A short destination is rejected")
+    {
+        std::vector<T> decompressed(data.size());
+        CHECK(vbz_decompress_checksummed(compressed.data(), compressed_size, decompressed.data(),
+                                         input_data_size - 1, &options) == VBZ_DESTINATION_SIZE_ERROR);
+    }
+}
+
+SCENARIO("vbz crc32c checksums")
+{
+    std::string const check = "123456789";
+
+    THEN("The standard check value is produced")
+    {
+        CHECK(vbz_crc32c(0, check.data(), check.size()) == 0xE3069283);
+    }
+
+    THEN("Checksums can be extended")
+    {
+        auto const partial = vbz_crc32c(0, check.data(), 4);
+        CHECK(vbz_crc32c(partial, check.data() + 4, check.size() - 4) == 0xE3069283);
+    }
+
+    THEN("Unaligned data of any length matches the bytewise checksum")
+    {
+        std::vector<char> data(100);
+        std::iota(data.begin(), data.end(), 0);
+        for (std::size_t offset = 0; offset < 8; ++offset)
+        {
+            for (std::size_t size = 0; size + offset <= data.size(); size += 7)
+            {
+                std::uint32_t bytewise = 0;
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    bytewise = vbz_crc32c(bytewise, data.data() + offset + i, 1);
+                }
+                CHECK(vbz_crc32c(0, data.data() + offset, size) == bytewise);
+            }
+        }
+    }
+}
+
+SCENARIO("vbz checksummed compression")
+{
+    GIVEN("Test data spanning several checksum blocks")
+    {
+        std::vector<std::int16_t> data;
+        while (data.size() < 100 * 1000)
+        {
+            data.insert(data.end(), test_data.begin(), test_data.end());
+        }
+
+        WHEN("Compressing with zstd and zig-zag deltas")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_checksummed_compression_test(data, options);
+        }
+
+        WHEN("Compressing with zig-zag deltas only")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 0, VBZ_DEFAULT_VERSION};
+            perform_checksummed_compression_test(data, options);
+
+            THEN("Corrupted data is reported")
+            {
+                auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+                std::vector<int8_t> compressed(vbz_max_checksummed_compressed_size(input_data_size, &options));
+                auto compressed_size = vbz_compress_checksummed(data.data(), input_data_size, compressed.data(),
+                                                                vbz_size_t(compressed.size()), &options);
+                REQUIRE(!vbz_is_error(compressed_size));
+
+                // Flip a low bit of a data byte in the last block, which keeps the stream valid but changes a value.
+                compressed[compressed_size - 1] ^= 0x1;
+                std::vector<std::int16_t> decompressed(data.size());
+                CHECK(vbz_decompress_checksummed(compressed.data(), compressed_size, decompressed.data(),
+                                                 input_data_size, &options) == VBZ_CHECKSUM_ERROR);
+            }
+        }
+
+        WHEN("Compressing with zstd only")
+        {
+            CompressionOptions options{false, 0, 1, VBZ_DEFAULT_VERSION};
+            perform_checksummed_compression_test(data, options);
+        }
+
+        WHEN("Compressing with version 1")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 1, 1};
+            perform_checksummed_compression_test(data, options);
+        }
+    }
+
+    GIVEN("Empty data")
+    {
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        std::vector<int8_t> compressed(vbz_max_checksummed_compressed_size(0, &options));
+        auto compressed_size = vbz_compress_checksummed(nullptr, 0, compressed.data(), vbz_size_t(compressed.size()), &options);
+        REQUIRE(!vbz_is_error(compressed_size));
+        CHECK(vbz_decompress_checksummed(compressed.data(), compressed_size, nullptr, 0, &options) == 0);
+    }
+
+    GIVEN("Headers claiming blocks larger than their data")
+    {
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        std::vector<std::int16_t> decompressed(8);
+
+        THEN("They are rejected without reserving space for the blocks")
+        {
+            // No data, in a single block of almost 4GB.
+            std::vector<std::uint32_t> const empty{ 0, 0xfffffff0, 0, 0 };
+            CHECK(vbz_decompress_checksummed(empty.data(), vbz_size_t(empty.size() * 4), decompressed.data(), 16,
+                                             &options) == VBZ_INPUT_SIZE_ERROR);
+
+            // 16 bytes in one 2GB block.
+            std::vector<std::uint32_t> const short_data{ 16, 0x80000000, 0, 16, 0, 0, 0, 0 };
+            CHECK(vbz_decompress_checksummed(short_data.data(), vbz_size_t(short_data.size() * 4),
+                                             decompressed.data(), 16, &options) == VBZ_INPUT_SIZE_ERROR);
+        }
+    }
+
+    THEN("The checksum error has a description")
+    {
+        CHECK(std::string(vbz_error_string(VBZ_CHECKSUM_ERROR)) == "VBZ_CHECKSUM_ERROR");
+        CHECK(vbz_is_error(VBZ_CHECKSUM_ERROR));
+    }
+}
+
+using VbzFunction = vbz_size_t (*)(void const*, vbz_size_t, void*, vbz_size_t, CompressionOptions const*);
+using VbzTranscodeFunction = vbz_size_t (*)(void const*, vbz_size_t, void*, vbz_size_t, CompressionOptions const*,
+                                            CompressionOptions const*);
+
+template <typename T>
+std::vector<int8_t> compress_for_transcode(std::vector<T> const& data, CompressionOptions const& options,
+                                           VbzFunction compress)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_checksummed_compressed_size(input_data_size, &options));
+    auto compressed_size = compress(data.data(), input_data_size, compressed.data(),
+                                    vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+    return compressed;
+}
+
+template <typename T>
+void perform_transcode_test(
+    std::vector<T> const& data,
+    CompressionOptions const& source_options,
+    CompressionOptions const& destination_options,
+    VbzFunction compress,
+    VbzFunction decompress,
+    VbzTranscodeFunction transcode)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    auto const source = compress_for_transcode(data, source_options, compress);
+
+    std::vector<int8_t> transcoded(vbz_max_checksummed_compressed_size(input_data_size, &destination_options));
+    auto transcoded_size = transcode(source.data(), vbz_size_t(source.size()), transcoded.data(),
+                                     vbz_size_t(transcoded.size()), &source_options, &destination_options);
+    REQUIRE(!vbz_is_error(transcoded_size));
+    transcoded.resize(transcoded_size);
+
+    THEN("The data is compressed exactly as compressing it with the destination options would")
+    {
+        CHECK(transcoded == compress_for_transcode(data, destination_options, compress));
+    }
+
+    THEN("The data decompresses with the destination options")
+    {
+        std::vector<T> decompressed(data.size());
+        auto decompressed_size = decompress(transcoded.data(), transcoded_size, decompressed.data(),
+                                            input_data_size, &destination_options);
+        REQUIRE(decompressed_size == input_data_size);
+        CHECK(decompressed == data);
+    }
+
+    THEN("A short destination is rejected")
+    {
+        std::vector<int8_t> destination(transcoded_size - 1);
+        auto result = transcode(source.data(), vbz_size_t(source.size()), destination.data(),
+                                vbz_size_t(destination.size()), &source_options, &destination_options);
+        CHECK(vbz_is_error(result));
+    }
+
+    THEN("Truncated data is rejected")
+    {
+        // Without zstd sized data can't be checked without decoding it.
+        if (source_options.zstd_compression_level == 0 && transcode == &vbz_transcode_sized)
+        {
+            return;
+        }
+        std::vector<int8_t> destination(transcoded.size());
+        auto result = transcode(source.data(), vbz_size_t(source.size() - 1), destination.data(),
+                                vbz_size_t(destination.size()), &source_options, &destination_options);
+        CHECK(vbz_is_error(result));
+    }
+}
+
+SCENARIO("vbz transcoding")
+{
+    GIVEN("Test data spanning several checksum blocks")
+    {
+        std::vector<std::int16_t> data;
+        while (data.size() < 100 * 1000)
+        {
+            data.insert(data.end(), test_data.begin(), test_data.end());
+        }
+
+        CompressionOptions const level_1{true, sizeof(data[0]), 1, VBZ_DEFAULT_VERSION};
+        CompressionOptions const level_19{true, sizeof(data[0]), 19, VBZ_DEFAULT_VERSION};
+        CompressionOptions const no_zstd{true, sizeof(data[0]), 0, VBZ_DEFAULT_VERSION};
+        CompressionOptions const version_0{true, sizeof(data[0]), 19, 0};
+        CompressionOptions const zstd_only_1{false, 0, 1, 0};
+        CompressionOptions const zstd_only_19{false, 0, 19, 1};
+
+        WHEN("Transcoding sized data from zstd level 1 to 19")
+        {
+            perform_transcode_test(data, level_1, level_19, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+        }
+
+        WHEN("Transcoding sized data from zstd level 19 to 1")
+        {
+            perform_transcode_test(data, level_19, level_1, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+        }
+
+        WHEN("Transcoding sized data to and from no zstd")
+        {
+            perform_transcode_test(data, level_1, no_zstd, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+            perform_transcode_test(data, no_zstd, level_19, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+        }
+
+        WHEN("Transcoding sized data between vbz versions")
+        {
+            perform_transcode_test(data, level_1, version_0, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+        }
+
+        WHEN("Transcoding sized zstd only data, where the vbz version is unused")
+        {
+            perform_transcode_test(data, zstd_only_1, zstd_only_19, &vbz_compress_sized, &vbz_decompress_sized,
+                                   &vbz_transcode_sized);
+        }
+
+        WHEN("Transcoding checksummed data from zstd level 1 to 19")
+        {
+            perform_transcode_test(data, level_1, level_19, &vbz_compress_checksummed,
+                                   &vbz_decompress_checksummed, &vbz_transcode_checksummed);
+        }
+
+        WHEN("Transcoding checksummed data to and from no zstd")
+        {
+            perform_transcode_test(data, level_19, no_zstd, &vbz_compress_checksummed,
+                                   &vbz_decompress_checksummed, &vbz_transcode_checksummed);
+            perform_transcode_test(data, no_zstd, level_1, &vbz_compress_checksummed,
+                                   &vbz_decompress_checksummed, &vbz_transcode_checksummed);
+        }
+
+        WHEN("Transcoding checksummed data between vbz versions")
+        {
+            perform_transcode_test(data, version_0, level_1, &vbz_compress_checksummed,
+                                   &vbz_decompress_checksummed, &vbz_transcode_checksummed);
+        }
+    }
+
+    GIVEN("Empty data")
+    {
+        std::vector<std::int16_t> data;
+        CompressionOptions const level_1{true, 2, 1, VBZ_DEFAULT_VERSION};
+        CompressionOptions const level_19{true, 2, 19, VBZ_DEFAULT_VERSION};
+        auto const source = compress_for_transcode(data, level_1, &vbz_compress_checksummed);
+        std::vector<int8_t> transcoded(vbz_max_checksummed_compressed_size(0, &level_19));
+        auto transcoded_size = vbz_transcode_checksummed(source.data(), vbz_size_t(source.size()), transcoded.data(),
+                                                         vbz_size_t(transcoded.size()), &level_1, &level_19);
+        REQUIRE(!vbz_is_error(transcoded_size));
+        CHECK(vbz_decompress_checksummed(transcoded.data(), transcoded_size, nullptr, 0, &level_19) == 0);
+    }
+}
+
+std::vector<int8_t> merge_for_test(std::vector<int8_t> const& first, std::vector<int8_t> const& second,
+                                   CompressionOptions const& options)
+{
+    std::vector<int8_t> merged(vbz_max_merged_checksummed_size(vbz_size_t(first.size()), vbz_size_t(second.size())));
+    auto merged_size = vbz_merge_checksummed(first.data(), vbz_size_t(first.size()), second.data(),
+                                             vbz_size_t(second.size()), merged.data(), vbz_size_t(merged.size()),
+                                             &options);
+    REQUIRE(!vbz_is_error(merged_size));
+    merged.resize(merged_size);
+    return merged;
+}
+
+template <typename T>
+void perform_merge_test(std::vector<T> const& data, std::size_t first_count, std::size_t second_count,
+                        CompressionOptions const& options)
+{
+    std::vector<T> const first_data(data.begin(), data.begin() + first_count);
+    std::vector<T> const second_data(data.begin() + first_count, data.begin() + first_count + second_count);
+    std::vector<T> const third_data(data.begin() + first_count + second_count, data.end());
+    auto const first = compress_for_transcode(first_data, options, &vbz_compress_checksummed);
+    auto const second = compress_for_transcode(second_data, options, &vbz_compress_checksummed);
+    auto const third = compress_for_transcode(third_data, options, &vbz_compress_checksummed);
+
+    auto const merged = merge_for_test(merge_for_test(first, second, options), third, options);
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    REQUIRE(vbz_decompressed_size(merged.data(), vbz_size_t(merged.size()), &options) == input_data_size);
+
+    THEN("The merged data decompresses to the joined parts")
+    {
+        std::vector<T> decompressed(data.size());
+        auto decompressed_size = vbz_decompress_checksummed(merged.data(), vbz_size_t(merged.size()),
+                                                            decompressed.data(), input_data_size, &options);
+        REQUIRE(decompressed_size == input_data_size);
+        CHECK(decompressed == data);
+    }
+
+    THEN("The merged data transcodes")
+    {
+        auto destination_options = options;
+        destination_options.zstd_compression_level = options.zstd_compression_level == 0 ? 3 : 0;
+        std::vector<int8_t> transcoded(vbz_max_checksummed_transcoded_size(
+            merged.data(), vbz_size_t(merged.size()), &options, &destination_options));
+        auto transcoded_size = vbz_transcode_checksummed(merged.data(), vbz_size_t(merged.size()), transcoded.data(),
+                                                         vbz_size_t(transcoded.size()), &options, &destination_options);
+        REQUIRE(!vbz_is_error(transcoded_size));
+
+        std::vector<T> decompressed(data.size());
+        auto decompressed_size = vbz_decompress_checksummed(transcoded.data(), transcoded_size, decompressed.data(),
+                                                            input_data_size, &destination_options);
+        REQUIRE(decompressed_size == input_data_size);
+        CHECK(decompressed == data);
+    }
+
+    THEN("A corrupted block in a later part is reported")
+    {
+        auto corrupted = merge_for_test(first, second, options);
+        // Find the second part's first checksum (and encoded size) among the blocks after the first part's.
+        auto const first_header_size = 8 + 8 * ((first_data.size() * sizeof(T) + 0xffff) / 0x10000);
+        auto const checksum_offset = std::search(corrupted.begin() + first_header_size, corrupted.end(),
+                                                 second.begin() + 8, second.begin() + 16) - corrupted.begin();
+        REQUIRE(checksum_offset < vbz_size_t(corrupted.size()));
+        corrupted[checksum_offset] ^= 0x1;
+
+        std::vector<T> decompressed(first_data.size() + second_data.size());
+        CHECK(vbz_decompress_checksummed(corrupted.data(), vbz_size_t(corrupted.size()), decompressed.data(),
+                                         vbz_size_t(decompressed.size() * sizeof(T)), &options) == VBZ_CHECKSUM_ERROR);
+    }
+
+    THEN("A short destination is rejected")
+    {
+        std::vector<int8_t> destination(merged.size() - 1);
+        auto const first_second = merge_for_test(first, second, options);
+        CHECK(vbz_merge_checksummed(first_second.data(), vbz_size_t(first_second.size()), third.data(),
+                                    vbz_size_t(third.size()), destination.data(), vbz_size_t(destination.size()),
+                                    &options) == VBZ_DESTINATION_SIZE_ERROR);
+    }
+}
+
+SCENARIO("vbz checksummed merging")
+{
+    GIVEN("Test data split into parts of several checksum blocks")
+    {
+        std::vector<std::int16_t> data;
+        while (data.size() < 300 * 1000)
+        {
+            data.insert(data.end(), test_data.begin(), test_data.end());
+        }
+        // 64KB checksum blocks hold 32768 samples.
+        std::size_t const block_samples = 32 * 1024;
+
+        WHEN("Merging parts not ending on whole blocks, with zstd")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 1, VBZ_DEFAULT_VERSION};
+            perform_merge_test(data, 100 * 1000 + 1, 70 * 1000 + 3, options);
+        }
+
+        WHEN("Merging parts not ending on whole blocks, with zig-zag deltas only")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 0, VBZ_DEFAULT_VERSION};
+            perform_merge_test(data, 100 * 1000 + 1, 70 * 1000 + 3, options);
+        }
+
+        WHEN("Merging parts not ending on whole blocks, with zstd only")
+        {
+            CompressionOptions options{false, 0, 1, 1};
+            perform_merge_test(data, 100 * 1000 + 1, 70 * 1000 + 3, options);
+        }
+
+        WHEN("Merging parts ending on whole blocks")
+        {
+            CompressionOptions options{true, sizeof(data[0]), 1, 1};
+            perform_merge_test(data, 3 * block_samples, block_samples, options);
+
+            THEN("The parts merge into unmerged data")
+            {
+                std::vector<std::int16_t> const first_data(data.begin(), data.begin() + block_samples);
+                std::vector<std::int16_t> const second_data(data.begin() + block_samples, data.end());
+                auto const first = compress_for_transcode(first_data, options, &vbz_compress_checksummed);
+                auto const second = compress_for_transcode(second_data, options, &vbz_compress_checksummed);
+                auto const merged = merge_for_test(first, second, options);
+                CHECK(merged.size() == first.size() + second.size() - 8);
+            }
+        }
+    }
+
+    GIVEN("Empty parts")
+    {
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        std::vector<std::int16_t> const data(test_data.begin(), test_data.end());
+        auto const empty = compress_for_transcode(std::vector<std::int16_t>(), options, &vbz_compress_checksummed);
+        auto const part = compress_for_transcode(data, options, &vbz_compress_checksummed);
+
+        auto const merged = merge_for_test(merge_for_test(empty, part, options), empty, options);
+        std::vector<std::int16_t> decompressed(data.size());
+        CHECK(vbz_decompress_checksummed(merged.data(), vbz_size_t(merged.size()), decompressed.data(),
+                                         vbz_size_t(data.size() * sizeof(data[0])), &options)
+              == data.size() * sizeof(data[0]));
+        CHECK(decompressed == data);
+
+        auto const empty_merged = merge_for_test(empty, empty, options);
+        CHECK(vbz_decompress_checksummed(empty_merged.data(), vbz_size_t(empty_merged.size()), nullptr, 0, &options) == 0);
+    }
+}
+
+SCENARIO("vbz scratch arena compression")
+{
+    GIVEN("Test data larger than a huge page once encoded")
+    {
+        std::vector<std::int16_t> data;
+        while (data.size() < 2 * 1000 * 1000)
+        {
+            data.insert(data.end(), test_data.begin(), test_data.end());
+        }
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+
+        for (unsigned int page_mode : { VBZ_SCRATCH_ARENA_DEFAULT_PAGES,
+                                        VBZ_SCRATCH_ARENA_TRANSPARENT_HUGE_PAGES,
+                                        VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES })
+        {
+            std::unique_ptr<VbzScratchArena, decltype(&vbz_free_scratch_arena)> arena(
+                vbz_create_scratch_arena(page_mode), &vbz_free_scratch_arena);
+            REQUIRE(arena);
+            CHECK(vbz_scratch_arena_page_mode(arena.get()) == VBZ_SCRATCH_ARENA_DEFAULT_PAGES);
+
+            WHEN("Compressing repeatedly through an arena with page mode " << page_mode)
+            {
+                CompressionOptions options{true, sizeof(data[0]), 1, VBZ_DEFAULT_VERSION};
+                std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+                std::vector<int8_t> expected(compressed.size());
+                auto expected_size = vbz_compress(data.data(), input_data_size, expected.data(),
+                                                  vbz_size_t(expected.size()), &options);
+                REQUIRE(!vbz_is_error(expected_size));
+                expected.resize(expected_size);
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    // Vary the size, so the arena serves both smaller and larger requests.
+                    auto const size = i == 1 ? input_data_size / 2 : input_data_size;
+                    auto compressed_size = vbz_compress_with_arena(data.data(), size, compressed.data(),
+                                                                   vbz_size_t(compressed.size()), &options, arena.get());
+                    REQUIRE(!vbz_is_error(compressed_size));
+
+                    std::vector<std::int16_t> decompressed(size / sizeof(data[0]));
+                    auto decompressed_size = vbz_decompress_with_arena(compressed.data(), compressed_size,
+                                                                       decompressed.data(), size, &options, arena.get());
+                    REQUIRE(decompressed_size == size);
+                    CHECK(std::equal(decompressed.begin(), decompressed.end(), data.begin()));
+
+                    if (size == input_data_size)
+                    {
+                        CHECK(compressed_size == expected.size());
+                        CHECK(std::equal(expected.begin(), expected.end(), compressed.begin()));
+                    }
+                }
+
+                THEN("The arena has fallen back to at most the requested page mode")
+                {
+                    CHECK(vbz_scratch_arena_page_mode(arena.get()) <= page_mode);
+                }
+            }
+        }
+    }
+
+    GIVEN("No arena")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+        auto compressed_size = vbz_compress_with_arena(test_data.data(), input_data_size, compressed.data(),
+                                                       vbz_size_t(compressed.size()), &options, nullptr);
+        REQUIRE(!vbz_is_error(compressed_size));
+
+        std::vector<std::int16_t> decompressed(test_data.size());
+        CHECK(vbz_decompress_with_arena(compressed.data(), compressed_size, decompressed.data(),
+                                        input_data_size, &options, nullptr) == input_data_size);
+        CHECK(decompressed == test_data);
+    }
+
+    GIVEN("An unknown page mode")
+    {
+        CHECK(vbz_create_scratch_arena(VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES + 1) == nullptr);
+    }
+}
+
+template <typename T>
+void perform_bounded_error_compression_test(
+    std::vector<T> const& data,
+    vbz_size_t max_absolute_error,
+    CompressionOptions const& options)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_bounded_error_compressed_size(input_data_size, &options));
+    auto compressed_size = vbz_compress_bounded_error(data.data(), input_data_size, compressed.data(),
+                                                      vbz_size_t(compressed.size()), max_absolute_error, &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+    REQUIRE(vbz_decompressed_size(compressed.data(), compressed_size, &options) == input_data_size);
+    CHECK(vbz_bounded_error_max_absolute_error(compressed.data(), compressed_size) == max_absolute_error);
+
+    THEN("Every decompressed value is within the bound")
+    {
+        std::vector<T> decompressed(data.size());
+        auto decompressed_size = vbz_decompress_bounded_error(compressed.data(), compressed_size, decompressed.data(),
+                                                              input_data_size, &options);
+        REQUIRE(decompressed_size == input_data_size);
+
+        std::int64_t max_error = 0;
+        for (std::size_t i = 0; i < data.size(); ++i)
+        {
+            max_error = std::max(max_error, std::abs(std::int64_t(data[i]) - std::int64_t(decompressed[i])));
+        }
+        CHECK(max_error <= std::int64_t(max_absolute_error));
+    }
+
+    THEN("A short destination is rejected")
+    {
+        std::vector<T> decompressed(data.size());
+        CHECK(vbz_decompress_bounded_error(compressed.data(), compressed_size, decompressed.data(),
+                                           input_data_size - 1, &options) == VBZ_DESTINATION_SIZE_ERROR);
+    }
+}
+
+SCENARIO("vbz bounded error compression")
+{
+    GIVEN("Signal data")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        perform_bounded_error_compression_test(test_data, 1, options);
+        perform_bounded_error_compression_test(test_data, 2, options);
+
+        WHEN("Compressed with a bound of 2 ADC units")
+        {
+            auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+            std::vector<int8_t> lossless(vbz_max_compressed_size(input_data_size, &options));
+            auto lossless_size = vbz_compress(test_data.data(), input_data_size, lossless.data(),
+                                              vbz_size_t(lossless.size()), &options);
+            std::vector<int8_t> bounded(vbz_max_bounded_error_compressed_size(input_data_size, &options));
+            auto bounded_size = vbz_compress_bounded_error(test_data.data(), input_data_size, bounded.data(),
+                                                           vbz_size_t(bounded.size()), 2, &options);
+
+            THEN("It is much smaller than lossless compression")
+            {
+                REQUIRE(!vbz_is_error(lossless_size));
+                REQUIRE(!vbz_is_error(bounded_size));
+                CHECK(bounded_size < lossless_size * 3 / 4);
+            }
+        }
+    }
+
+    GIVEN("Signal data without zstd, or with v1 encoding")
+    {
+        perform_bounded_error_compression_test(test_data, 1, CompressionOptions{true, sizeof(test_data[0]), 0, VBZ_DEFAULT_VERSION});
+        perform_bounded_error_compression_test(test_data, 1, CompressionOptions{true, sizeof(test_data[0]), 1, 1});
+    }
+
+    GIVEN("Values at the limits of their types")
+    {
+        std::vector<std::int8_t> int8_data{ 0, 127, -128, 127, 126, -127, -128, 0, 1, -1 };
+        perform_bounded_error_compression_test(int8_data, 1, CompressionOptions{true, 1, 1, VBZ_DEFAULT_VERSION});
+        perform_bounded_error_compression_test(int8_data, 100, CompressionOptions{true, 1, 1, VBZ_DEFAULT_VERSION});
+
+        std::vector<std::uint16_t> uint16_data{ 0, 65535, 0, 65534, 1, 65535, 32768 };
+        perform_bounded_error_compression_test(uint16_data, 2, CompressionOptions{false, 2, 1, VBZ_DEFAULT_VERSION});
+
+        std::vector<std::int32_t> int32_data{
+            std::numeric_limits<std::int32_t>::max(), std::numeric_limits<std::int32_t>::min(),
+            std::numeric_limits<std::int32_t>::max(), 0, -5 };
+        perform_bounded_error_compression_test(int32_data, 1, CompressionOptions{true, 4, 1, VBZ_DEFAULT_VERSION});
+        perform_bounded_error_compression_test(int32_data, std::numeric_limits<std::int32_t>::max(),
+                                               CompressionOptions{true, 4, 1, VBZ_DEFAULT_VERSION});
+
+        std::vector<std::uint32_t> uint32_data{ std::numeric_limits<std::uint32_t>::max(), 0, 7 };
+        perform_bounded_error_compression_test(uint32_data, 1, CompressionOptions{false, 4, 1, VBZ_DEFAULT_VERSION});
+    }
+
+    GIVEN("Invalid bounds and options")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> compressed(vbz_max_bounded_error_compressed_size(input_data_size, &options));
+
+        CHECK(vbz_compress_bounded_error(test_data.data(), input_data_size, compressed.data(),
+                                         vbz_size_t(compressed.size()), 0, &options) == VBZ_ERROR_BOUND_ERROR);
+        CHECK(vbz_compress_bounded_error(test_data.data(), input_data_size, compressed.data(), vbz_size_t(compressed.size()),
+                                         vbz_size_t(std::numeric_limits<std::int32_t>::max()) + 1, &options) == VBZ_ERROR_BOUND_ERROR);
+
+        CompressionOptions no_integers{true, 0, 1, VBZ_DEFAULT_VERSION};
+        CHECK(vbz_max_bounded_error_compressed_size(input_data_size, &no_integers) == VBZ_INTEGER_SIZE_ERROR);
+        CompressionOptions floats{false, 4, 1, VBZ_FLOAT32_VERSION};
+        CHECK(vbz_max_bounded_error_compressed_size(input_data_size, &floats) == VBZ_INTEGER_SIZE_ERROR);
+
+        std::int8_t const short_header[4] = {};
+        CHECK(vbz_bounded_error_max_absolute_error(short_header, sizeof(short_header)) == VBZ_INPUT_SIZE_ERROR);
+        CHECK(std::string(vbz_error_string(VBZ_ERROR_BOUND_ERROR)) == "VBZ_ERROR_BOUND_ERROR");
+    }
+
+    GIVEN("Corrupt indices with the largest bound")
+    {
+        auto const max_bound = std::uint32_t(std::numeric_limits<std::int32_t>::max());
+
+        THEN("Unsigned values reconstruct clamped to their type")
+        {
+            std::vector<std::uint32_t> values{ 0xffffffff, 0x80000000, 2, 1, 0 };
+            vbz_dequantise(values.data(), values.size(), 4, false, max_bound);
+            CHECK(values == std::vector<std::uint32_t>{ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0 });
+        }
+
+        THEN("Signed values reconstruct clamped to their type")
+        {
+            auto const min = std::numeric_limits<std::int32_t>::min();
+            auto const max = std::numeric_limits<std::int32_t>::max();
+            std::vector<std::int32_t> values{ min, max, -2, 2, 0 };
+            vbz_dequantise(values.data(), values.size(), 4, true, max_bound);
+            CHECK(values == std::vector<std::int32_t>{ min, max, min, max, 0 });
+        }
+    }
+}
+
+// Frames of [channel_count] channels, [stride] integers apart, each channel a different part of [signal].
+template <typename T, typename U>
+std::vector<T> make_interleaved_data(
+    std::vector<U> const& signal,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    std::size_t stride)
+{
+    std::vector<T> data(frame_count * stride, T(0x55));
+    for (std::size_t frame = 0; frame < frame_count; ++frame)
+    {
+        for (std::size_t channel = 0; channel < channel_count; ++channel)
+        {
+            data[frame * stride + channel] = T(signal[(frame + channel * 131) % signal.size()]);
+        }
+    }
+    return data;
+}
+
+template <typename T>
+void perform_interleaved_compression_test(
+    std::vector<T> const& data,
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    vbz_size_t stride,
+    CompressionOptions const& options)
+{
+    auto const original_size = vbz_size_t(frame_count * channel_count * sizeof(T));
+    std::vector<int8_t> compressed(vbz_max_interleaved_compressed_size(frame_count, channel_count, &options));
+    auto compressed_size = vbz_compress_interleaved(data.data(), frame_count, channel_count, stride,
+                                                    compressed.data(), vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+    REQUIRE(vbz_decompressed_size(compressed.data(), compressed_size, &options) == original_size);
+    CHECK(vbz_interleaved_channel_count(compressed.data(), compressed_size) == channel_count);
+
+    THEN("Re-interleaved frames match, leaving the integers between frames untouched")
+    {
+        std::vector<T> decompressed(data.size(), T(0x55));
+        auto decompressed_size = vbz_decompress_interleaved(compressed.data(), compressed_size, decompressed.data(),
+                                                            vbz_size_t(decompressed.size() * sizeof(T)), stride, &options);
+        REQUIRE(decompressed_size == original_size);
+        CHECK(decompressed == data);
+    }
+
+    THEN("Channel major output holds each channel contiguously")
+    {
+        std::vector<T> decompressed(std::size_t(frame_count) * channel_count);
+        auto decompressed_size = vbz_decompress_interleaved(compressed.data(), compressed_size, decompressed.data(),
+                                                            original_size, 0, &options);
+        REQUIRE(decompressed_size == original_size);
+
+        std::size_t mismatches = 0;
+        for (std::size_t channel = 0; channel < channel_count; ++channel)
+        {
+            for (std::size_t frame = 0; frame < frame_count; ++frame)
+            {
+                mismatches += decompressed[channel * frame_count + frame] != data[frame * stride + channel];
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    THEN("A short destination is rejected")
+    {
+        std::vector<T> decompressed(data.size());
+        CHECK(vbz_decompress_interleaved(compressed.data(), compressed_size, decompressed.data(),
+                                         original_size - 1, 0, &options) == VBZ_DESTINATION_SIZE_ERROR);
+    }
+}
+
+SCENARIO("vbz interleaved compression")
+{
+    GIVEN("Signal data interleaved across many channels")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        vbz_size_t const frame_count = 300;
+        vbz_size_t const channel_count = 512;
+        auto const data = make_interleaved_data<std::int16_t>(test_data, frame_count, channel_count, channel_count);
+        perform_interleaved_compression_test(data, frame_count, channel_count, channel_count, options);
+
+        WHEN("Compared to compressing each de-interleaved channel")
+        {
+            std::vector<std::int16_t> channel(frame_count);
+            std::size_t channels_size = 0;
+            for (std::size_t c = 0; c < channel_count; ++c)
+            {
+                for (std::size_t frame = 0; frame < frame_count; ++frame)
+                {
+                    channel[frame] = data[frame * channel_count + c];
+                }
+                auto const channel_size = vbz_size_t(channel.size() * sizeof(channel[0]));
+                std::vector<int8_t> compressed(vbz_max_compressed_size(channel_size, &options));
+                channels_size += vbz_compress(channel.data(), channel_size, compressed.data(),
+                                              vbz_size_t(compressed.size()), &options);
+            }
+
+            std::vector<int8_t> compressed(vbz_max_interleaved_compressed_size(frame_count, channel_count, &options));
+            auto compressed_size = vbz_compress_interleaved(data.data(), frame_count, channel_count, channel_count,
+                                                            compressed.data(), vbz_size_t(compressed.size()), &options);
+
+            THEN("It is no larger")
+            {
+                REQUIRE(!vbz_is_error(compressed_size));
+                CHECK(compressed_size <= channels_size);
+            }
+        }
+    }
+
+    GIVEN("Channel counts and strides which don't fill whole tiles")
+    {
+        auto const data = make_interleaved_data<std::int16_t>(test_data, 1001, 13, 20);
+        perform_interleaved_compression_test(data, 1001, 13, 20, CompressionOptions{true, 2, 1, VBZ_DEFAULT_VERSION});
+        perform_interleaved_compression_test(data, 1001, 13, 20, CompressionOptions{true, 2, 0, VBZ_DEFAULT_VERSION});
+        perform_interleaved_compression_test(data, 1001, 13, 20, CompressionOptions{true, 2, 1, 1});
+        perform_interleaved_compression_test(data, 1001, 13, 20, CompressionOptions{false, 2, 1, VBZ_DEFAULT_VERSION});
+
+        auto const single_channel = make_interleaved_data<std::int16_t>(test_data, 5, 1, 1);
+        perform_interleaved_compression_test(single_channel, 5, 1, 1, CompressionOptions{true, 2, 1, VBZ_DEFAULT_VERSION});
+    }
+
+    GIVEN("Other integer sizes, wrapping at the limits of their types")
+    {
+        std::vector<std::int32_t> int32_signal{ std::numeric_limits<std::int32_t>::max(), std::numeric_limits<std::int32_t>::min(), 0, -7, 12 };
+        auto const int32_data = make_interleaved_data<std::int32_t>(int32_signal, 70, 9, 9);
+        perform_interleaved_compression_test(int32_data, 70, 9, 9, CompressionOptions{true, 4, 1, VBZ_DEFAULT_VERSION});
+
+        std::vector<std::uint8_t> uint8_signal{ 0, 255, 128, 1, 254 };
+        auto const uint8_data = make_interleaved_data<std::uint8_t>(uint8_signal, 70, 17, 17);
+        perform_interleaved_compression_test(uint8_data, 70, 17, 17, CompressionOptions{false, 1, 1, VBZ_DEFAULT_VERSION});
+        perform_interleaved_compression_test(uint8_data, 70, 17, 17, CompressionOptions{true, 1, 0, VBZ_DEFAULT_VERSION});
+    }
+
+    GIVEN("Invalid channels, strides and options")
+    {
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        std::vector<std::int16_t> data(64);
+        std::vector<int8_t> compressed(vbz_max_interleaved_compressed_size(8, 8, &options));
+
+        CHECK(vbz_max_interleaved_compressed_size(8, 0, &options) == VBZ_INPUT_SIZE_ERROR);
+        CHECK(vbz_compress_interleaved(data.data(), 8, 8, 7, compressed.data(),
+                                       vbz_size_t(compressed.size()), &options) == VBZ_INPUT_SIZE_ERROR);
+
+        auto compressed_size = vbz_compress_interleaved(data.data(), 8, 8, 8, compressed.data(),
+                                                        vbz_size_t(compressed.size()), &options);
+        REQUIRE(!vbz_is_error(compressed_size));
+        CHECK(vbz_decompress_interleaved(compressed.data(), compressed_size, data.data(),
+                                         vbz_size_t(data.size() * 2), 7, &options) == VBZ_INPUT_SIZE_ERROR);
+
+        CompressionOptions no_integers{true, 0, 1, VBZ_DEFAULT_VERSION};
+        CHECK(vbz_max_interleaved_compressed_size(8, 8, &no_integers) == VBZ_INTEGER_SIZE_ERROR);
+
+        std::int8_t const short_header[8] = {};
+        CHECK(vbz_interleaved_channel_count(short_header, sizeof(short_header)) == VBZ_INPUT_SIZE_ERROR);
+    }
+}
+
+template <typename T>
+vbz_size_t perform_run_length_compression_test(std::vector<T> const& data, CompressionOptions const& options)
+{
+    auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+    std::vector<int8_t> compressed(vbz_max_run_length_compressed_size(input_data_size, &options));
+    auto compressed_size = vbz_compress_run_length(data.data(), input_data_size, compressed.data(),
+                                                   vbz_size_t(compressed.size()), &options);
+    REQUIRE(!vbz_is_error(compressed_size));
+    compressed.resize(compressed_size);
+    REQUIRE(vbz_decompressed_size(compressed.data(), compressed_size, &options) == input_data_size);
+
+    std::vector<T> decompressed(data.size());
+    auto decompressed_size = vbz_decompress_run_length(compressed.data(), compressed_size, decompressed.data(),
+                                                       input_data_size, &options);
+    REQUIRE(decompressed_size == input_data_size);
+    CHECK(decompressed == data);
+    return compressed_size;
+}
+
+SCENARIO("vbz run length compression")
+{
+    GIVEN("A sparse mask")
+    {
+        std::vector<std::uint8_t> mask(100000);
+        std::default_random_engine rand(3);
+        std::uniform_int_distribution<std::size_t> position_dist(0, mask.size() - 50);
+        for (int event = 0; event < 200; ++event)
+        {
+            auto const position = position_dist(rand);
+            std::fill(mask.begin() + position, mask.begin() + position + (position % 40), std::uint8_t(1 + event % 3));
+        }
+
+        CompressionOptions options{false, 1, 1, 1};
+        auto const run_length_size = perform_run_length_compression_test(mask, options);
+        perform_run_length_compression_test(mask, CompressionOptions{false, 1, 0, 1});
+        perform_run_length_compression_test(mask, CompressionOptions{true, 1, 1, VBZ_DEFAULT_VERSION});
+
+        THEN("It is smaller than compressing every zero")
+        {
+            std::vector<int8_t> compressed(vbz_max_compressed_size(vbz_size_t(mask.size()), &options));
+            auto compressed_size = vbz_compress(mask.data(), vbz_size_t(mask.size()), compressed.data(),
+                                                vbz_size_t(compressed.size()), &options);
+            REQUIRE(!vbz_is_error(compressed_size));
+            CHECK(run_length_size < compressed_size);
+        }
+    }
+
+    GIVEN("Ramps of constant deltas between signal")
+    {
+        std::vector<std::int16_t> data(test_data.begin(), test_data.begin() + 1000);
+        for (int step = -3; step <= 3; ++step)
+        {
+            for (int i = 0; i < 100 + step; ++i)
+            {
+                data.push_back(std::int16_t(data.back() + step));
+            }
+            data.insert(data.end(), test_data.begin() + 1000, test_data.begin() + 1100);
+        }
+        perform_run_length_compression_test(data, CompressionOptions{true, 2, 1, VBZ_DEFAULT_VERSION});
+        perform_run_length_compression_test(data, CompressionOptions{true, 2, 0, 1});
+        perform_run_length_compression_test(data, CompressionOptions{false, 2, 1, VBZ_DEFAULT_VERSION});
+    }
+
+    GIVEN("Runs at the edges, runs too short to collapse, and runs wrapping at the limits of the type")
+    {
+        std::vector<std::int32_t> data(40, 7);
+        data.insert(data.end(), 31, 0);
+        data.push_back(1);
+        for (int i = 0; i < 64; ++i)
+        {
+            data.push_back(std::int32_t(std::uint32_t(std::numeric_limits<std::int32_t>::max()) + std::uint32_t(i) * 0x10000000u));
+        }
+        data.insert(data.end(), 33, -1);
+        perform_run_length_compression_test(data, CompressionOptions{true, 4, 1, VBZ_DEFAULT_VERSION});
+        perform_run_length_compression_test(data, CompressionOptions{false, 4, 1, VBZ_DEFAULT_VERSION});
+
+        perform_run_length_compression_test(std::vector<std::uint16_t>(5000, 9), CompressionOptions{false, 2, 1, VBZ_DEFAULT_VERSION});
+        perform_run_length_compression_test(std::vector<std::uint16_t>(3, 9), CompressionOptions{true, 2, 1, VBZ_DEFAULT_VERSION});
+        perform_run_length_compression_test(std::vector<std::uint16_t>(), CompressionOptions{true, 2, 0, VBZ_DEFAULT_VERSION});
+    }
+
+    GIVEN("Invalid options and corrupt runs")
+    {
+        CompressionOptions no_integers{true, 0, 1, VBZ_DEFAULT_VERSION};
+        CHECK(vbz_max_run_length_compressed_size(100, &no_integers) == VBZ_INTEGER_SIZE_ERROR);
+        CompressionOptions options{false, 2, 0, VBZ_DEFAULT_VERSION};
+        CHECK(vbz_max_run_length_compressed_size(101, &options) == VBZ_INPUT_SIZE_ERROR);
+
+        std::vector<std::uint16_t> data(1000, 0);
+        data[500] = 1;
+        std::vector<int8_t> compressed(vbz_max_run_length_compressed_size(vbz_size_t(data.size() * 2), &options));
+        auto compressed_size = vbz_compress_run_length(data.data(), vbz_size_t(data.size() * 2), compressed.data(),
+                                                       vbz_size_t(compressed.size()), &options);
+        REQUIRE(!vbz_is_error(compressed_size));
+
+        // The first run's length, the second uint32 of the runs after the 12 byte header and the runs' keys,
+        // is one byte when stored without zstd.
+        compressed[12 + 1 + 1] = 100;
+        std::vector<std::uint16_t> decompressed(data.size());
+        CHECK(vbz_is_error(vbz_decompress_run_length(compressed.data(), compressed_size, decompressed.data(),
+                                                     vbz_size_t(decompressed.size() * 2), &options)));
+    }
+}
+
+struct DecodedChunks
+{
+    CompressionOptions options;
+    std::vector<std::vector<std::int16_t>> reads;
+};
+
+void decode_test_chunk(std::size_t index, void const* data, vbz_size_t size, void* user_data)
+{
+    auto& decoded = *static_cast<DecodedChunks*>(user_data);
+    auto& read = decoded.reads[index];
+    read.resize(vbz_decompressed_size(data, size, &decoded.options) / sizeof(std::int16_t));
+    auto const read_size = vbz_decompress_sized(data, size, read.data(), vbz_size_t(read.size() * sizeof(std::int16_t)),
+                                                &decoded.options);
+    read.resize(vbz_is_error(read_size) ? 0 : read_size / sizeof(std::int16_t));
+}
+
+SCENARIO("vbz chunk readers")
+{
+    GIVEN("A file of compressed reads")
+    {
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        std::vector<std::vector<std::int16_t>> reads;
+        for (std::size_t offset = 0; offset + 1000 <= test_data.size(); offset += 700)
+        {
+            reads.emplace_back(test_data.begin() + offset, test_data.begin() + offset + (offset % 1000) + 1);
+        }
+        reads.emplace_back();
+
+        std::unique_ptr<FILE, decltype(&fclose)> file(tmpfile(), &fclose);
+        REQUIRE(file);
+        std::vector<VbzChunk> chunks;
+        std::uint64_t file_size = 0;
+        for (auto const& read : reads)
+        {
+            auto const read_size = vbz_size_t(read.size() * sizeof(read[0]));
+            std::vector<char> compressed(vbz_max_compressed_size(read_size, &options));
+            compressed.resize(vbz_compress_sized(read.data(), read_size, compressed.data(),
+                                                 vbz_size_t(compressed.size()), &options));
+            REQUIRE(fwrite(compressed.data(), 1, compressed.size(), file.get()) == compressed.size());
+            chunks.push_back(VbzChunk{fileno(file.get()), file_size, vbz_size_t(compressed.size())});
+            file_size += compressed.size();
+        }
+        REQUIRE(fflush(file.get()) == 0);
+
+        for (unsigned int reader = VBZ_PREAD_CHUNK_READER; reader <= VBZ_IO_URING_CHUNK_READER; ++reader)
+        {
+            if (!vbz_chunk_reader_supported(reader))
+            {
+                continue;
+            }
+
+            WHEN("Reading the chunks with reader " + std::to_string(reader))
+            {
+                DecodedChunks decoded{options, std::vector<std::vector<std::int16_t>>(chunks.size())};
+                auto const result = vbz_read_chunks(reader, chunks.data(), vbz_size_t(chunks.size()), 3, 4,
+                                                    decode_test_chunk, &decoded);
+                THEN("Every read is decoded")
+                {
+                    CHECK(result == chunks.size());
+                    CHECK(decoded.reads == reads);
+                }
+            }
+
+            WHEN("Reading past the end of the file with reader " + std::to_string(reader))
+            {
+                auto past_end = chunks;
+                past_end[1].offset = file_size;
+                DecodedChunks decoded{options, std::vector<std::vector<std::int16_t>>(chunks.size())};
+                THEN("The read fails")
+                {
+                    CHECK(vbz_read_chunks(reader, past_end.data(), vbz_size_t(past_end.size()), 2, 1,
+                                          decode_test_chunk, &decoded) == VBZ_IO_ERROR);
+                }
+            }
+        }
+
+        WHEN("Reading with no workers or an unknown reader")
+        {
+            DecodedChunks decoded{options, std::vector<std::vector<std::int16_t>>(chunks.size())};
+            CHECK(vbz_read_chunks(VBZ_PREAD_CHUNK_READER, chunks.data(), vbz_size_t(chunks.size()), 0, 1,
+                                  decode_test_chunk, &decoded) == VBZ_INPUT_SIZE_ERROR);
+            CHECK(vbz_read_chunks(VBZ_IO_URING_CHUNK_READER + 1, chunks.data(), vbz_size_t(chunks.size()), 1, 1,
+                                  decode_test_chunk, &decoded) == VBZ_IO_ERROR);
+            CHECK(std::string(vbz_error_string(VBZ_IO_ERROR)) != std::string(vbz_error_string(VBZ_INPUT_SIZE_ERROR)));
+        }
+    }
+
+    GIVEN("An empty chunk in an empty file")
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> file(tmpfile(), &fclose);
+        REQUIRE(file);
+        VbzChunk const chunk{fileno(file.get()), 0, 0};
+
+        for (unsigned int reader = VBZ_PREAD_CHUNK_READER; reader <= VBZ_IO_URING_CHUNK_READER; ++reader)
+        {
+            if (!vbz_chunk_reader_supported(reader))
+            {
+                continue;
+            }
+
+            WHEN("Reading the chunk with reader " + std::to_string(reader))
+            {
+                std::vector<vbz_size_t> sizes;
+                auto const result = vbz_read_chunks(reader, &chunk, 1, 1, 1,
+                    [](std::size_t, void const*, vbz_size_t size, void* user_data) {
+                        static_cast<std::vector<vbz_size_t>*>(user_data)->push_back(size);
+                    }, &sizes);
+                THEN("The empty read succeeds")
+                {
+                    CHECK(result == 1);
+                    CHECK(sizes == std::vector<vbz_size_t>{ 0 });
+                }
+            }
+        }
+    }
+}
+
+#if defined(VBZ_ENABLE_SERVER)
+SCENARIO("vbz compression server")
+{
+    GIVEN("A server and two clients")
+    {
+        auto const socket_path = "/tmp/vbz_test_server_" + std::to_string(std::random_device()()) + ".sock";
+        std::unique_ptr<VbzServer, decltype(&vbz_stop_server)> server(vbz_start_server(socket_path.c_str(), 2),
+                                                                     &vbz_stop_server);
+        REQUIRE(server);
+
+        std::size_t const buffer_size = 1 << 20;
+        std::unique_ptr<VbzServerClient, decltype(&vbz_disconnect_server)> first(
+            vbz_connect_server(socket_path.c_str(), buffer_size), &vbz_disconnect_server);
+        std::unique_ptr<VbzServerClient, decltype(&vbz_disconnect_server)> second(
+            vbz_connect_server(socket_path.c_str(), buffer_size), &vbz_disconnect_server);
+        REQUIRE(first);
+        REQUIRE(second);
+        CHECK(vbz_server_buffer_size(first.get()) == buffer_size);
+
+        CompressionOptions options{true, 2, 1, VBZ_DEFAULT_VERSION};
+        auto const source_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::size_t const compressed_offset = buffer_size / 2;
+
+        WHEN("Each client compresses and decompresses through its shared buffer")
+        {
+            for (auto client : { first.get(), second.get() })
+            {
+                auto const buffer = static_cast<char*>(vbz_server_buffer(client));
+                std::memcpy(buffer, test_data.data(), source_size);
+                auto const compressed_size = vbz_server_compress(client, 0, source_size, compressed_offset,
+                    vbz_max_compressed_size(source_size, &options), &options);
+                REQUIRE(!vbz_is_error(compressed_size));
+                CHECK(compressed_size < source_size);
+
+                std::vector<char> expected(vbz_max_compressed_size(source_size, &options));
+                expected.resize(vbz_compress_sized(test_data.data(), source_size, expected.data(),
+                                                   vbz_size_t(expected.size()), &options));
+                CHECK(std::vector<char>(buffer + compressed_offset, buffer + compressed_offset + compressed_size) == expected);
+
+                std::memset(buffer, 0, source_size);
+                CHECK(vbz_server_decompress(client, compressed_offset, compressed_size, 0, source_size, &options) == source_size);
+                CHECK(std::memcmp(buffer, test_data.data(), source_size) == 0);
+            }
+        }
+
+        WHEN("Jobs name regions outside the shared buffer or overlapping")
+        {
+            CHECK(vbz_server_compress(first.get(), buffer_size - 1, 2, 0, 100, &options) == VBZ_INPUT_SIZE_ERROR);
+            CHECK(vbz_server_compress(first.get(), 0, 100, buffer_size, 100, &options) == VBZ_INPUT_SIZE_ERROR);
+            CHECK(vbz_server_compress(first.get(), 0, 100, 50, 100, &options) == VBZ_INPUT_SIZE_ERROR);
+
+            THEN("The connection is still usable")
+            {
+                CHECK(!vbz_is_error(vbz_server_compress(first.get(), 0, 100, 100, 1000, &options)));
+            }
+        }
+
+        WHEN("The server stops")
+        {
+            server.reset();
+            THEN("Jobs fail and new clients can't connect")
+            {
+                CHECK(vbz_server_compress(first.get(), 0, 100, 100, 1000, &options) == VBZ_IO_ERROR);
+                CHECK(!vbz_connect_server(socket_path.c_str(), buffer_size));
+            }
+        }
+
+        THEN("The socket is only accessible to its owner")
+        {
+            struct stat status;
+            REQUIRE(stat(socket_path.c_str(), &status) == 0);
+            CHECK((status.st_mode & 0777) == 0600);
+        }
+    }
+
+    GIVEN("A regular file at the socket path")
+    {
+        auto const file_path = "/tmp/vbz_test_server_" + std::to_string(std::random_device()()) + ".txt";
+        std::ofstream(file_path) << "not a socket";
+
+        THEN("The server refuses to replace it")
+        {
+            CHECK(!vbz_start_server(file_path.c_str(), 1));
+            CHECK(std::ifstream(file_path).good());
+        }
+        std::remove(file_path.c_str());
+    }
+}
+#endif
+
+SCENARIO("vbz float32 compression")
+{
+    GIVEN("Calibrated float signal")
+    {
+        // Picoamp signal as persisted by processing: (raw + offset) * scale, centred so it crosses zero.
+        std::vector<float> data;
+        for (auto raw : test_data)
+        {
+            data.push_back((raw - 450.0f) * 0.1755f);
+        }
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+
+        for (unsigned int zstd_level : { 0u, 1u })
+        {
+            CompressionOptions options{false, sizeof(float), zstd_level, VBZ_FLOAT32_VERSION};
+            WHEN("Compressing as float32 with zstd level " << zstd_level)
+            {
+                std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+                auto compressed_size = vbz_compress(data.data(), input_data_size, compressed.data(),
+                                                    vbz_size_t(compressed.size()), &options);
+                REQUIRE(!vbz_is_error(compressed_size));
+
+                std::vector<float> decompressed(data.size());
+                auto decompressed_size = vbz_decompress(compressed.data(), compressed_size, decompressed.data(),
+                                                        input_data_size, &options);
+                REQUIRE(decompressed_size == input_data_size);
+
+                THEN("The floats round trip bit for bit")
+                {
+                    CHECK(std::memcmp(decompressed.data(), data.data(), input_data_size) == 0);
+                }
+
+                if (zstd_level != 0)
+                {
+                    // The float keys are larger than streamvbyte's, so it relies on zstd to come out ahead.
+                    AND_THEN("The data compresses better than treating it as int32 deltas")
+                    {
+                        CompressionOptions int_options{true, sizeof(float), zstd_level, VBZ_DEFAULT_VERSION};
+                        std::vector<int8_t> int_compressed(vbz_max_compressed_size(input_data_size, &int_options));
+                        auto int_compressed_size = vbz_compress(data.data(), input_data_size, int_compressed.data(),
+                                                                vbz_size_t(int_compressed.size()), &int_options);
+                        REQUIRE(!vbz_is_error(int_compressed_size));
+                        CHECK(compressed_size < int_compressed_size);
+                    }
+                }
+
+                AND_THEN("The estimate is close to the compressed size")
+                {
+                    auto estimate = vbz_estimate_compressed_size(data.data(), input_data_size, &options);
+                    REQUIRE(!vbz_is_error(estimate));
+                    CHECK(estimate == Approx(compressed_size).epsilon(0.25));
+                }
+            }
+        }
+
+        WHEN("Compressing with the checksummed format")
+        {
+            CompressionOptions options{false, sizeof(float), 1, VBZ_FLOAT32_VERSION};
+            std::vector<int8_t> compressed(vbz_max_checksummed_compressed_size(input_data_size, &options));
+            auto compressed_size = vbz_compress_checksummed(data.data(), input_data_size, compressed.data(),
+                                                            vbz_size_t(compressed.size()), &options);
+            REQUIRE(!vbz_is_error(compressed_size));
+
+            std::vector<float> decompressed(data.size());
+            CHECK(vbz_decompress_checksummed(compressed.data(), compressed_size, decompressed.data(),
+                                             input_data_size, &options) == input_data_size);
+            CHECK(std::memcmp(decompressed.data(), data.data(), input_data_size) == 0);
+        }
+    }
+
+    GIVEN("Special float values")
+    {
+        std::vector<float> data{
+            0.0f, -0.0f, 1.0f, 1.0f, -1.0f,
+            std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::quiet_NaN(),
+            std::numeric_limits<float>::denorm_min(),
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::lowest(),
+            256.0f, 65536.0f,
+        };
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+
+        WHEN("Encoding with the float32 encoding")
+        {
+            std::vector<int8_t> encoded(vbz_max_float32_compressed_size(input_data_size));
+            auto encoded_size = vbz_float32_compress(data.data(), input_data_size, encoded.data(),
+                                                         vbz_size_t(encoded.size()));
+            REQUIRE(!vbz_is_error(encoded_size));
+
+            THEN("The values round trip bit for bit")
+            {
+                std::vector<float> decoded(data.size());
+                CHECK(vbz_float32_decompress(encoded.data(), encoded_size, decoded.data(), input_data_size) == input_data_size);
+                CHECK(std::memcmp(decoded.data(), data.data(), input_data_size) == 0);
+            }
+
+            THEN("Repeated values use no data bytes")
+            {
+                VbzStreamVByteStatistics statistics = {};
+                CHECK(vbz_float32_statistics(data.data(), input_data_size, &statistics) == encoded_size);
+                // The second 1.0f repeats the first.
+                CHECK(((encoded[1] >> 4) & 0xF) == 0);
+            }
+
+            THEN("Invalid keys are rejected")
+            {
+                encoded[0] = std::int8_t(0xFF);
+                std::vector<float> decoded(data.size());
+                CHECK(vbz_float32_decompress(encoded.data(), encoded_size, decoded.data(), input_data_size)
+                      == VBZ_STREAMVBYTE_STREAM_ERROR);
+            }
+
+            THEN("Truncated data is rejected")
+            {
+                std::vector<float> decoded(data.size());
+                CHECK(vbz_float32_decompress(encoded.data(), encoded_size - 1, decoded.data(), input_data_size)
+                      == VBZ_STREAMVBYTE_STREAM_ERROR);
+            }
+        }
+    }
+
+    GIVEN("Invalid float options")
+    {
+        float value = 1.0f;
+        std::vector<int8_t> compressed(64);
+        CompressionOptions wrong_size{false, 2, 1, VBZ_FLOAT32_VERSION};
+        CHECK(vbz_compress(&value, sizeof(value), compressed.data(), vbz_size_t(compressed.size()), &wrong_size)
+              == VBZ_INTEGER_SIZE_ERROR);
+        CompressionOptions unknown_version{false, 4, 1, VBZ_FLOAT32_VERSION + 1};
+        CHECK(vbz_max_compressed_size(sizeof(value), &unknown_version) == VBZ_VERSION_ERROR);
+    }
+}
+
+struct TraceRecord
+{
+    unsigned int stage;
+    vbz_size_t size;
+    bool begin;
+};
+
+void record_trace_begin(unsigned int stage, vbz_size_t size, void* user_data)
+{
+    static_cast<std::vector<TraceRecord>*>(user_data)->push_back({stage, size, true});
+}
+
+void record_trace_end(unsigned int stage, vbz_size_t size, void* user_data)
+{
+    static_cast<std::vector<TraceRecord>*>(user_data)->push_back({stage, size, false});
+}
+
+SCENARIO("vbz trace hooks")
+{
+    GIVEN("Hooks recording every stage")
+    {
+        std::vector<std::int32_t> data(test_data.begin(), test_data.end());
+        auto const input_data_size = vbz_size_t(data.size() * sizeof(data[0]));
+        CompressionOptions options{true, sizeof(data[0]), 1, VBZ_DEFAULT_VERSION};
+
+        std::vector<TraceRecord> records;
+        vbz_set_trace_hooks(record_trace_begin, record_trace_end, &records);
+
+        std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+        auto compressed_size = vbz_compress(data.data(), input_data_size, compressed.data(),
+                                            vbz_size_t(compressed.size()), &options);
+        std::vector<std::int32_t> decompressed(data.size());
+        auto decompressed_size = vbz_decompress(compressed.data(), compressed_size, decompressed.data(),
+                                                input_data_size, &options);
+        vbz_set_trace_hooks(nullptr, nullptr, nullptr);
+        REQUIRE(decompressed_size == input_data_size);
+
+        THEN("Each stage is reported, with matching begin and end calls")
+        {
+            std::vector<unsigned int> open_stages;
+            std::vector<unsigned int> stages;
+            for (auto const& record : records)
+            {
+                if (record.begin)
+                {
+                    open_stages.push_back(record.stage);
+                    stages.push_back(record.stage);
+                }
+                else
+                {
+                    REQUIRE(!open_stages.empty());
+                    CHECK(open_stages.back() == record.stage);
+                    open_stages.pop_back();
+                }
+            }
+            CHECK(open_stages.empty());
+
+            // The int32 kernel is the generic one, which reports its transform separately.
+            std::vector<unsigned int> expected_stages{
+                VBZ_TRACE_STREAMVBYTE_ENCODE,
+                VBZ_TRACE_TRANSFORM,
+                VBZ_TRACE_ZSTD_COMPRESS,
+                VBZ_TRACE_ZSTD_DECOMPRESS,
+                VBZ_TRACE_STREAMVBYTE_DECODE,
+                VBZ_TRACE_VALIDATION,
+                VBZ_TRACE_TRANSFORM,
+            };
+            CHECK(stages == expected_stages);
+            CHECK(records.front().size == input_data_size);
+        }
+
+        AND_WHEN("The hooks are removed")
+        {
+            records.clear();
+            vbz_compress(data.data(), input_data_size, compressed.data(), vbz_size_t(compressed.size()), &options);
+
+            THEN("No stages are reported")
+            {
+                CHECK(records.empty());
+            }
+        }
+    }
+
+    GIVEN("The built in recorder")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+
+        REQUIRE(vbz_start_trace_recorder(4));
+        for (int i = 0; i < 3; ++i)
+        {
+            vbz_compress(test_data.data(), input_data_size, compressed.data(), vbz_size_t(compressed.size()), &options);
+        }
+        vbz_stop_trace_recorder();
+
+        char const* trace_path = "vbz_trace_test.json";
+        REQUIRE(vbz_write_trace_recorder_json(trace_path));
+        std::ifstream trace_file(trace_path);
+        std::string const trace((std::istreambuf_iterator<char>(trace_file)), std::istreambuf_iterator<char>());
+        trace_file.close();
+        std::remove(trace_path);
+
+        THEN("The trace holds the most recent events as chrome trace json")
+        {
+            CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+            CHECK(trace.find("\"name\":\"zstd_compress\"") != std::string::npos);
+            // Only the last 4 events of the 12 recorded are kept.
+            CHECK(std::count(trace.begin(), trace.end(), '\n') == 6);
+        }
+    }
+
+    GIVEN("Hooks registered repeatedly")
+    {
+        std::vector<TraceRecord> records;
+        AllocationCounter counter;
+        for (int i = 0; i < 1000; ++i)
+        {
+            vbz_set_trace_hooks(record_trace_begin, record_trace_end, &records);
+            vbz_set_trace_hooks(nullptr, nullptr, nullptr);
+        }
+        auto const counts = counter.end_call();
+
+        THEN("Registering holds no memory")
+        {
+            CHECK(counts.allocations == 0);
+        }
+    }
+
+    GIVEN("The recorder's ring wrapping on several threads at once")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+
+        REQUIRE(vbz_start_trace_recorder(8));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&] {
+                std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+                for (int i = 0; i < 200; ++i)
+                {
+                    vbz_compress(test_data.data(), input_data_size, compressed.data(),
+                                 vbz_size_t(compressed.size()), &options);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        vbz_stop_trace_recorder();
+
+        char const* trace_path = "vbz_trace_wrap_test.json";
+        REQUIRE(vbz_write_trace_recorder_json(trace_path));
+        std::ifstream trace_file(trace_path);
+        std::vector<std::string> events;
+        for (std::string line; std::getline(trace_file, line);)
+        {
+            if (line.find("{\"name\":") == 0)
+            {
+                events.push_back(line);
+            }
+        }
+        trace_file.close();
+        std::remove(trace_path);
+
+        THEN("Every event kept is whole")
+        {
+            CHECK(!events.empty());
+            CHECK(events.size() <= 8);
+            for (auto const& event : events)
+            {
+                CHECK(event.find("\"name\":\"unknown\"") == std::string::npos);
+                CHECK(event.find(",\"args\":{\"size\":") != std::string::npos);
+            }
+        }
+    }
+
+    THEN("Stages have names")
+    {
+        CHECK(std::string(vbz_trace_stage_name(VBZ_TRACE_STREAMVBYTE_DECODE)) == "streamvbyte_decode");
+        CHECK(std::string(vbz_trace_stage_name(VBZ_TRACE_STAGE_COUNT)) == "unknown");
+    }
+}
+
+std::string read_metrics(char const* path)
+{
+    REQUIRE(vbz_write_metrics(path));
+    std::ifstream metrics_file(path);
+    std::string const metrics((std::istreambuf_iterator<char>(metrics_file)), std::istreambuf_iterator<char>());
+    metrics_file.close();
+    std::remove(path);
+    return metrics;
+}
+
+// Find the value of a [series] (name and labels) in Prometheus text.
+std::uint64_t metric_value(std::string const& metrics, std::string const& series)
+{
+    auto const line = metrics.find("\n" + series + " ");
+    REQUIRE(line != std::string::npos);
+    return std::stoull(metrics.substr(line + series.size() + 2));
+}
+
+SCENARIO("vbz metrics")
+{
+    GIVEN("Metrics counted without a textfile")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> compressed(vbz_max_compressed_size(input_data_size, &options));
+        std::vector<std::int16_t> decompressed(test_data.size());
+
+        char const* metrics_path = "vbz_metrics_test.prom";
+        REQUIRE(vbz_start_metrics(nullptr, 1));
+        auto const before = read_metrics(metrics_path);
+
+        auto const compressed_size = vbz_compress(test_data.data(), input_data_size, compressed.data(),
+                                                  vbz_size_t(compressed.size()), &options);
+        CHECK(vbz_decompress(compressed.data(), compressed_size, decompressed.data(), input_data_size, &options)
+              == input_data_size);
+        std::vector<int8_t> const garbage(64, 0x55);
+        CHECK(vbz_decompress(garbage.data(), vbz_size_t(garbage.size()), decompressed.data(), input_data_size,
+                             &options) == VBZ_ZSTD_ERROR);
+        auto const after = read_metrics(metrics_path);
+
+        THEN("Each call is counted")
+        {
+            auto const change = [&](std::string const& series) {
+                return metric_value(after, series) - metric_value(before, series);
+            };
+            CHECK(change("vbz_chunks_total{operation=\"compress\"}") == 1);
+            CHECK(change("vbz_chunks_total{operation=\"decompress\"}") == 2);
+            CHECK(change("vbz_bytes_in_total{operation=\"compress\"}") == input_data_size);
+            CHECK(change("vbz_bytes_out_total{operation=\"compress\"}") == compressed_size);
+            CHECK(change("vbz_bytes_out_total{operation=\"decompress\"}") == input_data_size);
+            CHECK(change("vbz_errors_total{operation=\"decompress\",error=\"VBZ_ZSTD_ERROR\"}") == 1);
+            CHECK(change("vbz_errors_total{operation=\"compress\",error=\"VBZ_ZSTD_ERROR\"}") == 0);
+            CHECK(change("vbz_compression_ratio_count{operation=\"compress\"}") == 1);
+            CHECK(change("vbz_compression_ratio_bucket{operation=\"compress\",le=\"1\"}") == 1);
+            CHECK(change("vbz_chunk_duration_seconds_count{operation=\"decompress\"}") == 2);
+            CHECK(change("vbz_stage_duration_seconds_count{stage=\"zstd_compress\"}") == 1);
+            CHECK(after.find("# TYPE vbz_stage_duration_seconds histogram\n") != std::string::npos);
+        }
+
+        AND_WHEN("The metrics are stopped")
+        {
+            vbz_stop_metrics();
+            vbz_compress(test_data.data(), input_data_size, compressed.data(), vbz_size_t(compressed.size()),
+                         &options);
+
+            THEN("Calls are no longer counted")
+            {
+                auto const stopped = read_metrics(metrics_path);
+                CHECK(metric_value(stopped, "vbz_chunks_total{operation=\"compress\"}")
+                      == metric_value(after, "vbz_chunks_total{operation=\"compress\"}"));
+            }
+        }
+        vbz_stop_metrics();
+    }
+
+    GIVEN("Metrics counted for calls encoding several parts")
+    {
+        CompressionOptions options{true, sizeof(test_data[0]), 1, VBZ_DEFAULT_VERSION};
+        auto const input_data_size = vbz_size_t(test_data.size() * sizeof(test_data[0]));
+        std::vector<int8_t> run_length(vbz_max_run_length_compressed_size(input_data_size, &options));
+        std::vector<int8_t> bounded(vbz_max_bounded_error_compressed_size(input_data_size, &options));
+        std::vector<std::int16_t> decompressed(test_data.size());
+
+        char const* metrics_path = "vbz_metrics_test.prom";
+        REQUIRE(vbz_start_metrics(nullptr, 1));
+        auto const before = read_metrics(metrics_path);
+
+        auto const run_length_size = vbz_compress_run_length(test_data.data(), input_data_size, run_length.data(),
+                                                             vbz_size_t(run_length.size()), &options);
+        CHECK(vbz_decompress_run_length(run_length.data(), run_length_size, decompressed.data(), input_data_size,
+                                        &options) == input_data_size);
+        auto const bounded_size = vbz_compress_bounded_error(test_data.data(), input_data_size, bounded.data(),
+                                                             vbz_size_t(bounded.size()), 2, &options);
+        CHECK(vbz_decompress_bounded_error(bounded.data(), bounded_size, decompressed.data(), input_data_size,
+                                           &options) == input_data_size);
+
+        // Reencoding the integers with another version both decompresses and compresses again.
+        CompressionOptions const version_0_options{true, sizeof(test_data[0]), 1, 0};
+        std::vector<int8_t> sized(vbz_max_compressed_size(input_data_size, &options) + sizeof(vbz_size_t));
+        std::vector<int8_t> transcoded(vbz_max_compressed_size(input_data_size, &version_0_options)
+                                       + sizeof(vbz_size_t));
+        auto const after_encoding = read_metrics(metrics_path);
+        auto const sized_size = vbz_compress_sized(test_data.data(), input_data_size, sized.data(),
+                                                   vbz_size_t(sized.size()), &options);
+        auto const transcoded_size = vbz_transcode_sized(sized.data(), sized_size, transcoded.data(),
+                                                         vbz_size_t(transcoded.size()), &options,
+                                                         &version_0_options);
+        CHECK(!vbz_is_error(transcoded_size));
+        auto const after = read_metrics(metrics_path);
+        vbz_stop_metrics();
+
+        THEN("Each call is counted once, for its whole input")
+        {
+            auto const change = [&](std::string const& series) {
+                return metric_value(after, series) - metric_value(before, series);
+            };
+            CHECK(change("vbz_chunks_total{operation=\"compress\"}") == 3);
+            CHECK(change("vbz_chunks_total{operation=\"decompress\"}") == 2);
+            CHECK(change("vbz_bytes_in_total{operation=\"compress\"}") == 3 * input_data_size);
+            CHECK(change("vbz_bytes_out_total{operation=\"compress\"}")
+                  == run_length_size + bounded_size + sized_size);
+            CHECK(change("vbz_bytes_out_total{operation=\"decompress\"}") == 2 * input_data_size);
+            CHECK(change("vbz_compression_ratio_count{operation=\"compress\"}") == 3);
+        }
+
+        THEN("Transcoding is counted once, as its own operation")
+        {
+            auto const change = [&](std::string const& series) {
+                return metric_value(after, series) - metric_value(after_encoding, series);
+            };
+            CHECK(change("vbz_chunks_total{operation=\"compress\"}") == 1);
+            CHECK(change("vbz_chunks_total{operation=\"decompress\"}") == 0);
+            CHECK(change("vbz_chunks_total{operation=\"transcode\"}") == 1);
+            CHECK(change("vbz_bytes_in_total{operation=\"transcode\"}") == sized_size);
+            CHECK(change("vbz_bytes_out_total{operation=\"transcode\"}") == transcoded_size);
+            CHECK(change("vbz_compression_ratio_count{operation=\"transcode\"}") == 0);
+        }
+    }
+
+    GIVEN("Metrics written to a textfile")
+    {
+        char const* textfile_path = "vbz_metrics_textfile_test.prom";
+        std::remove(textfile_path);
+        REQUIRE(vbz_start_metrics(textfile_path, 60));
+        vbz_stop_metrics();
+
+        THEN("The textfile is written when the metrics stop")
+        {
+            std::ifstream textfile(textfile_path);
+            std::string const metrics((std::istreambuf_iterator<char>(textfile)), std::istreambuf_iterator<char>());
+            textfile.close();
+            std::remove(textfile_path);
+            CHECK(metrics.find("# TYPE vbz_chunks_total counter\n") != std::string::npos);
+        }
+    }
+}
+
 SCENARIO("my_flow_test_1", "[myflow1]")
 {
     GIVEN("A small sample data vector")
@@ -4,6 +4,23 @@
 #include "vbz.h"
 
 #include <cstddef>
+#include <cstdint>
+
+/// \brief Summary of the streamvbyte encoding of some data, gathered without writing the encoded stream.
+/// Calls to the statistics functions accumulate into an instance, which should be zero initialised.
+struct VbzStreamVByteStatistics
+{
+    /// Number of integers summarised.
+    std::uint64_t integer_count;
+    /// Number of bytes used by the encoded keys.
+    std::uint64_t key_bytes;
+    /// Number of bytes used by the encoded data.
+    std::uint64_t data_bytes;
+    /// Occurrences of each key byte.
+    std::uint32_t key_histogram[256];
+    /// Occurrences of each symbol written to the data section (bytes for version 0, half bytes for version 1).
+    std::uint32_t data_histogram[256];
+};
 
 // Version 1 of streamvbyte
 //
@@ -51,4 +68,19 @@ VBZ_EXPORT vbz_size_t vbz_delta_zig_zag_streamvbyte_decompress_v0(
     void* destination,
     vbz_size_t destination_size,
     int integer_size,
-    bool use_delta_zig_zag_encoding);
\ No newline at end of file
+    bool use_delta_zig_zag_encoding);
+
+/// \brief Gather statistics describing the delta zig zag + streamvbyte encoding of the source data,
+///        without writing the encoded stream.
+/// \param source                       Source data to summarise.
+/// \param source_size                  Source data size (in bytes)
+/// \param integer_size                 Number of bytes per integer
+/// \param use_delta_zig_zag_encoding   Control if the data should be delta-zig-zag encoded before streamvbyte encoding.
+/// \param statistics                   Statistics to accumulate the encoding summary into.
+/// \return The number of bytes #vbz_delta_zig_zag_streamvbyte_compress_v0 would write for [source].
+VBZ_EXPORT vbz_size_t vbz_delta_zig_zag_streamvbyte_statistics_v0(
+    void const* source,
+    vbz_size_t source_size,
+    int integer_size,
+    bool use_delta_zig_zag_encoding,
+    VbzStreamVByteStatistics* statistics);
\ No newline at end of file
@@ -1,27 +1,36 @@
 #pragma once
 
 #include "vbz.h"
+#include "vbz_streamvbyte.h"
+#include "vbz_trace_scope.h"
 
 #include "streamvbyte.h"
-#include "streamvbyte_zigzag.h"
 
 #include <gsl/gsl-lite.hpp>
 
 #include <algorithm>
 #include <cstdint>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 /// \brief Generic implementation, safe for all integer types, and platforms.
 template <typename T, bool UseZigZag>
-struct StreamVByteWorkerV0
+struct StreamVByteWorkerV0Generic
 {
+    static char const* name() { return "generic"; }
+
     static vbz_size_t compress(gsl::span<char const> input_bytes, gsl::span<char> output)
     {
         auto const input = input_bytes.as_span<T const>();
         
         if (!UseZigZag)
         {
-            auto input_buffer = cast<std::uint32_t>(input);
+            std::vector<std::uint32_t> input_buffer;
+            {
+                VbzTraceScope trace(VBZ_TRACE_TRANSFORM, input_bytes.size());
+                input_buffer = cast<std::uint32_t>(input);
+            }
             return vbz_size_t(streamvbyte_encode(
                 input_buffer.data(),
                 std::uint32_t(input_buffer.size()),
@@ -29,9 +38,11 @@ struct StreamVByteWorkerV0
             ));
         }
         
-        std::vector<std::int32_t> input_buffer = cast<std::int32_t>(input);
         std::vector<std::uint32_t> intermediate_buffer(input.size());
-        zigzag_delta_encode(input_buffer.data(), intermediate_buffer.data(), input_buffer.size(), 0);
+        {
+            VbzTraceScope trace(VBZ_TRACE_TRANSFORM, input_bytes.size());
+            zig_zag_delta_encode(input, gsl::make_span(intermediate_buffer));
+        }
 
         return vbz_size_t(streamvbyte_encode(
             intermediate_buffer.data(),
@@ -40,13 +51,61 @@ struct StreamVByteWorkerV0
         ));
     }
     
+    static vbz_size_t statistics(gsl::span<char const> input_bytes, VbzStreamVByteStatistics& statistics)
+    {
+        auto const input = input_bytes.as_span<T const>();
+
+        std::uint64_t data_bytes = 0;
+        std::uint32_t key = 0;
+        UnsignedT previous = 0;
+        for (std::size_t i = 0; i < input.size(); ++i)
+        {
+            // Matches the conversions performed by compress, without the intermediate buffers.
+            std::uint32_t value = std::uint32_t(std::int32_t(input[i]));
+            if (UseZigZag)
+            {
+                value = zig_zag_delta(input[i], previous);
+                previous = UnsignedT(input[i]);
+            }
+
+            std::uint32_t const code = (value > 0x000000FF) + (value > 0x0000FFFF) + (value > 0x00FFFFFF);
+            key |= code << ((i & 3) * 2);
+            if ((i & 3) == 3)
+            {
+                statistics.key_histogram[key] += 1;
+                key = 0;
+            }
+
+            for (std::uint32_t byte = 0; byte <= code; ++byte)
+            {
+                statistics.data_histogram[(value >> (byte * 8)) & 0xFF] += 1;
+            }
+            data_bytes += code + 1;
+        }
+        if (input.size() & 3)
+        {
+            statistics.key_histogram[key] += 1;
+        }
+
+        std::uint64_t const key_bytes = (input.size() + 3) / 4;
+        statistics.integer_count += input.size();
+        statistics.key_bytes += key_bytes;
+        statistics.data_bytes += data_bytes;
+        return vbz_size_t(key_bytes + data_bytes);
+    }
+    
     static vbz_size_t decompress(gsl::span<char const> input, gsl::span<char> output_bytes)
     {
         auto const output = output_bytes.as_span<T>();
         auto in_data = input.as_span<std::uint8_t const>().data();
         auto const out_size = vbz_size_t(output.size());
 
-        if (!streamvbyte_validate_stream(in_data, input.size_bytes(), out_size)) {
+        bool valid_stream;
+        {
+            VbzTraceScope trace(VBZ_TRACE_VALIDATION, input.size_bytes());
+            valid_stream = streamvbyte_validate_stream(in_data, input.size_bytes(), out_size);
+        }
+        if (!valid_stream) {
             return VBZ_STREAMVBYTE_STREAM_ERROR;
         }
 
@@ -66,18 +125,49 @@ struct StreamVByteWorkerV0
             return VBZ_STREAMVBYTE_STREAM_ERROR;
         }
         
+        VbzTraceScope trace(VBZ_TRACE_TRANSFORM, output_bytes.size());
         if (!UseZigZag)
         {
             cast(gsl::make_span(intermediate_buffer), output);
             return vbz_size_t(output.size() * sizeof(T));
         }
         
-        std::vector<std::int32_t> output_buffer(output.size());
-        zigzag_delta_decode(intermediate_buffer.data(), output_buffer.data(), output_buffer.size(), 0);
-        
-        cast(gsl::make_span(output_buffer), output);
+        zig_zag_delta_decode(gsl::make_span(intermediate_buffer), output);
         return vbz_size_t(output.size() * sizeof(T));
     }
+
+    using UnsignedT = typename std::make_unsigned<T>::type;
+
+    // Delta zig zag encode in the width of T, so deltas wrap exactly as they do in the vectorised kernels.
+    static std::uint32_t zig_zag_delta(T current, UnsignedT previous)
+    {
+        auto const delta = UnsignedT(UnsignedT(current) - previous);
+        auto const sign = UnsignedT(0) - UnsignedT(delta >> (sizeof(T) * 8 - 1));
+        return UnsignedT(UnsignedT(delta << 1) ^ sign);
+    }
+
+    static void zig_zag_delta_encode(gsl::span<T const> input, gsl::span<std::uint32_t> output)
+    {
+        UnsignedT previous = 0;
+        for (std::size_t i = 0; i < input.size(); ++i)
+        {
+            output[i] = zig_zag_delta(input[i], previous);
+            previous = UnsignedT(input[i]);
+        }
+    }
+
+    // Undo delta zig zag encoding directly into the output type, matching zigzag_delta_decode's
+    // 32 bit accumulation without requiring another full size intermediate buffer.
+    static void zig_zag_delta_decode(gsl::span<std::uint32_t const> input, gsl::span<T> output)
+    {
+        std::uint32_t previous = 0;
+        for (std::size_t i = 0; i < input.size(); ++i)
+        {
+            auto const zig_zag = input[i];
+            previous += (zig_zag >> 1) ^ (0u - (zig_zag & 1));
+            output[i] = T(std::int32_t(previous));
+        }
+    }
     
     template <typename U, typename V>
     static std::vector<U> cast(gsl::span<V> const& input)
@@ -100,6 +190,21 @@ struct StreamVByteWorkerV0
     }
 };
 
+/// \brief Worker used to compress and decompress <T, UseZigZag> data, specialised
+///        where a faster kernel is available for the platform.
+template <typename T, bool UseZigZag>
+struct StreamVByteWorkerV0 : StreamVByteWorkerV0Generic<T, UseZigZag>
+{
+};
+
+/// \brief All kernels available for <T, UseZigZag> data on the platform, which must
+///        produce identical results - used to cross check new kernels against the generic one.
+template <typename T, bool UseZigZag>
+struct StreamVByteKernelsV0
+{
+    using Kernels = std::tuple<StreamVByteWorkerV0Generic<T, UseZigZag>>;
+};
+
 #ifdef __SSE3__
 
 #include "vbz_streamvbyte_impl_sse3.h"
@@ -400,9 +400,10 @@ void dump_reg(std::ostream& str, RegType reg)
 }
 
 /// \brief Optimised ssse3 implementation for x64 when performing zig zag deltas.
-template <>
-struct StreamVByteWorkerV0<std::int16_t, true>
+struct StreamVByteWorkerV0Sse3
 {
+    static char const* name() { return "sse3"; }
+
     static vbz_size_t compress(gsl::span<char const> input_bytes, gsl::span<char> output)
     {
         auto const input = input_bytes.as_span<std::int16_t const>();
@@ -465,6 +466,82 @@ struct StreamVByteWorkerV0<std::int16_t, true>
         return dataPtr - output.begin();
     }
     
+    static vbz_size_t statistics(gsl::span<char const> input_bytes, VbzStreamVByteStatistics& statistics)
+    {
+        auto const input = input_bytes.as_span<std::int16_t const>();
+        std::size_t const size = input.size();
+
+        const __m128i zero = _mm_set1_epi16(0);
+
+        std::uint64_t data_bytes = 0;
+        std::array<std::uint16_t, 8> values;
+
+        auto step = 8;
+        std::size_t completed = 0;
+
+        auto prev_current = _mm_set1_epi16(0);
+        for (; (completed+step) <= size; completed += step)
+        {
+            // Same zig zag delta as compress, only the keys are generated - no data is shuffled or stored.
+            auto current = _mm_lddqu_si128((__m128i*)(input.data() + completed));
+            auto prev = _mm_alignr_epi8(current, prev_current, 14);
+            auto delta = _mm_sub_epi16(current, prev);
+            prev_current = current;
+
+            auto shl = _mm_slli_epi16(delta, 1);
+            auto shr = _mm_srai_epi16(delta, 15);
+            auto xor_res = _mm_xor_si128(shl, shr);
+
+            auto const keys = compute_keys(_mm_unpacklo_epi16(xor_res, zero), _mm_unpackhi_epi16(xor_res, zero));
+            statistics.key_histogram[keys & 0xFF] += 1;
+            statistics.key_histogram[keys >> 8] += 1;
+            data_bytes += len_lut[keys & 0xFF] + len_lut[keys >> 8];
+
+            _mm_storeu_si128((__m128i*)values.data(), xor_res);
+            for (auto value : values)
+            {
+                statistics.data_histogram[value & 0xFF] += 1;
+                if (value > 0xFF)
+                {
+                    statistics.data_histogram[value >> 8] += 1;
+                }
+            }
+        }
+
+        std::array<std::uint32_t, 8> final_elements;
+        std::int16_t last_value = completed == 0 ? 0 : input[completed-1];
+        auto const remaining = scalar_to_zig_zag(input.subspan(completed), final_elements, last_value);
+
+        // do remaining
+        uint32_t key = 0;
+        for (std::size_t i = 0; i < remaining; i++)
+        {
+            uint32_t dw = final_elements[i];
+            uint32_t symbol = (dw > 0x000000FF) + (dw > 0x0000FFFF) + (dw > 0x00FFFFFF);
+            key |= symbol << ((i & 3) * 2);
+            if ((i & 3) == 3)
+            {
+                statistics.key_histogram[key] += 1;
+                key = 0;
+            }
+            for (uint32_t byte = 0; byte <= symbol; ++byte)
+            {
+                statistics.data_histogram[(dw >> (byte * 8)) & 0xFF] += 1;
+            }
+            data_bytes += 1 + symbol;
+        }
+        if (remaining & 3)
+        {
+            statistics.key_histogram[key] += 1;
+        }
+
+        std::uint64_t const key_bytes = (size + 3) / 4;
+        statistics.integer_count += size;
+        statistics.key_bytes += key_bytes;
+        statistics.data_bytes += data_bytes;
+        return vbz_size_t(key_bytes + data_bytes);
+    }
+
     static vbz_size_t decompress(gsl::span<char const> input, gsl::span<char> output_bytes)
     {
         auto const output = output_bytes.as_span<std::int16_t>();
@@ -472,13 +549,14 @@ struct StreamVByteWorkerV0<std::int16_t, true>
         int count = output.size();
         if (count == 0)
         {
-            return 0;
+            // Reject trailing data in the same way as the generic kernel.
+            return input.size() == 0 ? 0 : VBZ_STREAMVBYTE_STREAM_ERROR;
         }
 
         vbz_size_t key_byte_count = (count + 3) / 4;
         if (input.size() < key_byte_count)
         {
-            return VBZ_STREAMVBYTE_INPUT_SIZE_ERROR;
+            return VBZ_STREAMVBYTE_STREAM_ERROR;
         }
 
         // full list of keys starts
@@ -505,23 +583,23 @@ struct StreamVByteWorkerV0<std::int16_t, true>
 
             auto const key_2 = keys[key_idx*2+1];
             auto data_2 = decompress_int_registers(key_2, data);
-            
+
+            // Perform un-zig zag int reorganisation on the full 32 bit values, so streams holding values
+            // wider than 16 bits decode the same as the generic kernel.
+            // (n >> 1) ^ - (n & 1)
+            auto zero = _mm_set1_epi16(0);
+            const __m128i mask_1 = _mm_set1_epi32(1);
+            auto unzig_1 = _mm_xor_si128(_mm_srli_epi32(data_1, 1), _mm_sub_epi32(zero, _mm_and_si128(data_1, mask_1)));
+            auto unzig_2 = _mm_xor_si128(_mm_srli_epi32(data_2, 1), _mm_sub_epi32(zero, _mm_and_si128(data_2, mask_1)));
+
             // Now unpack the decompressed data to signed integers.
             auto const to_16_bit_left = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1, 0,1,  4,5,  8,9,  12, 13);
             auto const to_16_bit_right = _mm_setr_epi8(0,1,  4,5,  8,9,  12, 13, -1,-1,-1,-1,-1,-1,-1,-1);
-            auto const left = _mm_shuffle_epi8(data_1, to_16_bit_left);
-            auto const right = _mm_shuffle_epi8(data_2, to_16_bit_right);
-            auto const values = _mm_alignr_epi8(right, left, 8);
-            
-            const __m128i mask_1 = _mm_set1_epi16(1);
-            // Perform un-zig zag int reorganisation
-            // (n >> 1) ^ - (n & 1)
-            auto shr = _mm_srli_epi16(values, 1);
-            auto neg_bit = _mm_sign_epi16(_mm_and_si128(values, mask_1), _mm_set1_epi16(-1));
-            auto xor_res = _mm_xor_si128(shr, neg_bit);
-        
+            auto const left = _mm_shuffle_epi8(unzig_1, to_16_bit_left);
+            auto const right = _mm_shuffle_epi8(unzig_2, to_16_bit_right);
+            auto const xor_res = _mm_alignr_epi8(right, left, 8);
+
             // Combine to find previous values
-            auto zero = _mm_set1_epi16(0);
             auto cum_sum = xor_res;
             auto cum_sum_adder = xor_res;
             
@@ -579,9 +657,8 @@ struct StreamVByteWorkerV0<std::int16_t, true>
         return output.size() * sizeof(std::int16_t);
     }
 
-    inline static void compress_int_registers(__m128i r0, __m128i r1, char*& keyPtr, char*& dataPtr)
+    inline static std::size_t compute_keys(__m128i r0, __m128i r1)
     {
-        std::size_t keys;
         __m128i r2, r3;
 
         const __m128i mask_01 = _mm_set1_epi8(0x01);
@@ -592,7 +669,13 @@ struct StreamVByteWorkerV0<std::int16_t, true>
         r2 = _mm_packus_epi16(r2, r3);
         r2 = _mm_min_epi16(r2, mask_01); // convert 0x01FF to 0x0101
         r2 = _mm_adds_epu16(r2, mask_7F00); // convert: 0x0101 to 0x8001, 0xFF01 to 0xFFFF
-        keys = (size_t)_mm_movemask_epi8(r2);
+        return (size_t)_mm_movemask_epi8(r2);
+    }
+
+    inline static void compress_int_registers(__m128i r0, __m128i r1, char*& keyPtr, char*& dataPtr)
+    {
+        std::size_t keys = compute_keys(r0, r1);
+        __m128i r2, r3;
 
         r2 = _mm_loadu_si128((__m128i*)&encode_shuf_lut[(keys << 4) & 0x03F0]);
         r3 = _mm_loadu_si128((__m128i*)&encode_shuf_lut[(keys >> 4) & 0x03F0]);
@@ -657,3 +740,14 @@ struct StreamVByteWorkerV0<std::int16_t, true>
         }
     }
 };
+
+template <>
+struct StreamVByteWorkerV0<std::int16_t, true> : StreamVByteWorkerV0Sse3
+{
+};
+
+template <>
+struct StreamVByteKernelsV0<std::int16_t, true>
+{
+    using Kernels = std::tuple<StreamVByteWorkerV0Generic<std::int16_t, true>, StreamVByteWorkerV0Sse3>;
+};
@@ -2,6 +2,7 @@
 #include "vbz_streamvbyte_impl.h"
 #include "../v0/vbz_streamvbyte_impl.h" // for 4 byte case
 #include "vbz.h"
+#include "vbz_trace_scope.h"
 
 #include <cstdint>
 #include <gsl/gsl-lite.hpp>
@@ -32,6 +33,7 @@ vbz_size_t vbz_delta_zig_zag_streamvbyte_compress_v1(
         return VBZ_INPUT_SIZE_ERROR;
     }
     
+    VbzTraceScope trace(VBZ_TRACE_STREAMVBYTE_ENCODE, source_size);
     auto const input_span = gsl::make_span(static_cast<char const*>(source), source_size);
     auto const output_span = gsl::make_span(static_cast<char*>(destination), destination_capacity);
     switch(integer_size) {
@@ -77,6 +79,7 @@ vbz_size_t vbz_delta_zig_zag_streamvbyte_decompress_v1(
         return VBZ_DESTINATION_SIZE_ERROR;
     }
     
+    VbzTraceScope trace(VBZ_TRACE_STREAMVBYTE_DECODE, source_size);
     auto const input_span = gsl::make_span(static_cast<char const*>(source), source_size);
     auto const output_span = gsl::make_span(static_cast<char*>(destination), destination_size);
     switch(integer_size) {
@@ -111,3 +114,46 @@ vbz_size_t vbz_delta_zig_zag_streamvbyte_decompress_v1(
             return VBZ_INTEGER_SIZE_ERROR;
     }
 }
+
+vbz_size_t vbz_delta_zig_zag_streamvbyte_statistics_v1(
+    void const* source,
+    vbz_size_t source_size,
+    int integer_size,
+    bool use_delta_zig_zag_encoding,
+    VbzStreamVByteStatistics* statistics)
+{
+    if (source_size % integer_size != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const input_span = gsl::make_span(static_cast<char const*>(source), source_size);
+    switch(integer_size) {
+        case 1: {
+            if (use_delta_zig_zag_encoding) {
+                return StreamVByteWorkerV1<std::int8_t, true>::statistics(input_span, *statistics);
+            }
+            else {
+                return StreamVByteWorkerV1<std::int8_t, false>::statistics(input_span, *statistics);
+            }
+        }
+        case 2: {
+            if (use_delta_zig_zag_encoding) {
+                return StreamVByteWorkerV0<std::int16_t, true>::statistics(input_span, *statistics);
+            }
+            else {
+                return StreamVByteWorkerV0<std::int16_t, false>::statistics(input_span, *statistics);
+            }
+        }
+        case 4: {
+            if (use_delta_zig_zag_encoding) {
+                return StreamVByteWorkerV0<std::int32_t, true>::statistics(input_span, *statistics);
+            }
+            else {
+                return StreamVByteWorkerV0<std::int32_t, false>::statistics(input_span, *statistics);
+            }
+        }
+        default:
+            return VBZ_INTEGER_SIZE_ERROR;
+    }
+}
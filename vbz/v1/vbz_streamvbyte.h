@@ -2,6 +2,7 @@
 
 #include "vbz/vbz_export.h"
 #include "vbz.h"
+#include "../v0/vbz_streamvbyte.h" // for VbzStreamVByteStatistics
 
 #include <cstddef>
 
@@ -51,4 +52,19 @@ VBZ_EXPORT vbz_size_t vbz_delta_zig_zag_streamvbyte_decompress_v1(
     void* destination,
     vbz_size_t destination_size,
     int integer_size,
-    bool use_delta_zig_zag_encoding);
\ No newline at end of file
+    bool use_delta_zig_zag_encoding);
+
+/// \brief Gather statistics describing the delta zig zag + streamvbyte encoding of the source data,
+///        without writing the encoded stream.
+/// \param source                       Source data to summarise.
+/// \param source_size                  Source data size (in bytes)
+/// \param integer_size                 Number of bytes per integer
+/// \param use_delta_zig_zag_encoding   Control if the data should be delta-zig-zag encoded before streamvbyte encoding.
+/// \param statistics                   Statistics to accumulate the encoding summary into.
+/// \return The number of bytes #vbz_delta_zig_zag_streamvbyte_compress_v1 would write for [source].
+VBZ_EXPORT vbz_size_t vbz_delta_zig_zag_streamvbyte_statistics_v1(
+    void const* source,
+    vbz_size_t source_size,
+    int integer_size,
+    bool use_delta_zig_zag_encoding,
+    VbzStreamVByteStatistics* statistics);
\ No newline at end of file
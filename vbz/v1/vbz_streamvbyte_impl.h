@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vbz.h"
+#include "vbz_streamvbyte.h"
+#include "vbz_trace_scope.h"
 
 #include "streamvbyte.h"
 #include "streamvbyte_zigzag.h"
@@ -226,7 +228,11 @@ struct StreamVByteWorkerV1
         
         if (!UseZigZag)
         {
-            auto input_buffer = cast<std::uint32_t>(input);
+            std::vector<std::uint32_t> input_buffer;
+            {
+                VbzTraceScope trace(VBZ_TRACE_TRANSFORM, input_bytes.size());
+                input_buffer = cast<std::uint32_t>(input);
+            }
             return vbz_size_t(streamvbyte_encode_half(
                 input_buffer.data(),
                 std::uint32_t(input_buffer.size()),
@@ -234,9 +240,12 @@ struct StreamVByteWorkerV1
             ));
         }
         
-        std::vector<std::int32_t> input_buffer = cast<std::int32_t>(input);
         std::vector<std::uint32_t> intermediate_buffer(input.size());
-        zigzag_delta_encode(input_buffer.data(), intermediate_buffer.data(), input_buffer.size(), 0);
+        {
+            VbzTraceScope trace(VBZ_TRACE_TRANSFORM, input_bytes.size());
+            std::vector<std::int32_t> input_buffer = cast<std::int32_t>(input);
+            zigzag_delta_encode(input_buffer.data(), intermediate_buffer.data(), input_buffer.size(), 0);
+        }
 
         return vbz_size_t(streamvbyte_encode_half(
             intermediate_buffer.data(),
@@ -245,13 +254,66 @@ struct StreamVByteWorkerV1
         ));
     }
     
+    static vbz_size_t statistics(gsl::span<char const> input_bytes, VbzStreamVByteStatistics& statistics)
+    {
+        auto const input = input_bytes.as_span<T const>();
+
+        std::uint64_t data_half_bytes = 0;
+        std::uint32_t key = 0;
+        std::uint32_t previous = 0;
+        for (std::size_t i = 0; i < input.size(); ++i)
+        {
+            // Matches the conversions performed by compress, without the intermediate buffers.
+            std::uint32_t value = std::uint32_t(std::int32_t(input[i]));
+            if (UseZigZag)
+            {
+                auto const current = value;
+                auto const delta = std::int32_t(current - previous);
+                value = (std::uint32_t(delta) << 1) ^ std::uint32_t(delta >> 31);
+                previous = current;
+            }
+
+            // Codes and sizes as written by _encode_data.
+            std::uint32_t const code = value == 0 ? 0 : value < (1 << 4) ? 1 : value < (1 << 8) ? 2 : 3;
+            key |= code << ((i & 3) * 2);
+            if ((i & 3) == 3)
+            {
+                statistics.key_histogram[key] += 1;
+                key = 0;
+            }
+
+            std::uint32_t const half_bytes = (1 << code) >> 1;
+            for (std::uint32_t half_byte = 0; half_byte < half_bytes; ++half_byte)
+            {
+                statistics.data_histogram[(value >> (half_byte * 4)) & 0xF] += 1;
+            }
+            data_half_bytes += half_bytes;
+        }
+        if (input.size() & 3)
+        {
+            statistics.key_histogram[key] += 1;
+        }
+
+        std::uint64_t const key_bytes = (input.size() + 3) / 4;
+        std::uint64_t const data_bytes = (data_half_bytes + 1) / 2;
+        statistics.integer_count += input.size();
+        statistics.key_bytes += key_bytes;
+        statistics.data_bytes += data_bytes;
+        return vbz_size_t(key_bytes + data_bytes);
+    }
+    
     static vbz_size_t decompress(gsl::span<char const> input, gsl::span<char> output_bytes)
     {
         auto const output = output_bytes.as_span<T>();
         auto in_data = input.as_span<std::uint8_t const>().data();
         auto const out_size = vbz_size_t(output.size());
 
-        if (!streamvbyte_validate_stream_half(in_data, input.size_bytes(), out_size)) {
+        bool valid_stream;
+        {
+            VbzTraceScope trace(VBZ_TRACE_VALIDATION, input.size_bytes());
+            valid_stream = streamvbyte_validate_stream_half(in_data, input.size_bytes(), out_size);
+        }
+        if (!valid_stream) {
             return VBZ_STREAMVBYTE_STREAM_ERROR;
         }
         
@@ -266,18 +328,29 @@ struct StreamVByteWorkerV1
             return VBZ_STREAMVBYTE_STREAM_ERROR;
         }
         
+        VbzTraceScope trace(VBZ_TRACE_TRANSFORM, output_bytes.size());
         if (!UseZigZag)
         {
             cast(gsl::make_span(intermediate_buffer), output);
             return vbz_size_t(output.size() * sizeof(T));
         }
         
-        std::vector<std::int32_t> output_buffer(output.size());
-        zigzag_delta_decode(intermediate_buffer.data(), output_buffer.data(), output_buffer.size(), 0);
-        
-        cast(gsl::make_span(output_buffer), output);
+        zig_zag_delta_decode(gsl::make_span(intermediate_buffer), output);
         return vbz_size_t(output.size() * sizeof(T));
     }
+
+    // Undo delta zig zag encoding directly into the output type, matching zigzag_delta_decode's
+    // 32 bit accumulation without requiring another full size intermediate buffer.
+    static void zig_zag_delta_decode(gsl::span<std::uint32_t const> input, gsl::span<T> output)
+    {
+        std::uint32_t previous = 0;
+        for (std::size_t i = 0; i < input.size(); ++i)
+        {
+            auto const zig_zag = input[i];
+            previous += (zig_zag >> 1) ^ (0u - (zig_zag & 1));
+            output[i] = T(std::int32_t(previous));
+        }
+    }
     
     template <typename U, typename V>
     static std::vector<U> cast(gsl::span<V> const& input)
@@ -1,35 +1,35 @@
 #include "v0/vbz_streamvbyte.h"
 #include "v1/vbz_streamvbyte.h"
+#include "vbz_codec.h"
+#include "vbz_float32.h"
+#include "vbz_interleave.h"
+#include "vbz_metrics_scope.h"
+#include "vbz_quantise.h"
+#include "vbz_run_length.h"
+#include "vbz_scratch_arena.h"
+#include "vbz_trace_scope.h"
 
 #include <gsl/gsl-lite.hpp>
 #include <zstd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <numeric>
+#include <new>
 
 // include last - it uses c headers which can mess things up.
 #include "vbz.h"
 
-namespace {
-// util for using malloc with unique_ptr.
-// This is required since a vector would throw if the size was too big.
-struct free_delete
-{
-    void operator()(void* x) { free(x); }
-};
-    
-gsl::span<char> make_data_buffer(void* data, vbz_size_t size)
-{
-    return gsl::make_span(static_cast<char*>(data), size);
-}
+using namespace vbz::detail;
+
+namespace vbz::detail {
 
-gsl::span<char const> make_data_buffer(void const* data, vbz_size_t size)
-{
-    return gsl::make_span(static_cast<char const*>(data), size);
-}
-    
 vbz_size_t copy_buffer(
     gsl::span<char const> source,
     gsl::span<char> dest)
@@ -41,19 +41,404 @@ vbz_size_t copy_buffer(
     return vbz_size_t(source.size());
 }
 
+std::size_t zstd_compress(void* destination, std::size_t capacity, void const* source, std::size_t size, int level)
+{
+    VbzTraceScope trace(VBZ_TRACE_ZSTD_COMPRESS, size);
+    return ZSTD_compress(destination, capacity, source, size, level);
+}
+
+std::size_t zstd_decompress(void* destination, std::size_t capacity, void const* source, std::size_t size)
+{
+    VbzTraceScope trace(VBZ_TRACE_ZSTD_DECOMPRESS, size);
+    return ZSTD_decompress(destination, capacity, source, size);
+}
+
+std::size_t zstd_decompress_stream(ZSTD_DStream* stream, ZSTD_outBuffer* output, ZSTD_inBuffer* input)
+{
+    VbzTraceScope trace(VBZ_TRACE_ZSTD_DECOMPRESS, input->size - input->pos);
+    return ZSTD_decompressStream(stream, output, input);
+}
+
+bool is_float32(CompressionOptions const* options)
+{
+    return options->vbz_version == VBZ_FLOAT32_VERSION;
+}
+
+bool is_valid_version(CompressionOptions const* options)
+{
+    return options->vbz_version <= 1 || is_float32(options);
+}
+
 bool is_valid_integer_size(CompressionOptions const* options) {
-    return options->integer_size == 0
+    if (is_float32(options)) {
+        return options->integer_size == sizeof(float);
+    }
+    return (options->integer_size == 0
         || options->integer_size == 1
         || options->integer_size == 2
-        || options->integer_size == 4
+        || options->integer_size == 4)
         ;
 }
 
-struct VbzSizedHeader
+}
+
+namespace {
+
+// Adapt the float32 encoding to the signatures of the streamvbyte versions, it has no integer
+// size or delta zig zag options.
+vbz_size_t max_float32_compressed_size(std::size_t, vbz_size_t source_size)
+{
+    return vbz_max_float32_compressed_size(source_size);
+}
+
+vbz_size_t float32_compress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    int,
+    bool)
+{
+    return vbz_float32_compress(source, source_size, destination, destination_capacity);
+}
+
+vbz_size_t float32_decompress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size,
+    int,
+    bool)
+{
+    return vbz_float32_decompress(source, source_size, destination, destination_size);
+}
+
+vbz_size_t float32_statistics(
+    void const* source,
+    vbz_size_t source_size,
+    int,
+    bool,
+    VbzStreamVByteStatistics* statistics)
+{
+    return vbz_float32_statistics(source, source_size, statistics);
+}
+
+// Functions implementing the integer encoding stage for some options.
+struct IntegerCodec
+{
+    decltype(&vbz_max_streamvbyte_compressed_size_v0) max_size;
+    decltype(&vbz_delta_zig_zag_streamvbyte_compress_v0) compress;
+    decltype(&vbz_delta_zig_zag_streamvbyte_decompress_v0) decompress;
+    decltype(&vbz_delta_zig_zag_streamvbyte_statistics_v0) statistics;
+};
+
+// Select the integer encoding for [options]' version, callers check the version is valid.
+IntegerCodec integer_codec(CompressionOptions const* options)
+{
+    if (is_float32(options))
+    {
+        return { max_float32_compressed_size, float32_compress, float32_decompress, float32_statistics };
+    }
+    if (options->vbz_version == 1)
+    {
+        return {
+            vbz_max_streamvbyte_compressed_size_v1,
+            vbz_delta_zig_zag_streamvbyte_compress_v1,
+            vbz_delta_zig_zag_streamvbyte_decompress_v1,
+            vbz_delta_zig_zag_streamvbyte_statistics_v1
+        };
+    }
+    return {
+        vbz_max_streamvbyte_compressed_size_v0,
+        vbz_delta_zig_zag_streamvbyte_compress_v0,
+        vbz_delta_zig_zag_streamvbyte_decompress_v0,
+        vbz_delta_zig_zag_streamvbyte_statistics_v0
+    };
+}
+
+// The estimate summarises this many evenly spaced blocks of the input, inputs
+// smaller than the full sample are summarised completely.
+constexpr std::size_t estimate_block_count = 16;
+constexpr std::size_t estimate_block_elements = 256;
+
+// zstd model, calibrated against the test_data reads: zstd's entropy coding of the streamvbyte
+// keys lands within a few percent of their order-0 entropy, while the data section costs slightly
+// more than its order-0 entropy as it is coded as literals with few matches.
+constexpr double zstd_key_entropy_ratio = 1.0;
+constexpr double zstd_data_entropy_ratio = 1.06;
+
+// Size in bytes of an ideal order-0 entropy coding of the symbols counted in [histogram].
+double entropy_size(gsl::span<std::uint32_t const> histogram)
+{
+    double total = 0;
+    for (auto count : histogram)
+    {
+        total += count;
+    }
+
+    double bits = 0;
+    for (auto count : histogram)
+    {
+        if (count != 0)
+        {
+            bits -= count * std::log2(count / total);
+        }
+    }
+    return bits / 8;
+}
+
+// Call [summarise] with the (first element, element count) of each block sampled from [element_count] elements.
+template <typename SummariseFn>
+void sample_blocks(std::size_t element_count, SummariseFn&& summarise)
+{
+    if (element_count <= estimate_block_count * estimate_block_elements)
+    {
+        summarise(std::size_t(0), element_count);
+        return;
+    }
+
+    for (std::size_t block = 0; block < estimate_block_count; ++block)
+    {
+        // Evenly spaced blocks, the first starting at the beginning and the last ending at the end of the input.
+        auto const first = block * (element_count - estimate_block_elements) / (estimate_block_count - 1);
+        summarise(first, estimate_block_elements);
+    }
+}
+
+}
+
+namespace vbz::detail {
+
+vbz_size_t encode_integers(
+    gsl::span<char const> source,
+    gsl::span<char> destination,
+    CompressionOptions const* options)
+{
+    if (options->integer_size == 0)
+    {
+        return copy_buffer(source, destination);
+    }
+
+    auto const codec = integer_codec(options);
+    auto const max_size = codec.max_size(options->integer_size, vbz_size_t(source.size()));
+    if (vbz_is_error(max_size))
+    {
+        return max_size;
+    }
+    if (max_size > destination.size())
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    return codec.compress(
+        source.data(),
+        vbz_size_t(source.size()),
+        destination.data(),
+        vbz_size_t(destination.size()),
+        options->integer_size,
+        options->perform_delta_zig_zag
+    );
+}
+
+vbz_size_t decode_integers(
+    gsl::span<char const> source,
+    gsl::span<char> destination,
+    CompressionOptions const* options)
+{
+    if (options->integer_size == 0)
+    {
+        if (source.size() != destination.size())
+        {
+            return VBZ_DESTINATION_SIZE_ERROR;
+        }
+        return copy_buffer(source, destination);
+    }
+
+    return integer_codec(options).decompress(
+        source.data(),
+        vbz_size_t(source.size()),
+        destination.data(),
+        vbz_size_t(destination.size()),
+        options->integer_size,
+        options->perform_delta_zig_zag
+    );
+}
+
+vbz_size_t max_encoded_size(vbz_size_t size, CompressionOptions const* options)
+{
+    if (options->integer_size == 0)
+    {
+        return size;
+    }
+
+    return integer_codec(options).max_size(options->integer_size, size);
+}
+
+vbz_size_t ZstdStreamReader::init()
+{
+    m_stream.reset(ZSTD_createDStream());
+    if (!m_stream)
+    {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    if (ZSTD_isError(ZSTD_initDStream(m_stream.get())))
+    {
+        return VBZ_ZSTD_ERROR;
+    }
+    return 0;
+}
+
+vbz_size_t ZstdStreamReader::read(gsl::span<char> destination)
+{
+    ZSTD_outBuffer output{ destination.data(), destination.size(), 0 };
+    while (output.pos < output.size)
+    {
+        auto const input_pos = m_input.pos;
+        auto const output_pos = output.pos;
+        if (ZSTD_isError(zstd_decompress_stream(m_stream.get(), &output, &m_input)))
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+        if (m_input.pos == input_pos && output.pos == output_pos)
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+    }
+    return 0;
+}
+
+vbz_size_t ZstdStreamReader::skip(std::size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    auto const skip_capacity = std::min(size, ZSTD_DStreamOutSize());
+    std::unique_ptr<void, free_delete> skip_storage(malloc(skip_capacity));
+    if (!skip_storage)
+    {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+
+    for (std::size_t skipped = 0; skipped < size; skipped += skip_capacity)
+    {
+        auto const result = read(make_data_buffer(
+            skip_storage.get(),
+            vbz_size_t(std::min(skip_capacity, size - skipped))));
+        if (vbz_is_error(result))
+        {
+            return result;
+        }
+    }
+    return 0;
+}
+
+}
+
+namespace {
+
+// Bounded error data is a VbzBoundedErrorHeader, then the quantisation indices of the original data
+// compressed as #vbz_compress would, always with delta zig zag so the quantised residuals are encoded.
+// The header starts with the original size, as VbzSizedHeader does, so #vbz_decompressed_size applies.
+struct VbzBoundedErrorHeader
+{
+    vbz_size_t original_size;
+    vbz_size_t max_absolute_error;
+};
+
+constexpr vbz_size_t max_error_bound = vbz_size_t(std::numeric_limits<std::int32_t>::max());
+
+// Options encoding integers with streamvbyte, which the bounded error and interleaved formats transform.
+bool is_valid_integer_encoding_options(CompressionOptions const* options)
+{
+    return is_valid_integer_size(options)
+        && !is_float32(options)
+        && options->integer_size != 0;
+}
+
+// Interleaved data is a VbzInterleavedHeader, the encoded size of each block of frames, then the blocks
+// (each de-interleaved to channel major order and encoded as #vbz_compress would) concatenated into a
+// single zstd frame (or stored directly when zstd is disabled).
+// The header starts with the original size, as VbzSizedHeader does, so #vbz_decompressed_size applies.
+struct VbzInterleavedHeader
+{
+    vbz_size_t original_size;
+    vbz_size_t channel_count;
+    vbz_size_t block_frames;
+};
+
+// Blocks of about 64KB stay in L2 between being transposed and encoded (or decoded and transposed back),
+// in whole tiles of 8 frames.
+constexpr std::size_t interleaved_block_size = 64 * 1024;
+constexpr std::size_t interleaved_block_frame_multiple = 8;
+
+std::size_t interleaved_block_frames(std::size_t channel_count, std::size_t integer_size)
+{
+    auto const frames = interleaved_block_size / (channel_count * integer_size);
+    return std::max(interleaved_block_frame_multiple, frames - frames % interleaved_block_frame_multiple);
+}
+
+std::size_t interleaved_header_size(std::size_t block_count)
+{
+    return sizeof(VbzInterleavedHeader) + block_count * sizeof(vbz_size_t);
+}
+
+// Options compressing the quantisation indices of data compressed with [options].
+CompressionOptions index_options(CompressionOptions const* options)
+{
+    auto result = *options;
+    result.perform_delta_zig_zag = true;
+    return result;
+}
+
+// Run length data is a VbzRunLengthHeader, the runs compressed as #vbz_compress would (as pairs of uint32s,
+// see #vbz_collapse_runs), then the integers not in runs compressed as #vbz_compress would.
+// The header starts with the original size, as VbzSizedHeader does, so #vbz_decompressed_size applies.
+struct VbzRunLengthHeader
 {
     vbz_size_t original_size;
+    vbz_size_t run_count;
+    vbz_size_t compressed_runs_size;
 };
 
+constexpr std::size_t run_record_size = 2 * sizeof(std::uint32_t);
+
+// Options compressing the runs of data compressed with [options], their lengths need no delta zig zag.
+CompressionOptions run_options(CompressionOptions const* options)
+{
+    return CompressionOptions{
+        false,
+        sizeof(std::uint32_t),
+        options->zstd_compression_level,
+        options->vbz_version
+    };
+}
+
+// Intermediate storage for a single call, taken from an arena when the caller provides one,
+// otherwise allocated for the duration of the call.
+class ScratchStorage
+{
+public:
+    explicit ScratchStorage(VbzScratchArena* arena)
+    : m_arena(arena)
+    {
+    }
+
+    void* reserve(std::size_t size)
+    {
+        if (m_arena)
+        {
+            return m_arena->reserve(size);
+        }
+        m_storage.reset(malloc(size));
+        return m_storage.get();
+    }
+
+private:
+    VbzScratchArena* m_arena;
+    std::unique_ptr<void, free_delete> m_storage;
+};
 }
 
 extern "C" {
@@ -72,6 +457,10 @@ char const* vbz_error_string(vbz_size_t error_value)
     if (VBZ_STREAMVBYTE_STREAM_ERROR == error_value) return "VBZ_STREAMVBYTE_STREAM_ERROR";
     if (VBZ_VERSION_ERROR == error_value) return "VBZ_VERSION_ERROR";
     if (VBZ_OUT_OF_MEMORY_ERROR == error_value) return "VBZ_OUT_OF_MEMORY_ERROR";
+    if (VBZ_CHECKSUM_ERROR == error_value) return "VBZ_CHECKSUM_ERROR";
+    if (VBZ_ERROR_BOUND_ERROR == error_value) return "VBZ_ERROR_BOUND_ERROR";
+    if (VBZ_IO_ERROR == error_value) return "VBZ_IO_ERROR";
+    if (VBZ_CANCELLED_ERROR == error_value) return "VBZ_CANCELLED_ERROR";
 
     return "VBZ_UNKNOWN_ERROR";
 }
@@ -87,17 +476,12 @@ vbz_size_t vbz_max_compressed_size(
     vbz_size_t max_size = source_size;
     if (options->integer_size != 0)
     {
-        auto size_fn = vbz_max_streamvbyte_compressed_size_v0;
-        if (options->vbz_version == 1)
-        {
-            size_fn = vbz_max_streamvbyte_compressed_size_v1;
-        }
-        else if (options->vbz_version != 0)
+        if (!is_valid_version(options))
         {
             return VBZ_VERSION_ERROR;
         }
         
-        max_size = vbz_size_t(size_fn(options->integer_size, max_size));
+        max_size = vbz_size_t(integer_codec(options).max_size(options->integer_size, max_size));
         if (vbz_is_error(max_size))
         {
             return max_size;
@@ -113,12 +497,125 @@ vbz_size_t vbz_max_compressed_size(
     return max_size + sizeof(VbzSizedHeader);
 }
 
+vbz_size_t vbz_estimate_compressed_size(
+    void const* source,
+    vbz_size_t source_size,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+
+    if (options->zstd_compression_level == 0 && options->integer_size == 0)
+    {
+        return source_size;
+    }
+
+    // Estimated size of the data passed to zstd, and of zstd's output.
+    double uncompressed_size = source_size;
+    double compressed_size = source_size;
+
+    if (options->integer_size == 0)
+    {
+        std::uint32_t histogram[256] = {};
+        std::size_t sample_size = 0;
+        sample_blocks(source_buffer.size(), [&](std::size_t first, std::size_t count)
+        {
+            for (auto byte : source_buffer.subspan(first, count))
+            {
+                histogram[std::uint8_t(byte)] += 1;
+            }
+            sample_size += count;
+        });
+
+        double const scale = sample_size == 0 ? 0.0 : double(source_size) / sample_size;
+        compressed_size = std::min(
+            double(source_size),
+            entropy_size(histogram) * zstd_data_entropy_ratio * scale
+        );
+    }
+    else
+    {
+        if (!is_valid_version(options))
+        {
+            return VBZ_VERSION_ERROR;
+        }
+        auto const statistics_fn = integer_codec(options).statistics;
+
+        if (source_size % options->integer_size != 0)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+
+        VbzStreamVByteStatistics statistics = {};
+        vbz_size_t error = 0;
+        sample_blocks(source_size / options->integer_size, [&](std::size_t first, std::size_t count)
+        {
+            auto const block = source_buffer.subspan(first * options->integer_size, count * options->integer_size);
+            auto const result = statistics_fn(
+                block.data(),
+                vbz_size_t(block.size()),
+                options->integer_size,
+                options->perform_delta_zig_zag,
+                &statistics
+            );
+            if (vbz_is_error(result))
+            {
+                error = result;
+            }
+        });
+        if (error)
+        {
+            return error;
+        }
+
+        double const scale = statistics.integer_count == 0 ? 0.0
+            : double(source_size / options->integer_size) / statistics.integer_count;
+        double key_size = double(statistics.key_bytes);
+        double data_size = double(statistics.data_bytes);
+        uncompressed_size = (key_size + data_size) * scale;
+
+        // zstd stores blocks it cannot compress raw, so never estimate more than the input for either section.
+        key_size = std::min(key_size, entropy_size(statistics.key_histogram) * zstd_key_entropy_ratio);
+        data_size = std::min(data_size, entropy_size(statistics.data_histogram) * zstd_data_entropy_ratio);
+        compressed_size = (key_size + data_size) * scale;
+    }
+
+    if (options->zstd_compression_level == 0)
+    {
+        return vbz_size_t(std::ceil(uncompressed_size));
+    }
+
+    // Add zstd's framing: the frame header and a header per block.
+    auto const zstd_block_count = std::max(1.0, std::ceil(uncompressed_size / zstd_block_size_max));
+    compressed_size += zstd_frame_header_size_max + 3 * zstd_block_count;
+    compressed_size = std::min(compressed_size, double(ZSTD_compressBound(std::size_t(uncompressed_size))));
+    return vbz_size_t(std::ceil(compressed_size));
+}
+
 vbz_size_t vbz_compress(
     void const* source,
     vbz_size_t source_size,
     void* destination,
     vbz_size_t destination_capacity,
     CompressionOptions const* options)
+{
+    return vbz_compress_with_arena(source, source_size, destination, destination_capacity, options, nullptr);
+}
+
+}
+
+namespace vbz::detail {
+
+vbz_size_t compress_with_arena(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options,
+    VbzScratchArena* arena)
 {
     if (!is_valid_integer_size(options)) {
         return VBZ_INTEGER_SIZE_ERROR;
@@ -132,25 +629,19 @@ vbz_size_t vbz_compress(
         return copy_buffer(current_source, dest_buffer);
     }
 
-    // optional intermediate buffer - allocated if needed later, but stored for
+    // optional intermediate buffer - reserved if needed later, but stored for
     // duration of call.
-    std::unique_ptr<void, free_delete> intermediate_storage;
+    ScratchStorage intermediate_storage(arena);
     
     if (options->integer_size != 0)
     {
-        auto size_fn = vbz_max_streamvbyte_compressed_size_v0;
-        auto compress_fn = vbz_delta_zig_zag_streamvbyte_compress_v0;
-        if (options->vbz_version == 1)
-        {
-            size_fn = vbz_max_streamvbyte_compressed_size_v1;
-            compress_fn = vbz_delta_zig_zag_streamvbyte_compress_v1;
-        }
-        else if (options->vbz_version != 0)
+        if (!is_valid_version(options))
         {
             return VBZ_VERSION_ERROR;
         }
+        auto const codec = integer_codec(options);
         
-        auto max_stream_v_byte_size = size_fn(
+        auto max_stream_v_byte_size = codec.max_size(
             options->integer_size,
             vbz_size_t(current_source.size())
         );
@@ -162,18 +653,18 @@ vbz_size_t vbz_compress(
         auto streamvbyte_dest = dest_buffer;
         if (options->zstd_compression_level != 0)
         {
-            intermediate_storage.reset(malloc(max_stream_v_byte_size));
-            if (!intermediate_storage) {
+            auto intermediate = intermediate_storage.reserve(max_stream_v_byte_size);
+            if (!intermediate) {
                 return VBZ_OUT_OF_MEMORY_ERROR;
             }
-            streamvbyte_dest = make_data_buffer(intermediate_storage.get(), max_stream_v_byte_size);
+            streamvbyte_dest = make_data_buffer(intermediate, max_stream_v_byte_size);
         }
         else if (max_stream_v_byte_size > destination_capacity)
         {
             return VBZ_DESTINATION_SIZE_ERROR;
         }
 
-        auto compressed_size = compress_fn(
+        auto compressed_size = codec.compress(
             current_source.data(),
             vbz_size_t(current_source.size()),
             streamvbyte_dest.data(),
@@ -191,7 +682,7 @@ vbz_size_t vbz_compress(
         return vbz_size_t(current_source.size());
     }
     
-    auto compressed_size = ZSTD_compress(
+    auto compressed_size = zstd_compress(
         dest_buffer.data(),
         vbz_size_t(dest_buffer.size()),
         current_source.data(),
@@ -207,12 +698,44 @@ vbz_size_t vbz_compress(
     return vbz_size_t(compressed_size);
 }
 
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_with_arena(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options,
+    VbzScratchArena* arena)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, source_size);
+    return metrics.complete(
+        compress_with_arena(source, source_size, destination, destination_capacity, options, arena));
+}
+
 vbz_size_t vbz_decompress(
     const void* source,
     vbz_size_t source_size,
     void* destination,
     vbz_size_t destination_size,
     CompressionOptions const* options)
+{
+    return vbz_decompress_with_arena(source, source_size, destination, destination_size, options, nullptr);
+}
+
+}
+
+namespace vbz::detail {
+
+vbz_size_t decompress_with_arena(
+    const void* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size,
+    CompressionOptions const* options,
+    VbzScratchArena* arena)
 {
     if (!is_valid_integer_size(options)) {
         return VBZ_INTEGER_SIZE_ERROR;
@@ -227,9 +750,9 @@ vbz_size_t vbz_decompress(
         return copy_buffer(current_source, dest_buffer);
     }
 
-    // optional intermediate buffer - allocated if needed later, but stored for
+    // optional intermediate buffer - reserved if needed later, but stored for
     // duration of call.
-    std::unique_ptr<void, free_delete> intermediate_storage;
+    ScratchStorage intermediate_storage(arena);
     
     if (options->zstd_compression_level != 0)
     {
@@ -249,18 +772,18 @@ vbz_size_t vbz_decompress(
                 return VBZ_ZSTD_ERROR;
             }
 #endif
-            intermediate_storage.reset(malloc(max_zstd_decompressed_size));
-            if (!intermediate_storage) {
+            auto intermediate = intermediate_storage.reserve(max_zstd_decompressed_size);
+            if (!intermediate) {
                 return VBZ_OUT_OF_MEMORY_ERROR;
             }
-            zstd_dest = make_data_buffer(intermediate_storage.get(), (vbz_size_t)max_zstd_decompressed_size);
+            zstd_dest = make_data_buffer(intermediate, (vbz_size_t)max_zstd_decompressed_size);
         }
         else if (max_zstd_decompressed_size > destination_size)
         {
             return VBZ_DESTINATION_SIZE_ERROR;
         }
 
-        auto compressed_size = ZSTD_decompress(
+        auto compressed_size = zstd_decompress(
             zstd_dest.data(),
             zstd_dest.size(),
             current_source.data(),
@@ -279,17 +802,12 @@ vbz_size_t vbz_decompress(
         return vbz_size_t(current_source.size());
     }
 
-    auto decompress_fn = vbz_delta_zig_zag_streamvbyte_decompress_v0;
-    if (options->vbz_version == 1)
-    {
-        decompress_fn = vbz_delta_zig_zag_streamvbyte_decompress_v1;
-    }
-    else if (options->vbz_version != 0)
+    if (!is_valid_version(options))
     {
         return VBZ_VERSION_ERROR;
     }
     
-    return decompress_fn(
+    return integer_codec(options).decompress(
         current_source.data(),
         vbz_size_t(current_source.size()),
         dest_buffer.data(),
@@ -299,7 +817,28 @@ vbz_size_t vbz_decompress(
     );
 }
 
-vbz_size_t vbz_compress_sized(
+}
+
+extern "C" {
+
+vbz_size_t vbz_decompress_with_arena(
+    const void* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size,
+    CompressionOptions const* options,
+    VbzScratchArena* arena)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_with_arena(source, source_size, destination, destination_size, options, arena));
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_sized(
     void const* source,
     vbz_size_t source_size,
     void* destination,
@@ -318,18 +857,19 @@ vbz_size_t vbz_compress_sized(
 
     // Compress data info remaining dest buffer
     auto dest_compressed_data = dest_buffer.subspan(sizeof(VbzSizedHeader));
-    auto compressed_size = vbz_compress(
+    auto compressed_size = compress_with_arena(
         source,
         source_size,
         dest_compressed_data.data(),
         vbz_size_t(dest_compressed_data.size()),
-        options
+        options,
+        nullptr
     );
     
     return compressed_size + sizeof(VbzSizedHeader);
 }
 
-vbz_size_t vbz_decompress_sized(
+vbz_size_t decompress_sized(
     void const* source,
     vbz_size_t source_size,
     void* destination,
@@ -357,15 +897,42 @@ vbz_size_t vbz_decompress_sized(
 
     // Compress data info remaining dest buffer
     auto src_compressed_data = source_buffer.subspan(sizeof(VbzSizedHeader));
-    return vbz_decompress(
+    return decompress_with_arena(
         src_compressed_data.data(),
         vbz_size_t(src_compressed_data.size()),
         destination,
         source_header->original_size,
-        options
+        options,
+        nullptr
     );
 }
 
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_sized(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, source_size);
+    return metrics.complete(compress_sized(source, source_size, destination, destination_capacity, options));
+}
+
+vbz_size_t vbz_decompress_sized(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(decompress_sized(source, source_size, destination, destination_capacity, options));
+}
+
 vbz_size_t vbz_decompressed_size(
     void const* source,
     vbz_size_t source_size,
@@ -385,5 +952,1019 @@ vbz_size_t vbz_decompressed_size(
     return header_span[0].original_size;
 }
 
+}
+
+namespace vbz::detail {
+
+bool same_integer_encoding(CompressionOptions const* source, CompressionOptions const* destination)
+{
+    if (source->integer_size != destination->integer_size || is_float32(source) != is_float32(destination))
+    {
+        return false;
+    }
+    return source->integer_size == 0
+        || is_float32(source)
+        || (source->perform_delta_zig_zag == destination->perform_delta_zig_zag
+            && source->vbz_version == destination->vbz_version);
+}
+
+vbz_size_t relevel_zstd(
+    gsl::span<char const> source,
+    int source_level,
+    gsl::span<char> destination,
+    int destination_level,
+    vbz_size_t intermediate_size)
+{
+    auto intermediate = source;
+    std::unique_ptr<void, free_delete> intermediate_storage;
+    if (source_level != 0)
+    {
+        // Without zstd on the destination the encoded stream is its payload, so decode straight into it.
+        auto intermediate_buffer = destination;
+        if (destination_level != 0)
+        {
+            intermediate_storage.reset(malloc(std::max<std::size_t>(intermediate_size, 1)));
+            if (!intermediate_storage) {
+                return VBZ_OUT_OF_MEMORY_ERROR;
+            }
+            intermediate_buffer = make_data_buffer(intermediate_storage.get(), intermediate_size);
+        }
+        else if (intermediate_size > destination.size())
+        {
+            return VBZ_DESTINATION_SIZE_ERROR;
+        }
+
+        auto const decompressed_size = zstd_decompress(
+            intermediate_buffer.data(),
+            intermediate_size,
+            source.data(),
+            source.size()
+        );
+        if (ZSTD_isError(decompressed_size) || decompressed_size != intermediate_size)
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+        if (destination_level == 0)
+        {
+            return intermediate_size;
+        }
+        intermediate = intermediate_buffer.subspan(0, intermediate_size);
+    }
+    else if (source.size() != intermediate_size)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    if (destination_level == 0)
+    {
+        return copy_buffer(intermediate, destination);
+    }
+
+    auto const compressed_size = zstd_compress(
+        destination.data(),
+        destination.size(),
+        intermediate.data(),
+        intermediate.size(),
+        destination_level
+    );
+    if (ZSTD_isError(compressed_size))
+    {
+        return VBZ_ZSTD_ERROR;
+    }
+    return vbz_size_t(compressed_size);
+}
+
+vbz_size_t reencode(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options,
+    VbzFunction decompress,
+    VbzFunction compress)
+{
+    auto const original_size = vbz_decompressed_size(source, source_size, source_options);
+    if (vbz_is_error(original_size))
+    {
+        return original_size;
+    }
+
+    std::unique_ptr<void, free_delete> original(malloc(std::max<std::size_t>(original_size, 1)));
+    if (!original) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const decompressed_size = decompress(source, source_size, original.get(), original_size, source_options);
+    if (vbz_is_error(decompressed_size))
+    {
+        return decompressed_size;
+    }
+    return compress(original.get(), decompressed_size, destination, destination_capacity, destination_options);
+}
+
+}
+
+namespace {
+
+vbz_size_t transcode_sized(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options)
+{
+    if (!is_valid_integer_size(source_options) || !is_valid_integer_size(destination_options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!same_integer_encoding(source_options, destination_options))
+    {
+        return reencode(source, source_size, destination, destination_capacity,
+            source_options, destination_options, &decompress_sized, &compress_sized);
+    }
+    if (source_options->integer_size != 0 && !is_valid_version(source_options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    if (source_buffer.size() < sizeof(VbzSizedHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    if (dest_buffer.size() < sizeof(VbzSizedHeader))
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto const header = source_buffer.subspan(0, sizeof(VbzSizedHeader));
+    std::copy(header.begin(), header.end(), dest_buffer.begin());
+
+    auto const max_intermediate_size = max_encoded_size(
+        header.as_span<VbzSizedHeader const>()[0].original_size, source_options);
+    if (vbz_is_error(max_intermediate_size))
+    {
+        return max_intermediate_size;
+    }
+
+    // The payload is a single zstd frame, which records the size of the encoded stream.
+    auto const payload = source_buffer.subspan(sizeof(VbzSizedHeader));
+    std::uint64_t intermediate_size = payload.size();
+    if (source_options->zstd_compression_level != 0)
+    {
+        intermediate_size = ZSTD_getFrameContentSize(payload.data(), payload.size());
+        if (intermediate_size == ZSTD_CONTENTSIZE_ERROR || intermediate_size == ZSTD_CONTENTSIZE_UNKNOWN)
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+    }
+    if (intermediate_size > max_intermediate_size)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const payload_size = relevel_zstd(
+        payload,
+        source_options->zstd_compression_level,
+        dest_buffer.subspan(sizeof(VbzSizedHeader)),
+        destination_options->zstd_compression_level,
+        vbz_size_t(intermediate_size)
+    );
+    if (vbz_is_error(payload_size))
+    {
+        return payload_size;
+    }
+    return vbz_size_t(sizeof(VbzSizedHeader) + payload_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_transcode_sized(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_TRANSCODE, source_size);
+    return metrics.complete(transcode_sized(
+        source, source_size, destination, destination_capacity, source_options, destination_options));
+}
+
+vbz_size_t vbz_max_bounded_error_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+
+    auto const index_compression = index_options(options);
+    auto const max_index_size = vbz_max_compressed_size(source_size, &index_compression);
+    if (vbz_is_error(max_index_size))
+    {
+        return max_index_size;
+    }
+
+    auto const max_size = std::uint64_t(sizeof(VbzBoundedErrorHeader)) + max_index_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t max_absolute_error,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (max_absolute_error == 0 || max_absolute_error > max_error_bound)
+    {
+        return VBZ_ERROR_BOUND_ERROR;
+    }
+    if (source_size % options->integer_size != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    if (dest_buffer.size() < sizeof(VbzBoundedErrorHeader))
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    std::unique_ptr<void, free_delete> indices(malloc(source_size));
+    if (!indices && source_size != 0) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    vbz_quantise(
+        source,
+        source_size / options->integer_size,
+        options->integer_size,
+        options->perform_delta_zig_zag,
+        max_absolute_error,
+        indices.get()
+    );
+
+    auto const index_compression = index_options(options);
+    auto const payload = dest_buffer.subspan(sizeof(VbzBoundedErrorHeader));
+    auto const compressed_size = compress_with_arena(
+        indices.get(),
+        source_size,
+        payload.data(),
+        vbz_size_t(payload.size()),
+        &index_compression,
+        nullptr
+    );
+    if (vbz_is_error(compressed_size))
+    {
+        return compressed_size;
+    }
+
+    auto header_span = dest_buffer.subspan(0, sizeof(VbzBoundedErrorHeader)).as_span<VbzBoundedErrorHeader>();
+    header_span[0].original_size = source_size;
+    header_span[0].max_absolute_error = max_absolute_error;
+
+    return vbz_size_t(sizeof(VbzBoundedErrorHeader) + compressed_size);
+}
+
+vbz_size_t decompress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+
+    auto const max_absolute_error = vbz_bounded_error_max_absolute_error(source, source_size);
+    if (vbz_is_error(max_absolute_error))
+    {
+        return max_absolute_error;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    auto const header = source_buffer.subspan(0, sizeof(VbzBoundedErrorHeader)).as_span<VbzBoundedErrorHeader const>()[0];
+    if (destination_capacity < header.original_size)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    // Decode the indices straight into the destination, then reconstruct the values in place.
+    auto const index_compression = index_options(options);
+    auto const payload = source_buffer.subspan(sizeof(VbzBoundedErrorHeader));
+    auto const decompressed_size = decompress_with_arena(
+        payload.data(),
+        vbz_size_t(payload.size()),
+        destination,
+        header.original_size,
+        &index_compression,
+        nullptr
+    );
+    if (vbz_is_error(decompressed_size))
+    {
+        return decompressed_size;
+    }
+
+    vbz_dequantise(
+        destination,
+        decompressed_size / options->integer_size,
+        options->integer_size,
+        options->perform_delta_zig_zag,
+        max_absolute_error
+    );
+    return decompressed_size;
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t max_absolute_error,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, source_size);
+    return metrics.complete(
+        compress_bounded_error(source, source_size, destination, destination_capacity, max_absolute_error, options));
+}
+
+vbz_size_t vbz_decompress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_bounded_error(source, source_size, destination, destination_capacity, options));
+}
+
+vbz_size_t vbz_bounded_error_max_absolute_error(
+    void const* source,
+    vbz_size_t source_size)
+{
+    auto const source_buffer = make_data_buffer(source, source_size);
+    if (source_buffer.size() < sizeof(VbzBoundedErrorHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header = source_buffer.subspan(0, sizeof(VbzBoundedErrorHeader)).as_span<VbzBoundedErrorHeader const>()[0];
+    if (header.max_absolute_error == 0 || header.max_absolute_error > max_error_bound)
+    {
+        return VBZ_ERROR_BOUND_ERROR;
+    }
+    return header.max_absolute_error;
+}
+
+vbz_size_t vbz_max_interleaved_compressed_size(
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+    if (channel_count == 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const frame_size = std::uint64_t(channel_count) * options->integer_size;
+    if (frame_size * frame_count >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const block_frames = interleaved_block_frames(channel_count, options->integer_size);
+    auto const full_blocks = frame_count / block_frames;
+    auto const final_block_frames = frame_count % block_frames;
+    auto const block_count = full_blocks + (final_block_frames != 0 ? 1 : 0);
+
+    // Full blocks are no larger than the whole input, so only sized when there is one.
+    vbz_size_t max_block_size = 0;
+    if (full_blocks != 0)
+    {
+        max_block_size = max_encoded_size(vbz_size_t(block_frames * frame_size), options);
+    }
+    auto const max_final_block_size = max_encoded_size(vbz_size_t(final_block_frames * frame_size), options);
+    if (vbz_is_error(max_final_block_size))
+    {
+        return max_final_block_size;
+    }
+
+    std::uint64_t encoded_size = std::uint64_t(full_blocks) * max_block_size + max_final_block_size;
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = ZSTD_compressBound(std::size_t(std::min<std::uint64_t>(encoded_size, VBZ_FIRST_ERROR)));
+    }
+
+    auto const max_size = interleaved_header_size(block_count) + encoded_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_interleaved(
+    void const* source,
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    vbz_size_t stride,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    auto const max_size = vbz_max_interleaved_compressed_size(frame_count, channel_count, options);
+    if (vbz_is_error(max_size))
+    {
+        return max_size;
+    }
+    if (stride < channel_count)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const integer_size = options->integer_size;
+    auto const frame_size = std::size_t(channel_count) * integer_size;
+    auto const block_frames = interleaved_block_frames(channel_count, integer_size);
+    auto const block_count = (std::size_t(frame_count) + block_frames - 1) / block_frames;
+    auto const header_size = interleaved_header_size(block_count);
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    if (header_size > dest_buffer.size())
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto header_span = dest_buffer.subspan(0, sizeof(VbzInterleavedHeader)).as_span<VbzInterleavedHeader>();
+    header_span[0].original_size = vbz_size_t(frame_count * frame_size);
+    header_span[0].channel_count = channel_count;
+    header_span[0].block_frames = vbz_size_t(block_frames);
+    auto block_sizes = dest_buffer.subspan(sizeof(VbzInterleavedHeader), header_size - sizeof(VbzInterleavedHeader)).as_span<vbz_size_t>();
+    auto payload = dest_buffer.subspan(header_size);
+
+    // A block of channel major integers, followed by each channel's last integer of the previous block.
+    auto const block_storage_size = std::min<std::size_t>(block_frames, frame_count) * frame_size;
+    std::unique_ptr<void, free_delete> block_storage(malloc(block_storage_size + frame_size));
+    if (!block_storage) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const block_buffer = static_cast<char*>(block_storage.get());
+    auto const previous = block_buffer + block_storage_size;
+    std::fill(previous, previous + frame_size, 0);
+
+    std::unique_ptr<void, free_delete> intermediate_storage;
+    auto encoded_buffer = payload;
+    if (options->zstd_compression_level != 0)
+    {
+        intermediate_storage.reset(malloc(max_size));
+        if (!intermediate_storage) {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+        encoded_buffer = make_data_buffer(intermediate_storage.get(), max_size);
+    }
+
+    auto const input = static_cast<char const*>(source);
+    std::size_t encoded_size = 0;
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+        auto const first_frame = i * block_frames;
+        auto const frames = std::min<std::size_t>(block_frames, frame_count - first_frame);
+
+        // Encode each block while it is still in cache from being transposed.
+        vbz_deinterleave_frames(
+            input + first_frame * stride * integer_size,
+            frames,
+            channel_count,
+            stride,
+            integer_size,
+            options->perform_delta_zig_zag,
+            previous,
+            block_buffer
+        );
+
+        auto const block = make_data_buffer(static_cast<char const*>(block_buffer), vbz_size_t(frames * frame_size));
+        auto const block_encoded_size = encode_integers(block, encoded_buffer.subspan(encoded_size), options);
+        if (vbz_is_error(block_encoded_size))
+        {
+            return block_encoded_size;
+        }
+        block_sizes[i] = block_encoded_size;
+        encoded_size += block_encoded_size;
+    }
+
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = zstd_compress(
+            payload.data(),
+            payload.size(),
+            encoded_buffer.data(),
+            encoded_size,
+            options->zstd_compression_level
+        );
+        if (ZSTD_isError(encoded_size))
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+    }
+
+    return vbz_size_t(header_size + encoded_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_interleaved(
+    void const* source,
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    vbz_size_t stride,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    // The frames' size is only known once the options are; calls with invalid options consume nothing.
+    auto const source_size = is_valid_integer_encoding_options(options)
+        ? std::uint64_t(frame_count) * channel_count * options->integer_size
+        : 0;
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, metrics_size(source_size));
+    return metrics.complete(
+        compress_interleaved(source, frame_count, channel_count, stride, destination, destination_capacity, options));
+}
+
+}
+
+namespace {
+
+vbz_size_t decompress_interleaved(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t stride,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto const channel_count = vbz_interleaved_channel_count(source, source_size);
+    if (vbz_is_error(channel_count))
+    {
+        return channel_count;
+    }
+    if (stride != 0 && stride < channel_count)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    auto const header = source_buffer.subspan(0, sizeof(VbzInterleavedHeader)).as_span<VbzInterleavedHeader const>()[0];
+    auto const integer_size = options->integer_size;
+    auto const frame_size = std::size_t(channel_count) * integer_size;
+    if (header.block_frames == 0 || header.original_size % frame_size != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const frame_count = header.original_size / frame_size;
+    auto const block_frames = std::size_t(header.block_frames);
+    auto required_capacity = std::uint64_t(header.original_size);
+    if (stride != 0 && frame_count != 0)
+    {
+        required_capacity = (std::uint64_t(frame_count - 1) * stride + channel_count) * integer_size;
+    }
+    if (destination_capacity < required_capacity)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto const block_count = (frame_count + block_frames - 1) / block_frames;
+    if (block_count > (source_buffer.size() - sizeof(VbzInterleavedHeader)) / sizeof(vbz_size_t))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header_size = interleaved_header_size(block_count);
+    auto const block_sizes = source_buffer.subspan(sizeof(VbzInterleavedHeader), header_size - sizeof(VbzInterleavedHeader)).as_span<vbz_size_t const>();
+    auto const payload = source_buffer.subspan(header_size);
+
+    // Blocks are no larger than the whole output, so their sizes fit a vbz_size_t.
+    auto const block_storage_size = std::min(block_frames, frame_count) * frame_size;
+    auto const max_block_size = max_encoded_size(vbz_size_t(block_storage_size), options);
+    if (vbz_is_error(max_block_size))
+    {
+        return max_block_size;
+    }
+
+    // A decoded block, each channel's last integer of the previous block, then (with zstd) an encoded block.
+    auto const encoded_storage_size = options->zstd_compression_level != 0 ? max_block_size : 0;
+    std::unique_ptr<void, free_delete> block_storage(malloc(block_storage_size + frame_size + encoded_storage_size));
+    if (!block_storage) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const block_buffer = static_cast<char*>(block_storage.get());
+    auto const previous = block_buffer + block_storage_size;
+    auto const encoded_storage = previous + frame_size;
+    std::fill(previous, previous + frame_size, 0);
+
+    // zstd is stream decoded a block at a time, so the intermediate buffer holds a single block.
+    ZstdStreamReader reader(payload);
+    if (options->zstd_compression_level != 0)
+    {
+        auto const result = reader.init();
+        if (vbz_is_error(result))
+        {
+            return result;
+        }
+    }
+
+    auto const output = static_cast<char*>(destination);
+    std::size_t payload_offset = 0;
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+        auto const encoded_size = block_sizes[i];
+        if (encoded_size > max_block_size)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+
+        gsl::span<char const> encoded_block;
+        if (options->zstd_compression_level != 0)
+        {
+            auto const encoded_buffer = make_data_buffer(encoded_storage, encoded_size);
+            auto const result = reader.read(encoded_buffer);
+            if (vbz_is_error(result))
+            {
+                return result;
+            }
+            encoded_block = encoded_buffer;
+        }
+        else
+        {
+            if (encoded_size > payload.size() - payload_offset)
+            {
+                return VBZ_INPUT_SIZE_ERROR;
+            }
+            encoded_block = payload.subspan(payload_offset, encoded_size);
+            payload_offset += encoded_size;
+        }
+
+        auto const first_frame = i * block_frames;
+        auto const frames = std::min(block_frames, frame_count - first_frame);
+        auto const decoded_size = decode_integers(
+            encoded_block,
+            make_data_buffer(block_buffer, vbz_size_t(frames * frame_size)),
+            options);
+        if (vbz_is_error(decoded_size))
+        {
+            return decoded_size;
+        }
+
+        if (stride == 0)
+        {
+            vbz_interleave_frames(block_buffer, frames, channel_count, integer_size, options->perform_delta_zig_zag,
+                                  previous, output + first_frame * integer_size, 1, frame_count);
+        }
+        else
+        {
+            vbz_interleave_frames(block_buffer, frames, channel_count, integer_size, options->perform_delta_zig_zag,
+                                  previous, output + first_frame * stride * integer_size, stride, 1);
+        }
+    }
+
+    return header.original_size;
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_decompress_interleaved(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t stride,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_interleaved(source, source_size, destination, destination_capacity, stride, options));
+}
+
+vbz_size_t vbz_interleaved_channel_count(
+    void const* source,
+    vbz_size_t source_size)
+{
+    auto const source_buffer = make_data_buffer(source, source_size);
+    if (source_buffer.size() < sizeof(VbzInterleavedHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header = source_buffer.subspan(0, sizeof(VbzInterleavedHeader)).as_span<VbzInterleavedHeader const>()[0];
+    if (header.channel_count == 0 || header.channel_count >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return header.channel_count;
+}
+
+vbz_size_t vbz_max_run_length_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (source_size % options->integer_size != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const max_values_size = vbz_max_compressed_size(source_size, options);
+    if (vbz_is_error(max_values_size))
+    {
+        return max_values_size;
+    }
+
+    auto const runs = run_options(options);
+    auto const max_runs_size = vbz_max_compressed_size(
+        vbz_size_t(vbz_max_run_count(source_size / options->integer_size) * run_record_size),
+        &runs);
+    if (vbz_is_error(max_runs_size))
+    {
+        return max_runs_size;
+    }
+
+    auto const max_size = std::uint64_t(sizeof(VbzRunLengthHeader)) + max_runs_size + max_values_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    auto const max_size = vbz_max_run_length_compressed_size(source_size, options);
+    if (vbz_is_error(max_size))
+    {
+        return max_size;
+    }
+
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    if (dest_buffer.size() < sizeof(VbzRunLengthHeader))
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    // The integers not in runs, followed by the runs.
+    auto const count = source_size / options->integer_size;
+    std::unique_ptr<void, free_delete> storage(malloc(source_size + vbz_max_run_count(count) * run_record_size));
+    if (!storage) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const kept = static_cast<char*>(storage.get());
+    auto const runs = reinterpret_cast<std::uint32_t*>(kept + source_size);
+
+    auto const run_count = vbz_collapse_runs(
+        source,
+        count,
+        options->integer_size,
+        options->perform_delta_zig_zag,
+        kept,
+        runs
+    );
+    std::size_t kept_count = count;
+    for (std::size_t r = 0; r < run_count; ++r)
+    {
+        kept_count -= runs[2 * r + 1];
+    }
+
+    auto const runs_compression = run_options(options);
+    auto payload = dest_buffer.subspan(sizeof(VbzRunLengthHeader));
+    auto const runs_size = compress_with_arena(
+        runs,
+        vbz_size_t(run_count * run_record_size),
+        payload.data(),
+        vbz_size_t(payload.size()),
+        &runs_compression,
+        nullptr
+    );
+    if (vbz_is_error(runs_size))
+    {
+        return runs_size;
+    }
+
+    payload = payload.subspan(runs_size);
+    auto const values_size = compress_with_arena(
+        kept,
+        vbz_size_t(kept_count * options->integer_size),
+        payload.data(),
+        vbz_size_t(payload.size()),
+        options,
+        nullptr
+    );
+    if (vbz_is_error(values_size))
+    {
+        return values_size;
+    }
+
+    auto header_span = dest_buffer.subspan(0, sizeof(VbzRunLengthHeader)).as_span<VbzRunLengthHeader>();
+    header_span[0].original_size = source_size;
+    header_span[0].run_count = vbz_size_t(run_count);
+    header_span[0].compressed_runs_size = runs_size;
+
+    return vbz_size_t(sizeof(VbzRunLengthHeader) + runs_size + values_size);
+}
+
+vbz_size_t decompress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_encoding_options(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    if (source_buffer.size() < sizeof(VbzRunLengthHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header = source_buffer.subspan(0, sizeof(VbzRunLengthHeader)).as_span<VbzRunLengthHeader const>()[0];
+    auto const integer_size = options->integer_size;
+    auto const count = std::size_t(header.original_size / integer_size);
+    auto const payload = source_buffer.subspan(sizeof(VbzRunLengthHeader));
+    if (header.original_size % integer_size != 0
+        || header.run_count > vbz_max_run_count(count)
+        || header.compressed_runs_size > payload.size())
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    if (destination_capacity < header.original_size)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto const runs_size = header.run_count * run_record_size;
+    std::unique_ptr<void, free_delete> runs_storage(malloc(std::max<std::size_t>(runs_size, 1)));
+    if (!runs_storage) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const runs = static_cast<std::uint32_t const*>(runs_storage.get());
+
+    auto const runs_compression = run_options(options);
+    auto const decompressed_runs_size = decompress_with_arena(
+        payload.data(),
+        header.compressed_runs_size,
+        runs_storage.get(),
+        vbz_size_t(runs_size),
+        &runs_compression,
+        nullptr
+    );
+    if (vbz_is_error(decompressed_runs_size))
+    {
+        return decompressed_runs_size;
+    }
+    if (decompressed_runs_size != runs_size)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    std::uint64_t collapsed_count = 0;
+    for (std::size_t r = 0; r < header.run_count; ++r)
+    {
+        collapsed_count += runs[2 * r + 1];
+    }
+    if (collapsed_count > count)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    // Decode the integers not in runs into the start of the destination, then expand the runs in place.
+    auto const kept_count = count - std::size_t(collapsed_count);
+    auto const values = payload.subspan(header.compressed_runs_size);
+    auto const decompressed_size = decompress_with_arena(
+        values.data(),
+        vbz_size_t(values.size()),
+        destination,
+        vbz_size_t(kept_count * integer_size),
+        options,
+        nullptr
+    );
+    if (vbz_is_error(decompressed_size))
+    {
+        return decompressed_size;
+    }
+    if (decompressed_size != kept_count * integer_size)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    if (!vbz_expand_runs(destination, kept_count, count, integer_size, options->perform_delta_zig_zag, runs, header.run_count))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return header.original_size;
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, source_size);
+    return metrics.complete(
+        compress_run_length(source, source_size, destination, destination_capacity, options));
+}
+
+vbz_size_t vbz_decompress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_run_length(source, source_size, destination, destination_capacity, options));
+}
+
+VbzScratchArena* vbz_create_scratch_arena(unsigned int page_mode)
+{
+    if (page_mode > VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES)
+    {
+        return nullptr;
+    }
+    return new (std::nothrow) VbzScratchArena(page_mode);
+}
+
+void vbz_free_scratch_arena(VbzScratchArena* arena)
+{
+    delete arena;
+}
+
+unsigned int vbz_scratch_arena_page_mode(VbzScratchArena const* arena)
+{
+    return arena->page_mode();
+}
 
 }
@@ -9,6 +9,10 @@ extern "C" {
 #endif
 
 #define VBZ_DEFAULT_VERSION 0
+// Version compressing 4 byte floats losslessly, by predicting each value from the previous one,
+// in place of delta zig zag + streamvbyte encoding. Requires an integer_size of 4, and ignores
+// perform_delta_zig_zag. Readers predating float support report VBZ_VERSION_ERROR for it.
+#define VBZ_FLOAT32_VERSION 0x100
 
 typedef uint32_t vbz_size_t;
 
@@ -19,7 +23,11 @@ typedef uint32_t vbz_size_t;
 #define VBZ_STREAMVBYTE_STREAM_ERROR ((vbz_size_t)-5)
 #define VBZ_VERSION_ERROR ((vbz_size_t)-6)
 #define VBZ_OUT_OF_MEMORY_ERROR ((vbz_size_t)-7)
-#define VBZ_FIRST_ERROR VBZ_OUT_OF_MEMORY_ERROR
+#define VBZ_CHECKSUM_ERROR ((vbz_size_t)-8)
+#define VBZ_ERROR_BOUND_ERROR ((vbz_size_t)-9)
+#define VBZ_IO_ERROR ((vbz_size_t)-10)
+#define VBZ_CANCELLED_ERROR ((vbz_size_t)-11)
+#define VBZ_FIRST_ERROR VBZ_CANCELLED_ERROR
 
 // Deprecated aliases.
 #define VBZ_STREAMVBYTE_INPUT_SIZE_ERROR VBZ_INPUT_SIZE_ERROR
@@ -49,6 +57,7 @@ struct CompressionOptions
     // version of vbz to apply.
     // Should be initialised to 'VBZ_DEFAULT_VERSION' for the best, newest compression.
     // of set to older values to decompress older streams.
+    // Set to 'VBZ_FLOAT32_VERSION' to compress 4 byte floats.
     unsigned int vbz_version;
 };
 
@@ -66,6 +75,20 @@ VBZ_EXPORT vbz_size_t vbz_max_compressed_size(
     vbz_size_t source_size,
     CompressionOptions const* options);
 
+/// \brief Estimate the compressed size of data, without compressing it.
+/// \note The estimate samples blocks of the source, summarising their streamvbyte keys and
+///       applying a model of zstd's compression ratio - it is much cheaper than #vbz_compress, and
+///       suitable for planning storage, but must not be used to size the destination of #vbz_compress
+///       (see #vbz_max_compressed_size).
+/// \param source               Source data for compression.
+/// \param source_size          Source data size (in bytes)
+/// \param options              Options which will be used to compress the data.
+/// \return The approximate size #vbz_compress would produce in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_estimate_compressed_size(
+    void const* source,
+    vbz_size_t source_size,
+    CompressionOptions const* options);
+
 /// \brief  Compress data into a provided output buffer
 /// \param source               Source data for compression.
 /// \param source_size          Source data size (in bytes)
@@ -98,6 +121,40 @@ VBZ_EXPORT vbz_size_t vbz_decompress(
     vbz_size_t destination_size,
     CompressionOptions const* options);
 
+/// \brief Find the buffer capacity required to decompress data in place with #vbz_decompress_in_place.
+/// \param source_size      The size of the compressed data in bytes.
+/// \param destination_size The size of the decompressed data in bytes.
+/// \param options          The options which will be used to decompress data.
+VBZ_EXPORT vbz_size_t vbz_in_place_decompression_capacity(
+    vbz_size_t source_size,
+    vbz_size_t destination_size,
+    CompressionOptions const* options);
+
+/// \brief Decompress data stored at the end of a buffer into the start of the same buffer.
+/// \note The compressed data must be placed in the final source_size bytes of buffer, the
+///       decompressed data is written to the first destination_size bytes. This avoids holding
+///       separate source and destination buffers when decompressing large blocks.
+/// \note Only some options decompress without holding data sized memory besides [buffer]:
+///       - Neither zstd nor integer encoding: nothing is allocated.
+///       - zstd alone: only zstd's fixed size decompression context (with zstd 1.5.4 or later,
+///         earlier versions also copy the compressed data).
+///       - Integer encoding alone: a copy of the compressed data.
+///       - zstd and integer encoding: zstd's context and the integer encoded data zstd decodes to,
+///         as #vbz_decompress holds, so only the separate destination is saved.
+/// \param buffer               Buffer holding the compressed data at its end.
+/// \param buffer_capacity      Size of buffer in bytes, must be at least #vbz_in_place_decompression_capacity.
+/// \param source_size          Compressed Source data size (in bytes)
+/// \param destination_size     Number of expected decompressed bytes (see #vbz_decompress).
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress).
+/// \return The size of the decompressed object in bytes (will equal destination_size unless an error occurs).
+VBZ_EXPORT vbz_size_t vbz_decompress_in_place(
+    void* buffer,
+    vbz_size_t buffer_capacity,
+    vbz_size_t source_size,
+    vbz_size_t destination_size,
+    CompressionOptions const* options);
+
 /// \brief Compress data into a provided output buffer, with the original size information stored.
 /// \note Must decompress data with #vbz_decompress_sized.
 /// \param source               Source data for compression.
@@ -129,9 +186,281 @@ VBZ_EXPORT vbz_size_t vbz_decompress_sized(
     vbz_size_t destination_capacity,
     CompressionOptions const* options);
 
+/// \brief Find a theoretical max size for compressed output of #vbz_compress_checksummed.
+/// \param source_size      The size of the source buffer for compression in bytes.
+/// \param options          The options which will be used to compress data.
+VBZ_EXPORT vbz_size_t vbz_max_checksummed_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options);
+
+/// \brief Compress data with the original size and a checksum of each block of the original data stored.
+/// \note Each 64KB block of the source is checksummed (CRC32C, hardware accelerated where available) just
+///       before it is encoded, and verified just after it is decoded by #vbz_decompress_checksummed, while
+///       the block is still in cache. Must decompress data with #vbz_decompress_checksummed.
+/// \param source               Source data for compression.
+/// \param source_size          Source data size (in bytes)
+/// \param destination          Destination buffer for compressed output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_checksummed_compressed_size)
+/// \param options              Options controlling compression to apply.
+/// \return The size of the compressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Decompress data stored with #vbz_compress_checksummed, verifying the checksum of every block.
+/// \param source               Source compressed data for decompression.
+/// \param source_size          Compressed Source data size (in bytes)
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least #vbz_decompressed_size bytes.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_checksummed).
+/// \return The size of the decompressed object in bytes, VBZ_CHECKSUM_ERROR if a block does not match its
+///         checksum, or another error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Recompress data stored with #vbz_compress_sized using [source_options] as if it had been compressed
+///        with [destination_options], e.g. to move an archive to a different zstd level.
+/// \note When the options differ only in zstd level (or in vbz version, for integer size 0) the integers are
+///       already encoded as [destination_options] would encode them, so only zstd is rerun over the encoded
+///       stream, and the delta zig zag and streamvbyte layers are skipped. Otherwise (e.g. switching between
+///       vbz versions 0 and 1) the data is fully decompressed and compressed again.
+/// \param source               Source data, as written by #vbz_compress_sized.
+/// \param source_size          Source data size (in bytes)
+/// \param destination          Destination buffer for the recompressed output.
+/// \param destination_capacity Size of the destination buffer to write to, enough for
+///                             #vbz_max_compressed_size of #vbz_decompressed_size plus the 4 byte size header.
+/// \param source_options       Options the source was compressed with.
+/// \param destination_options  Options to recompress with.
+/// \return The size of the recompressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_transcode_sized(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options);
+
+/// \brief Recompress data stored with #vbz_compress_checksummed using [source_options] as if it had been
+///        compressed with [destination_options], as #vbz_transcode_sized does for sized data.
+/// \note Only zstd is rerun when the encoding is unchanged, the block checksums are carried over without
+///       being verified. They are verified as usual when the data is fully decompressed.
+/// \param destination_capacity Size of the destination buffer to write to
+///                             (see #vbz_max_checksummed_transcoded_size).
+VBZ_EXPORT vbz_size_t vbz_transcode_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options);
+
+/// \brief Find a theoretical max size for the output of #vbz_transcode_checksummed transcoding [source].
+/// \note Merged data (see #vbz_merge_checksummed) keeps its layout when only zstd is rerun, so can need
+///       more than #vbz_max_checksummed_compressed_size of its decompressed size.
+VBZ_EXPORT vbz_size_t vbz_max_checksummed_transcoded_size(
+    void const* source,
+    vbz_size_t source_size,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options);
+
+/// \brief Find a theoretical max size for the output of #vbz_merge_checksummed.
+/// \param first_size       The size of the first part in bytes.
+/// \param second_size      The size of the second part in bytes.
+VBZ_EXPORT vbz_size_t vbz_max_merged_checksummed_size(
+    vbz_size_t first_size,
+    vbz_size_t second_size);
+
+/// \brief Merge two parts stored with #vbz_compress_checksummed (or merged before) into data decompressing
+///        to the first part's data followed by the second's, e.g. to join the segments of a read.
+/// \note Every checksummed block is encoded independently, so nothing is decoded or encoded again: the
+///       block tables of the parts are joined and their compressed blocks copied. When the first part ends
+///       on a whole block the result is plain checksummed data, otherwise the parts are kept as segments of
+///       merged data, which #vbz_decompress_checksummed, #vbz_transcode_checksummed and this function read.
+/// \param first                The first part.
+/// \param first_size           The first part's size (in bytes)
+/// \param second               The second part.
+/// \param second_size          The second part's size (in bytes)
+/// \param destination          Destination buffer for the merged output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_merged_checksummed_size)
+/// \param options              Options both parts were compressed with.
+/// \return The size of the merged object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_merge_checksummed(
+    void const* first,
+    vbz_size_t first_size,
+    void const* second,
+    vbz_size_t second_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Find a theoretical max size for compressed output of #vbz_compress_bounded_error.
+/// \param source_size      The size of the source buffer for compression in bytes.
+/// \param options          The options which will be used to compress data.
+VBZ_EXPORT vbz_size_t vbz_max_bounded_error_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options);
+
+/// \brief Compress integers lossily, with every decompressed value guaranteed to be within
+///        [max_absolute_error] of the original.
+/// \note Differences between neighbouring values are quantised to multiples of (2 * max_absolute_error + 1)
+///       before delta zig zag and streamvbyte encoding, which removes most of the noise the encoding
+///       otherwise stores. Delta zig zag is always applied, whatever perform_delta_zig_zag is set to.
+///       The original size and the bound are stored in a header (see #vbz_bounded_error_max_absolute_error).
+///       Integers are treated as signed when perform_delta_zig_zag is set, and unsigned otherwise.
+///       Must decompress data with #vbz_decompress_bounded_error.
+/// \param source               Source data for compression.
+/// \param source_size          Source data size (in bytes)
+/// \param destination          Destination buffer for compressed output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_bounded_error_compressed_size)
+/// \param max_absolute_error   Largest difference allowed between a value and its decompressed value,
+///                             between 1 and INT32_MAX (use #vbz_compress for lossless compression).
+/// \param options              Options controlling compression to apply, integer_size must be 1, 2 or 4.
+/// \return The size of the compressed object in bytes, VBZ_ERROR_BOUND_ERROR if [max_absolute_error] is
+///         out of range, or another error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t max_absolute_error,
+    CompressionOptions const* options);
+
+/// \brief Decompress data stored with #vbz_compress_bounded_error.
+/// \param source               Source compressed data for decompression.
+/// \param source_size          Compressed Source data size (in bytes)
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least #vbz_decompressed_size bytes.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_bounded_error).
+/// \return The size of the decompressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_bounded_error(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Find the error bound data from #vbz_compress_bounded_error was compressed with.
+/// \param source           Source compressed data.
+/// \param source_size      The size of the compressed source buffer in bytes.
+/// \return The max_absolute_error passed to #vbz_compress_bounded_error, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_bounded_error_max_absolute_error(
+    void const* source,
+    vbz_size_t source_size);
+
+/// \brief Find a theoretical max size for compressed output of #vbz_compress_interleaved.
+/// \param frame_count      The number of frames to compress.
+/// \param channel_count    The number of channels in each frame.
+/// \param options          The options which will be used to compress data.
+VBZ_EXPORT vbz_size_t vbz_max_interleaved_compressed_size(
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    CompressionOptions const* options);
+
+/// \brief Compress frames of interleaved channels, without de-interleaving them first.
+/// \note Blocks of frames are transposed into channel major order as they are encoded, and each channel
+///       is delta zig zag encoded against its own previous integer (when perform_delta_zig_zag is set).
+///       The original size and channel count are stored in a header (see #vbz_interleaved_channel_count).
+///       Must decompress data with #vbz_decompress_interleaved.
+/// \param source               Source frames, each frame holding an integer per channel.
+/// \param frame_count          The number of frames in [source].
+/// \param channel_count        The number of channels in each frame.
+/// \param stride               Integers between the starts of consecutive frames, at least [channel_count].
+/// \param destination          Destination buffer for compressed output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_interleaved_compressed_size)
+/// \param options              Options controlling compression to apply, integer_size must be 1, 2 or 4.
+/// \return The size of the compressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_interleaved(
+    void const* source,
+    vbz_size_t frame_count,
+    vbz_size_t channel_count,
+    vbz_size_t stride,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Decompress data stored with #vbz_compress_interleaved, either re-interleaving the frames or
+///        leaving each channel's integers contiguous.
+/// \param source               Source compressed data for decompression.
+/// \param source_size          Compressed Source data size (in bytes)
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least #vbz_decompressed_size
+///                             bytes, or enough for every frame at [stride] when re-interleaving.
+/// \param stride               Integers between the starts of consecutive frames written to [destination],
+///                             at least the channel count, or 0 to write each channel's integers contiguously
+///                             (channel by channel). Integers between the channels of a frame are left untouched.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_interleaved).
+/// \return The size of the decompressed integers in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_interleaved(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    vbz_size_t stride,
+    CompressionOptions const* options);
+
+/// \brief Find the number of channels data from #vbz_compress_interleaved holds.
+/// \param source           Source compressed data.
+/// \param source_size      The size of the compressed source buffer in bytes.
+/// \return The channel_count passed to #vbz_compress_interleaved, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_interleaved_channel_count(
+    void const* source,
+    vbz_size_t source_size);
+
+/// \brief Find a theoretical max size for compressed output of #vbz_compress_run_length.
+/// \param source_size      The size of the source buffer for compression in bytes.
+/// \param options          The options which will be used to compress data.
+VBZ_EXPORT vbz_size_t vbz_max_run_length_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options);
+
+/// \brief Compress integers with long runs, such as sparse masks and move tables, collapsing each run
+///        into a single record before streamvbyte encoding.
+/// \note Runs of constant deltas are collapsed when perform_delta_zig_zag is set, and runs of a constant
+///       value otherwise, either way long stretches of zeros are collapsed. Runs must be at least 32
+///       integers long. The integers outside runs are compressed as #vbz_compress would.
+///       Must decompress data with #vbz_decompress_run_length.
+/// \param source               Source data for compression.
+/// \param source_size          Source data size (in bytes)
+/// \param destination          Destination buffer for compressed output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_run_length_compressed_size)
+/// \param options              Options controlling compression to apply, integer_size must be 1, 2 or 4.
+/// \return The size of the compressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Decompress data stored with #vbz_compress_run_length.
+/// \param source               Source compressed data for decompression.
+/// \param source_size          Compressed Source data size (in bytes)
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least #vbz_decompressed_size bytes.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_run_length).
+/// \return The size of the decompressed object in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_run_length(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
 /// \brief Find the size for a decompressed block.
 ///        should be used to find the size of the destination buffer to allocate for decompression.
-/// \note This is only valid for use with data from #vbz_compress_sized.
+/// \note This is only valid for use with data from #vbz_compress_sized, #vbz_compress_checksummed,
+///       #vbz_compress_bounded_error, #vbz_compress_interleaved or #vbz_compress_run_length.
 /// \param source           Source compressed data for decompression.
 /// \param source_size      The size of the compressed source buffer in bytes.
 /// \param options          The options which will be used to decompress data.
@@ -140,6 +469,132 @@ VBZ_EXPORT vbz_size_t vbz_decompressed_size(
     vbz_size_t source_size,
     CompressionOptions const* options);
 
+/// \brief Find a theoretical max size for a compressed batch of reads.
+///        should be used to find the size of the destination buffer to allocate for #vbz_compress_batch.
+/// \param source_sizes     The size of each read in bytes.
+/// \param read_count       The number of reads in the batch.
+/// \param options          The options which will be used to compress data.
+VBZ_EXPORT vbz_size_t vbz_max_batch_compressed_size(
+    vbz_size_t const* source_sizes,
+    vbz_size_t read_count,
+    CompressionOptions const* options);
+
+/// \brief Compress many reads into a single batch, sharing one zstd frame between them.
+/// \note Each read is streamvbyte encoded separately, then the encodings are compressed as one zstd frame
+///       so redundancy across reads is exploited and the frame overhead is paid once. The size and
+///       position of each read is stored with the batch, see #vbz_decompress_batch_read.
+/// \param sources              Source data for each read.
+/// \param source_sizes         Source data size of each read (in bytes)
+/// \param read_count           The number of reads in the batch.
+/// \param destination          Destination buffer for compressed output.
+/// \param destination_capacity Size of the destination buffer to write to (see #vbz_max_batch_compressed_size)
+/// \param options              Options controlling compression to apply.
+/// \return The size of the compressed batch in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_batch(
+    void const* const* sources,
+    vbz_size_t const* source_sizes,
+    vbz_size_t read_count,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Find the number of reads stored in a batch from #vbz_compress_batch.
+/// \param source           Source compressed batch.
+/// \param source_size      The size of the compressed batch in bytes.
+VBZ_EXPORT vbz_size_t vbz_batch_read_count(
+    void const* source,
+    vbz_size_t source_size);
+
+/// \brief Find the decompressed size of one read stored in a batch from #vbz_compress_batch.
+/// \param source           Source compressed batch.
+/// \param source_size      The size of the compressed batch in bytes.
+/// \param read_index       Index of the read in the batch.
+VBZ_EXPORT vbz_size_t vbz_batch_decompressed_size(
+    void const* source,
+    vbz_size_t source_size,
+    vbz_size_t read_index);
+
+/// \brief Decompress one read from a batch.
+/// \note The shared zstd frame is stream decoded only as far as the end of the requested read.
+/// \param source               Source compressed batch.
+/// \param source_size          The size of the compressed batch in bytes.
+/// \param read_index           Index of the read to decompress.
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least #vbz_batch_decompressed_size bytes.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_batch).
+/// \return The size of the decompressed read in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_batch_read(
+    void const* source,
+    vbz_size_t source_size,
+    vbz_size_t read_index,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+/// \brief Decompress every read in a batch, writing the reads one after another in batch order.
+/// \param source               Source compressed batch.
+/// \param source_size          The size of the compressed batch in bytes.
+/// \param destination          Destination buffer for decompressed output.
+/// \param destination_capacity Capacity of the destination buffer, should be at least the sum of
+///                             #vbz_batch_decompressed_size for every read.
+/// \param options              Options controlling decompression to
+///                             apply (must be the same as the arguments passed to #vbz_compress_batch).
+/// \return The total size of the decompressed reads in bytes, or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_batch(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options);
+
+// Page modes for #vbz_create_scratch_arena.
+// Back the arena with normal pages.
+#define VBZ_SCRATCH_ARENA_DEFAULT_PAGES 0
+// Back the arena with transparent huge pages (madvise MADV_HUGEPAGE), falling back to normal pages.
+#define VBZ_SCRATCH_ARENA_TRANSPARENT_HUGE_PAGES 1
+// Back the arena with reserved huge pages (mmap MAP_HUGETLB), falling back to transparent then normal pages.
+#define VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES 2
+
+/// \brief Scratch memory kept resident across calls to #vbz_compress_with_arena and #vbz_decompress_with_arena.
+typedef struct VbzScratchArena VbzScratchArena;
+
+/// \brief Create a scratch arena, avoiding the page faults of allocating intermediate buffers on every call
+///        when compressing large (multi megabyte) chunks.
+/// \note An arena is not thread safe, use one per thread. Huge pages are only used on linux.
+/// \param page_mode    One of the VBZ_SCRATCH_ARENA_* page modes.
+/// \return The new arena, to be freed with #vbz_free_scratch_arena, or null if it could not be created.
+VBZ_EXPORT VbzScratchArena* vbz_create_scratch_arena(unsigned int page_mode);
+
+/// \brief Free an arena created by #vbz_create_scratch_arena.
+VBZ_EXPORT void vbz_free_scratch_arena(VbzScratchArena* arena);
+
+/// \brief Find the page mode an arena's memory is currently backed by, after any fallbacks.
+/// \return One of the VBZ_SCRATCH_ARENA_* page modes, VBZ_SCRATCH_ARENA_DEFAULT_PAGES until the arena is first used.
+VBZ_EXPORT unsigned int vbz_scratch_arena_page_mode(VbzScratchArena const* arena);
+
+/// \brief Compress data as #vbz_compress, taking intermediate buffers from [arena].
+/// \param arena    Arena to take intermediate buffers from, or null to allocate them as #vbz_compress does.
+/// \return The number of bytes used to compress data into [destination], or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_compress_with_arena(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options,
+    VbzScratchArena* arena);
+
+/// \brief Decompress data as #vbz_decompress, taking intermediate buffers from [arena].
+/// \param arena    Arena to take intermediate buffers from, or null to allocate them as #vbz_decompress does.
+/// \return The number of bytes used to decompress data into [destination], or an error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_decompress_with_arena(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size,
+    CompressionOptions const* options,
+    VbzScratchArena* arena);
+
 #if defined(__cplusplus)
 }
 #endif
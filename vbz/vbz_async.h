@@ -0,0 +1,126 @@
+#pragma once
+
+// Coroutine interface to vbz, for services which can't block their threads on compression:
+//
+//     auto compressed_size = co_await vbz::compress_async(source, destination, options, stop_token);
+//
+// Each await submits a #VbzAsyncJob held in the coroutine frame to a #VbzAsyncPool, and suspends until a
+// worker has run it, so awaiting allocates nothing once the pool is started. The coroutine resumes on the
+// worker thread, reschedule onto an executor after the await if needed. Requires C++20.
+
+#include "vbz_async_pool.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <stop_token>
+
+namespace vbz {
+
+/// \brief Awaitable running a #VbzAsyncJob on a pool, resuming with its vbz_size_t result.
+class AsyncCall
+{
+public:
+    AsyncCall(
+        VbzAsyncJob::Function function,
+        std::span<std::byte const> source,
+        std::span<std::byte> destination,
+        CompressionOptions const& options,
+        std::stop_token stop_token,
+        VbzAsyncPool& pool)
+    : m_pool(pool)
+    , m_stop_token(std::move(stop_token))
+    {
+        m_job.function = function;
+        m_job.source = source.data();
+        m_job.source_size = vbz_size_t(source.size());
+        m_job.destination = destination.data();
+        m_job.destination_capacity = vbz_size_t(destination.size());
+        m_job.options = options;
+        m_job.complete = &resume;
+        m_job.result = VBZ_CANCELLED_ERROR;
+    }
+
+    AsyncCall(AsyncCall const&) = delete;
+    AsyncCall& operator=(AsyncCall const&) = delete;
+
+    // Don't suspend if stop has already been requested.
+    bool await_ready() const noexcept { return m_stop_token.stop_requested(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_job.context = handle.address();
+        // Registered before submitting, as a worker may resume (and destroy) this as soon as the job is queued.
+        // Cancelling never resumes the coroutine itself, a worker does.
+        m_stop_callback.emplace(m_stop_token, Cancel{ this });
+        m_pool.submit(m_job);
+    }
+
+    vbz_size_t await_resume() const noexcept { return m_job.result; }
+
+private:
+    struct Cancel
+    {
+        AsyncCall* call;
+        void operator()() const noexcept { call->m_pool.cancel(call->m_job); }
+    };
+
+    static void resume(VbzAsyncJob& job)
+    {
+        std::coroutine_handle<>::from_address(job.context).resume();
+    }
+
+    VbzAsyncPool& m_pool;
+    std::stop_token m_stop_token;
+    VbzAsyncJob m_job{};
+    std::optional<std::stop_callback<Cancel>> m_stop_callback;
+};
+
+/// \brief Compress [source] into [destination] as #vbz_compress on [pool].
+/// \return An awaitable resuming with the compressed size, an error code if something went wrong, or
+///         VBZ_CANCELLED_ERROR if [stop_token] was stopped before compression started.
+inline AsyncCall compress_async(
+    std::span<std::byte const> source,
+    std::span<std::byte> destination,
+    CompressionOptions const& options,
+    std::stop_token stop_token = {},
+    VbzAsyncPool& pool = VbzAsyncPool::default_pool())
+{
+    return AsyncCall(&vbz_compress, source, destination, options, std::move(stop_token), pool);
+}
+
+/// \brief Decompress [source] into [destination] as #vbz_decompress on [pool].
+inline AsyncCall decompress_async(
+    std::span<std::byte const> source,
+    std::span<std::byte> destination,
+    CompressionOptions const& options,
+    std::stop_token stop_token = {},
+    VbzAsyncPool& pool = VbzAsyncPool::default_pool())
+{
+    return AsyncCall(&vbz_decompress, source, destination, options, std::move(stop_token), pool);
+}
+
+/// \brief Compress [source] into [destination] as #vbz_compress_sized on [pool].
+inline AsyncCall compress_sized_async(
+    std::span<std::byte const> source,
+    std::span<std::byte> destination,
+    CompressionOptions const& options,
+    std::stop_token stop_token = {},
+    VbzAsyncPool& pool = VbzAsyncPool::default_pool())
+{
+    return AsyncCall(&vbz_compress_sized, source, destination, options, std::move(stop_token), pool);
+}
+
+/// \brief Decompress [source] into [destination] as #vbz_decompress_sized on [pool].
+inline AsyncCall decompress_sized_async(
+    std::span<std::byte const> source,
+    std::span<std::byte> destination,
+    CompressionOptions const& options,
+    std::stop_token stop_token = {},
+    VbzAsyncPool& pool = VbzAsyncPool::default_pool())
+{
+    return AsyncCall(&vbz_decompress_sized, source, destination, options, std::move(stop_token), pool);
+}
+
+}
@@ -0,0 +1,121 @@
+#include "vbz_async_pool.h"
+
+#include <algorithm>
+
+VbzAsyncPool::VbzAsyncPool(std::size_t worker_count)
+{
+    if (worker_count == 0)
+    {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < worker_count; ++i)
+    {
+        m_workers.emplace_back([this] { run(); });
+    }
+}
+
+VbzAsyncPool::~VbzAsyncPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (auto job = m_front; job; job = job->next)
+        {
+            job->cancelled = true;
+        }
+    }
+    m_submitted.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+VbzAsyncPool& VbzAsyncPool::default_pool()
+{
+    static VbzAsyncPool pool(0);
+    return pool;
+}
+
+void VbzAsyncPool::submit(VbzAsyncJob& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job.queued = true;
+        job.cancelled = job.cancelled || m_stopping;
+        job.previous = m_back;
+        job.next = nullptr;
+        (m_back ? m_back->next : m_front) = &job;
+        m_back = &job;
+    }
+    m_submitted.notify_one();
+}
+
+void VbzAsyncPool::cancel(VbzAsyncJob& job)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!job.queued)
+    {
+        // Not submitted yet (or already started, when this has no effect).
+        job.cancelled = true;
+        return;
+    }
+    if (!job.cancelled)
+    {
+        job.cancelled = true;
+        unlink(job);
+        link_front(job);
+    }
+}
+
+void VbzAsyncPool::link_front(VbzAsyncJob& job)
+{
+    job.previous = nullptr;
+    job.next = m_front;
+    (m_front ? m_front->previous : m_back) = &job;
+    m_front = &job;
+}
+
+void VbzAsyncPool::unlink(VbzAsyncJob& job)
+{
+    (job.previous ? job.previous->next : m_front) = job.next;
+    (job.next ? job.next->previous : m_back) = job.previous;
+    job.previous = nullptr;
+    job.next = nullptr;
+}
+
+void VbzAsyncPool::run()
+{
+    for (;;)
+    {
+        VbzAsyncJob* job;
+        bool cancelled;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_submitted.wait(lock, [&] { return m_stopping || m_front; });
+            if (!m_front)
+            {
+                return;
+            }
+            job = m_front;
+            unlink(*job);
+            job->queued = false;
+            cancelled = job->cancelled;
+        }
+
+        // The job may be freed as soon as it completes, it isn't touched afterwards.
+        if (cancelled)
+        {
+            job->result = VBZ_CANCELLED_ERROR;
+        }
+        else if (job->run)
+        {
+            job->result = job->run(*job);
+        }
+        else
+        {
+            job->result = job->function(job->source, job->source_size, job->destination, job->destination_capacity, &job->options);
+        }
+        job->complete(*job);
+    }
+}
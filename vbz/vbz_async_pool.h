@@ -0,0 +1,81 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "vbz.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// \brief A call to one of the vbz compression functions sharing #vbz_compress's signature
+///        (vbz_compress, vbz_decompress, vbz_compress_sized, vbz_decompress_sized), run by a #VbzAsyncPool.
+///
+/// Jobs are linked into the pool's queue in place, so submitting one never allocates. The job must stay
+/// alive until [complete] is called, and start with [queued] and [cancelled] false.
+struct VbzAsyncJob
+{
+    typedef vbz_size_t (*Function)(void const*, vbz_size_t, void*, vbz_size_t, CompressionOptions const*);
+    typedef vbz_size_t (*Run)(VbzAsyncJob& job);
+
+    Function function;
+    /// Called instead of [function] when set, for calls needing more than the job's options, found through [context].
+    Run run;
+    void const* source;
+    vbz_size_t source_size;
+    void* destination;
+    vbz_size_t destination_capacity;
+    CompressionOptions options;
+
+    /// Called on a worker thread once [result] is set, VBZ_CANCELLED_ERROR if the job was cancelled first.
+    void (*complete)(VbzAsyncJob& job);
+    void* context;
+    vbz_size_t result;
+
+    // Owned by the pool while the job is submitted.
+    VbzAsyncJob* previous;
+    VbzAsyncJob* next;
+    bool queued;
+    bool cancelled;
+};
+
+/// \brief Threads running #VbzAsyncJob, in the order submitted.
+class VBZ_EXPORT VbzAsyncPool
+{
+public:
+    /// \param worker_count     The number of threads, or 0 for one per core.
+    explicit VbzAsyncPool(std::size_t worker_count);
+
+    /// \brief Waits for the jobs already running, jobs still queued complete as cancelled.
+    ~VbzAsyncPool();
+
+    VbzAsyncPool(VbzAsyncPool const&) = delete;
+    VbzAsyncPool& operator=(VbzAsyncPool const&) = delete;
+
+    /// \brief The pool used when none is given, started on first use with a thread per core.
+    static VbzAsyncPool& default_pool();
+
+    /// \brief Queue [job] to run on a worker.
+    void submit(VbzAsyncJob& job);
+
+    /// \brief Complete [job] as cancelled, without running it, if no worker has started it.
+    /// \note A queued job is moved to the front of the queue, so it still completes on a worker thread,
+    ///       but without waiting behind the jobs submitted before it. A job not yet submitted is
+    ///       cancelled once it is.
+    void cancel(VbzAsyncJob& job);
+
+    std::size_t worker_count() const { return m_workers.size(); }
+
+private:
+    void run();
+    void link_front(VbzAsyncJob& job);
+    void unlink(VbzAsyncJob& job);
+
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;
+    VbzAsyncJob* m_front = nullptr;
+    VbzAsyncJob* m_back = nullptr;
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,478 @@
+#include "vbz_codec.h"
+#include "vbz_metrics_scope.h"
+
+#include <gsl/gsl-lite.hpp>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+
+// include last - it uses c headers which can mess things up.
+#include "vbz.h"
+
+using namespace vbz::detail;
+
+namespace {
+
+// A batch is a VbzBatchHeader, a VbzBatchEntry per read, then the encoded reads concatenated
+// into a single zstd frame (or stored directly when zstd is disabled).
+struct VbzBatchHeader
+{
+    vbz_size_t read_count;
+};
+
+struct VbzBatchEntry
+{
+    vbz_size_t original_size;
+    // Position of the read's streamvbyte encoding within the decoded frame.
+    vbz_size_t encoded_offset;
+    vbz_size_t encoded_size;
+};
+
+std::size_t batch_header_size(std::size_t read_count)
+{
+    return sizeof(VbzBatchHeader) + read_count * sizeof(VbzBatchEntry);
+}
+
+// Split [source] into its batch entries and encoded payload. Returns 0 or an error code.
+vbz_size_t parse_batch(
+    gsl::span<char const> source,
+    gsl::span<VbzBatchEntry const>& entries,
+    gsl::span<char const>& payload)
+{
+    if (source.size() < sizeof(VbzBatchHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header = source.subspan(0, sizeof(VbzBatchHeader)).as_span<VbzBatchHeader const>().begin();
+    if (header->read_count > (source.size() - sizeof(VbzBatchHeader)) / sizeof(VbzBatchEntry))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const header_size = batch_header_size(header->read_count);
+    entries = source.subspan(sizeof(VbzBatchHeader), header_size - sizeof(VbzBatchHeader)).as_span<VbzBatchEntry const>();
+    payload = source.subspan(header_size);
+    return 0;
+}
+
+bool entry_in_range(VbzBatchEntry const& entry, std::size_t encoded_size)
+{
+    return entry.encoded_offset <= encoded_size
+        && entry.encoded_size <= encoded_size - entry.encoded_offset;
+}
+
+// Stream decode [frame], discarding the first [offset] decoded bytes then filling [destination].
+// Decoding stops as soon as [destination] is full, the rest of the frame is never touched.
+vbz_size_t stream_decompress_range(
+    gsl::span<char const> frame,
+    std::size_t offset,
+    gsl::span<char> destination)
+{
+    ZstdStreamReader reader(frame);
+    auto result = reader.init();
+    if (!vbz_is_error(result))
+    {
+        result = reader.skip(offset);
+    }
+    if (!vbz_is_error(result))
+    {
+        result = reader.read(destination);
+    }
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+    return vbz_size_t(destination.size());
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_max_batch_compressed_size(
+    vbz_size_t const* source_sizes,
+    vbz_size_t read_count,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    std::uint64_t encoded_size = 0;
+    for (vbz_size_t i = 0; i < read_count; ++i)
+    {
+        auto const read_size = max_encoded_size(source_sizes[i], options);
+        if (vbz_is_error(read_size))
+        {
+            return read_size;
+        }
+        encoded_size += read_size;
+    }
+
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = ZSTD_compressBound(std::size_t(std::min<std::uint64_t>(encoded_size, VBZ_FIRST_ERROR)));
+    }
+
+    auto const max_size = batch_header_size(read_count) + encoded_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_batch(
+    void const* const* sources,
+    vbz_size_t const* source_sizes,
+    vbz_size_t read_count,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    auto const header_size = batch_header_size(read_count);
+    if (header_size > dest_buffer.size())
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto header_span = dest_buffer.subspan(0, sizeof(VbzBatchHeader)).as_span<VbzBatchHeader>();
+    header_span[0].read_count = read_count;
+    auto entries = dest_buffer.subspan(sizeof(VbzBatchHeader), header_size - sizeof(VbzBatchHeader)).as_span<VbzBatchEntry>();
+    auto payload = dest_buffer.subspan(header_size);
+
+    // Encode every read into one buffer, so zstd can match across reads. Without zstd the
+    // encodings are written straight into the destination.
+    std::unique_ptr<void, free_delete> intermediate_storage;
+    auto encoded_buffer = payload;
+    if (options->zstd_compression_level != 0)
+    {
+        auto const max_size = vbz_max_batch_compressed_size(source_sizes, read_count, options);
+        if (vbz_is_error(max_size))
+        {
+            return max_size;
+        }
+        intermediate_storage.reset(malloc(max_size));
+        if (!intermediate_storage) {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+        encoded_buffer = make_data_buffer(intermediate_storage.get(), max_size);
+    }
+
+    std::size_t encoded_size = 0;
+    for (vbz_size_t i = 0; i < read_count; ++i)
+    {
+        auto const read_size = encode_integers(
+            make_data_buffer(sources[i], source_sizes[i]),
+            encoded_buffer.subspan(encoded_size),
+            options
+        );
+        if (vbz_is_error(read_size))
+        {
+            return read_size;
+        }
+
+        entries[i].original_size = source_sizes[i];
+        entries[i].encoded_offset = vbz_size_t(encoded_size);
+        entries[i].encoded_size = read_size;
+        encoded_size += read_size;
+    }
+
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = zstd_compress(
+            payload.data(),
+            payload.size(),
+            encoded_buffer.data(),
+            encoded_size,
+            options->zstd_compression_level
+        );
+        if (ZSTD_isError(encoded_size))
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+    }
+
+    return vbz_size_t(header_size + encoded_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_batch(
+    void const* const* sources,
+    vbz_size_t const* source_sizes,
+    vbz_size_t read_count,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    auto const source_size = std::accumulate(source_sizes, source_sizes + read_count, std::uint64_t(0));
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, metrics_size(source_size));
+    return metrics.complete(
+        compress_batch(sources, source_sizes, read_count, destination, destination_capacity, options));
+}
+
+vbz_size_t vbz_batch_read_count(
+    void const* source,
+    vbz_size_t source_size)
+{
+    gsl::span<VbzBatchEntry const> entries;
+    gsl::span<char const> payload;
+    auto const result = parse_batch(make_data_buffer(source, source_size), entries, payload);
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+    return vbz_size_t(entries.size());
+}
+
+vbz_size_t vbz_batch_decompressed_size(
+    void const* source,
+    vbz_size_t source_size,
+    vbz_size_t read_index)
+{
+    gsl::span<VbzBatchEntry const> entries;
+    gsl::span<char const> payload;
+    auto const result = parse_batch(make_data_buffer(source, source_size), entries, payload);
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+    if (read_index >= entries.size())
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return entries[read_index].original_size;
+}
+
+}
+
+namespace {
+
+vbz_size_t decompress_batch_read(
+    void const* source,
+    vbz_size_t source_size,
+    vbz_size_t read_index,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    gsl::span<VbzBatchEntry const> entries;
+    gsl::span<char const> payload;
+    auto const result = parse_batch(make_data_buffer(source, source_size), entries, payload);
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+    if (read_index >= entries.size())
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const& entry = entries[read_index];
+    if (destination_capacity < entry.original_size)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+    auto dest_buffer = make_data_buffer(destination, entry.original_size);
+
+    if (options->zstd_compression_level == 0)
+    {
+        if (!entry_in_range(entry, payload.size()))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        return decode_integers(payload.subspan(entry.encoded_offset, entry.encoded_size), dest_buffer, options);
+    }
+
+    // Without streamvbyte the decoded frame holds the read as is, stream it straight to the destination.
+    if (options->integer_size == 0)
+    {
+        if (entry.encoded_size != entry.original_size)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        return stream_decompress_range(payload, entry.encoded_offset, dest_buffer);
+    }
+
+    std::unique_ptr<void, free_delete> encoded_storage(malloc(std::max<std::size_t>(entry.encoded_size, 1)));
+    if (!encoded_storage) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    auto const encoded_buffer = make_data_buffer(encoded_storage.get(), entry.encoded_size);
+    auto const decoded_size = stream_decompress_range(payload, entry.encoded_offset, encoded_buffer);
+    if (vbz_is_error(decoded_size))
+    {
+        return decoded_size;
+    }
+    return decode_integers(encoded_buffer, dest_buffer, options);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_decompress_batch_read(
+    void const* source,
+    vbz_size_t source_size,
+    vbz_size_t read_index,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_batch_read(source, source_size, read_index, destination, destination_capacity, options));
+}
+
+}
+
+namespace {
+
+vbz_size_t decompress_batch(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    gsl::span<VbzBatchEntry const> entries;
+    gsl::span<char const> payload;
+    auto const result = parse_batch(make_data_buffer(source, source_size), entries, payload);
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+
+    // The entries' sizes bound the frame, whose header alone can't be trusted to size its buffer.
+    std::uint64_t original_size = 0;
+    std::uint64_t max_frame_size = 0;
+    for (auto const& entry : entries)
+    {
+        auto const max_entry_size = max_encoded_size(entry.original_size, options);
+        if (vbz_is_error(max_entry_size))
+        {
+            return max_entry_size;
+        }
+        original_size += entry.original_size;
+        max_frame_size += max_entry_size;
+    }
+    if (original_size > destination_capacity)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    std::unique_ptr<void, free_delete> intermediate_storage;
+    auto encoded_buffer = payload;
+    if (options->zstd_compression_level != 0)
+    {
+        auto const frame_size = ZSTD_getFrameContentSize(payload.data(), payload.size());
+        if (ZSTD_isError(frame_size) || frame_size >= VBZ_FIRST_ERROR)
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+        if (frame_size > max_frame_size)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        intermediate_storage.reset(malloc(std::max<std::size_t>(std::size_t(frame_size), 1)));
+        if (!intermediate_storage) {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+        auto const decoded_size = zstd_decompress(
+            intermediate_storage.get(),
+            std::size_t(frame_size),
+            payload.data(),
+            payload.size()
+        );
+        if (ZSTD_isError(decoded_size))
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+        encoded_buffer = make_data_buffer(intermediate_storage.get(), vbz_size_t(decoded_size));
+    }
+
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    std::size_t decompressed_size = 0;
+    for (auto const& entry : entries)
+    {
+        if (!entry_in_range(entry, encoded_buffer.size()))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        if (entry.original_size > dest_buffer.size() - decompressed_size)
+        {
+            return VBZ_DESTINATION_SIZE_ERROR;
+        }
+
+        auto const read_size = decode_integers(
+            encoded_buffer.subspan(entry.encoded_offset, entry.encoded_size),
+            dest_buffer.subspan(decompressed_size, entry.original_size),
+            options
+        );
+        if (vbz_is_error(read_size))
+        {
+            return read_size;
+        }
+        decompressed_size += read_size;
+    }
+
+    return vbz_size_t(decompressed_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_decompress_batch(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_batch(source, source_size, destination, destination_capacity, options));
+}
+
+}
@@ -0,0 +1,706 @@
+#include "vbz_codec.h"
+#include "vbz_crc32c.h"
+#include "vbz_metrics_scope.h"
+
+#include <gsl/gsl-lite.hpp>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// include last - it uses c headers which can mess things up.
+#include "vbz.h"
+
+using namespace vbz::detail;
+
+namespace {
+
+// Checksummed data is a VbzChecksummedHeader, a VbzChecksumBlock per block of the original data, then
+// the encoded blocks concatenated into a single zstd frame (or stored directly when zstd is disabled).
+// The header starts with the original size, as VbzSizedHeader does, so #vbz_decompressed_size applies.
+//
+// Merged checksummed data (see #vbz_merge_checksummed) is a VbzChecksummedHeader with a block size of
+// merged_block_size, a segment count, then each segment's VbzChecksummedHeader and VbzChecksumBlocks,
+// then the encoded blocks of every segment, in order, as a zstd frame per merged part (or stored directly).
+// Every block is encoded independently, so the segments' blocks decode as a single sequence.
+struct VbzChecksummedHeader
+{
+    vbz_size_t original_size;
+    vbz_size_t block_size;
+};
+
+// The block size marking merged checksummed data, no real block is empty.
+constexpr vbz_size_t merged_block_size = 0;
+
+struct VbzChecksumBlock
+{
+    // CRC32C of the block's original data.
+    std::uint32_t checksum;
+    vbz_size_t encoded_size;
+};
+
+// 64KB blocks stay in L2 between being checksummed and encoded (or decoded and verified).
+constexpr vbz_size_t checksum_block_size = 64 * 1024;
+
+std::size_t checksummed_header_size(std::size_t block_count)
+{
+    return sizeof(VbzChecksummedHeader) + block_count * sizeof(VbzChecksumBlock);
+}
+
+// A run of equally sized blocks in checksummed data, which holds one (or several once merged).
+struct ChecksummedSegment
+{
+    vbz_size_t original_size;
+    vbz_size_t block_size;
+    gsl::span<VbzChecksumBlock const> blocks;
+};
+
+struct ChecksummedLayout
+{
+    vbz_size_t original_size;
+    // Largest block of any segment, no larger than the segment's data.
+    vbz_size_t max_block_size;
+    // The segments' headers and blocks, read in order with #next_segment.
+    gsl::span<char const> segments;
+    // The encoded blocks.
+    gsl::span<char const> payload;
+};
+
+// Split checksummed data (merged or not) into its segments and payload, checking the segments describe
+// [options] data of the original size.
+vbz_size_t parse_checksummed(
+    gsl::span<char const> source,
+    CompressionOptions const* options,
+    ChecksummedLayout& layout)
+{
+    if (source.size() < sizeof(VbzChecksummedHeader))
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    auto const header = source.subspan(0, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader const>().begin();
+
+    // Unmerged data is a single segment, described by the header itself.
+    std::size_t segments_offset = 0;
+    std::size_t segment_count = 1;
+    if (header->block_size == merged_block_size)
+    {
+        segments_offset = sizeof(VbzChecksummedHeader) + sizeof(vbz_size_t);
+        if (source.size() < segments_offset)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        segment_count = source.subspan(sizeof(VbzChecksummedHeader), sizeof(vbz_size_t)).as_span<vbz_size_t const>()[0];
+    }
+
+    std::uint64_t original_size = 0;
+    vbz_size_t max_block_size = 0;
+    auto offset = segments_offset;
+    for (std::size_t i = 0; i < segment_count; ++i)
+    {
+        if (source.size() - offset < sizeof(VbzChecksummedHeader))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        auto const segment = source.subspan(offset, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader const>().begin();
+        auto const block_size = segment->block_size;
+        if (block_size == merged_block_size || (options->integer_size != 0 && block_size % options->integer_size != 0))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        // Data shorter than a block is written with the default block size, any other block larger than
+        // its segment is corrupt (and would have decoding reserve space for it).
+        if (block_size > segment->original_size && block_size != checksum_block_size)
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+
+        auto const block_count = (std::size_t(segment->original_size) + block_size - 1) / block_size;
+        if (block_count > (source.size() - offset - sizeof(VbzChecksummedHeader)) / sizeof(VbzChecksumBlock))
+        {
+            return VBZ_INPUT_SIZE_ERROR;
+        }
+        original_size += segment->original_size;
+        max_block_size = std::max(max_block_size, std::min(block_size, segment->original_size));
+        offset += checksummed_header_size(block_count);
+    }
+    if (original_size != header->original_size)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    layout.original_size = header->original_size;
+    layout.max_block_size = max_block_size;
+    layout.segments = source.subspan(segments_offset, offset - segments_offset);
+    layout.payload = source.subspan(offset);
+    return 0;
+}
+
+// Read the segment at the start of [segments], checked by #parse_checksummed, and move past it.
+ChecksummedSegment next_segment(gsl::span<char const>& segments)
+{
+    auto const header = segments.subspan(0, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader const>().begin();
+    auto const block_count = (std::size_t(header->original_size) + header->block_size - 1) / header->block_size;
+    auto const size = checksummed_header_size(block_count);
+
+    ChecksummedSegment segment{
+        header->original_size,
+        header->block_size,
+        segments.subspan(sizeof(VbzChecksummedHeader), size - sizeof(VbzChecksummedHeader)).as_span<VbzChecksumBlock const>()
+    };
+    segments = segments.subspan(size);
+    return segment;
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_max_checksummed_compressed_size(
+    vbz_size_t source_size,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto const full_blocks = source_size / checksum_block_size;
+    auto const final_block_size = source_size % checksum_block_size;
+    auto const block_count = full_blocks + (final_block_size != 0 ? 1 : 0);
+
+    auto const max_block_size = max_encoded_size(checksum_block_size, options);
+    auto const max_final_block_size = max_encoded_size(final_block_size, options);
+    if (vbz_is_error(max_final_block_size))
+    {
+        return max_final_block_size;
+    }
+
+    std::uint64_t encoded_size = std::uint64_t(full_blocks) * max_block_size + max_final_block_size;
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = ZSTD_compressBound(std::size_t(std::min<std::uint64_t>(encoded_size, VBZ_FIRST_ERROR)));
+    }
+
+    auto const max_size = checksummed_header_size(block_count) + encoded_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+}
+
+namespace {
+
+vbz_size_t compress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    auto const max_size = vbz_max_checksummed_compressed_size(source_size, options);
+    if (vbz_is_error(max_size))
+    {
+        return max_size;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+
+    auto const block_count = (std::size_t(source_size) + checksum_block_size - 1) / checksum_block_size;
+    auto const header_size = checksummed_header_size(block_count);
+    if (header_size > dest_buffer.size())
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto header_span = dest_buffer.subspan(0, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader>();
+    header_span[0].original_size = source_size;
+    header_span[0].block_size = checksum_block_size;
+    auto blocks = dest_buffer.subspan(sizeof(VbzChecksummedHeader), header_size - sizeof(VbzChecksummedHeader)).as_span<VbzChecksumBlock>();
+    auto payload = dest_buffer.subspan(header_size);
+
+    std::unique_ptr<void, free_delete> intermediate_storage;
+    auto encoded_buffer = payload;
+    if (options->zstd_compression_level != 0)
+    {
+        intermediate_storage.reset(malloc(max_size));
+        if (!intermediate_storage) {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+        encoded_buffer = make_data_buffer(intermediate_storage.get(), max_size);
+    }
+
+    std::size_t encoded_size = 0;
+    for (std::size_t i = 0; i < block_count; ++i)
+    {
+        auto const block = source_buffer.subspan(
+            i * checksum_block_size,
+            std::min<std::size_t>(checksum_block_size, source_buffer.size() - i * checksum_block_size));
+
+        // Checksum the block as it is pulled into cache, so encoding it reads it from there.
+        blocks[i].checksum = vbz_crc32c(0, block.data(), block.size());
+
+        auto const block_encoded_size = encode_integers(block, encoded_buffer.subspan(encoded_size), options);
+        if (vbz_is_error(block_encoded_size))
+        {
+            return block_encoded_size;
+        }
+        blocks[i].encoded_size = block_encoded_size;
+        encoded_size += block_encoded_size;
+    }
+
+    if (options->zstd_compression_level != 0)
+    {
+        encoded_size = zstd_compress(
+            payload.data(),
+            payload.size(),
+            encoded_buffer.data(),
+            encoded_size,
+            options->zstd_compression_level
+        );
+        if (ZSTD_isError(encoded_size))
+        {
+            return VBZ_ZSTD_ERROR;
+        }
+    }
+
+    return vbz_size_t(header_size + encoded_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_compress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_COMPRESS, source_size);
+    return metrics.complete(
+        compress_checksummed(source, source_size, destination, destination_capacity, options));
+}
+
+}
+
+namespace {
+
+vbz_size_t decompress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    ChecksummedLayout layout;
+    auto const parsed = parse_checksummed(make_data_buffer(source, source_size), options, layout);
+    if (vbz_is_error(parsed))
+    {
+        return parsed;
+    }
+    if (destination_capacity < layout.original_size)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto const max_block_size = max_encoded_size(layout.max_block_size, options);
+    if (vbz_is_error(max_block_size))
+    {
+        return max_block_size;
+    }
+
+    // zstd is stream decoded a block at a time, so the intermediate buffer holds a single block.
+    // Merged data's frames follow each other in the stream.
+    ZstdStreamReader reader(layout.payload);
+    std::unique_ptr<void, free_delete> block_storage;
+    if (options->zstd_compression_level != 0)
+    {
+        auto const result = reader.init();
+        if (vbz_is_error(result))
+        {
+            return result;
+        }
+        block_storage.reset(malloc(std::max<std::size_t>(max_block_size, 1)));
+        if (!block_storage) {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+    }
+
+    auto dest_buffer = make_data_buffer(destination, layout.original_size);
+    std::size_t payload_offset = 0;
+    auto segments = layout.segments;
+    while (!segments.empty())
+    {
+        auto const segment = next_segment(segments);
+        auto const segment_buffer = dest_buffer.subspan(0, segment.original_size);
+        dest_buffer = dest_buffer.subspan(segment.original_size);
+
+        auto const max_segment_block_size = max_encoded_size(std::min(segment.block_size, segment.original_size), options);
+        for (std::size_t i = 0; i < std::size_t(segment.blocks.size()); ++i)
+        {
+            auto const encoded_size = segment.blocks[i].encoded_size;
+            if (encoded_size > max_segment_block_size)
+            {
+                return VBZ_INPUT_SIZE_ERROR;
+            }
+
+            auto const dest_block = segment_buffer.subspan(
+                i * segment.block_size,
+                std::min<std::size_t>(segment.block_size, segment_buffer.size() - i * segment.block_size));
+
+            gsl::span<char const> encoded_block;
+            if (options->zstd_compression_level != 0)
+            {
+                auto const block_buffer = make_data_buffer(block_storage.get(), encoded_size);
+                auto const result = reader.read(block_buffer);
+                if (vbz_is_error(result))
+                {
+                    return result;
+                }
+                encoded_block = block_buffer;
+            }
+            else
+            {
+                if (encoded_size > layout.payload.size() - payload_offset)
+                {
+                    return VBZ_INPUT_SIZE_ERROR;
+                }
+                encoded_block = layout.payload.subspan(payload_offset, encoded_size);
+                payload_offset += encoded_size;
+            }
+
+            auto const decoded_size = decode_integers(encoded_block, dest_block, options);
+            if (vbz_is_error(decoded_size))
+            {
+                return decoded_size;
+            }
+
+            // Verify the block while it is still in cache from being decoded.
+            if (vbz_crc32c(0, dest_block.data(), dest_block.size()) != segment.blocks[i].checksum)
+            {
+                return VBZ_CHECKSUM_ERROR;
+            }
+        }
+    }
+
+    return layout.original_size;
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_decompress_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_DECOMPRESS, source_size);
+    return metrics.complete(
+        decompress_checksummed(source, source_size, destination, destination_capacity, options));
+}
+
+}
+
+namespace {
+
+// Size of the encoded stream of checksummed data, the total of every block's encoded size.
+vbz_size_t checksummed_encoded_size(ChecksummedLayout const& layout, CompressionOptions const* options)
+{
+    std::size_t encoded_size = 0;
+    auto segments = layout.segments;
+    while (!segments.empty())
+    {
+        auto const segment = next_segment(segments);
+        auto const max_block_size = max_encoded_size(segment.block_size, options);
+        if (vbz_is_error(max_block_size))
+        {
+            return max_block_size;
+        }
+        for (auto const& block : segment.blocks)
+        {
+            if (block.encoded_size > max_block_size)
+            {
+                return VBZ_INPUT_SIZE_ERROR;
+            }
+            encoded_size += block.encoded_size;
+        }
+    }
+    if (encoded_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(encoded_size);
+}
+
+vbz_size_t transcode_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options)
+{
+    if (!is_valid_integer_size(source_options) || !is_valid_integer_size(destination_options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!same_integer_encoding(source_options, destination_options))
+    {
+        return reencode(source, source_size, destination, destination_capacity,
+            source_options, destination_options, &decompress_checksummed, &compress_checksummed);
+    }
+    if (!is_valid_version(source_options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    ChecksummedLayout layout;
+    auto const parsed = parse_checksummed(source_buffer, source_options, layout);
+    if (vbz_is_error(parsed))
+    {
+        return parsed;
+    }
+
+    // The headers and checksums describe the original data, which is unchanged.
+    auto const header_size = std::size_t(layout.payload.data() - source_buffer.data());
+    if (header_size > dest_buffer.size())
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+    std::copy(source_buffer.begin(), source_buffer.begin() + header_size, dest_buffer.begin());
+
+    auto const intermediate_size = checksummed_encoded_size(layout, source_options);
+    if (vbz_is_error(intermediate_size))
+    {
+        return intermediate_size;
+    }
+
+    auto const payload_size = relevel_zstd(
+        layout.payload,
+        source_options->zstd_compression_level,
+        dest_buffer.subspan(header_size),
+        destination_options->zstd_compression_level,
+        intermediate_size
+    );
+    if (vbz_is_error(payload_size))
+    {
+        return payload_size;
+    }
+    return vbz_size_t(header_size + payload_size);
+}
+
+}
+
+extern "C" {
+
+vbz_size_t vbz_transcode_checksummed(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options)
+{
+    VbzMetricsScope metrics(VBZ_METRICS_TRANSCODE, source_size);
+    return metrics.complete(transcode_checksummed(
+        source, source_size, destination, destination_capacity, source_options, destination_options));
+}
+
+vbz_size_t vbz_max_checksummed_transcoded_size(
+    void const* source,
+    vbz_size_t source_size,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options)
+{
+    if (!is_valid_integer_size(source_options) || !is_valid_integer_size(destination_options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!same_integer_encoding(source_options, destination_options))
+    {
+        auto const original_size = vbz_decompressed_size(source, source_size, source_options);
+        if (vbz_is_error(original_size))
+        {
+            return original_size;
+        }
+        return vbz_max_checksummed_compressed_size(original_size, destination_options);
+    }
+    if (!is_valid_version(source_options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    auto const source_buffer = make_data_buffer(source, source_size);
+    ChecksummedLayout layout;
+    auto const parsed = parse_checksummed(source_buffer, source_options, layout);
+    if (vbz_is_error(parsed))
+    {
+        return parsed;
+    }
+    auto const intermediate_size = checksummed_encoded_size(layout, source_options);
+    if (vbz_is_error(intermediate_size))
+    {
+        return intermediate_size;
+    }
+
+    std::uint64_t max_size = std::size_t(layout.payload.data() - source_buffer.data());
+    max_size += destination_options->zstd_compression_level != 0
+        ? ZSTD_compressBound(intermediate_size)
+        : intermediate_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+vbz_size_t vbz_max_merged_checksummed_size(
+    vbz_size_t first_size,
+    vbz_size_t second_size)
+{
+    // Merging adds at most a merged header (the size, and a segment count) to the two parts.
+    auto const max_size = std::uint64_t(first_size) + second_size + sizeof(VbzChecksummedHeader) + sizeof(vbz_size_t);
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+vbz_size_t vbz_merge_checksummed(
+    void const* first,
+    vbz_size_t first_size,
+    void const* second,
+    vbz_size_t second_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+    if (!is_valid_version(options))
+    {
+        return VBZ_VERSION_ERROR;
+    }
+
+    ChecksummedLayout parts[2];
+    auto result = parse_checksummed(make_data_buffer(first, first_size), options, parts[0]);
+    if (!vbz_is_error(result))
+    {
+        result = parse_checksummed(make_data_buffer(second, second_size), options, parts[1]);
+    }
+    if (vbz_is_error(result))
+    {
+        return result;
+    }
+    auto const original_size = std::uint64_t(parts[0].original_size) + parts[1].original_size;
+    if (original_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto dest_buffer = make_data_buffer(destination, destination_capacity);
+    auto const segments_offset = sizeof(VbzChecksummedHeader) + sizeof(vbz_size_t);
+    if (dest_buffer.size() < segments_offset)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    // Copy the segments of both parts, extending the previous segment instead when it ends on a whole
+    // block of the same size, so merging whole blocks keeps a single segment.
+    auto offset = segments_offset;
+    vbz_size_t segment_count = 0;
+    VbzChecksummedHeader* previous = nullptr;
+    for (auto const& part : parts)
+    {
+        auto segments = part.segments;
+        while (!segments.empty())
+        {
+            auto const segment = next_segment(segments);
+            if (segment.original_size == 0)
+            {
+                continue;
+            }
+
+            auto const extend = previous
+                && previous->block_size == segment.block_size
+                && previous->original_size % previous->block_size == 0;
+            auto const blocks_size = segment.blocks.size() * sizeof(VbzChecksumBlock);
+            if (dest_buffer.size() - offset < (extend ? 0 : sizeof(VbzChecksummedHeader)) + blocks_size)
+            {
+                return VBZ_DESTINATION_SIZE_ERROR;
+            }
+
+            if (extend)
+            {
+                previous->original_size += segment.original_size;
+            }
+            else
+            {
+                previous = &dest_buffer.subspan(offset, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader>()[0];
+                previous->original_size = segment.original_size;
+                previous->block_size = segment.block_size;
+                offset += sizeof(VbzChecksummedHeader);
+                ++segment_count;
+            }
+            std::memcpy(dest_buffer.data() + offset, segment.blocks.data(), blocks_size);
+            offset += blocks_size;
+        }
+    }
+
+    auto header = dest_buffer.subspan(0, sizeof(VbzChecksummedHeader)).as_span<VbzChecksummedHeader>();
+    if (segment_count > 1)
+    {
+        header[0].original_size = vbz_size_t(original_size);
+        header[0].block_size = merged_block_size;
+        dest_buffer.subspan(sizeof(VbzChecksummedHeader), sizeof(vbz_size_t)).as_span<vbz_size_t>()[0] = segment_count;
+    }
+    else if (segment_count == 1)
+    {
+        // A single segment is written as unmerged data, its header leading.
+        std::memmove(dest_buffer.data(), dest_buffer.data() + segments_offset, offset - segments_offset);
+        offset -= segments_offset;
+    }
+    else
+    {
+        header[0].original_size = 0;
+        header[0].block_size = checksum_block_size;
+        offset = sizeof(VbzChecksummedHeader);
+    }
+
+    // The encoded blocks are in the same order as their segments, zstd frames decode one after another.
+    for (auto const& part : parts)
+    {
+        auto const copied = copy_buffer(part.payload, dest_buffer.subspan(offset));
+        if (vbz_is_error(copied))
+        {
+            return copied;
+        }
+        offset += copied;
+    }
+    return vbz_size_t(offset);
+}
+
+}
@@ -0,0 +1,658 @@
+#include "vbz_chunk_reader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <cerrno>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define VBZ_CHUNK_READER_POSIX 1
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+# include <linux/io_uring.h>
+// Reads and opcode probing arrived together in Linux 5.6, older headers have neither.
+# if defined(IO_URING_OP_SUPPORTED)
+#  include <sys/syscall.h>
+#  define VBZ_CHUNK_READER_IO_URING 1
+# endif
+#endif
+
+namespace {
+
+struct free_delete
+{
+    void operator()(void* x) { free(x); }
+};
+
+// Marks a chunk handed to the workers without a buffer, its data is mapped.
+constexpr std::size_t no_buffer = std::size_t(-1);
+
+// Buffers for chunks read ahead of the workers, each as large as the largest chunk.
+// The reader acquires a free buffer to read into, and the worker handling it releases it.
+class ChunkBuffers
+{
+public:
+    bool allocate(std::size_t count, std::size_t size)
+    {
+        m_size = std::max<std::size_t>(size, 1);
+        m_storage.reset(malloc(count * m_size));
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            m_free.push_back(i);
+        }
+        return m_storage != nullptr;
+    }
+
+    char* data(std::size_t buffer) const
+    {
+        return static_cast<char*>(m_storage.get()) + buffer * m_size;
+    }
+
+    // Wait for a free buffer.
+    std::size_t acquire()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released.wait(lock, [&] { return !m_free.empty(); });
+        return take();
+    }
+
+    // Find a free buffer without waiting, or no_buffer.
+    std::size_t try_acquire()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_free.empty() ? no_buffer : take();
+    }
+
+    void release(std::size_t buffer)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(buffer);
+        }
+        m_released.notify_one();
+    }
+
+    // Leak the storage rather than free it, when reads into it can't be stopped.
+    void abandon()
+    {
+        m_storage.release();
+    }
+
+private:
+    std::size_t take()
+    {
+        auto const buffer = m_free.back();
+        m_free.pop_back();
+        return buffer;
+    }
+
+    std::unique_ptr<void, free_delete> m_storage;
+    std::size_t m_size = 0;
+    std::vector<std::size_t> m_free;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+};
+
+struct ReadChunk
+{
+    std::size_t index;
+    char const* data;
+    std::size_t buffer;
+};
+
+// Threads calling the handler for each chunk pushed, releasing each chunk's buffer afterwards.
+class ChunkWorkers
+{
+public:
+    ChunkWorkers(
+        std::size_t worker_count,
+        VbzChunk const* chunks,
+        ChunkBuffers& buffers,
+        vbz_chunk_handler handler,
+        void* user_data)
+    : m_chunks(chunks)
+    , m_buffers(buffers)
+    , m_handler(handler)
+    , m_user_data(user_data)
+    {
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            m_threads.emplace_back([this] { run(); });
+        }
+    }
+
+    // Waits for every chunk pushed to be handled.
+    ~ChunkWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_pushed.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    void push(ReadChunk chunk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(chunk);
+        }
+        m_pushed.notify_one();
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            ReadChunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_pushed.wait(lock, [&] { return m_closed || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                chunk = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            m_handler(chunk.index, chunk.data, m_chunks[chunk.index].size, m_user_data);
+            if (chunk.buffer != no_buffer)
+            {
+                m_buffers.release(chunk.buffer);
+            }
+        }
+    }
+
+    VbzChunk const* m_chunks;
+    ChunkBuffers& m_buffers;
+    vbz_chunk_handler m_handler;
+    void* m_user_data;
+
+    std::mutex m_mutex;
+    std::condition_variable m_pushed;
+    std::deque<ReadChunk> m_queue;
+    bool m_closed = false;
+    std::vector<std::thread> m_threads;
+};
+
+#ifdef VBZ_CHUNK_READER_POSIX
+
+// Read all of [chunk] into [destination], retrying short or interrupted reads.
+bool pread_chunk(VbzChunk const& chunk, char* destination)
+{
+    std::size_t done = 0;
+    while (done < chunk.size)
+    {
+        auto const result = pread(chunk.file_descriptor, destination + done, chunk.size - done, off_t(chunk.offset + done));
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        done += std::size_t(result);
+    }
+    return true;
+}
+
+bool read_chunks_pread(VbzChunk const* chunks, std::size_t chunk_count, ChunkBuffers& buffers, ChunkWorkers& workers)
+{
+    for (std::size_t i = 0; i < chunk_count; ++i)
+    {
+        auto const buffer = buffers.acquire();
+        if (!pread_chunk(chunks[i], buffers.data(buffer)))
+        {
+            buffers.release(buffer);
+            return false;
+        }
+        workers.push({ i, buffers.data(buffer), buffer });
+    }
+    return true;
+}
+
+// Whole files mapped for the duration of a call.
+class MappedFiles
+{
+public:
+    ~MappedFiles()
+    {
+        for (auto const& file : m_files)
+        {
+            if (file.second.size != 0)
+            {
+                munmap(file.second.data, file.second.size);
+            }
+        }
+    }
+
+    // Find [chunk]'s data, mapping its file the first time it is seen, or null if it can't be mapped.
+    char const* find(VbzChunk const& chunk)
+    {
+        // An empty chunk has no data to map, even at the end of an empty file.
+        static char const empty = 0;
+        if (chunk.size == 0)
+        {
+            return &empty;
+        }
+
+        auto it = m_files.find(chunk.file_descriptor);
+        if (it == m_files.end())
+        {
+            Mapping mapping{ nullptr, 0 };
+            struct stat status;
+            if (fstat(chunk.file_descriptor, &status) != 0)
+            {
+                return nullptr;
+            }
+            mapping.size = std::size_t(status.st_size);
+            if (mapping.size != 0)
+            {
+                mapping.data = mmap(nullptr, mapping.size, PROT_READ, MAP_SHARED, chunk.file_descriptor, 0);
+                if (mapping.data == MAP_FAILED)
+                {
+                    return nullptr;
+                }
+            }
+            it = m_files.emplace(chunk.file_descriptor, mapping).first;
+        }
+
+        auto const& mapping = it->second;
+        if (chunk.offset > mapping.size || chunk.size > mapping.size - chunk.offset)
+        {
+            return nullptr;
+        }
+        return static_cast<char const*>(mapping.data) + chunk.offset;
+    }
+
+private:
+    struct Mapping
+    {
+        void* data;
+        std::size_t size;
+    };
+    std::map<int, Mapping> m_files;
+};
+
+bool read_chunks_mmap(VbzChunk const* chunks, std::size_t chunk_count, MappedFiles& files, ChunkWorkers& workers)
+{
+    for (std::size_t i = 0; i < chunk_count; ++i)
+    {
+        auto const data = files.find(chunks[i]);
+        if (!data)
+        {
+            return false;
+        }
+        workers.push({ i, data, no_buffer });
+    }
+    return true;
+}
+
+#endif
+
+#ifdef VBZ_CHUNK_READER_IO_URING
+
+// An io_uring driven with raw system calls (liburing isn't required), by a single thread.
+class IoUring
+{
+public:
+    ~IoUring()
+    {
+        if (m_submission_ring != MAP_FAILED)
+        {
+            munmap(m_submission_ring, m_submission_ring_size);
+        }
+        if (m_completion_ring != MAP_FAILED)
+        {
+            munmap(m_completion_ring, m_completion_ring_size);
+        }
+        if (m_entries != MAP_FAILED)
+        {
+            munmap(m_entries, m_entries_size);
+        }
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    bool init(unsigned int entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        m_submission_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_completion_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_submission_ring = mmap(nullptr, m_submission_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        m_completion_ring = mmap(nullptr, m_completion_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        m_entries_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_entries = mmap(nullptr, m_entries_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_submission_ring == MAP_FAILED || m_completion_ring == MAP_FAILED || m_entries == MAP_FAILED)
+        {
+            return false;
+        }
+
+        auto const submission = static_cast<char*>(m_submission_ring);
+        m_submission_tail = reinterpret_cast<unsigned*>(submission + params.sq_off.tail);
+        m_submission_mask = *reinterpret_cast<unsigned*>(submission + params.sq_off.ring_mask);
+        m_submission_array = reinterpret_cast<unsigned*>(submission + params.sq_off.array);
+
+        auto const completion = static_cast<char*>(m_completion_ring);
+        m_completion_head = reinterpret_cast<unsigned*>(completion + params.cq_off.head);
+        m_completion_tail = reinterpret_cast<unsigned*>(completion + params.cq_off.tail);
+        m_completion_mask = *reinterpret_cast<unsigned*>(completion + params.cq_off.ring_mask);
+        m_completions = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+        return true;
+    }
+
+    // Check the kernel supports [opcode], the probe needs Linux 5.6 (as do reads).
+    bool supports(unsigned int opcode)
+    {
+        constexpr unsigned int op_count = 256;
+        // The kernel requires the probe to be zeroed.
+        std::unique_ptr<void, free_delete> storage(calloc(1, sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op)));
+        auto const probe = static_cast<io_uring_probe*>(storage.get());
+        if (!probe || syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, op_count) < 0)
+        {
+            return false;
+        }
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+    // Queue a read of [size] bytes at [offset] into [destination], the caller keeps no more reads
+    // in flight than the ring has entries.
+    void prepare_read(int fd, char* destination, std::size_t size, std::uint64_t offset, std::uint64_t user_data)
+    {
+        auto const tail = *m_submission_tail;
+        auto const index = tail & m_submission_mask;
+        auto& entry = static_cast<io_uring_sqe*>(m_entries)[index];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_READ;
+        entry.fd = fd;
+        entry.addr = reinterpret_cast<std::uintptr_t>(destination);
+        entry.len = unsigned(size);
+        entry.off = offset;
+        entry.user_data = user_data;
+        m_submission_array[index] = index;
+        __atomic_store_n(m_submission_tail, tail + 1, __ATOMIC_RELEASE);
+        ++m_unsubmitted;
+    }
+
+    // Submit the queued reads and wait for at least one completion.
+    bool submit_and_wait()
+    {
+        for (;;)
+        {
+            auto const result = syscall(__NR_io_uring_enter, m_fd, m_unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result >= 0)
+            {
+                m_unsubmitted -= unsigned(result);
+                return true;
+            }
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+    }
+
+    // Wait for the [in_flight] reads queued to complete, discarding their results. Reads the kernel accepted
+    // keep writing to their buffers even once the ring is closed, those never submitted are dropped.
+    // Returns false if the ring can't be waited on.
+    bool drain(std::size_t in_flight)
+    {
+        auto outstanding = in_flight - m_unsubmitted;
+        for (;;)
+        {
+            reap([&](std::uint64_t, std::int32_t) { --outstanding; });
+            if (outstanding == 0)
+            {
+                return true;
+            }
+            auto const result = syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                return false;
+            }
+        }
+    }
+
+    // Call [fn] with the user data and result of each completed read.
+    template <typename Fn>
+    void reap(Fn&& fn)
+    {
+        auto head = *m_completion_head;
+        auto const tail = __atomic_load_n(m_completion_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            auto const& completion = m_completions[head & m_completion_mask];
+            fn(completion.user_data, completion.res);
+        }
+        __atomic_store_n(m_completion_head, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int m_fd = -1;
+    void* m_submission_ring = MAP_FAILED;
+    void* m_completion_ring = MAP_FAILED;
+    void* m_entries = MAP_FAILED;
+    std::size_t m_submission_ring_size = 0;
+    std::size_t m_completion_ring_size = 0;
+    std::size_t m_entries_size = 0;
+
+    unsigned* m_submission_tail = nullptr;
+    unsigned m_submission_mask = 0;
+    unsigned* m_submission_array = nullptr;
+    unsigned* m_completion_head = nullptr;
+    unsigned* m_completion_tail = nullptr;
+    unsigned m_completion_mask = 0;
+    io_uring_cqe* m_completions = nullptr;
+    unsigned m_unsubmitted = 0;
+};
+
+bool read_chunks_io_uring(
+    VbzChunk const* chunks,
+    std::size_t chunk_count,
+    std::size_t queue_depth,
+    ChunkBuffers& buffers,
+    ChunkWorkers& workers)
+{
+    // Rings are limited to 4096 entries, deeper queues just read further ahead of the workers.
+    auto const ring_depth = std::min<std::size_t>(queue_depth, 4096);
+    IoUring ring;
+    if (!ring.init(unsigned(ring_depth)))
+    {
+        return false;
+    }
+
+    // The chunk each buffer is reading, and how much of it has arrived.
+    std::vector<std::size_t> buffer_chunks(queue_depth);
+    std::vector<std::size_t> buffer_done(queue_depth);
+    auto const read_remaining = [&](std::size_t buffer)
+    {
+        auto const& chunk = chunks[buffer_chunks[buffer]];
+        auto const done = buffer_done[buffer];
+        ring.prepare_read(chunk.file_descriptor, buffers.data(buffer) + done, chunk.size - done, chunk.offset + done, buffer);
+    };
+
+    std::size_t next = 0;
+    std::size_t in_flight = 0;
+    bool failed = false;
+    while ((next < chunk_count && !failed) || in_flight != 0)
+    {
+        // Keep every free buffer reading, waiting for the workers only when nothing is in flight.
+        while (next < chunk_count && !failed && in_flight < ring_depth)
+        {
+            auto const buffer = in_flight == 0 ? buffers.acquire() : buffers.try_acquire();
+            if (buffer == no_buffer)
+            {
+                break;
+            }
+            buffer_chunks[buffer] = next++;
+            buffer_done[buffer] = 0;
+            if (chunks[buffer_chunks[buffer]].size == 0)
+            {
+                workers.push({ buffer_chunks[buffer], buffers.data(buffer), buffer });
+                continue;
+            }
+            read_remaining(buffer);
+            ++in_flight;
+        }
+        if (in_flight == 0)
+        {
+            continue;
+        }
+
+        if (!ring.submit_and_wait())
+        {
+            // Reads already submitted must finish before their buffers are freed, closing the ring
+            // doesn't cancel them. If they can't be waited for the buffers are leaked instead.
+            if (!ring.drain(in_flight))
+            {
+                buffers.abandon();
+            }
+            return false;
+        }
+        ring.reap([&](std::uint64_t user_data, std::int32_t result)
+        {
+            auto const buffer = std::size_t(user_data);
+            auto const& chunk = chunks[buffer_chunks[buffer]];
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                read_remaining(buffer);
+                return;
+            }
+            --in_flight;
+            if (result <= 0 || failed)
+            {
+                failed = true;
+                buffers.release(buffer);
+                return;
+            }
+
+            buffer_done[buffer] += std::size_t(result);
+            if (buffer_done[buffer] < chunk.size)
+            {
+                read_remaining(buffer);
+                ++in_flight;
+                return;
+            }
+            workers.push({ buffer_chunks[buffer], buffers.data(buffer), buffer });
+        });
+    }
+    return !failed;
+}
+
+#endif
+}
+
+extern "C" {
+
+bool vbz_chunk_reader_supported(unsigned int reader)
+{
+    switch (reader)
+    {
+#ifdef VBZ_CHUNK_READER_POSIX
+    case VBZ_PREAD_CHUNK_READER:
+    case VBZ_MMAP_CHUNK_READER:
+        return true;
+#endif
+#ifdef VBZ_CHUNK_READER_IO_URING
+    case VBZ_IO_URING_CHUNK_READER:
+    {
+        IoUring ring;
+        return ring.init(1) && ring.supports(IORING_OP_READ);
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+vbz_size_t vbz_read_chunks(
+    unsigned int reader,
+    VbzChunk const* chunks,
+    vbz_size_t chunk_count,
+    std::size_t worker_count,
+    std::size_t queue_depth,
+    vbz_chunk_handler handler,
+    void* user_data)
+{
+    if (worker_count == 0 || queue_depth == 0 || chunk_count >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    if (reader > VBZ_IO_URING_CHUNK_READER || !vbz_chunk_reader_supported(reader))
+    {
+        return VBZ_IO_ERROR;
+    }
+
+    ChunkBuffers buffers;
+    if (reader != VBZ_MMAP_CHUNK_READER)
+    {
+        vbz_size_t max_chunk_size = 0;
+        for (std::size_t i = 0; i < chunk_count; ++i)
+        {
+            max_chunk_size = std::max(max_chunk_size, chunks[i].size);
+        }
+        if (!buffers.allocate(queue_depth, max_chunk_size))
+        {
+            return VBZ_OUT_OF_MEMORY_ERROR;
+        }
+    }
+
+    bool read = false;
+#ifdef VBZ_CHUNK_READER_POSIX
+    // Mappings must outlive the workers reading from them.
+    MappedFiles files;
+#endif
+    {
+        ChunkWorkers workers(worker_count, chunks, buffers, handler, user_data);
+        switch (reader)
+        {
+#ifdef VBZ_CHUNK_READER_POSIX
+        case VBZ_PREAD_CHUNK_READER:
+            read = read_chunks_pread(chunks, chunk_count, buffers, workers);
+            break;
+        case VBZ_MMAP_CHUNK_READER:
+            read = read_chunks_mmap(chunks, chunk_count, files, workers);
+            break;
+#endif
+#ifdef VBZ_CHUNK_READER_IO_URING
+        case VBZ_IO_URING_CHUNK_READER:
+            read = read_chunks_io_uring(chunks, chunk_count, queue_depth, buffers, workers);
+            break;
+#endif
+        }
+    }
+
+    return read ? chunk_count : VBZ_IO_ERROR;
+}
+
+}
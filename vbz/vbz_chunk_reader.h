@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "vbz.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Ways of reading chunks from files, see #vbz_read_chunks.
+// pread the chunks one at a time from the calling thread, decoding overlaps reading but the
+// drive only ever sees a single request.
+#define VBZ_PREAD_CHUNK_READER 0
+// Map each file, workers fault the pages of their chunks in as they decode them.
+#define VBZ_MMAP_CHUNK_READER 1
+// Keep up to the queue depth of reads in flight with io_uring (Linux 5.6 or later).
+#define VBZ_IO_URING_CHUNK_READER 2
+
+/// \brief A chunk of a file to read, such as a compressed read in an archive or a raw chunk file.
+struct VbzChunk
+{
+    int file_descriptor;
+    uint64_t offset;
+    vbz_size_t size;
+};
+
+/// \brief Callback made on a worker thread with the data of a chunk passed to #vbz_read_chunks.
+/// \param index        The index of the chunk.
+/// \param data         The chunk's data, only valid for the duration of the call.
+/// \param size         The chunk's size in bytes.
+/// \param user_data    The user data passed to #vbz_read_chunks.
+typedef void (*vbz_chunk_handler)(size_t index, void const* data, vbz_size_t size, void* user_data);
+
+/// \brief Check a VBZ_*_CHUNK_READER can be used, io_uring reads need Linux 5.6 and may be
+///        blocked by a sandbox, and no reader is available outside POSIX systems.
+VBZ_EXPORT bool vbz_chunk_reader_supported(unsigned int reader);
+
+/// \brief Read [chunks], handing each to a pool of worker threads as soon as its data arrives.
+/// \note Chunks are handled in any order, by up to [worker_count] threads at once, all chunks
+///       have been handled when the call returns. Files must stay open for the duration of the call.
+/// \param reader           The VBZ_*_CHUNK_READER to read with.
+/// \param chunks           The chunks to read.
+/// \param chunk_count      The number of chunks.
+/// \param worker_count     The number of threads calling [handler], at least 1.
+/// \param queue_depth      The number of chunks read ahead of the workers (and, with io_uring, in flight
+///                         at once), at least 1. Each needs a buffer as large as the largest chunk,
+///                         mapped files need no buffers.
+/// \param handler          Called with each chunk's data.
+/// \param user_data        Passed to each call of [handler].
+/// \return [chunk_count], VBZ_IO_ERROR if a read failed (some chunks may have been handled) or the
+///         reader is unsupported, or another error code if something went wrong.
+VBZ_EXPORT vbz_size_t vbz_read_chunks(
+    unsigned int reader,
+    struct VbzChunk const* chunks,
+    vbz_size_t chunk_count,
+    size_t worker_count,
+    size_t queue_depth,
+    vbz_chunk_handler handler,
+    void* user_data);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "vbz.h"
+
+#include <gsl/gsl-lite.hpp>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+
+// Codec stages shared by vbz.cpp and the container formats built on them (checksummed, batch and in place),
+// private to the library.
+
+namespace vbz::detail {
+
+// util for using malloc with unique_ptr.
+// This is required since a vector would throw if the size was too big.
+struct free_delete
+{
+    void operator()(void* x) { free(x); }
+};
+
+inline gsl::span<char> make_data_buffer(void* data, vbz_size_t size)
+{
+    return gsl::make_span(static_cast<char*>(data), size);
+}
+
+inline gsl::span<char const> make_data_buffer(void const* data, vbz_size_t size)
+{
+    return gsl::make_span(static_cast<char const*>(data), size);
+}
+
+// The number of bytes a call consumes, as counted by #VbzMetricsScope, saturating at the largest size.
+inline vbz_size_t metrics_size(std::uint64_t size)
+{
+    return vbz_size_t(std::min<std::uint64_t>(size, std::numeric_limits<vbz_size_t>::max()));
+}
+
+vbz_size_t copy_buffer(
+    gsl::span<char const> source,
+    gsl::span<char> dest);
+
+// zstd entry points, reported to any registered trace hooks.
+std::size_t zstd_compress(void* destination, std::size_t capacity, void const* source, std::size_t size, int level);
+std::size_t zstd_decompress(void* destination, std::size_t capacity, void const* source, std::size_t size);
+std::size_t zstd_decompress_stream(ZSTD_DStream* stream, ZSTD_outBuffer* output, ZSTD_inBuffer* input);
+
+bool is_float32(CompressionOptions const* options);
+bool is_valid_version(CompressionOptions const* options);
+bool is_valid_integer_size(CompressionOptions const* options);
+
+struct VbzSizedHeader
+{
+    vbz_size_t original_size;
+};
+
+// Margin required by zstd to decompress a frame in place, this mirrors
+// ZSTD_DECOMPRESSION_MARGIN which is only available to static zstd users.
+constexpr std::size_t zstd_frame_header_size_max = 18;
+constexpr std::size_t zstd_checksum_size = 4;
+constexpr std::size_t zstd_block_size_max = 128 * 1024;
+
+inline std::size_t zstd_in_place_margin(std::size_t original_size)
+{
+    auto const block_count = (original_size + zstd_block_size_max - 1) / zstd_block_size_max;
+    return zstd_frame_header_size_max
+        + zstd_checksum_size
+        + 3 * block_count
+        + zstd_block_size_max;
+}
+
+// zstd documents in place decompression as safe (given the margin above) from 1.5.4,
+// older versions decompress from a copy of the frame.
+constexpr bool zstd_supports_in_place = ZSTD_VERSION_NUMBER >= 10504;
+
+// Encode [source] with the streamvbyte stage of [options], or copy it if streamvbyte is disabled.
+vbz_size_t encode_integers(
+    gsl::span<char const> source,
+    gsl::span<char> destination,
+    CompressionOptions const* options);
+
+// Decode [source] into exactly [destination], reversing #encode_integers.
+vbz_size_t decode_integers(
+    gsl::span<char const> source,
+    gsl::span<char> destination,
+    CompressionOptions const* options);
+
+// Largest encoding #encode_integers can produce for [size] bytes, or an error code.
+vbz_size_t max_encoded_size(vbz_size_t size, CompressionOptions const* options);
+
+struct zstd_dstream_delete
+{
+    void operator()(ZSTD_DStream* x) { ZSTD_freeDStream(x); }
+};
+
+// Decodes a zstd frame incrementally, into as many destinations as the caller likes.
+class ZstdStreamReader
+{
+public:
+    explicit ZstdStreamReader(gsl::span<char const> frame)
+        : m_input{ frame.data(), frame.size(), 0 }
+    {
+    }
+
+    // Returns 0, or an error code if the stream could not be created.
+    vbz_size_t init();
+
+    // Fill [destination] with the next decoded bytes. Returns 0, or an error code if the frame
+    // is invalid or ends first.
+    vbz_size_t read(gsl::span<char> destination);
+
+    // Decode and discard the next [size] bytes. zstd keeps its own window for back
+    // references, so skipped output can be overwritten freely.
+    vbz_size_t skip(std::size_t size);
+
+private:
+    std::unique_ptr<ZSTD_DStream, zstd_dstream_delete> m_stream;
+    ZSTD_inBuffer m_input;
+};
+
+// #vbz_compress and #vbz_decompress, without counting the call in the metrics. Container formats
+// encode their parts with these and count the whole call once.
+vbz_size_t compress_with_arena(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* options,
+    VbzScratchArena* arena);
+
+vbz_size_t decompress_with_arena(
+    const void* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size,
+    CompressionOptions const* options,
+    VbzScratchArena* arena);
+
+// Check if data compressed with [source] has its integers encoded exactly as [destination] would encode
+// them, so transcoding between them only needs to change the zstd level.
+bool same_integer_encoding(CompressionOptions const* source, CompressionOptions const* destination);
+
+// Rerun zstd over the [intermediate_size] byte integer encoded [source] payload, compressed at
+// [source_level] (0 when stored directly, otherwise any number of zstd frames), writing it to
+// [destination] at [destination_level].
+vbz_size_t relevel_zstd(
+    gsl::span<char const> source,
+    int source_level,
+    gsl::span<char> destination,
+    int destination_level,
+    vbz_size_t intermediate_size);
+
+using VbzFunction = vbz_size_t (*)(void const*, vbz_size_t, void*, vbz_size_t, CompressionOptions const*);
+
+// Transcode between options encoding integers differently, by decompressing with [decompress] and
+// compressing again with [compress].
+vbz_size_t reencode(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity,
+    CompressionOptions const* source_options,
+    CompressionOptions const* destination_options,
+    VbzFunction decompress,
+    VbzFunction compress);
+
+}
@@ -0,0 +1,161 @@
+#include "vbz_crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <intrin.h>
+# include <nmmintrin.h>
+# define VBZ_CRC32C_X86 1
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+# include <x86intrin.h>
+# define VBZ_CRC32C_X86 1
+#endif
+
+namespace {
+
+// Reflected CRC32C polynomial.
+constexpr std::uint32_t crc32c_polynomial = 0x82F63B78;
+
+// Slice-by-8 tables, table[k][b] is the crc of byte b followed by k zero bytes.
+using Crc32cTables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+Crc32cTables make_tables()
+{
+    Crc32cTables tables{};
+    for (std::uint32_t byte = 0; byte < 256; ++byte)
+    {
+        auto crc = byte;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (std::size_t slice = 1; slice < tables.size(); ++slice)
+    {
+        for (std::uint32_t byte = 0; byte < 256; ++byte)
+        {
+            auto const previous = tables[slice - 1][byte];
+            tables[slice][byte] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+std::uint32_t crc32c_software(std::uint32_t crc, unsigned char const* data, std::size_t size)
+{
+    static const Crc32cTables tables = make_tables();
+
+    while (size >= 8)
+    {
+        std::uint32_t low = 0;
+        std::uint32_t high = 0;
+        std::memcpy(&low, data, 4);
+        std::memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF]
+            ^ tables[6][(low >> 8) & 0xFF]
+            ^ tables[5][(low >> 16) & 0xFF]
+            ^ tables[4][low >> 24]
+            ^ tables[3][high & 0xFF]
+            ^ tables[2][(high >> 8) & 0xFF]
+            ^ tables[1][(high >> 16) & 0xFF]
+            ^ tables[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+
+    for (; size != 0; --size)
+    {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef VBZ_CRC32C_X86
+
+#if !defined(_MSC_VER)
+__attribute__((target("sse4.2")))
+#endif
+std::uint32_t crc32c_sse42(std::uint32_t crc, unsigned char const* data, std::size_t size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    std::uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        std::uint64_t word = 0;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = std::uint32_t(crc64);
+#endif
+    while (size >= 4)
+    {
+        std::uint32_t word = 0;
+        std::memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        size -= 4;
+    }
+    for (; size != 0; --size)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+bool host_has_sse42()
+{
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+    return (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+#endif
+
+using Crc32cFn = std::uint32_t(*)(std::uint32_t, unsigned char const*, std::size_t);
+
+Crc32cFn select_crc32c()
+{
+#ifdef VBZ_CRC32C_X86
+    if (host_has_sse42())
+    {
+        return crc32c_sse42;
+    }
+#endif
+    return crc32c_software;
+}
+
+Crc32cFn crc32c_impl()
+{
+    static const Crc32cFn impl = select_crc32c();
+    return impl;
+}
+
+}
+
+std::uint32_t vbz_crc32c(
+    std::uint32_t crc,
+    void const* data,
+    std::size_t size)
+{
+    return ~crc32c_impl()(~crc, static_cast<unsigned char const*>(data), size);
+}
+
+bool vbz_crc32c_is_hardware_accelerated()
+{
+    return crc32c_impl() != crc32c_software;
+}
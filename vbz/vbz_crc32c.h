@@ -0,0 +1,21 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/// \brief Extend a CRC32C (Castagnoli) checksum with [size] bytes of [data].
+/// \note Uses the SSE4.2 crc32 instruction when the host supports it, and a table driven
+///       implementation otherwise - both give identical results.
+/// \param crc      The checksum of the data before [data], or 0 to start a new checksum.
+/// \param data     Data to checksum.
+/// \param size     Size of [data] in bytes.
+/// \return The checksum of the previous data followed by [data].
+VBZ_EXPORT std::uint32_t vbz_crc32c(
+    std::uint32_t crc,
+    void const* data,
+    std::size_t size);
+
+/// \brief Find if #vbz_crc32c uses the hardware crc32 instruction on this host.
+VBZ_EXPORT bool vbz_crc32c_is_hardware_accelerated();
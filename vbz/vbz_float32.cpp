@@ -0,0 +1,272 @@
+#include "vbz_float32.h"
+#include "vbz_trace_scope.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+namespace {
+
+// Key codes, for n stored bytes preceded by t trailing zero bytes: code = first_code[n] + t.
+// Code 0 is a repeated value (a difference of 0), codes above 10 are invalid.
+constexpr std::array<std::uint8_t, 5> first_code{ { 0, 1, 5, 8, 10 } };
+constexpr std::uint8_t invalid_code_size = 0xFF;
+constexpr std::array<std::uint8_t, 16> code_byte_count{ {
+    0,
+    1, 1, 1, 1,
+    2, 2, 2,
+    3, 3,
+    4,
+    invalid_code_size, invalid_code_size, invalid_code_size, invalid_code_size, invalid_code_size,
+} };
+constexpr std::array<std::uint8_t, 16> code_shift{ {
+    0,
+    0, 8, 16, 24,
+    0, 8, 16,
+    0, 8,
+    0,
+} };
+constexpr std::array<std::uint32_t, 5> byte_count_mask{ { 0, 0xFF, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF } };
+
+// Zero byte counts of a non zero value.
+unsigned int leading_zero_bytes(std::uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse(&index, value);
+    return (31 - index) / 8;
+#else
+    return unsigned(__builtin_clz(value)) / 8;
+#endif
+}
+
+unsigned int trailing_zero_bytes(std::uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return index / 8;
+#else
+    return unsigned(__builtin_ctz(value)) / 8;
+#endif
+}
+
+std::size_t key_byte_count(std::size_t value_count)
+{
+    return (value_count + 1) / 2;
+}
+
+// Map float bits to an integer ordered as the floats are, and back.
+std::uint32_t to_ordered(std::uint32_t bits)
+{
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+std::uint32_t from_ordered(std::uint32_t ordered)
+{
+    return (ordered & 0x80000000) ? (ordered & 0x7FFFFFFF) : ~ordered;
+}
+
+// Call [fn] with the code, and shifted stored bits, for each value of [source].
+template <typename Fn>
+void for_each_code(char const* source, std::size_t value_count, Fn&& fn)
+{
+    std::uint32_t previous = 0;
+    for (std::size_t i = 0; i < value_count; ++i)
+    {
+        std::uint32_t value = 0;
+        std::memcpy(&value, source + i * sizeof(value), sizeof(value));
+        value = to_ordered(value);
+        auto const delta = value - previous;
+        auto bits = (delta << 1) ^ (0u - (delta >> 31));
+        previous = value;
+
+        std::uint8_t code = 0;
+        if (bits != 0)
+        {
+            auto const trailing = trailing_zero_bytes(bits);
+            auto const stored = 4 - leading_zero_bytes(bits) - trailing;
+            code = std::uint8_t(first_code[stored] + trailing);
+            bits >>= trailing * 8;
+        }
+        fn(i, code, bits);
+    }
+}
+
+}
+
+vbz_size_t vbz_max_float32_compressed_size(
+    vbz_size_t source_size)
+{
+    if (source_size % sizeof(float) != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const value_count = source_size / sizeof(float);
+    auto const max_size = std::uint64_t(key_byte_count(value_count)) + source_size;
+    if (max_size >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(max_size);
+}
+
+vbz_size_t vbz_float32_compress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity)
+{
+    auto const max_size = vbz_max_float32_compressed_size(source_size);
+    if (vbz_is_error(max_size))
+    {
+        return max_size;
+    }
+    // Values are written four bytes at a time, relying on the worst case capacity to stay in bounds.
+    if (max_size > destination_capacity)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    VbzTraceScope trace(VBZ_TRACE_STREAMVBYTE_ENCODE, source_size);
+    auto const value_count = source_size / sizeof(float);
+    auto const keys = static_cast<std::uint8_t*>(destination);
+    auto data = keys + key_byte_count(value_count);
+    for_each_code(static_cast<char const*>(source), value_count, [&](std::size_t i, std::uint8_t code, std::uint32_t bits)
+    {
+        if (i & 1)
+        {
+            keys[i / 2] |= std::uint8_t(code << 4);
+        }
+        else
+        {
+            keys[i / 2] = code;
+        }
+
+        std::memcpy(data, &bits, sizeof(bits));
+        data += code_byte_count[code];
+    });
+
+    return vbz_size_t(data - keys);
+}
+
+vbz_size_t vbz_float32_decompress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size)
+{
+    if (destination_size % sizeof(float) != 0)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    VbzTraceScope trace(VBZ_TRACE_STREAMVBYTE_DECODE, source_size);
+    auto const value_count = destination_size / sizeof(float);
+    auto const key_size = key_byte_count(value_count);
+    if (source_size < key_size)
+    {
+        return VBZ_STREAMVBYTE_STREAM_ERROR;
+    }
+
+    auto const keys = static_cast<std::uint8_t const*>(source);
+    {
+        // Check every code is valid, and the codes account for the data exactly, so decoding needs no checks.
+        VbzTraceScope validation_trace(VBZ_TRACE_VALIDATION, source_size);
+        std::size_t data_size = 0;
+        for (std::size_t i = 0; i < key_size; ++i)
+        {
+            auto const low = code_byte_count[keys[i] & 0xF];
+            auto const high = code_byte_count[keys[i] >> 4];
+            if (low == invalid_code_size || high == invalid_code_size)
+            {
+                return VBZ_STREAMVBYTE_STREAM_ERROR;
+            }
+            data_size += low + high;
+        }
+        // The unused half of an odd final key must be zero.
+        if ((value_count & 1) && (keys[key_size - 1] >> 4) != 0)
+        {
+            return VBZ_STREAMVBYTE_STREAM_ERROR;
+        }
+        if (data_size != source_size - key_size)
+        {
+            return VBZ_STREAMVBYTE_STREAM_ERROR;
+        }
+    }
+
+    auto data = keys + key_size;
+    auto const data_end = keys + source_size;
+    auto output = static_cast<char*>(destination);
+    std::uint32_t previous = 0;
+    for (std::size_t i = 0; i < value_count; ++i)
+    {
+        auto const code = std::uint8_t((keys[i / 2] >> ((i & 1) * 4)) & 0xF);
+        auto const byte_count = code_byte_count[code];
+
+        std::uint32_t bits = 0;
+        if (data_end - data >= std::ptrdiff_t(sizeof(bits)))
+        {
+            std::memcpy(&bits, data, sizeof(bits));
+            bits &= byte_count_mask[byte_count];
+        }
+        else
+        {
+            std::memcpy(&bits, data, byte_count);
+        }
+        data += byte_count;
+
+        bits <<= code_shift[code];
+        previous += (bits >> 1) ^ (0u - (bits & 1));
+        auto const value = from_ordered(previous);
+        std::memcpy(output + i * sizeof(value), &value, sizeof(value));
+    }
+
+    return destination_size;
+}
+
+vbz_size_t vbz_float32_statistics(
+    void const* source,
+    vbz_size_t source_size,
+    VbzStreamVByteStatistics* statistics)
+{
+    if (source_size % sizeof(float) != 0)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+
+    auto const value_count = source_size / sizeof(float);
+    std::uint64_t data_bytes = 0;
+    std::uint32_t key = 0;
+    for_each_code(static_cast<char const*>(source), value_count, [&](std::size_t i, std::uint8_t code, std::uint32_t bits)
+    {
+        key |= std::uint32_t(code) << ((i & 1) * 4);
+        if (i & 1)
+        {
+            statistics->key_histogram[key] += 1;
+            key = 0;
+        }
+
+        auto const byte_count = code_byte_count[code];
+        for (std::uint32_t byte = 0; byte < byte_count; ++byte)
+        {
+            statistics->data_histogram[(bits >> (byte * 8)) & 0xFF] += 1;
+        }
+        data_bytes += byte_count;
+    });
+    if (value_count & 1)
+    {
+        statistics->key_histogram[key] += 1;
+    }
+
+    auto const key_bytes = key_byte_count(value_count);
+    statistics->integer_count += value_count;
+    statistics->key_bytes += key_bytes;
+    statistics->data_bytes += data_bytes;
+    return vbz_size_t(key_bytes + data_bytes);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "v0/vbz_streamvbyte.h"
+#include "vbz.h"
+
+// Lossless float32 encoding
+//
+// Each value's bits are mapped to an integer with the same ordering as the floats (so values either
+// side of zero are close), and predicted from the previous value. The zig zag encoded difference has
+// leading zero bytes when neighbouring samples are close, and trailing zero bytes when values have
+// short mantissas (eg: converted integers). A 4 bit key per value records the count of leading and
+// trailing zero bytes, and only the bytes between them are stored. As with streamvbyte, the keys
+// are stored first (two per byte, first value in the low half), followed by the data bytes.
+//
+// The packing is implemented in portable scalar code, there are no SIMD paths as there are for streamvbyte.
+
+/// \brief find the maximum size a float32 data stream encoded with #vbz_float32_compress could be.
+/// \param source_size      The size of the input buffer, in bytes.
+VBZ_EXPORT vbz_size_t vbz_max_float32_compressed_size(
+    vbz_size_t source_size);
+
+/// \brief Encode float32 source data using the predictive float32 encoding.
+/// \param source                       Source data for compression.
+/// \param source_size                  Source data size (in bytes), must be a multiple of 4.
+/// \param destination                  Destination buffer for compressed output.
+/// \param destination_capacity         Size of the destination buffer to write to (see #vbz_max_float32_compressed_size)
+/// \return The number of bytes used to compress data into [destination].
+VBZ_EXPORT vbz_size_t vbz_float32_compress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_capacity);
+
+/// \brief Decode float32 data encoded with #vbz_float32_compress.
+/// \param source                       Source compressed data for decompression.
+/// \param source_size                  Source data size (in bytes)
+/// \param destination                  Destination buffer for decompressed output.
+/// \param destination_size             Size of the destination buffer to write to in bytes, equal to the number of
+///                                     expected output bytes exactly.
+/// \return The number of bytes used to decompress data into [destination].
+VBZ_EXPORT vbz_size_t vbz_float32_decompress(
+    void const* source,
+    vbz_size_t source_size,
+    void* destination,
+    vbz_size_t destination_size);
+
+/// \brief Gather statistics describing the float32 encoding of the source data, without writing the encoded stream.
+/// \note Keys are summarised a byte (two values) at a time, data bytes into data_histogram.
+/// \param source                       Source data to summarise.
+/// \param source_size                  Source data size (in bytes), must be a multiple of 4.
+/// \param statistics                   Statistics to accumulate the encoding summary into.
+/// \return The number of bytes #vbz_float32_compress would write for [source].
+VBZ_EXPORT vbz_size_t vbz_float32_statistics(
+    void const* source,
+    vbz_size_t source_size,
+    VbzStreamVByteStatistics* statistics);
@@ -0,0 +1,105 @@
+#include "vbz_codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// include last - it uses c headers which can mess things up.
+#include "vbz.h"
+
+using namespace vbz::detail;
+
+extern "C" {
+
+vbz_size_t vbz_in_place_decompression_capacity(
+    vbz_size_t source_size,
+    vbz_size_t destination_size,
+    CompressionOptions const* options)
+{
+    if (!is_valid_integer_size(options)) {
+        return VBZ_INTEGER_SIZE_ERROR;
+    }
+
+    std::size_t capacity = std::max(source_size, destination_size);
+    if (zstd_supports_in_place
+        && options->zstd_compression_level != 0
+        && options->integer_size == 0)
+    {
+        // zstd writes directly over the frame, so needs room to stay behind its read position.
+        capacity = std::max<std::size_t>(
+            source_size,
+            destination_size + zstd_in_place_margin(destination_size)
+        );
+    }
+
+    if (capacity >= VBZ_FIRST_ERROR)
+    {
+        return VBZ_INPUT_SIZE_ERROR;
+    }
+    return vbz_size_t(capacity);
+}
+
+vbz_size_t vbz_decompress_in_place(
+    void* buffer,
+    vbz_size_t buffer_capacity,
+    vbz_size_t source_size,
+    vbz_size_t destination_size,
+    CompressionOptions const* options)
+{
+    auto const required_capacity = vbz_in_place_decompression_capacity(source_size, destination_size, options);
+    if (vbz_is_error(required_capacity))
+    {
+        return required_capacity;
+    }
+    if (buffer_capacity < required_capacity)
+    {
+        return VBZ_DESTINATION_SIZE_ERROR;
+    }
+
+    auto const whole_buffer = make_data_buffer(buffer, buffer_capacity);
+    auto const source_buffer = whole_buffer.subspan(buffer_capacity - source_size);
+
+    // When zstd and streamvbyte are both enabled zstd decompresses into an intermediate
+    // buffer (the size of the streamvbyte encoding), so the frame is fully consumed before
+    // anything is written over it.
+    bool const can_decompress_directly = options->zstd_compression_level != 0
+        && (options->integer_size != 0 || zstd_supports_in_place);
+    if (can_decompress_directly)
+    {
+        return vbz_decompress(
+            source_buffer.data(),
+            source_size,
+            whole_buffer.data(),
+            destination_size,
+            options
+        );
+    }
+
+    if (options->zstd_compression_level == 0 && options->integer_size == 0)
+    {
+        if (source_size > destination_size)
+        {
+            return VBZ_DESTINATION_SIZE_ERROR;
+        }
+        std::memmove(whole_buffer.data(), source_buffer.data(), source_size);
+        return source_size;
+    }
+
+    // Otherwise the decoder would overwrite data it has not read yet, decompress from a copy
+    // of the (compressed) source - still avoiding a separate destination sized buffer.
+    std::unique_ptr<void, free_delete> source_copy(malloc(source_size));
+    if (!source_copy && source_size != 0) {
+        return VBZ_OUT_OF_MEMORY_ERROR;
+    }
+    std::copy(source_buffer.begin(), source_buffer.end(), static_cast<char*>(source_copy.get()));
+
+    return vbz_decompress(
+        source_copy.get(),
+        source_size,
+        whole_buffer.data(),
+        destination_size,
+        options
+    );
+}
+
+}
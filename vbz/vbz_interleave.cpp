@@ -0,0 +1,281 @@
+#include "vbz_interleave.h"
+#include "vbz_trace_scope.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __SSE3__
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <x86intrin.h>
+# endif
+#endif
+
+namespace {
+
+// Integers are (de)interleaved in 8x8 tiles, so both the rows read and the rows written stay in cache.
+constexpr std::size_t tile_size = 8;
+
+// Element (frame, channel) of a strided buffer.
+template <typename U>
+struct StridedFrames
+{
+    U* data;
+    std::size_t frame_stride;
+    std::size_t channel_stride;
+
+    U& at(std::size_t frame, std::size_t channel) const
+    {
+        return data[frame * frame_stride + channel * channel_stride];
+    }
+};
+
+#ifdef __SSE3__
+void transpose_8x8(__m128i rows[tile_size])
+{
+    __m128i pairs[tile_size];
+    for (std::size_t i = 0; i < tile_size; i += 2)
+    {
+        pairs[i / 2] = _mm_unpacklo_epi16(rows[i], rows[i + 1]);
+        pairs[i / 2 + 4] = _mm_unpackhi_epi16(rows[i], rows[i + 1]);
+    }
+
+    __m128i quads[tile_size];
+    for (std::size_t i = 0; i < tile_size; i += 4)
+    {
+        quads[i] = _mm_unpacklo_epi32(pairs[i], pairs[i + 1]);
+        quads[i + 1] = _mm_unpackhi_epi32(pairs[i], pairs[i + 1]);
+        quads[i + 2] = _mm_unpacklo_epi32(pairs[i + 2], pairs[i + 3]);
+        quads[i + 3] = _mm_unpackhi_epi32(pairs[i + 2], pairs[i + 3]);
+    }
+
+    for (std::size_t i = 0; i < tile_size; i += 4)
+    {
+        rows[i] = _mm_unpacklo_epi64(quads[i], quads[i + 2]);
+        rows[i + 1] = _mm_unpackhi_epi64(quads[i], quads[i + 2]);
+        rows[i + 2] = _mm_unpacklo_epi64(quads[i + 1], quads[i + 3]);
+        rows[i + 3] = _mm_unpackhi_epi64(quads[i + 1], quads[i + 3]);
+    }
+}
+
+// Transpose a full tile of 16 bit integers when one side is interleaved and the other channel major,
+// adding the channels' offsets while the interleaved rows hold a channel per lane.
+// Returns false if the layouts need the scalar copy.
+bool copy_tile(
+    StridedFrames<std::uint16_t const> source,
+    StridedFrames<std::uint16_t> destination,
+    std::uint16_t const* offsets,
+    std::size_t frame,
+    std::size_t channel)
+{
+    __m128i rows[tile_size];
+    auto const tile_offsets = _mm_loadu_si128(reinterpret_cast<__m128i const*>(offsets + channel));
+    if (source.channel_stride == 1 && destination.frame_stride == 1)
+    {
+        for (std::size_t i = 0; i < tile_size; ++i)
+        {
+            auto const row = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&source.at(frame + i, channel)));
+            rows[i] = _mm_add_epi16(row, tile_offsets);
+        }
+        transpose_8x8(rows);
+        for (std::size_t i = 0; i < tile_size; ++i)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&destination.at(frame, channel + i)), rows[i]);
+        }
+        return true;
+    }
+
+    if (source.frame_stride == 1 && destination.channel_stride == 1)
+    {
+        for (std::size_t i = 0; i < tile_size; ++i)
+        {
+            rows[i] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&source.at(frame, channel + i)));
+        }
+        transpose_8x8(rows);
+        for (std::size_t i = 0; i < tile_size; ++i)
+        {
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(&destination.at(frame + i, channel)),
+                _mm_add_epi16(rows[i], tile_offsets));
+        }
+        return true;
+    }
+    return false;
+}
+#endif
+
+template <typename U>
+bool copy_tile(StridedFrames<U const>, StridedFrames<U>, U const*, std::size_t, std::size_t)
+{
+    return false;
+}
+
+// Copy every integer of [source] to [destination], adding its channel's offset (wrapping).
+template <typename U>
+void copy_frames(
+    StridedFrames<U const> source,
+    StridedFrames<U> destination,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    U const* offsets)
+{
+    for (std::size_t frame = 0; frame < frame_count; frame += tile_size)
+    {
+        auto const frame_end = std::min(frame + tile_size, frame_count);
+        for (std::size_t channel = 0; channel < channel_count; channel += tile_size)
+        {
+            auto const channel_end = std::min(channel + tile_size, channel_count);
+            if (frame_end - frame == tile_size
+                && channel_end - channel == tile_size
+                && copy_tile(source, destination, offsets, frame, channel))
+            {
+                continue;
+            }
+
+            for (auto i = frame; i < frame_end; ++i)
+            {
+                for (auto j = channel; j < channel_end; ++j)
+                {
+                    destination.at(i, j) = U(source.at(i, j) + offsets[j]);
+                }
+            }
+        }
+    }
+}
+
+template <typename U>
+void deinterleave_frames(
+    U const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    std::size_t stride,
+    bool per_channel_delta,
+    U* previous,
+    U* destination)
+{
+    StridedFrames<U const> const input{ source, stride, 1 };
+    StridedFrames<U> const output{ destination, 1, frame_count };
+    auto const last_frame = frame_count - 1;
+
+    // Each channel's first integer follows the previous channel's last (offset) integer in [destination],
+    // offset it so the delta between them is the channel's own delta from its previous block.
+    // The offsets are held in [previous] until the block is copied.
+    U preceding = 0;
+    for (std::size_t channel = 0; channel < channel_count; ++channel)
+    {
+        auto const offset = per_channel_delta ? U(preceding - previous[channel]) : U(0);
+        preceding = U(input.at(last_frame, channel) + offset);
+        previous[channel] = offset;
+    }
+
+    copy_frames(input, output, frame_count, channel_count, static_cast<U const*>(previous));
+
+    for (std::size_t channel = 0; channel < channel_count; ++channel)
+    {
+        previous[channel] = input.at(last_frame, channel);
+    }
+}
+
+template <typename U>
+void interleave_frames(
+    U const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    bool per_channel_delta,
+    U* previous,
+    U* destination,
+    std::size_t frame_stride,
+    std::size_t channel_stride)
+{
+    StridedFrames<U const> const input{ source, 1, frame_count };
+    StridedFrames<U> const output{ destination, frame_stride, channel_stride };
+    auto const last_frame = frame_count - 1;
+
+    // Recompute the offsets #deinterleave_frames applied, and hold their negations in [previous].
+    U preceding = 0;
+    for (std::size_t channel = 0; channel < channel_count; ++channel)
+    {
+        auto const offset = per_channel_delta ? U(preceding - previous[channel]) : U(0);
+        preceding = input.at(last_frame, channel);
+        previous[channel] = U(0 - offset);
+    }
+
+    copy_frames(input, output, frame_count, channel_count, static_cast<U const*>(previous));
+
+    for (std::size_t channel = 0; channel < channel_count; ++channel)
+    {
+        previous[channel] = U(input.at(last_frame, channel) + previous[channel]);
+    }
+}
+}
+
+void vbz_deinterleave_frames(
+    void const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    std::size_t stride,
+    unsigned int integer_size,
+    bool per_channel_delta,
+    void* previous,
+    void* destination)
+{
+    if (frame_count == 0)
+    {
+        return;
+    }
+
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, frame_count * channel_count * integer_size);
+    switch (integer_size)
+    {
+    case 1:
+        deinterleave_frames(static_cast<std::uint8_t const*>(source), frame_count, channel_count, stride,
+                            per_channel_delta, static_cast<std::uint8_t*>(previous), static_cast<std::uint8_t*>(destination));
+        break;
+    case 2:
+        deinterleave_frames(static_cast<std::uint16_t const*>(source), frame_count, channel_count, stride,
+                            per_channel_delta, static_cast<std::uint16_t*>(previous), static_cast<std::uint16_t*>(destination));
+        break;
+    case 4:
+        deinterleave_frames(static_cast<std::uint32_t const*>(source), frame_count, channel_count, stride,
+                            per_channel_delta, static_cast<std::uint32_t*>(previous), static_cast<std::uint32_t*>(destination));
+        break;
+    }
+}
+
+void vbz_interleave_frames(
+    void const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    unsigned int integer_size,
+    bool per_channel_delta,
+    void* previous,
+    void* destination,
+    std::size_t frame_stride,
+    std::size_t channel_stride)
+{
+    if (frame_count == 0)
+    {
+        return;
+    }
+
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, frame_count * channel_count * integer_size);
+    switch (integer_size)
+    {
+    case 1:
+        interleave_frames(static_cast<std::uint8_t const*>(source), frame_count, channel_count, per_channel_delta,
+                          static_cast<std::uint8_t*>(previous), static_cast<std::uint8_t*>(destination),
+                          frame_stride, channel_stride);
+        break;
+    case 2:
+        interleave_frames(static_cast<std::uint16_t const*>(source), frame_count, channel_count, per_channel_delta,
+                          static_cast<std::uint16_t*>(previous), static_cast<std::uint16_t*>(destination),
+                          frame_stride, channel_stride);
+        break;
+    case 4:
+        interleave_frames(static_cast<std::uint32_t const*>(source), frame_count, channel_count, per_channel_delta,
+                          static_cast<std::uint32_t*>(previous), static_cast<std::uint32_t*>(destination),
+                          frame_stride, channel_stride);
+        break;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+
+#include <cstddef>
+
+// Multi channel (de)interleaving
+//
+// Interleaved frames of channels are transposed a block of frames at a time into channel major order,
+// each channel's frames contiguous, for the delta zig zag streamvbyte kernels. The kernels predict each
+// integer from the one before it, so within a block each channel is shifted by an offset (wrapping in the
+// width of the integers) chosen so its first integer is predicted from the channel's last integer of the
+// previous block, rather than the previous channel's. Every channel keeps its own predictor, while the
+// block is still encoded as a single stream. The integers' signedness doesn't affect the wrapping offsets.
+
+/// \brief Transpose [frame_count] frames of [channel_count] interleaved integers of [integer_size] bytes
+///        from [source] into channel major [destination], [frame_count] integers per channel.
+/// \param stride           Integers between the starts of consecutive frames in [source], at least [channel_count].
+/// \param per_channel_delta    Offset the channels so delta encoding [destination] predicts each channel
+///                             from itself, otherwise the integers are copied unchanged.
+/// \param previous         [channel_count] integers holding each channel's last integer of the previous block,
+///                         zero before the first block, updated to this block's last integers.
+VBZ_EXPORT void vbz_deinterleave_frames(
+    void const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    std::size_t stride,
+    unsigned int integer_size,
+    bool per_channel_delta,
+    void* previous,
+    void* destination);
+
+/// \brief Reverse #vbz_deinterleave_frames, writing the channel major integers in [source] to [destination],
+///        with integer (frame, channel) at (frame * frame_stride + channel * channel_stride).
+/// \note A [channel_stride] of 1 re-interleaves the frames, a [frame_stride] of 1 keeps the channels contiguous.
+/// \param previous         As passed to #vbz_deinterleave_frames for the same block, updated in the same way.
+VBZ_EXPORT void vbz_interleave_frames(
+    void const* source,
+    std::size_t frame_count,
+    std::size_t channel_count,
+    unsigned int integer_size,
+    bool per_channel_delta,
+    void* previous,
+    void* destination,
+    std::size_t frame_stride,
+    std::size_t channel_stride);
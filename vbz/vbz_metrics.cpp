@@ -0,0 +1,487 @@
+#include "vbz_metrics_scope.h"
+#include "vbz_trace.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t error_count = std::size_t(vbz_size_t(0) - VBZ_FIRST_ERROR);
+
+// Upper bounds of the latency buckets in nanoseconds, powers of 4 from 1us to about 1s.
+constexpr std::array<std::uint64_t, 11> latency_bounds{ {
+    1000, 4000, 16000, 64000, 256000, 1024000, 4096000, 16384000, 65536000, 262144000, 1048576000,
+} };
+
+// Upper bounds of the compression ratio (compressed / uncompressed size) buckets in millionths.
+constexpr std::array<std::uint64_t, 11> ratio_bounds{ {
+    100000, 200000, 300000, 400000, 500000, 600000, 700000, 800000, 900000, 1000000, 1500000,
+} };
+
+std::array<char const*, VBZ_METRICS_OPERATION_COUNT> const operation_names{ {
+    "compress",
+    "decompress",
+    "transcode",
+} };
+
+template <typename Count, std::size_t BoundCount>
+struct Histogram
+{
+    // The last bucket holds values above every bound.
+    std::array<Count, BoundCount + 1> buckets;
+    Count sum;
+};
+
+template <typename Count>
+struct Counts
+{
+    struct Operation
+    {
+        Count chunks;
+        Count bytes_in;
+        Count bytes_out;
+        std::array<Count, error_count> errors;
+        Histogram<Count, latency_bounds.size()> latency;
+        Histogram<Count, ratio_bounds.size()> ratio;
+    };
+
+    std::array<Operation, VBZ_METRICS_OPERATION_COUNT> operations;
+    std::array<Histogram<Count, latency_bounds.size()>, VBZ_TRACE_STAGE_COUNT> stages;
+};
+
+// Written only by the owning thread, read by writers of the textfile.
+using ThreadCounts = Counts<std::atomic<std::uint64_t>>;
+using Totals = Counts<std::uint64_t>;
+
+void add(std::atomic<std::uint64_t>& count, std::uint64_t value)
+{
+    // Each thread has its own counts, so a load and store is enough.
+    count.store(count.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+template <std::size_t BoundCount>
+void add(
+    Histogram<std::atomic<std::uint64_t>, BoundCount>& histogram,
+    std::array<std::uint64_t, BoundCount> const& bounds,
+    std::uint64_t value)
+{
+    auto const bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    add(histogram.buckets[std::size_t(bucket)], 1);
+    add(histogram.sum, value);
+}
+
+std::uint64_t load(std::atomic<std::uint64_t> const& count)
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+template <std::size_t BoundCount>
+void accumulate(
+    Histogram<std::uint64_t, BoundCount>& total,
+    Histogram<std::atomic<std::uint64_t>, BoundCount> const& histogram)
+{
+    for (std::size_t i = 0; i < total.buckets.size(); ++i)
+    {
+        total.buckets[i] += load(histogram.buckets[i]);
+    }
+    total.sum += load(histogram.sum);
+}
+
+void accumulate(Totals& totals, ThreadCounts const& counts)
+{
+    for (std::size_t i = 0; i < totals.operations.size(); ++i)
+    {
+        auto& total = totals.operations[i];
+        auto const& operation = counts.operations[i];
+        total.chunks += load(operation.chunks);
+        total.bytes_in += load(operation.bytes_in);
+        total.bytes_out += load(operation.bytes_out);
+        for (std::size_t error = 0; error < total.errors.size(); ++error)
+        {
+            total.errors[error] += load(operation.errors[error]);
+        }
+        accumulate(total.latency, operation.latency);
+        accumulate(total.ratio, operation.ratio);
+    }
+    for (std::size_t stage = 0; stage < totals.stages.size(); ++stage)
+    {
+        accumulate(totals.stages[stage], counts.stages[stage]);
+    }
+}
+
+// The counts of each thread that has recorded metrics, folded into [m_retired] as threads exit.
+class Registry
+{
+public:
+    ThreadCounts& attach()
+    {
+        std::unique_ptr<ThreadCounts> counts(new ThreadCounts());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threads.push_back(counts.get());
+        return *counts.release();
+    }
+
+    void detach(ThreadCounts* counts)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        accumulate(m_retired, *counts);
+        m_threads.erase(std::find(m_threads.begin(), m_threads.end(), counts));
+        delete counts;
+    }
+
+    Totals totals()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto totals = m_retired;
+        for (auto counts : m_threads)
+        {
+            accumulate(totals, *counts);
+        }
+        return totals;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<ThreadCounts*> m_threads;
+    Totals m_retired{};
+};
+
+// Never destroyed, threads may still exit after statics are destroyed.
+Registry& registry()
+{
+    static auto registry = new Registry();
+    return *registry;
+}
+
+struct ThreadAttachment
+{
+    ThreadCounts& counts = registry().attach();
+
+    ~ThreadAttachment()
+    {
+        registry().detach(&counts);
+    }
+};
+
+ThreadCounts& thread_counts()
+{
+    thread_local ThreadAttachment attachment;
+    return attachment.counts;
+}
+
+template <std::size_t BoundCount>
+void write_histogram(
+    std::ostream& output,
+    char const* name,
+    std::string const& labels,
+    Histogram<std::uint64_t, BoundCount> const& histogram,
+    std::array<std::uint64_t, BoundCount> const& bounds,
+    double scale)
+{
+    std::uint64_t count = 0;
+    for (std::size_t i = 0; i < histogram.buckets.size(); ++i)
+    {
+        count += histogram.buckets[i];
+        output << name << "_bucket{" << labels << ",le=\"";
+        if (i < bounds.size())
+        {
+            output << double(bounds[i]) * scale;
+        }
+        else
+        {
+            output << "+Inf";
+        }
+        output << "\"} " << count << "\n";
+    }
+    output << name << "_sum{" << labels << "} " << double(histogram.sum) * scale << "\n"
+        << name << "_count{" << labels << "} " << count << "\n";
+}
+
+void write_header(std::ostream& output, char const* name, char const* type, char const* help)
+{
+    output << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+}
+
+void write_totals(std::ostream& output, Totals const& totals)
+{
+    output.precision(9);
+
+    struct Counter
+    {
+        char const* name;
+        char const* help;
+        std::uint64_t Totals::Operation::* count;
+    };
+    std::array<Counter, 3> const counters{ {
+        { "vbz_chunks_total", "Chunks passed to vbz compression calls.", &Totals::Operation::chunks },
+        { "vbz_bytes_in_total", "Bytes consumed by successful calls.", &Totals::Operation::bytes_in },
+        { "vbz_bytes_out_total", "Bytes produced by successful calls.", &Totals::Operation::bytes_out },
+    } };
+    for (auto const& counter : counters)
+    {
+        write_header(output, counter.name, "counter", counter.help);
+        for (std::size_t i = 0; i < totals.operations.size(); ++i)
+        {
+            output << counter.name << "{operation=\"" << operation_names[i] << "\"} "
+                << totals.operations[i].*counter.count << "\n";
+        }
+    }
+
+    write_header(output, "vbz_errors_total", "counter", "Failed calls, by the vbz_error_string of their result.");
+    for (std::size_t i = 0; i < totals.operations.size(); ++i)
+    {
+        for (std::size_t error = 0; error < error_count; ++error)
+        {
+            output << "vbz_errors_total{operation=\"" << operation_names[i]
+                << "\",error=\"" << vbz_error_string(vbz_size_t(0) - vbz_size_t(error + 1)) << "\"} "
+                << totals.operations[i].errors[error] << "\n";
+        }
+    }
+
+    write_header(output, "vbz_compression_ratio", "histogram",
+        "Compressed size over uncompressed size of successful calls.");
+    for (std::size_t i = 0; i < totals.operations.size(); ++i)
+    {
+        write_histogram(output, "vbz_compression_ratio", std::string("operation=\"") + operation_names[i] + "\"",
+            totals.operations[i].ratio, ratio_bounds, 1e-6);
+    }
+
+    write_header(output, "vbz_chunk_duration_seconds", "histogram", "Time taken by each call.");
+    for (std::size_t i = 0; i < totals.operations.size(); ++i)
+    {
+        write_histogram(output, "vbz_chunk_duration_seconds",
+            std::string("operation=\"") + operation_names[i] + "\"", totals.operations[i].latency, latency_bounds, 1e-9);
+    }
+
+    write_header(output, "vbz_stage_duration_seconds", "histogram", "Time taken by each pipeline stage.");
+    for (std::size_t stage = 0; stage < totals.stages.size(); ++stage)
+    {
+        write_histogram(output, "vbz_stage_duration_seconds",
+            std::string("stage=\"") + vbz_trace_stage_name(unsigned(stage)) + "\"", totals.stages[stage],
+            latency_bounds, 1e-9);
+    }
+}
+
+bool write_textfile(std::string const& path)
+{
+    // Textfile collectors may read at any time, so the file is replaced rather than rewritten.
+    auto const temporary_path = path + ".tmp";
+    {
+        std::ofstream output(temporary_path);
+        if (!output)
+        {
+            return false;
+        }
+        write_totals(output, registry().totals());
+        if (!output.flush())
+        {
+            output.close();
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+// Writes the textfile periodically on its own thread.
+class TextfileWriter
+{
+public:
+    ~TextfileWriter()
+    {
+        stop();
+    }
+
+    bool start(std::string path, std::chrono::seconds interval)
+    {
+        stop();
+        m_path = std::move(path);
+        m_interval = interval;
+        m_stopping = false;
+        try
+        {
+            m_thread = std::thread([this] { run(); });
+        }
+        catch (std::system_error const&)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_stop_requested.notify_all();
+        m_thread.join();
+        write_textfile(m_path);
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop_requested.wait_for(lock, m_interval, [this] { return m_stopping; }))
+        {
+            lock.unlock();
+            write_textfile(m_path);
+            lock.lock();
+        }
+    }
+
+    std::string m_path;
+    std::chrono::seconds m_interval{ 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_stop_requested;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+std::atomic<bool> metrics_enabled{ false };
+// Set once the metrics are started or stopped explicitly, which takes precedence over the environment.
+std::atomic<bool> metrics_configured{ false };
+
+std::mutex& control_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+TextfileWriter& textfile_writer()
+{
+    static TextfileWriter writer;
+    return writer;
+}
+
+void stop_textfile_writer()
+{
+    std::lock_guard<std::mutex> lock(control_mutex());
+    textfile_writer().stop();
+}
+
+bool start_metrics(char const* textfile_path, unsigned int interval_seconds)
+{
+    std::lock_guard<std::mutex> lock(control_mutex());
+    metrics_configured.store(true);
+    textfile_writer().stop();
+    if (textfile_path)
+    {
+        // Join the writer, writing the final counts, as the process exits or the library is unloaded,
+        // before the statics it uses are destroyed.
+        static bool const stop_registered = std::atexit(&stop_textfile_writer) == 0;
+        if (!stop_registered || !textfile_writer().start(textfile_path, std::chrono::seconds(interval_seconds)))
+        {
+            return false;
+        }
+    }
+    metrics_enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+}
+
+bool vbz_metrics_enabled()
+{
+    return metrics_enabled.load(std::memory_order_relaxed);
+}
+
+void vbz_metrics_record_stage(unsigned int stage, std::uint64_t nanoseconds)
+{
+    if (stage < VBZ_TRACE_STAGE_COUNT)
+    {
+        add(thread_counts().stages[stage], latency_bounds, nanoseconds);
+    }
+}
+
+void vbz_metrics_record_call(
+    unsigned int operation,
+    vbz_size_t source_size,
+    vbz_size_t result,
+    std::uint64_t nanoseconds)
+{
+    auto& counts = thread_counts().operations[operation];
+    add(counts.chunks, 1);
+    add(counts.latency, latency_bounds, nanoseconds);
+
+    if (vbz_is_error(result))
+    {
+        auto const error = std::size_t(vbz_size_t(0) - result) - 1;
+        if (error < error_count)
+        {
+            add(counts.errors[error], 1);
+        }
+        return;
+    }
+
+    add(counts.bytes_in, source_size);
+    add(counts.bytes_out, result);
+    if (operation == VBZ_METRICS_TRANSCODE)
+    {
+        // Both sides are compressed, so there's no compression ratio to sample.
+        return;
+    }
+
+    auto const uncompressed_size = operation == VBZ_METRICS_COMPRESS ? source_size : result;
+    auto const compressed_size = operation == VBZ_METRICS_COMPRESS ? result : source_size;
+    if (uncompressed_size != 0)
+    {
+        add(counts.ratio, ratio_bounds, std::uint64_t(compressed_size) * 1000000 / uncompressed_size);
+    }
+}
+
+extern "C" {
+
+bool vbz_start_metrics(char const* textfile_path, unsigned int interval_seconds)
+{
+    return start_metrics(textfile_path, std::max(interval_seconds, 1u));
+}
+
+bool vbz_start_metrics_from_environment(void)
+{
+    auto const path = std::getenv(VBZ_METRICS_TEXTFILE_ENVIRONMENT);
+    if (!path || !*path || metrics_configured.load())
+    {
+        return false;
+    }
+
+    unsigned long interval_seconds = 15;
+    if (auto const interval = std::getenv(VBZ_METRICS_INTERVAL_ENVIRONMENT))
+    {
+        interval_seconds = std::strtoul(interval, nullptr, 10);
+    }
+    return start_metrics(path, unsigned(std::max(interval_seconds, 1ul)));
+}
+
+void vbz_stop_metrics(void)
+{
+    std::lock_guard<std::mutex> lock(control_mutex());
+    metrics_configured.store(true);
+    metrics_enabled.store(false, std::memory_order_relaxed);
+    textfile_writer().stop();
+}
+
+bool vbz_write_metrics(char const* path)
+{
+    return write_textfile(path);
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "vbz.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Environment variables read by #vbz_start_metrics_from_environment, for users of applications (and the hdf5
+// plugin, which calls it when hdf loads it) that don't call #vbz_start_metrics themselves.
+// The textfile path to write, e.g. a file in node-exporter's textfile collector directory.
+#define VBZ_METRICS_TEXTFILE_ENVIRONMENT "VBZ_METRICS_TEXTFILE"
+// Seconds between writes, 15 if not set.
+#define VBZ_METRICS_INTERVAL_ENVIRONMENT "VBZ_METRICS_INTERVAL"
+
+/// \brief Start counting compression calls on each thread: chunks, bytes in and out, compression ratios,
+///        call and stage latencies, and errors by type.
+/// \note A chunk is a call to vbz_compress or vbz_decompress (directly, or through the sized, in place, bounded
+///       error and run length functions), or to the checksummed, interleaved and batch functions. Transcoding
+///       calls are counted as their own operation, without a compression ratio.
+///       Counters are kept per thread, so counting adds no contention between threads. They are never
+///       reset, stopping and starting again carries on from the previous counts.
+/// \param textfile_path        Path to write the counts to in Prometheus text format, or null to only count.
+///                             Each write replaces the file atomically, through a temporary file beside it.
+/// \param interval_seconds     Seconds between writes, the file is also written when the metrics are stopped.
+///                             The writing thread is stopped and joined, after a final write, when the
+///                             metrics are stopped or the process exits.
+/// \return True if the metrics were started, false if the writing thread could not be started.
+VBZ_EXPORT bool vbz_start_metrics(char const* textfile_path, unsigned int interval_seconds);
+
+/// \brief Start the metrics as #vbz_start_metrics, writing to the textfile in VBZ_METRICS_TEXTFILE every
+///        VBZ_METRICS_INTERVAL seconds.
+/// \return True if the metrics were started, false if VBZ_METRICS_TEXTFILE isn't set, the metrics were already
+///         started or stopped explicitly, or the writing thread could not be started.
+VBZ_EXPORT bool vbz_start_metrics_from_environment(void);
+
+/// \brief Stop counting, and writing the textfile after a final write.
+VBZ_EXPORT void vbz_stop_metrics(void);
+
+/// \brief Write the current counts to [path] in Prometheus text format.
+/// \return True if the file was written.
+VBZ_EXPORT bool vbz_write_metrics(char const* path);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vbz_metrics.h"
+
+#include <chrono>
+#include <cstdint>
+
+// Operations counted as chunks.
+#define VBZ_METRICS_COMPRESS 0
+#define VBZ_METRICS_DECOMPRESS 1
+#define VBZ_METRICS_TRANSCODE 2
+#define VBZ_METRICS_OPERATION_COUNT 3
+
+/// \brief Check if metrics are being counted.
+VBZ_EXPORT bool vbz_metrics_enabled();
+
+/// \brief Count a VBZ_TRACE_* stage taking [nanoseconds] on the calling thread.
+VBZ_EXPORT void vbz_metrics_record_stage(unsigned int stage, std::uint64_t nanoseconds);
+
+/// \brief Count a VBZ_METRICS_* call on the calling thread, consuming [source_size] bytes and returning [result].
+VBZ_EXPORT void vbz_metrics_record_call(
+    unsigned int operation,
+    vbz_size_t source_size,
+    vbz_size_t result,
+    std::uint64_t nanoseconds);
+
+/// \brief Times a VBZ_METRICS_* call for the lifetime of the scope, while metrics are enabled.
+class VbzMetricsScope
+{
+public:
+    VbzMetricsScope(unsigned int operation, vbz_size_t source_size)
+    : m_enabled(vbz_metrics_enabled())
+    , m_operation(operation)
+    , m_source_size(source_size)
+    {
+        if (m_enabled)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    VbzMetricsScope(VbzMetricsScope const&) = delete;
+    VbzMetricsScope& operator=(VbzMetricsScope const&) = delete;
+
+    /// \brief Count the call, returning its [result].
+    vbz_size_t complete(vbz_size_t result) const
+    {
+        if (m_enabled)
+        {
+            auto const duration = std::chrono::steady_clock::now() - m_start;
+            vbz_metrics_record_call(m_operation, m_source_size, result,
+                std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+        }
+        return result;
+    }
+
+private:
+    bool m_enabled;
+    unsigned int m_operation;
+    vbz_size_t m_source_size;
+    std::chrono::steady_clock::time_point m_start;
+};
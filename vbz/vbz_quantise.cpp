@@ -0,0 +1,139 @@
+#include "vbz_quantise.h"
+#include "vbz_trace_scope.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+template <typename T>
+void quantise(char const* source, std::size_t count, std::uint32_t max_absolute_error, char* destination)
+{
+    // Values and steps are below 2^33, so the correctly rounded quotient is never close enough to
+    // the next integer to round up to it, and the floor is exact, without a 64 bit integer division per value.
+    auto const step = 2 * double(max_absolute_error) + 1;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        T value;
+        std::memcpy(&value, source + i * sizeof(T), sizeof(T));
+        auto const quotient = (double(value) + max_absolute_error) / step;
+        // Truncation rounds negative quotients up, step back down to the floor.
+        auto index = std::int64_t(quotient);
+        index -= double(index) > quotient;
+        auto const stored = T(index);
+        std::memcpy(destination + i * sizeof(T), &stored, sizeof(T));
+    }
+}
+
+template <typename T, typename ProductT>
+void dequantise(char* buffer, std::size_t count, std::uint32_t max_absolute_error)
+{
+    // Indices beyond these reconstruct outside T whatever their value, so are clamped to them first,
+    // keeping corrupt indices' products (of up to 32 bits by 32 bits) from overflowing.
+    auto const step = 2 * ProductT(max_absolute_error) + 1;
+    auto const min_index = ProductT(std::numeric_limits<T>::min()) / step - 1;
+    auto const max_index = ProductT(std::numeric_limits<T>::max()) / step + 1;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        T index;
+        std::memcpy(&index, buffer + i * sizeof(T), sizeof(T));
+        auto const clamped_index = std::min<ProductT>(std::max<ProductT>(index, min_index), max_index);
+        auto const value = T(std::min<ProductT>(
+            std::max<ProductT>(clamped_index * step, std::numeric_limits<T>::min()),
+            std::numeric_limits<T>::max()));
+        std::memcpy(buffer + i * sizeof(T), &value, sizeof(T));
+    }
+}
+
+// Products of 8 or 16 bit indices with steps below 2^15 fit 32 bits, which vectorises far better
+// than the 64 bits needed by larger indices or steps (both below 2^32).
+template <typename T>
+void dequantise(char* buffer, std::size_t count, std::uint32_t max_absolute_error)
+{
+    if (sizeof(T) <= 2 && max_absolute_error < (1 << 14))
+    {
+        dequantise<T, std::int32_t>(buffer, count, max_absolute_error);
+        return;
+    }
+    dequantise<T, std::int64_t>(buffer, count, max_absolute_error);
+}
+}
+
+void vbz_quantise(
+    void const* source,
+    std::size_t count,
+    unsigned int integer_size,
+    bool is_signed,
+    std::uint32_t max_absolute_error,
+    void* destination)
+{
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, count * integer_size);
+    auto const input = static_cast<char const*>(source);
+    auto const output = static_cast<char*>(destination);
+    switch (integer_size)
+    {
+    case 1:
+        if (is_signed) {
+            quantise<std::int8_t>(input, count, max_absolute_error, output);
+        }
+        else {
+            quantise<std::uint8_t>(input, count, max_absolute_error, output);
+        }
+        break;
+    case 2:
+        if (is_signed) {
+            quantise<std::int16_t>(input, count, max_absolute_error, output);
+        }
+        else {
+            quantise<std::uint16_t>(input, count, max_absolute_error, output);
+        }
+        break;
+    case 4:
+        if (is_signed) {
+            quantise<std::int32_t>(input, count, max_absolute_error, output);
+        }
+        else {
+            quantise<std::uint32_t>(input, count, max_absolute_error, output);
+        }
+        break;
+    }
+}
+
+void vbz_dequantise(
+    void* buffer,
+    std::size_t count,
+    unsigned int integer_size,
+    bool is_signed,
+    std::uint32_t max_absolute_error)
+{
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, count * integer_size);
+    auto const data = static_cast<char*>(buffer);
+    switch (integer_size)
+    {
+    case 1:
+        if (is_signed) {
+            dequantise<std::int8_t>(data, count, max_absolute_error);
+        }
+        else {
+            dequantise<std::uint8_t>(data, count, max_absolute_error);
+        }
+        break;
+    case 2:
+        if (is_signed) {
+            dequantise<std::int16_t>(data, count, max_absolute_error);
+        }
+        else {
+            dequantise<std::uint16_t>(data, count, max_absolute_error);
+        }
+        break;
+    case 4:
+        if (is_signed) {
+            dequantise<std::int32_t>(data, count, max_absolute_error);
+        }
+        else {
+            dequantise<std::uint32_t>(data, count, max_absolute_error);
+        }
+        break;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Bounded error quantisation
+//
+// Each value is rounded to the nearest multiple of a step of (2 * max_absolute_error + 1), and
+// stored as the index of that multiple. This is equivalent to quantising the difference from the
+// previous reconstructed value, so delta zig zag encoding the indices gives the quantised residuals,
+// but leaves the indices the same type as the values for the existing streamvbyte kernels.
+// Reconstructed values are clamped to the range of the integer type, which only moves them closer
+// to the original, so every value is within max_absolute_error of the original.
+
+/// \brief Quantise [count] integers of [integer_size] bytes from [source] into indices in [destination].
+/// \note [source] and [destination] may be the same buffer.
+/// \param is_signed            True if the integers are signed.
+/// \param max_absolute_error   Largest difference allowed between a value and its reconstruction,
+///                             between 1 and INT32_MAX.
+VBZ_EXPORT void vbz_quantise(
+    void const* source,
+    std::size_t count,
+    unsigned int integer_size,
+    bool is_signed,
+    std::uint32_t max_absolute_error,
+    void* destination);
+
+/// \brief Reconstruct [count] integers of [integer_size] bytes from the indices in [buffer], in place,
+///        reversing #vbz_quantise.
+/// \note Any indices reconstruct without overflow, corrupt indices give wrong (but in range) values.
+VBZ_EXPORT void vbz_dequantise(
+    void* buffer,
+    std::size_t count,
+    unsigned int integer_size,
+    bool is_signed,
+    std::uint32_t max_absolute_error);
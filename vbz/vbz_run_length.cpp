@@ -0,0 +1,245 @@
+#include "vbz_run_length.h"
+#include "vbz_trace_scope.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
+#ifdef __SSE3__
+# if !defined(_MSC_VER)
+#  include <x86intrin.h>
+# endif
+#endif
+
+namespace {
+
+// Continuation masks cover 16 bytes of integers, with every byte of an integer set if it continues a run.
+constexpr std::size_t mask_bytes = 16;
+constexpr std::uint32_t full_mask = (1u << mask_bytes) - 1;
+
+unsigned int trailing_zero_bits(std::uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return unsigned(__builtin_ctz(value));
+#endif
+}
+
+// The first integer which can continue a run, runs continue from the integers before them.
+std::size_t first_continuing(bool constant_delta)
+{
+    return constant_delta ? 2 : 1;
+}
+
+template <typename U>
+bool continues(U const* values, std::size_t i, bool constant_delta)
+{
+    if (constant_delta)
+    {
+        return U(values[i] - values[i - 1]) == U(values[i - 1] - values[i - 2]);
+    }
+    return values[i] == values[i - 1];
+}
+
+// Continuation mask for the integers from [i], any past [count] don't continue.
+template <typename U>
+std::uint32_t continuation_mask(U const* values, std::size_t i, std::size_t count, bool constant_delta)
+{
+    constexpr std::size_t lanes = mask_bytes / sizeof(U);
+#ifdef __SSE3__
+    if (count - i >= lanes)
+    {
+        auto const load = [&](std::size_t index) {
+            return _mm_loadu_si128(reinterpret_cast<__m128i const*>(values + index));
+        };
+        auto const sub = [](__m128i a, __m128i b) {
+            return sizeof(U) == 1 ? _mm_sub_epi8(a, b) : sizeof(U) == 2 ? _mm_sub_epi16(a, b) : _mm_sub_epi32(a, b);
+        };
+        auto const equal = [](__m128i a, __m128i b) {
+            return sizeof(U) == 1 ? _mm_cmpeq_epi8(a, b) : sizeof(U) == 2 ? _mm_cmpeq_epi16(a, b) : _mm_cmpeq_epi32(a, b);
+        };
+
+        auto const current = load(i);
+        auto const previous = load(i - 1);
+        auto const matches = constant_delta
+            ? equal(sub(current, previous), sub(previous, load(i - 2)))
+            : equal(current, previous);
+        return std::uint32_t(_mm_movemask_epi8(matches));
+    }
+#endif
+
+    std::uint32_t mask = 0;
+    for (std::size_t lane = 0; lane < lanes && i + lane < count; ++lane)
+    {
+        if (continues(values, i + lane, constant_delta))
+        {
+            mask |= ((1u << sizeof(U)) - 1) << (lane * sizeof(U));
+        }
+    }
+    return mask;
+}
+
+template <typename U>
+std::size_t collapse_runs(U const* source, std::size_t count, bool constant_delta, U* destination, std::uint32_t* runs)
+{
+    std::size_t run_count = 0;
+    std::size_t kept_count = 0;
+    std::size_t previous_end = 0;
+    auto run_start = first_continuing(constant_delta);
+
+    // Integers [run_start, end) continue from those before them, collapse them if there are enough.
+    auto const end_run = [&](std::size_t end)
+    {
+        if (end < run_start + vbz_min_collapsed_run)
+        {
+            return;
+        }
+        auto const kept = run_start - previous_end;
+        std::memcpy(destination + kept_count, source + previous_end, kept * sizeof(U));
+        kept_count += kept;
+        runs[2 * run_count] = std::uint32_t(kept);
+        runs[2 * run_count + 1] = std::uint32_t(end - run_start);
+        ++run_count;
+        previous_end = end;
+    };
+
+    constexpr std::size_t lanes = mask_bytes / sizeof(U);
+    for (auto i = run_start; i < count; i += lanes)
+    {
+        auto const mask = continuation_mask(source, i, count, constant_delta);
+        // Runs span whole masks quickly, otherwise visit each integer breaking a run.
+        auto breaks = ~mask & full_mask;
+        while (breaks != 0)
+        {
+            auto const lane = trailing_zero_bits(breaks) / sizeof(U);
+            auto const index = i + lane;
+            if (index >= count)
+            {
+                break;
+            }
+            end_run(index);
+            run_start = index + 1;
+            breaks &= ~(((1u << sizeof(U)) - 1) << (lane * sizeof(U)));
+        }
+    }
+    end_run(count);
+
+    std::memcpy(destination + kept_count, source + previous_end, (count - previous_end) * sizeof(U));
+    return run_count;
+}
+
+template <typename U>
+bool expand_runs(
+    U* buffer,
+    std::size_t kept_count,
+    std::size_t count,
+    bool constant_delta,
+    std::uint32_t const* runs,
+    std::size_t run_count)
+{
+    // Check the runs account for every integer, and the first run has integers to continue from.
+    std::uint64_t total_kept = 0;
+    std::uint64_t total_collapsed = 0;
+    for (std::size_t r = 0; r < run_count; ++r)
+    {
+        total_kept += runs[2 * r];
+        total_collapsed += runs[2 * r + 1];
+    }
+    if (total_kept > kept_count
+        || total_collapsed != count - kept_count
+        || (run_count != 0 && runs[0] < first_continuing(constant_delta)))
+    {
+        return false;
+    }
+
+    // Move the kept integers to their final positions, the last first so none are overwritten.
+    auto segment = kept_count - std::size_t(total_kept);
+    auto source_end = kept_count;
+    auto destination_end = count;
+    for (auto r = run_count; r-- > 0;)
+    {
+        std::memmove(buffer + destination_end - segment, buffer + source_end - segment, segment * sizeof(U));
+        source_end -= segment;
+        destination_end -= segment + runs[2 * r + 1];
+        segment = runs[2 * r];
+    }
+
+    // Then fill the runs in order, as each may continue from the end of the one before.
+    std::size_t position = 0;
+    for (std::size_t r = 0; r < run_count; ++r)
+    {
+        position += runs[2 * r];
+        auto const length = runs[2 * r + 1];
+        auto const base = buffer[position - 1];
+        auto const delta = constant_delta ? U(base - buffer[position - 2]) : U(0);
+        // Each integer is computed from the base, rather than the one before, so the fill vectorises.
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            buffer[position + i] = U(base + U(i + 1) * delta);
+        }
+        position += length;
+    }
+    return true;
+}
+}
+
+std::size_t vbz_max_run_count(std::size_t count)
+{
+    // Runs are separated by at least one kept integer.
+    return count / (vbz_min_collapsed_run + 1) + 1;
+}
+
+std::size_t vbz_collapse_runs(
+    void const* source,
+    std::size_t count,
+    unsigned int integer_size,
+    bool constant_delta,
+    void* destination,
+    std::uint32_t* runs)
+{
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, count * integer_size);
+    switch (integer_size)
+    {
+    case 1:
+        return collapse_runs(static_cast<std::uint8_t const*>(source), count, constant_delta,
+                             static_cast<std::uint8_t*>(destination), runs);
+    case 2:
+        return collapse_runs(static_cast<std::uint16_t const*>(source), count, constant_delta,
+                             static_cast<std::uint16_t*>(destination), runs);
+    case 4:
+        return collapse_runs(static_cast<std::uint32_t const*>(source), count, constant_delta,
+                             static_cast<std::uint32_t*>(destination), runs);
+    }
+    return 0;
+}
+
+bool vbz_expand_runs(
+    void* buffer,
+    std::size_t kept_count,
+    std::size_t count,
+    unsigned int integer_size,
+    bool constant_delta,
+    std::uint32_t const* runs,
+    std::size_t run_count)
+{
+    if (kept_count > count)
+    {
+        return false;
+    }
+
+    VbzTraceScope trace(VBZ_TRACE_TRANSFORM, count * integer_size);
+    switch (integer_size)
+    {
+    case 1:
+        return expand_runs(static_cast<std::uint8_t*>(buffer), kept_count, count, constant_delta, runs, run_count);
+    case 2:
+        return expand_runs(static_cast<std::uint16_t*>(buffer), kept_count, count, constant_delta, runs, run_count);
+    case 4:
+        return expand_runs(static_cast<std::uint32_t*>(buffer), kept_count, count, constant_delta, runs, run_count);
+    }
+    return false;
+}
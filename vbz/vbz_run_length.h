@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Run length collapsing
+//
+// A run is a stretch of integers each predictable from the integers before it: equal to the previous
+// integer, or with constant_delta, differing from it by the same (wrapping) delta as the previous pair.
+// Runs of at least vbz_min_collapsed_run integers are removed, leaving the integers they continue from,
+// and recorded as a pair of uint32s: the number of integers kept since the end of the previous run (or
+// the start), then the number removed. Zero runs in masks and move tables, and ramps in signal, then
+// cost a record rather than a key (and possibly data) per integer.
+
+/// Runs shorter than this are kept, a record would cost more than the integers compress to.
+constexpr std::size_t vbz_min_collapsed_run = 32;
+
+/// \brief Find the most runs #vbz_collapse_runs can record for [count] integers.
+VBZ_EXPORT std::size_t vbz_max_run_count(std::size_t count);
+
+/// \brief Remove the runs from [count] integers of [integer_size] bytes in [source].
+/// \param constant_delta   Collapse runs of a constant delta, rather than of a constant value.
+/// \param destination      Receives the integers not in runs, needs space for [count] integers.
+/// \param runs             Receives a pair of uint32s per run, needs space for #vbz_max_run_count pairs.
+/// \return The number of runs recorded.
+VBZ_EXPORT std::size_t vbz_collapse_runs(
+    void const* source,
+    std::size_t count,
+    unsigned int integer_size,
+    bool constant_delta,
+    void* destination,
+    std::uint32_t* runs);
+
+/// \brief Restore the runs removed by #vbz_collapse_runs, in place.
+/// \param buffer           Holds the [kept_count] integers not in runs, with space for [count] integers.
+/// \param runs             [run_count] pairs of uint32s, as recorded by #vbz_collapse_runs.
+/// \return False (leaving [buffer] partially restored) if the runs don't account for [kept_count] and [count].
+VBZ_EXPORT bool vbz_expand_runs(
+    void* buffer,
+    std::size_t kept_count,
+    std::size_t count,
+    unsigned int integer_size,
+    bool constant_delta,
+    std::uint32_t const* runs,
+    std::size_t run_count);
@@ -0,0 +1,168 @@
+#include "vbz_scratch_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__linux__)
+# include <sys/mman.h>
+# define VBZ_SCRATCH_ARENA_MMAP 1
+#endif
+
+// include last - it uses c headers which can mess things up.
+#include "vbz.h"
+
+namespace {
+
+// Regions are sized (and for transparent huge pages, aligned) in multiples of the
+// x86/arm64 huge page size, smaller pages divide it exactly.
+constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+constexpr std::size_t small_page_size = 4 * 1024;
+
+std::size_t round_up(std::size_t size, std::size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+#ifdef VBZ_SCRATCH_ARENA_MMAP
+
+void* map_explicit_huge_pages(std::size_t size)
+{
+#ifdef MAP_HUGETLB
+    // Fails unless huge pages have been reserved (vm.nr_hugepages), callers fall back.
+    auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (data != MAP_FAILED)
+    {
+        return data;
+    }
+#endif
+    (void)size;
+    return nullptr;
+}
+
+// Map [size] bytes aligned to a huge page, so the kernel can back the whole region
+// with transparent huge pages.
+void* map_transparent_huge_pages(std::size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    auto const mapped_size = size + huge_page_size;
+    auto mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    auto const mapped_begin = reinterpret_cast<std::uintptr_t>(mapped);
+    auto const begin = round_up(mapped_begin, huge_page_size);
+    auto const head = begin - mapped_begin;
+    auto const tail = mapped_size - head - size;
+    if (head)
+    {
+        munmap(mapped, head);
+    }
+    if (tail)
+    {
+        munmap(reinterpret_cast<void*>(begin + size), tail);
+    }
+
+    auto data = reinterpret_cast<void*>(begin);
+    if (madvise(data, size, MADV_HUGEPAGE) != 0)
+    {
+        // Transparent huge pages are unavailable (or disabled) on this kernel.
+        munmap(data, size);
+        return nullptr;
+    }
+
+    // Fault the region in now the advice is in place, so calls using it don't.
+    auto bytes = static_cast<volatile char*>(data);
+    for (std::size_t offset = 0; offset < size; offset += small_page_size)
+    {
+        bytes[offset] = 0;
+    }
+    return data;
+#else
+    (void)size;
+    return nullptr;
+#endif
+}
+
+void* map_default_pages(std::size_t size)
+{
+    auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    return data == MAP_FAILED ? nullptr : data;
+}
+
+#endif
+
+}
+
+VbzScratchArena::VbzScratchArena(unsigned int page_mode)
+: m_requested_page_mode(page_mode)
+, m_mapped_page_mode(VBZ_SCRATCH_ARENA_DEFAULT_PAGES)
+{
+}
+
+VbzScratchArena::~VbzScratchArena()
+{
+    release();
+}
+
+void* VbzScratchArena::reserve(std::size_t size)
+{
+    if (m_data && size <= m_capacity)
+    {
+        return m_data;
+    }
+
+    // Grow geometrically, so slowly increasing sizes don't remap on every call.
+    auto const capacity = round_up(std::max(std::max<std::size_t>(size, 1), m_capacity * 2), huge_page_size);
+    release();
+
+#ifdef VBZ_SCRATCH_ARENA_MMAP
+    if (m_requested_page_mode == VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES)
+    {
+        m_data = map_explicit_huge_pages(capacity);
+        m_mapped_page_mode = VBZ_SCRATCH_ARENA_EXPLICIT_HUGE_PAGES;
+    }
+    if (!m_data && m_requested_page_mode != VBZ_SCRATCH_ARENA_DEFAULT_PAGES)
+    {
+        m_data = map_transparent_huge_pages(capacity);
+        m_mapped_page_mode = VBZ_SCRATCH_ARENA_TRANSPARENT_HUGE_PAGES;
+    }
+    if (!m_data)
+    {
+        m_data = map_default_pages(capacity);
+        m_mapped_page_mode = VBZ_SCRATCH_ARENA_DEFAULT_PAGES;
+    }
+#else
+    // Huge pages are only requested on linux, elsewhere the arena just keeps its storage across calls.
+    m_data = malloc(capacity);
+    m_mapped_page_mode = VBZ_SCRATCH_ARENA_DEFAULT_PAGES;
+#endif
+
+    if (m_data)
+    {
+        m_capacity = capacity;
+    }
+    return m_data;
+}
+
+void VbzScratchArena::release()
+{
+    if (!m_data)
+    {
+        return;
+    }
+
+#ifdef VBZ_SCRATCH_ARENA_MMAP
+    munmap(m_data, m_capacity);
+#else
+    free(m_data);
+#endif
+    m_data = nullptr;
+    m_capacity = 0;
+    m_mapped_page_mode = VBZ_SCRATCH_ARENA_DEFAULT_PAGES;
+}
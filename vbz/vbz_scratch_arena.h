@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+/// \brief Scratch memory reused across compression calls, see #vbz_create_scratch_arena.
+///
+/// Holds a single region, since each call only needs one intermediate buffer at a time.
+/// The region grows to fit the largest request seen, and stays mapped (and faulted in)
+/// until the arena is freed.
+struct VbzScratchArena
+{
+public:
+    explicit VbzScratchArena(unsigned int page_mode);
+    ~VbzScratchArena();
+
+    VbzScratchArena(VbzScratchArena const&) = delete;
+    VbzScratchArena& operator=(VbzScratchArena const&) = delete;
+
+    /// \brief Find storage for at least [size] bytes, valid until the next call to reserve.
+    /// \return The storage, or null if it could not be allocated.
+    void* reserve(std::size_t size);
+
+    /// \brief The page mode the current region was mapped with.
+    unsigned int page_mode() const { return m_mapped_page_mode; }
+
+    /// \brief The size of the current region in bytes.
+    std::size_t capacity() const { return m_capacity; }
+
+private:
+    void release();
+
+    unsigned int m_requested_page_mode;
+    unsigned int m_mapped_page_mode;
+    void* m_data = nullptr;
+    std::size_t m_capacity = 0;
+};
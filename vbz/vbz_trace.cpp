@@ -0,0 +1,257 @@
+#include "vbz_trace_scope.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace {
+
+// The registered hooks, replaced in place. Stages copy them under a sequence lock (odd while they are
+// being replaced), so a call that copied the previous hooks can finish its stage after they are replaced.
+std::atomic<bool> tracing{ false };
+std::atomic<std::uint32_t> hooks_sequence{ 0 };
+std::atomic<vbz_trace_hook> hooks_begin{ nullptr };
+std::atomic<vbz_trace_hook> hooks_end{ nullptr };
+std::atomic<void*> hooks_user_data{ nullptr };
+
+std::mutex& registration_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+void no_op_hook(unsigned int, vbz_size_t, void*)
+{
+}
+
+std::array<char const*, VBZ_TRACE_STAGE_COUNT> const stage_names{ {
+    "transform",
+    "streamvbyte_encode",
+    "streamvbyte_decode",
+    "zstd_compress",
+    "zstd_decompress",
+    "validation",
+    "plugin_allocation",
+} };
+
+// Fields are atomic as a slot may be read while it is rewritten, [sequence] tells whether the read
+// was consistent: 2 * index + 2 once event [index] is written, odd while it is being written.
+struct TraceEvent
+{
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> timestamp_ns;
+    std::atomic<std::uint32_t> thread;
+    std::atomic<vbz_size_t> size;
+    std::atomic<std::uint8_t> stage;
+    std::atomic<bool> begin;
+};
+
+// Small sequential ids for threads, as chrome traces expect numeric thread ids.
+std::uint32_t current_thread_id()
+{
+    static std::atomic<std::uint32_t> next_thread_id{ 1 };
+    thread_local std::uint32_t const thread_id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+    return thread_id;
+}
+
+// Records begin/end events into a fixed size ring, each event claims its slot with one atomic increment.
+// Once the ring wraps a slot may be claimed by two threads at once, the later event is dropped rather
+// than tearing the slot, so the ring is lossy under contention.
+class TraceRecorder
+{
+public:
+    bool start(std::size_t event_capacity)
+    {
+        if (event_capacity != m_capacity)
+        {
+            m_events.reset(new (std::nothrow) TraceEvent[event_capacity]);
+            m_capacity = m_events ? event_capacity : 0;
+        }
+        for (std::size_t i = 0; i < m_capacity; ++i)
+        {
+            m_events[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        m_next_event.store(0, std::memory_order_relaxed);
+        m_epoch = std::chrono::steady_clock::now();
+        return m_capacity != 0;
+    }
+
+    void record(unsigned int stage, vbz_size_t size, bool begin)
+    {
+        auto const timestamp = std::chrono::steady_clock::now() - m_epoch;
+        auto const index = m_next_event.fetch_add(1, std::memory_order_relaxed);
+
+        auto& event = m_events[index % m_capacity];
+        // Claim the slot, unless another thread is writing it or has written a newer event to it.
+        auto sequence = event.sequence.load(std::memory_order_relaxed);
+        auto const claimed = 2 * index + 1;
+        if (sequence % 2 != 0
+            || sequence > claimed
+            || !event.sequence.compare_exchange_strong(sequence, claimed, std::memory_order_relaxed))
+        {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        event.timestamp_ns.store(
+            std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp).count()),
+            std::memory_order_relaxed);
+        event.thread.store(current_thread_id(), std::memory_order_relaxed);
+        event.size.store(size, std::memory_order_relaxed);
+        event.stage.store(std::uint8_t(stage), std::memory_order_relaxed);
+        event.begin.store(begin, std::memory_order_relaxed);
+        event.sequence.store(claimed + 1, std::memory_order_release);
+    }
+
+    bool write_json(char const* path) const
+    {
+        std::ofstream output(path);
+        if (!output)
+        {
+            return false;
+        }
+
+        auto const recorded = m_next_event.load(std::memory_order_relaxed);
+        auto const count = std::min<std::uint64_t>(recorded, m_capacity);
+
+        output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (auto index = recorded - count; index < recorded; ++index)
+        {
+            // Skip events dropped, still being written, or rewritten while being read.
+            auto const& event = m_events[index % m_capacity];
+            auto const sequence = event.sequence.load(std::memory_order_acquire);
+            auto const timestamp_ns = event.timestamp_ns.load(std::memory_order_relaxed);
+            auto const thread = event.thread.load(std::memory_order_relaxed);
+            auto const size = event.size.load(std::memory_order_relaxed);
+            auto const stage = event.stage.load(std::memory_order_relaxed);
+            auto const begin = event.begin.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence != 2 * index + 2 || event.sequence.load(std::memory_order_relaxed) != sequence)
+            {
+                continue;
+            }
+
+            output << (first ? "\n" : ",\n")
+                << "{\"name\":\"" << vbz_trace_stage_name(stage) << "\""
+                << ",\"cat\":\"vbz\""
+                << ",\"ph\":\"" << (begin ? "B" : "E") << "\""
+                << ",\"ts\":" << std::fixed << std::setprecision(3) << timestamp_ns / 1000.0
+                << ",\"pid\":1"
+                << ",\"tid\":" << thread
+                << ",\"args\":{\"size\":" << size << "}}";
+            first = false;
+        }
+        output << "\n]}\n";
+        return bool(output);
+    }
+
+private:
+    std::unique_ptr<TraceEvent[]> m_events;
+    std::size_t m_capacity = 0;
+    std::atomic<std::uint64_t> m_next_event{ 0 };
+    std::chrono::steady_clock::time_point m_epoch;
+};
+
+TraceRecorder& recorder()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+void record_begin(unsigned int stage, vbz_size_t size, void*)
+{
+    recorder().record(stage, size, true);
+}
+
+void record_end(unsigned int stage, vbz_size_t size, void*)
+{
+    recorder().record(stage, size, false);
+}
+
+}
+
+bool vbz_load_trace_hooks(VbzTraceHooks& hooks)
+{
+    if (!tracing.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        auto const sequence = hooks_sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0)
+        {
+            continue;
+        }
+        hooks.begin = hooks_begin.load(std::memory_order_relaxed);
+        hooks.end = hooks_end.load(std::memory_order_relaxed);
+        hooks.user_data = hooks_user_data.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (hooks_sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return true;
+        }
+    }
+}
+
+extern "C" {
+
+void vbz_set_trace_hooks(vbz_trace_hook begin, vbz_trace_hook end, void* user_data)
+{
+    std::lock_guard<std::mutex> lock(registration_mutex());
+    if (!begin && !end)
+    {
+        tracing.store(false, std::memory_order_release);
+        return;
+    }
+
+    auto const sequence = hooks_sequence.load(std::memory_order_relaxed);
+    hooks_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    hooks_begin.store(begin ? begin : no_op_hook, std::memory_order_relaxed);
+    hooks_end.store(end ? end : no_op_hook, std::memory_order_relaxed);
+    hooks_user_data.store(user_data, std::memory_order_relaxed);
+    hooks_sequence.store(sequence + 2, std::memory_order_release);
+    tracing.store(true, std::memory_order_release);
+}
+
+char const* vbz_trace_stage_name(unsigned int stage)
+{
+    if (stage >= stage_names.size())
+    {
+        return "unknown";
+    }
+    return stage_names[stage];
+}
+
+bool vbz_start_trace_recorder(size_t event_capacity)
+{
+    vbz_set_trace_hooks(nullptr, nullptr, nullptr);
+    if (!recorder().start(event_capacity))
+    {
+        return false;
+    }
+    vbz_set_trace_hooks(record_begin, record_end, nullptr);
+    return true;
+}
+
+void vbz_stop_trace_recorder(void)
+{
+    vbz_set_trace_hooks(nullptr, nullptr, nullptr);
+}
+
+bool vbz_write_trace_recorder_json(char const* path)
+{
+    return recorder().write_json(path);
+}
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "vbz/vbz_export.h"
+#include "vbz.h"
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Pipeline stages reported to trace hooks, stages may nest within each other.
+// Delta zig zag (and integer width) conversion, reported inside the streamvbyte stages.
+// Vectorised kernels that fuse the transform into the encoding don't report it separately.
+#define VBZ_TRACE_TRANSFORM 0
+// Streamvbyte encoding of integers, or the float32 encoding of floats.
+#define VBZ_TRACE_STREAMVBYTE_ENCODE 1
+#define VBZ_TRACE_STREAMVBYTE_DECODE 2
+#define VBZ_TRACE_ZSTD_COMPRESS 3
+#define VBZ_TRACE_ZSTD_DECOMPRESS 4
+// Checking a streamvbyte stream is well formed before decoding it.
+#define VBZ_TRACE_VALIDATION 5
+// The hdf5 plugin allocating a chunk buffer.
+#define VBZ_TRACE_PLUGIN_ALLOCATION 6
+#define VBZ_TRACE_STAGE_COUNT 7
+
+/// \brief Callback made at the beginning or end of a pipeline stage.
+/// \param stage        The VBZ_TRACE_* stage.
+/// \param size         The number of bytes the stage consumes.
+/// \param user_data    The user data passed to #vbz_set_trace_hooks.
+typedef void (*vbz_trace_hook)(unsigned int stage, vbz_size_t size, void* user_data);
+
+/// \brief Register callbacks made around every pipeline stage, on the thread performing the stage.
+/// \note Pass null hooks to stop tracing, stages only cost an atomic load when no hooks are registered.
+///       The hooks replace any registered before, calls already in progress may use the previous hooks
+///       until their current stage ends.
+/// \param begin        Called as a stage begins.
+/// \param end          Called as a stage ends.
+/// \param user_data    Passed to each call of [begin] and [end].
+VBZ_EXPORT void vbz_set_trace_hooks(vbz_trace_hook begin, vbz_trace_hook end, void* user_data);
+
+/// \brief Find a short name for a VBZ_TRACE_* stage.
+VBZ_EXPORT char const* vbz_trace_stage_name(unsigned int stage);
+
+/// \brief Start recording stages into a ring buffer, replacing any registered hooks.
+/// \note Once full the oldest events are overwritten. Events whose slot another thread is writing at the
+///       same time (only possible once the ring wraps) are dropped, so the ring is lossy but never torn.
+///       Don't restart the recorder with a different capacity while other threads are compressing, they
+///       may still be recording into the old buffer.
+/// \param event_capacity   Number of events to keep, each stage records a begin and an end event.
+/// \return True if the recorder was started, false if the buffer could not be allocated.
+VBZ_EXPORT bool vbz_start_trace_recorder(size_t event_capacity);
+
+/// \brief Stop recording, removing the recorder's hooks. Recorded events are kept until the next start.
+VBZ_EXPORT void vbz_stop_trace_recorder(void);
+
+/// \brief Write the recorded events to [path] as a Chrome trace (viewable in chrome://tracing or Perfetto).
+/// \note The recorder should be stopped first, events recorded during the write may be inconsistent.
+/// \return True if the file was written.
+VBZ_EXPORT bool vbz_write_trace_recorder_json(char const* path);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vbz_metrics_scope.h"
+#include "vbz_trace.h"
+
+#include <chrono>
+#include <cstddef>
+
+/// \brief Hooks registered with #vbz_set_trace_hooks.
+struct VbzTraceHooks
+{
+    vbz_trace_hook begin;
+    vbz_trace_hook end;
+    void* user_data;
+};
+
+/// \brief Copy the registered trace hooks into [hooks], returning false if tracing is off.
+VBZ_EXPORT bool vbz_load_trace_hooks(VbzTraceHooks& hooks);
+
+/// \brief Reports a pipeline stage to the registered trace hooks for the lifetime of the scope,
+///        and times it while metrics are enabled.
+class VbzTraceScope
+{
+public:
+    VbzTraceScope(unsigned int stage, std::size_t size)
+    : m_traced(vbz_load_trace_hooks(m_hooks))
+    , m_stage(stage)
+    , m_size(vbz_size_t(size))
+    , m_metrics(vbz_metrics_enabled())
+    {
+        if (m_traced)
+        {
+            m_hooks.begin(m_stage, m_size, m_hooks.user_data);
+        }
+        if (m_metrics)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~VbzTraceScope()
+    {
+        if (m_metrics)
+        {
+            auto const duration = std::chrono::steady_clock::now() - m_start;
+            vbz_metrics_record_stage(m_stage,
+                std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+        }
+        if (m_traced)
+        {
+            m_hooks.end(m_stage, m_size, m_hooks.user_data);
+        }
+    }
+
+    VbzTraceScope(VbzTraceScope const&) = delete;
+    VbzTraceScope& operator=(VbzTraceScope const&) = delete;
+
+private:
+    // The hooks the stage began with, which it also ends with.
+    VbzTraceHooks m_hooks;
+    bool m_traced;
+    unsigned int m_stage;
+    vbz_size_t m_size;
+    bool m_metrics;
+    std::chrono::steady_clock::time_point m_start;
+};
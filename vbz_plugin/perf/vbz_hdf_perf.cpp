@@ -4,10 +4,14 @@
 #include "hdf_id_helper.h"
 #include "vbz_plugin.h"
 #include "vbz_plugin_user_utils.h"
+#include "vbz.h"
 
 #include <hdf5.h>
 
 #include <array>
+#include <cstdio>
+#include <random>
+#include <string>
 
 #include <benchmark/benchmark.h>
 
@@ -65,17 +69,52 @@ void no_filter(hid_t creation_properties, int)
 
 using FilterSetupFn = decltype(no_filter)*;
 
+template <bool UseZigZag, std::size_t ZstdLevel>
+CompressionOptions vbz_filter_options(int int_size)
+{
+    return CompressionOptions{ UseZigZag, (unsigned int)int_size, ZstdLevel, FILTER_VBZ_VERSION };
+}
+
+// Report how much smaller the chunk buffers handed back to hdf are than the worst case
+// allocation the filter would otherwise hold on to.
+void report_chunk_memory(
+    benchmark::State& state,
+    std::size_t chunk_count,
+    std::size_t worst_case_bytes,
+    std::size_t stored_bytes)
+{
+    if (chunk_count == 0)
+    {
+        return;
+    }
+
+    state.counters["worst_case_chunk_bytes"] = double(worst_case_bytes) / chunk_count;
+    state.counters["stored_chunk_bytes"] = double(stored_bytes) / chunk_count;
+    state.counters["saved_bytes_per_chunk"] = double(worst_case_bytes - stored_bytes) / chunk_count;
+}
+
 template <typename Generator>
-void vbz_hdf_benchmark(benchmark::State& state, int integer_size, hid_t h5_type, FilterSetupFn setup_filter)
+void vbz_hdf_benchmark(
+    benchmark::State& state,
+    int integer_size,
+    hid_t h5_type,
+    FilterSetupFn setup_filter,
+    CompressionOptions const* vbz_options = nullptr)
 {
     (void)plugin_init_result;
     std::size_t max_element_count = 0;
     auto input_value_list = Generator::generate(max_element_count);
     
     std::size_t item_count = 0;
+    std::size_t chunk_count = 0;
+    std::size_t worst_case_bytes = 0;
+    std::size_t stored_bytes = 0;
     for (auto _ : state)
     {
         std::size_t id = 0;
+        chunk_count = 0;
+        worst_case_bytes = 0;
+        stored_bytes = 0;
         
         state.PauseTiming();
         auto file_id = H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
@@ -98,17 +137,34 @@ void vbz_hdf_benchmark(benchmark::State& state, int integer_size, hid_t h5_type,
             auto val = write_full_dataset(dataset.get(), h5_type, input_values);
             item_count += input_values.size();
             benchmark::DoNotOptimize(val);
+
+            if (vbz_options)
+            {
+                state.PauseTiming();
+                // Each dataset is written as a single chunk.
+                chunk_count += 1;
+                worst_case_bytes += vbz_max_compressed_size(
+                    vbz_size_t(input_values.size() * integer_size),
+                    vbz_options);
+                stored_bytes += H5Dget_storage_size(dataset.get());
+                state.ResumeTiming();
+            }
         }
     }
 
     state.SetItemsProcessed(state.iterations() * item_count);
     state.SetBytesProcessed(state.iterations() * item_count * integer_size);
+    if (vbz_options)
+    {
+        report_chunk_memory(state, chunk_count, worst_case_bytes, stored_bytes);
+    }
 }
 
 template <typename IntType, int ZstdLevel>
 void vbz_hdf_benchmark_sequence(benchmark::State& state)
 {
-    vbz_hdf_benchmark<SequenceGenerator<IntType>>(state, sizeof(IntType), get_h5_type<IntType>(), vbz_filter<true, ZstdLevel>);
+    auto const options = vbz_filter_options<true, ZstdLevel>(sizeof(IntType));
+    vbz_hdf_benchmark<SequenceGenerator<IntType>>(state, sizeof(IntType), get_h5_type<IntType>(), vbz_filter<true, ZstdLevel>, &options);
 }
 
 template <typename IntType>
@@ -126,7 +182,8 @@ void vbz_hdf_benchmark_sequence_zlib(benchmark::State& state)
 template <typename IntType, int ZstdLevel>
 void vbz_hdf_benchmark_random(benchmark::State& state)
 {
-    vbz_hdf_benchmark<SignalGenerator<IntType>>(state, sizeof(IntType), get_h5_type<IntType>(), vbz_filter<true, ZstdLevel>);
+    auto const options = vbz_filter_options<true, ZstdLevel>(sizeof(IntType));
+    vbz_hdf_benchmark<SignalGenerator<IntType>>(state, sizeof(IntType), get_h5_type<IntType>(), vbz_filter<true, ZstdLevel>, &options);
 }
 
 template <typename IntType>
@@ -141,6 +198,311 @@ void vbz_hdf_benchmark_random_zlib(benchmark::State& state)
     vbz_hdf_benchmark<SignalGenerator<IntType>>(state, sizeof(IntType), get_h5_type<IntType>(), zlib_filter);
 }
 
+// Write one long read as a dataset chunked into state.range(0) raw bytes per chunk.
+IdRef write_chunked_signal(
+    hid_t file_id,
+    char const* name,
+    std::vector<std::int16_t> const& signal,
+    std::size_t chunk_element_count,
+    FilterSetupFn setup_filter)
+{
+    auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+    std::array<hsize_t, 1> chunk_sizes{ { chunk_element_count } };
+    H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+
+    setup_filter(creation_properties.get(), sizeof(std::int16_t));
+
+    auto dataset = create_dataset(file_id, name, H5T_NATIVE_INT16, signal.size(), creation_properties.get());
+    write_full_dataset(dataset.get(), H5T_NATIVE_INT16, signal);
+    return dataset;
+}
+
+void report_chunk_sweep(benchmark::State& state, std::size_t element_count)
+{
+    state.SetItemsProcessed(state.iterations() * element_count);
+    state.SetBytesProcessed(state.iterations() * element_count * sizeof(std::int16_t));
+    state.counters["recommended_chunk_bytes"] = double(vbz_recommend_chunk_size(sizeof(std::int16_t)) * sizeof(std::int16_t));
+}
+
+template <int ZstdLevel>
+void vbz_hdf_chunk_sweep_write(benchmark::State& state)
+{
+    (void)plugin_init_result;
+    auto const& signal = LongSignalGenerator<std::int16_t>::generate();
+    auto const chunk_element_count = std::size_t(state.range(0)) / sizeof(std::int16_t);
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto file = IdRef::claim(H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+        state.ResumeTiming();
+
+        auto dataset = write_chunked_signal(file.get(), "signal", signal, chunk_element_count, vbz_filter<true, ZstdLevel>);
+        benchmark::DoNotOptimize(dataset);
+    }
+
+    report_chunk_sweep(state, signal.size());
+}
+
+template <int ZstdLevel>
+void vbz_hdf_chunk_sweep_read(benchmark::State& state)
+{
+    (void)plugin_init_result;
+    auto const& signal = LongSignalGenerator<std::int16_t>::generate();
+    auto const chunk_element_count = std::size_t(state.range(0)) / sizeof(std::int16_t);
+
+    {
+        auto file = IdRef::claim(H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+        write_chunked_signal(file.get(), "signal", signal, chunk_element_count, vbz_filter<true, ZstdLevel>);
+    }
+
+    auto file = IdRef::claim(H5Fopen("./test_file.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+    for (auto _ : state)
+    {
+        auto values = read_1d_dataset<std::int16_t>(file.get(), "signal", H5T_NATIVE_INT16);
+        benchmark::DoNotOptimize(values.data());
+    }
+
+    report_chunk_sweep(state, signal.size());
+}
+
+template <int ZstdLevel>
+struct VbzReadFilter
+{
+    static std::string name() { return "vbz" + std::to_string(ZstdLevel); }
+    static void setup(hid_t creation_properties, int int_size) { vbz_filter<true, ZstdLevel>(creation_properties, int_size); }
+};
+
+struct ZlibReadFilter
+{
+    static std::string name() { return "zlib"; }
+    static void setup(hid_t creation_properties, int int_size) { zlib_filter(creation_properties, int_size); }
+};
+
+struct UncompressedReadFilter
+{
+    static std::string name() { return "uncompressed"; }
+    static void setup(hid_t creation_properties, int int_size) { no_filter(creation_properties, int_size); }
+};
+
+std::string read_name(std::size_t id)
+{
+    return "read_" + std::to_string(id);
+}
+
+// A multi read file holding SignalGenerator's reads, one dataset per read stored as a single chunk as
+// in fast5 files. Written once per filter, and removed when the benchmarks exit.
+template <typename Filter>
+class ReadBenchmarkFile
+{
+public:
+    static ReadBenchmarkFile const& get()
+    {
+        static ReadBenchmarkFile file;
+        return file;
+    }
+
+    ~ReadBenchmarkFile()
+    {
+        std::remove(path.c_str());
+    }
+
+    std::string path;
+    std::vector<std::size_t> read_lengths;
+    std::size_t raw_bytes = 0;
+    std::size_t file_bytes = 0;
+
+private:
+    ReadBenchmarkFile()
+        : path("./read_perf_" + Filter::name() + ".h5")
+    {
+        (void)plugin_init_result;
+        std::size_t max_element_count = 0;
+        auto const reads = SignalGenerator<std::int16_t>::generate(max_element_count);
+
+        auto file = IdRef::claim(H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+        for (std::size_t id = 0; id < reads.size(); ++id)
+        {
+            auto const& signal = reads[id];
+            auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+            std::array<hsize_t, 1> chunk_sizes{ { signal.size() } };
+            H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+            Filter::setup(creation_properties.get(), sizeof(std::int16_t));
+
+            auto const dset_name = read_name(id);
+            auto dataset = create_dataset(file.get(), dset_name.c_str(), H5T_NATIVE_INT16, signal.size(), creation_properties.get());
+            write_full_dataset(dataset.get(), H5T_NATIVE_INT16, signal);
+
+            read_lengths.push_back(signal.size());
+            raw_bytes += signal.size() * sizeof(std::int16_t);
+        }
+
+        hsize_t size = 0;
+        H5Fget_filesize(file.get(), &size);
+        file_bytes = std::size_t(size);
+    }
+};
+
+// Dataset access properties with the chunk cache sized to hold any read's chunk, or disabled so every
+// access decodes its chunk again.
+IdRef read_access_properties(bool chunk_cache)
+{
+    auto access_properties = IdRef::claim(H5Pcreate(H5P_DATASET_ACCESS));
+    auto const cache_bytes = chunk_cache ? 16 * 1024 * 1024 : 0;
+    H5Pset_chunk_cache(access_properties.get(), 521, cache_bytes, 1.0);
+    return access_properties;
+}
+
+// Read indices in a random order, the same for every filter.
+std::vector<std::size_t> random_read_order(std::size_t read_count, std::size_t count)
+{
+    std::default_random_engine rand(5);
+    std::uniform_int_distribution<std::size_t> read_dist(0, read_count - 1);
+
+    std::vector<std::size_t> order(count);
+    for (auto& id : order)
+    {
+        id = read_dist(rand);
+    }
+    return order;
+}
+
+void report_read_benchmark(benchmark::State& state, std::size_t item_count, std::size_t raw_bytes, std::size_t file_bytes)
+{
+    state.SetItemsProcessed(state.iterations() * item_count);
+    state.SetBytesProcessed(state.iterations() * item_count * sizeof(std::int16_t));
+    state.counters["compression_ratio"] = double(raw_bytes) / file_bytes;
+}
+
+// Open randomly chosen reads and read each in full, as a basecaller picking reads out of a file does.
+template <typename Filter, bool ChunkCache>
+void vbz_hdf_read_random_access(benchmark::State& state)
+{
+    auto const& source = ReadBenchmarkFile<Filter>::get();
+    auto const order = random_read_order(source.read_lengths.size(), 64);
+    auto const access_properties = read_access_properties(ChunkCache);
+    auto file = IdRef::claim(H5Fopen(source.path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+
+    std::vector<std::int16_t> values;
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (auto id : order)
+        {
+            auto dataset = IdRef::claim(H5Dopen(file.get(), read_name(id).c_str(), access_properties.get()));
+            values.resize(source.read_lengths[id]);
+            if (H5Dread(dataset.get(), H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()) < 0)
+            {
+                state.SkipWithError("read failed");
+                return;
+            }
+            benchmark::DoNotOptimize(values.data());
+            item_count += values.size();
+        }
+    }
+
+    report_read_benchmark(state, item_count, source.raw_bytes, source.file_bytes);
+}
+
+// Read every read in the file in order.
+template <typename Filter, bool ChunkCache>
+void vbz_hdf_read_sequential_scan(benchmark::State& state)
+{
+    auto const& source = ReadBenchmarkFile<Filter>::get();
+    auto const access_properties = read_access_properties(ChunkCache);
+    auto file = IdRef::claim(H5Fopen(source.path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+
+    std::vector<std::int16_t> values;
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        for (std::size_t id = 0; id < source.read_lengths.size(); ++id)
+        {
+            auto dataset = IdRef::claim(H5Dopen(file.get(), read_name(id).c_str(), access_properties.get()));
+            values.resize(source.read_lengths[id]);
+            if (H5Dread(dataset.get(), H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()) < 0)
+            {
+                state.SkipWithError("read failed");
+                return;
+            }
+            benchmark::DoNotOptimize(values.data());
+            item_count += values.size();
+        }
+    }
+
+    report_read_benchmark(state, item_count, source.raw_bytes, source.file_bytes);
+}
+
+// Open randomly chosen reads and read several short windows of signal from each. With the chunk cache
+// on only the first window decodes the read's chunk.
+template <typename Filter, bool ChunkCache>
+void vbz_hdf_read_hyperslab(benchmark::State& state)
+{
+    const hsize_t window_size = 4000;
+    const std::size_t windows_per_read = 8;
+
+    auto const& source = ReadBenchmarkFile<Filter>::get();
+    auto const access_properties = read_access_properties(ChunkCache);
+    auto file = IdRef::claim(H5Fopen(source.path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+
+    // Reads shorter than a window have no window to read, so are left out.
+    std::vector<std::size_t> order;
+    for (auto id : random_read_order(source.read_lengths.size(), 64))
+    {
+        if (source.read_lengths[id] >= window_size)
+        {
+            order.push_back(id);
+        }
+    }
+    if (order.empty())
+    {
+        state.SkipWithError("no read holds a window");
+        return;
+    }
+
+    std::default_random_engine rand(5);
+    std::vector<hsize_t> window_offsets;
+    for (auto id : order)
+    {
+        std::uniform_int_distribution<hsize_t> offset_dist(0, source.read_lengths[id] - window_size);
+        for (std::size_t i = 0; i < windows_per_read; ++i)
+        {
+            window_offsets.push_back(offset_dist(rand));
+        }
+    }
+
+    std::array<hsize_t, 1> window_count{ { window_size } };
+    auto memory_space = IdRef::claim(H5Screate_simple(1, window_count.data(), nullptr));
+    std::vector<std::int16_t> values(window_size);
+    std::size_t item_count = 0;
+    for (auto _ : state)
+    {
+        item_count = 0;
+        auto offset_it = window_offsets.begin();
+        for (auto id : order)
+        {
+            auto dataset = IdRef::claim(H5Dopen(file.get(), read_name(id).c_str(), access_properties.get()));
+            auto file_space = IdRef::claim(H5Dget_space(dataset.get()));
+            for (std::size_t i = 0; i < windows_per_read; ++i)
+            {
+                std::array<hsize_t, 1> window_offset{ { *offset_it++ } };
+                H5Sselect_hyperslab(file_space.get(), H5S_SELECT_SET, window_offset.data(), nullptr, window_count.data(), nullptr);
+                if (H5Dread(dataset.get(), H5T_NATIVE_INT16, memory_space.get(), file_space.get(), H5P_DEFAULT, values.data()) < 0)
+                {
+                    state.SkipWithError("read failed");
+                    return;
+                }
+                benchmark::DoNotOptimize(values.data());
+                item_count += window_size;
+            }
+        }
+    }
+
+    report_read_benchmark(state, item_count, source.raw_bytes, source.file_bytes);
+}
+
 /*BENCHMARK_TEMPLATE2(vbz_hdf_benchmark_sequence, std::int8_t, 0);
 BENCHMARK_TEMPLATE2(vbz_hdf_benchmark_sequence, std::int16_t, 0);
 BENCHMARK_TEMPLATE2(vbz_hdf_benchmark_sequence, std::int32_t, 0);
@@ -171,5 +533,37 @@ BENCHMARK_TEMPLATE(vbz_hdf_benchmark_random_zlib, std::int16_t);
 BENCHMARK_TEMPLATE(vbz_hdf_benchmark_random_zlib, std::int32_t);
 */
 
+// Chunk size sweep from 4KB to 4MB of raw signal per chunk, fast5 files default to one chunk per read.
+BENCHMARK_TEMPLATE(vbz_hdf_chunk_sweep_write, 1)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+BENCHMARK_TEMPLATE(vbz_hdf_chunk_sweep_read, 1)->RangeMultiplier(2)->Range(4 << 10, 4 << 20);
+
+// Read path benchmarks, each against vbz level 0/1, zlib and uncompressed data with the hdf chunk cache on and off.
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, VbzReadFilter<0>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, VbzReadFilter<1>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, ZlibReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, UncompressedReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, VbzReadFilter<0>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, VbzReadFilter<1>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, ZlibReadFilter, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_random_access, UncompressedReadFilter, false);
+
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, VbzReadFilter<0>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, VbzReadFilter<1>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, ZlibReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, UncompressedReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, VbzReadFilter<0>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, VbzReadFilter<1>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, ZlibReadFilter, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_sequential_scan, UncompressedReadFilter, false);
+
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, VbzReadFilter<0>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, VbzReadFilter<1>, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, ZlibReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, UncompressedReadFilter, true);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, VbzReadFilter<0>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, VbzReadFilter<1>, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, ZlibReadFilter, false);
+BENCHMARK_TEMPLATE2(vbz_hdf_read_hyperslab, UncompressedReadFilter, false);
+
 // Run the benchmark
 BENCHMARK_MAIN();
@@ -6,7 +6,10 @@
 #include <hdf5.h>
 #include <catch2/catch.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <numeric>
 #include <random>
 
@@ -135,3 +138,231 @@ SCENARIO("Using zstd filter on a uint32 dataset")
     run_random_test<std::uint32_t>(H5T_NATIVE_UINT32, 10 * 1000 * 1000);
 }
 
+
+SCENARIO("Using zstd filter on a float32 dataset")
+{
+    (void)plugin_init_result;
+
+    GIVEN("An empty hdf file and a calibrated signal data set")
+    {
+        auto file_id = H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        auto file = IdRef::claim(file_id);
+
+        std::vector<float> data(100 * 1000);
+        std::default_random_engine random_engine(42);
+        std::normal_distribution<float> dist(0.0f, 20.0f);
+        for (auto& elem : data)
+        {
+            elem = std::round(dist(random_engine)) * 0.1755f;
+        }
+
+        WHEN("Inserting filtered data into file, with options chosen from the type")
+        {
+            auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+            std::array<hsize_t, 1> chunk_sizes{ { data.size() / 8 } };
+            H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+            CHECK(vbz_filter_enable_for_type(creation_properties.get(), H5T_NATIVE_FLOAT, 1) >= 0);
+
+            auto dataset = create_dataset(file_id, "foo", H5T_NATIVE_FLOAT, data.size(), creation_properties.get());
+
+            write_full_dataset(dataset.get(), H5T_NATIVE_FLOAT, data);
+
+            THEN("Data is read back exactly")
+            {
+                auto read_data = read_1d_dataset<float>(file_id, "foo", H5T_NATIVE_FLOAT);
+                REQUIRE(read_data.size() == data.size());
+                CHECK(std::memcmp(read_data.data(), data.data(), data.size() * sizeof(float)) == 0);
+            }
+        }
+
+        WHEN("Inserting data into a file, with the filter enabled for integers")
+        {
+            {
+                auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+                std::array<hsize_t, 1> chunk_sizes{ { data.size() / 8 } };
+                H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+                CHECK(vbz_filter_enable(creation_properties.get(), 4, true, 1) >= 0);
+
+                auto dataset = create_dataset(file_id, "foo", H5T_NATIVE_FLOAT, data.size(), creation_properties.get());
+                write_full_dataset(dataset.get(), H5T_NATIVE_FLOAT, data);
+            }
+            // Reopen the file, so chunks are read through the filter rather than from the chunk cache.
+            file = IdRef();
+            file = IdRef::claim(H5Fopen("./test_file.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+
+            THEN("The filter switched to the float32 version for the type")
+            {
+                auto dataset = IdRef::claim(H5Dopen2(file.get(), "foo", H5P_DEFAULT));
+                auto properties = IdRef::claim(H5Dget_create_plist(dataset.get()));
+                unsigned int flags = 0;
+                std::size_t value_count = 4;
+                unsigned int values[4] = {};
+                REQUIRE(H5Pget_filter_by_id2(properties.get(), FILTER_VBZ_ID, &flags, &value_count, values, 0, nullptr,
+                                             nullptr) >= 0);
+                CHECK(values[FILTER_VBZ_VERSION_OPTION] == FILTER_VBZ_FLOAT32_VERSION);
+                CHECK(values[FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION] == 0);
+            }
+
+            THEN("Data is read back exactly")
+            {
+                auto read_data = read_1d_dataset<float>(file.get(), "foo", H5T_NATIVE_FLOAT);
+                REQUIRE(read_data.size() == data.size());
+                CHECK(std::memcmp(read_data.data(), data.data(), data.size() * sizeof(float)) == 0);
+            }
+        }
+    }
+
+    GIVEN("Creation properties for a double dataset")
+    {
+        auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+        THEN("The filter can't be enabled for the type")
+        {
+            CHECK(vbz_filter_enable_for_type(creation_properties.get(), H5T_NATIVE_DOUBLE, 1) < 0);
+        }
+    }
+}
+
+SCENARIO("Reading a fast5 file written with legacy filter options")
+{
+    (void)plugin_init_result;
+
+    GIVEN("The vbz and gzip test fast5 files, the vbz file filtered with a 5th option of 1 on 2 byte integers")
+    {
+        auto vbz_file = IdRef::claim(H5Fopen("test_data/multi_fast5_vbz.fast5", H5F_ACC_RDONLY, H5P_DEFAULT));
+        auto zip_file = IdRef::claim(H5Fopen("test_data/multi_fast5_zip.fast5", H5F_ACC_RDONLY, H5P_DEFAULT));
+        REQUIRE(vbz_file.get() >= 0);
+        REQUIRE(zip_file.get() >= 0);
+
+        THEN("The 5th option is ignored, and the signal matches the gzip file")
+        {
+            char const* name = "read_0000173c-bf67-44e7-9a9c-1ad0bc728e74/Raw/Signal";
+            auto vbz_data = read_1d_dataset<std::int16_t>(vbz_file.get(), name, H5T_NATIVE_INT16);
+            auto zip_data = read_1d_dataset<std::int16_t>(zip_file.get(), name, H5T_NATIVE_INT16);
+            CHECK(!zip_data.empty());
+            CHECK(vbz_data == zip_data);
+        }
+    }
+
+    GIVEN("A 4 byte integer data set")
+    {
+        std::vector<std::int32_t> data(100 * 1000);
+        std::iota(data.begin(), data.end(), -50 * 1000);
+
+        WHEN("Inserting data filtered with a legacy 5th option of 1 into a file")
+        {
+            {
+                auto file = IdRef::claim(H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+                auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+                std::array<hsize_t, 1> chunk_sizes{ { data.size() / 8 } };
+                H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+                unsigned int const values[5] = { 0, sizeof(std::int32_t), 1, 1, 1 };
+                CHECK(H5Pset_filter(creation_properties.get(), FILTER_VBZ_ID, 0, 5, values) >= 0);
+
+                auto dataset = create_dataset(file.get(), "foo", H5T_NATIVE_INT32, data.size(), creation_properties.get());
+                write_full_dataset(dataset.get(), H5T_NATIVE_INT32, data);
+            }
+
+            THEN("The 5th option is ignored, and the integers are read back correctly")
+            {
+                auto file = IdRef::claim(H5Fopen("./test_file.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+                auto read_data = read_1d_dataset<std::int32_t>(file.get(), "foo", H5T_NATIVE_INT32);
+                CHECK(read_data == data);
+            }
+        }
+    }
+}
+
+SCENARIO("Using zstd filter with an error bound on a int16 dataset")
+{
+    (void)plugin_init_result;
+
+    GIVEN("A noisy data set")
+    {
+        std::vector<std::int16_t> data(100 * 1000);
+        std::default_random_engine random_engine(42);
+        std::normal_distribution<float> dist(500.0f, 20.0f);
+        for (auto& elem : data)
+        {
+            elem = std::int16_t(dist(random_engine));
+        }
+
+        WHEN("Inserting filtered data into a file")
+        {
+            {
+                auto file = IdRef::claim(H5Fcreate("./test_file.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+                auto creation_properties = IdRef::claim(H5Pcreate(H5P_DATASET_CREATE));
+                std::array<hsize_t, 1> chunk_sizes{ { data.size() / 8 } };
+                H5Pset_chunk(creation_properties.get(), int(chunk_sizes.size()), chunk_sizes.data());
+                CHECK(vbz_filter_enable_bounded_error(creation_properties.get(), sizeof(std::int16_t), true, 1, 2) >= 0);
+
+                auto dataset = create_dataset(file.get(), "foo", H5T_NATIVE_INT16, data.size(), creation_properties.get());
+                write_full_dataset(dataset.get(), H5T_NATIVE_INT16, data);
+            }
+
+            THEN("Data is read back from the file within the bound")
+            {
+                // Reopen the file, so chunks are read through the filter rather than from the chunk cache.
+                auto file = IdRef::claim(H5Fopen("./test_file.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+                auto read_data = read_1d_dataset<std::int16_t>(file.get(), "foo", H5T_NATIVE_INT16);
+                REQUIRE(read_data.size() == data.size());
+                int max_error = 0;
+                for (std::size_t i = 0; i < data.size(); ++i)
+                {
+                    max_error = std::max(max_error, std::abs(int(read_data[i]) - int(data[i])));
+                }
+                CHECK(max_error <= 2);
+                CHECK(read_data != data);
+            }
+        }
+    }
+}
+
+SCENARIO("Recommending a chunk size from host cache sizes")
+{
+    GIVEN("A host with a 256KB L2 cache")
+    {
+        vbz_cache_sizes const caches{ 32 * 1024, 256 * 1024, 8 * 1024 * 1024 };
+
+        THEN("The decode working set of a chunk fits in half the L2 cache")
+        {
+            CHECK(vbz_recommend_chunk_size(2, caches) == 16 * 1024);
+            CHECK(vbz_recommend_chunk_size(4, caches) == 8 * 1024);
+        }
+
+        THEN("Short datasets are stored as a single chunk")
+        {
+            CHECK(vbz_recommend_chunk_size(2, caches, 1000) == 1000);
+        }
+    }
+
+    GIVEN("A host with no known cache sizes")
+    {
+        vbz_cache_sizes const caches{ 0, 0, 0 };
+
+        THEN("A 1MB L2 cache is assumed")
+        {
+            CHECK(vbz_recommend_chunk_size(2, caches) == 64 * 1024);
+        }
+    }
+
+    GIVEN("A host with only a very large L3 cache")
+    {
+        vbz_cache_sizes const caches{ 0, 0, 256 * 1024 * 1024 };
+
+        THEN("The chunk is clamped to 4MB")
+        {
+            CHECK(vbz_recommend_chunk_size(1, caches) == 4 * 1024 * 1024);
+        }
+    }
+
+    GIVEN("The host running the test")
+    {
+        auto const chunk_bytes = vbz_recommend_chunk_size(2) * 2;
+
+        THEN("The chunk is between 4KB and 4MB")
+        {
+            CHECK(chunk_bytes >= 4 * 1024);
+            CHECK(chunk_bytes <= 4 * 1024 * 1024);
+        }
+    }
+}
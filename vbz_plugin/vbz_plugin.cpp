@@ -1,20 +1,36 @@
 #include "vbz_plugin/vbz_hdf_plugin_export.h"
 #include "vbz_plugin.h"
 #include "vbz.h"
+#include "vbz_metrics.h"
+#include "vbz_trace_scope.h"
 
 #include <gsl/gsl-lite.hpp>
 #include <hdf5/hdf5_plugin_types.h>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #ifdef _WIN32
 # ifndef NOMINMAX
 #  define NOMINMAX
 #endif
 # include <Windows.h>
+#else
+# include <dlfcn.h>
+# if defined(__APPLE__)
+#  include <sys/sysctl.h>
+# elif defined(__linux__)
+#  include <link.h>
+# endif
 #endif
 
 #define VBZ_DEBUG 0
@@ -64,6 +80,7 @@ HMODULE get_hdf_module()
 //
 void* h5_malloc(std::size_t size)
 {
+    VbzTraceScope trace(VBZ_TRACE_PLUGIN_ALLOCATION, size);
 #if defined(_WIN32) && !defined(HDF5_USE_STATIC_LIBRARIES)
     static auto module = get_hdf_module();
 
@@ -91,9 +108,239 @@ struct h5free_delete
     void operator()(void* x) { h5_free(x); }
 };
 
+struct free_delete
+{
+    void operator()(void* x) { free(x); }
+};
+
+#if defined(__linux__)
+// Find a loaded hdf library, hosts like h5py load it without exporting its symbols globally.
+int find_hdf_library(dl_phdr_info* info, std::size_t, void* data)
+{
+    if (info->dlpi_name && std::strstr(info->dlpi_name, "libhdf5"))
+    {
+        if (auto library = dlopen(info->dlpi_name, RTLD_LAZY | RTLD_NOLOAD))
+        {
+            *static_cast<void**>(data) = library;
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+// The plugin doesn't link hdf, so the functions it calls beyond allocation are looked up in the
+// library hosting it. Returns null if [name] can't be found.
+void* lookup_hdf_symbol(char const* name)
+{
+#if defined(_WIN32)
+# if defined(HDF5_USE_STATIC_LIBRARIES)
+    (void)name;
+    return nullptr;
+# else
+    return (void*)GetProcAddress(get_hdf_module(), name);
+# endif
+#else
+    // The handle to search, and whether one was found (RTLD_DEFAULT, searching every global symbol, can be null).
+    static std::pair<void*, bool> const library = [] {
+        auto const path = getenv("HDF5_LIB_PATH");
+        if (path && *path)
+        {
+            // Only a copy already hosting the plugin is useful, its ids mean nothing to another one.
+            auto const handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+            return std::make_pair(handle, handle != nullptr);
+        }
+        void* handle = RTLD_DEFAULT;
+# if defined(__linux__)
+        if (!dlsym(RTLD_DEFAULT, "H5get_libversion"))
+        {
+            dl_iterate_phdr(find_hdf_library, &handle);
+        }
+# endif
+        return std::make_pair(handle, true);
+    }();
+    return library.second ? dlsym(library.first, name) : nullptr;
+#endif
+}
+
+// Scratch space used to compress chunks before copying them into an exactly sized
+// hdf buffer. Kept per thread so repeated chunk writes don't pay for a worst case
+// allocation each time, very large chunks are not retained between calls.
+class CompressionScratch
+{
+public:
+    static constexpr std::size_t max_retained_size = 16 * 1024 * 1024;
+
+    void* get(std::size_t size)
+    {
+        if (size > m_capacity)
+        {
+            VbzTraceScope trace(VBZ_TRACE_PLUGIN_ALLOCATION, size);
+            m_buffer.reset();
+            m_buffer.reset(malloc(size));
+            m_capacity = m_buffer ? size : 0;
+        }
+        return m_buffer.get();
+    }
+
+    void release_if_oversized()
+    {
+        if (m_capacity > max_retained_size)
+        {
+            m_buffer.reset();
+            m_capacity = 0;
+        }
+    }
+
+private:
+    std::unique_ptr<void, free_delete> m_buffer;
+    std::size_t m_capacity = 0;
+};
+
+thread_local CompressionScratch compression_scratch;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+// Read a sysfs cache attribute, eg: "2\n" or "1024K\n".
+std::string read_cache_attribute(std::string const& index_path, char const* attribute)
+{
+    std::ifstream file(index_path + attribute);
+    std::string value;
+    std::getline(file, value);
+    return value;
+}
+
+std::size_t parse_cache_size(std::string const& size)
+{
+    std::size_t result = 0;
+    std::size_t idx = 0;
+    for (; idx < size.size() && size[idx] >= '0' && size[idx] <= '9'; ++idx)
+    {
+        result = result * 10 + std::size_t(size[idx] - '0');
+    }
+
+    if (idx < size.size())
+    {
+        switch (size[idx])
+        {
+        case 'K': result *= 1024; break;
+        case 'M': result *= 1024 * 1024; break;
+        case 'G': result *= 1024 * 1024 * 1024; break;
+        }
+    }
+    return result;
+}
+#endif
+
+vbz_cache_sizes query_host_cache_sizes()
+{
+    vbz_cache_sizes sizes{};
+#if defined(_WIN32)
+    DWORD buffer_size = 0;
+    GetLogicalProcessorInformation(nullptr, &buffer_size);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(buffer_size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (info.empty() || !GetLogicalProcessorInformation(info.data(), &buffer_size))
+    {
+        return sizes;
+    }
+
+    for (auto const& entry : info)
+    {
+        if (entry.Relationship != RelationCache
+            || (entry.Cache.Type != CacheData && entry.Cache.Type != CacheUnified))
+        {
+            continue;
+        }
+
+        switch (entry.Cache.Level)
+        {
+        case 1: sizes.l1d = std::max<std::size_t>(sizes.l1d, entry.Cache.Size); break;
+        case 2: sizes.l2 = std::max<std::size_t>(sizes.l2, entry.Cache.Size); break;
+        case 3: sizes.l3 = std::max<std::size_t>(sizes.l3, entry.Cache.Size); break;
+        }
+    }
+#elif defined(__APPLE__)
+    auto query = [](char const* name) -> std::size_t
+    {
+        std::int64_t value = 0;
+        std::size_t value_size = sizeof(value);
+        if (sysctlbyname(name, &value, &value_size, nullptr, 0) != 0 || value < 0)
+        {
+            return 0;
+        }
+        return std::size_t(value);
+    };
+    // Apple silicon reports the performance cores' caches under perflevel0.
+    sizes.l1d = query("hw.perflevel0.l1dcachesize");
+    sizes.l2 = query("hw.perflevel0.l2cachesize");
+    if (sizes.l1d == 0)
+    {
+        sizes.l1d = query("hw.l1dcachesize");
+        sizes.l2 = query("hw.l2cachesize");
+    }
+    sizes.l3 = query("hw.l3cachesize");
+#else
+    // sysfs rather than sysconf(_SC_LEVEL2_CACHE_SIZE), which is glibc only and reports 0 on many
+    // non x86 systems.
+    for (int index = 0; ; ++index)
+    {
+        auto const index_path = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+        auto const level = read_cache_attribute(index_path, "level");
+        if (level.empty())
+        {
+            break;
+        }
+
+        auto const type = read_cache_attribute(index_path, "type");
+        if (type != "Data" && type != "Unified")
+        {
+            continue;
+        }
+
+        auto const size = parse_cache_size(read_cache_attribute(index_path, "size"));
+        switch (level[0])
+        {
+        case '1': sizes.l1d = size; break;
+        case '2': sizes.l2 = size; break;
+        case '3': sizes.l3 = size; break;
+        }
+    }
+#endif
+    return sizes;
+}
+
 
 }
 
+extern "C" VBZ_HDF_PLUGIN_EXPORT bool vbz_filter_options(
+    size_t cd_nelmts,
+    const unsigned int cd_values[],
+    CompressionOptions* options,
+    unsigned int* max_absolute_error)
+{
+    static_assert(FILTER_VBZ_FLOAT32_VERSION == VBZ_FLOAT32_VERSION, "Filter versions must match vbz versions");
+    if (cd_nelmts <= FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION)
+    {
+        return false;
+    }
+
+    options->vbz_version = cd_values[FILTER_VBZ_VERSION_OPTION];
+    options->integer_size = cd_values[FILTER_VBZ_INTEGER_SIZE_OPTION];
+    options->perform_delta_zig_zag = cd_values[FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION] != 0;
+
+    options->zstd_compression_level = 1;
+    if (cd_nelmts > FILTER_VBZ_ZSTD_COMPRESSION_LEVEL_OPTION)
+    {
+        options->zstd_compression_level = cd_values[FILTER_VBZ_ZSTD_COMPRESSION_LEVEL_OPTION];
+    }
+
+    *max_absolute_error = 0;
+    if (cd_nelmts > FILTER_VBZ_MAX_ABSOLUTE_ERROR_OPTION)
+    {
+        *max_absolute_error = cd_values[FILTER_VBZ_MAX_ABSOLUTE_ERROR_OPTION];
+    }
+    return true;
+}
+
 size_t vbz_filter(
     unsigned flags,
     size_t cd_nelmts,
@@ -106,29 +353,22 @@ size_t vbz_filter(
     vbz_size_t outbuf_size = 0;
     vbz_size_t outbuf_used_size = 0;
 
-    if (cd_nelmts < 3)
+    CompressionOptions options{};
+    // Zero for lossless compression, otherwise chunks are stored with vbz_compress_bounded_error.
+    unsigned int max_absolute_error = 0;
+    if (!vbz_filter_options(cd_nelmts, cd_values, &options, &max_absolute_error))
     {
         return 0;
     }
-
-    unsigned int vbz_version = cd_values[FILTER_VBZ_VERSION_OPTION];
-    unsigned int integer_size = cd_values[FILTER_VBZ_INTEGER_SIZE_OPTION];
-    bool use_zig_zag = cd_values[FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION] != 0;
-
-    unsigned int compression_level = 1;
-    if (cd_nelmts > FILTER_VBZ_ZSTD_COMPRESSION_LEVEL_OPTION)
-    {
-        compression_level = cd_values[FILTER_VBZ_ZSTD_COMPRESSION_LEVEL_OPTION];
-    }
-    
-    CompressionOptions options{ use_zig_zag, integer_size, compression_level, vbz_version };
     
 #if VBZ_DEBUG
     std::cout << "======================================================\n"
         << "Using options:"
-        << " integer_size: " << integer_size
-        << " use_zig_zag: " << use_zig_zag
-        << " compression_level: " << compression_level
+        << " vbz_version: " << options.vbz_version
+        << " integer_size: " << options.integer_size
+        << " use_zig_zag: " << options.perform_delta_zig_zag
+        << " compression_level: " << options.zstd_compression_level
+        << " max_absolute_error: " << max_absolute_error
         << std::endl;
 #endif
 
@@ -155,9 +395,16 @@ size_t vbz_filter(
             std::cerr << "vbz_filter: size error" << std::endl;
             return 0;
         }
-        outbuf.reset(h5_malloc(expected_uncompressed_size));
+        outbuf_size = expected_uncompressed_size;
+        outbuf.reset(h5_malloc(outbuf_size));
+        if (!outbuf)
+        {
+            std::cerr << "vbz_filter: failed to allocate output buffer" << std::endl;
+            return 0;
+        }
 
-        outbuf_used_size = vbz_decompress_sized(
+        auto const decompress = max_absolute_error != 0 ? vbz_decompress_bounded_error : vbz_decompress_sized;
+        outbuf_used_size = decompress(
             input_span.data(),
             vbz_size_t(input_span.size()),
             outbuf.get(),
@@ -191,32 +438,73 @@ size_t vbz_filter(
             return 0;
         }
 
-        auto const byte_remainder = *buf_size % integer_size;
+        auto const byte_remainder = *buf_size % options.integer_size;
         if (byte_remainder != 0)
         {
             std::cerr << "vbz_filter: Invalid integer_size specified" << std::endl;
             return 0;
         }
 
-        outbuf_size = vbz_max_compressed_size(vbz_size_t(*buf_size), &options);
-        outbuf.reset(h5_malloc(outbuf_size));
-        
-        auto output_span = gsl::make_span(static_cast<char*>(outbuf.get()), outbuf_size);
+        auto const max_compressed_size = max_absolute_error != 0
+            ? vbz_max_bounded_error_compressed_size(vbz_size_t(*buf_size), &options)
+            : vbz_max_compressed_size(vbz_size_t(*buf_size), &options);
+        if (vbz_is_error(max_compressed_size))
+        {
+            std::cerr << "vbz_filter: compression error" << std::endl;
+            return 0;
+        }
+
+        auto scratch = compression_scratch.get(max_compressed_size);
+        if (!scratch)
+        {
+            std::cerr << "vbz_filter: failed to allocate compression buffer" << std::endl;
+            return 0;
+        }
+
+        auto output_span = gsl::make_span(static_cast<char*>(scratch), max_compressed_size);
 
         // do compress
-        outbuf_used_size += vbz_compress_sized(
-            *buf,
-            vbz_size_t(*buf_size),
-            output_span.data(),
-            vbz_size_t(output_span.size()),
-            &options
-        );
+        if (max_absolute_error != 0)
+        {
+            outbuf_used_size += vbz_compress_bounded_error(
+                *buf,
+                vbz_size_t(*buf_size),
+                output_span.data(),
+                vbz_size_t(output_span.size()),
+                max_absolute_error,
+                &options
+            );
+        }
+        else
+        {
+            outbuf_used_size += vbz_compress_sized(
+                *buf,
+                vbz_size_t(*buf_size),
+                output_span.data(),
+                vbz_size_t(output_span.size()),
+                &options
+            );
+        }
         if (vbz_is_error(outbuf_used_size))
         {
+            compression_scratch.release_if_oversized();
             std::cerr << "vbz_filter: compression error" << std::endl;;
             return 0;
         }
 
+        // hdf holds on to the buffer we return, so hand back one sized to the compressed
+        // data rather than the worst case bound.
+        outbuf_size = outbuf_used_size;
+        outbuf.reset(h5_malloc(outbuf_size));
+        if (!outbuf)
+        {
+            compression_scratch.release_if_oversized();
+            std::cerr << "vbz_filter: failed to allocate output buffer" << std::endl;
+            return 0;
+        }
+        std::copy_n(output_span.data(), outbuf_used_size, static_cast<char*>(outbuf.get()));
+        compression_scratch.release_if_oversized();
+
 #if VBZ_DEBUG
         std::cout << "Compressed dataset from " << *buf_size << "  bytes to " << outbuf_used_size << " with checksum " << checksum(gsl::make_span(output_span.data(), outbuf_used_size)) << std::endl;
 #endif
@@ -228,22 +516,125 @@ size_t vbz_filter(
     return outbuf_used_size;
 }
 
-H5Z_class2_t const vbz_filter_struct = {
-    H5Z_CLASS_T_VERS,   // version
-    FILTER_VBZ_ID,      // id
-    1,                  // encoder_present
-    1,                  // decoder_present
-    "vbz",              // name
-    nullptr,            // can_apply
-    nullptr,            // set_local
-    vbz_filter          // filter
+namespace {
+
+// hdf functions used to choose the filter options for a dataset's type, [Hid] is hid_t of the hosting hdf
+// version: 64 bit from 1.10, 32 bit before.
+template <typename Hid>
+struct HdfTypeFunctions
+{
+    // H5T_class_t values, stable across hdf versions.
+    static constexpr int integer_class = 0;
+    static constexpr int float_class = 1;
+
+    int (*get_class)(Hid type);
+    std::size_t (*get_size)(Hid type);
+    int (*get_filter_by_id)(Hid plist, int filter, unsigned int* flags, std::size_t* cd_nelmts,
+        unsigned int cd_values[], std::size_t namelen, char name[], unsigned int* filter_config);
+    int (*modify_filter)(Hid plist, int filter, unsigned int flags, std::size_t cd_nelmts,
+        const unsigned int cd_values[]);
+
+    static HdfTypeFunctions const& get()
+    {
+        static HdfTypeFunctions const functions{
+            (decltype(get_class))lookup_hdf_symbol("H5Tget_class"),
+            (decltype(get_size))lookup_hdf_symbol("H5Tget_size"),
+            (decltype(get_filter_by_id))lookup_hdf_symbol("H5Pget_filter_by_id2"),
+            (decltype(modify_filter))lookup_hdf_symbol("H5Pmodify_filter"),
+        };
+        return functions;
+    }
+
+    bool found() const
+    {
+        return get_class && get_size && get_filter_by_id && modify_filter;
+    }
 };
 
+// Called by hdf as a dataset is created, switches lossless filters on 4 byte float datasets to the
+// float32 version, so callers don't need to choose options from the type themselves.
+template <typename Hid>
+int vbz_set_local(Hid creation_properties, Hid type, Hid)
+{
+    auto const& functions = HdfTypeFunctions<Hid>::get();
+    if (functions.get_class(type) != HdfTypeFunctions<Hid>::float_class || functions.get_size(type) != sizeof(float))
+    {
+        return 0;
+    }
+
+    unsigned int flags = 0;
+    unsigned int values[FILTER_VBZ_MAX_ABSOLUTE_ERROR_OPTION + 1] = {};
+    std::size_t value_count = sizeof(values) / sizeof(values[0]);
+    if (functions.get_filter_by_id(creation_properties, FILTER_VBZ_ID, &flags, &value_count, values, 0, nullptr,
+                                   nullptr) < 0)
+    {
+        return -1;
+    }
+    // Values beyond those the filter reads are dropped.
+    value_count = std::min(value_count, sizeof(values) / sizeof(values[0]));
+
+    CompressionOptions options{};
+    unsigned int max_absolute_error = 0;
+    if (!vbz_filter_options(value_count, values, &options, &max_absolute_error) || max_absolute_error != 0)
+    {
+        // Invalid and lossy options are left to fail as the filter runs.
+        return 0;
+    }
+    values[FILTER_VBZ_VERSION_OPTION] = FILTER_VBZ_FLOAT32_VERSION;
+    values[FILTER_VBZ_INTEGER_SIZE_OPTION] = sizeof(float);
+    values[FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION] = 0;
+    return functions.modify_filter(creation_properties, FILTER_VBZ_ID, flags, value_count, values);
+}
+
+// Pick the set_local callback matching the hosting hdf's hid_t, null if its functions can't be found.
+void* find_set_local()
+{
+    auto const get_libversion = (int(*)(unsigned int*, unsigned int*, unsigned int*))lookup_hdf_symbol("H5get_libversion");
+    unsigned int major = 0;
+    unsigned int minor = 0;
+    unsigned int release = 0;
+    if (!get_libversion || get_libversion(&major, &minor, &release) < 0)
+    {
+        return nullptr;
+    }
+    if (major > 1 || minor >= 10)
+    {
+        return HdfTypeFunctions<std::int64_t>::get().found() ? (void*)&vbz_set_local<std::int64_t> : nullptr;
+    }
+    return HdfTypeFunctions<std::int32_t>::get().found() ? (void*)&vbz_set_local<std::int32_t> : nullptr;
+}
+
+H5Z_class2_t make_filter_struct()
+{
+    return {
+        H5Z_CLASS_T_VERS,   // version
+        FILTER_VBZ_ID,      // id
+        1,                  // encoder_present
+        1,                  // decoder_present
+        "vbz",              // name
+        nullptr,            // can_apply
+        find_set_local(),   // set_local
+        vbz_filter          // filter
+    };
+}
+
+}
+
 extern "C" VBZ_HDF_PLUGIN_EXPORT const void* vbz_plugin_info(void)
 {
+    static H5Z_class2_t const vbz_filter_struct = make_filter_struct();
+    // hdf applications can't start the metrics themselves, so the plugin does when the environment asks it to.
+    static bool const metrics_started = vbz_start_metrics_from_environment();
+    (void)metrics_started;
     return &vbz_filter_struct;
 }
 
+extern "C" VBZ_HDF_PLUGIN_EXPORT vbz_cache_sizes vbz_host_cache_sizes(void)
+{
+    static const vbz_cache_sizes sizes = query_host_cache_sizes();
+    return sizes;
+}
+
 // hdf plugin hooks
 extern "C" VBZ_HDF_PLUGIN_EXPORT H5PL_type_t H5PLget_plugin_type(void)
 {
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 /// Filter ID
 /// \todo Register with hdf group
 #define FILTER_VBZ_ID 32020
@@ -8,3 +15,37 @@
 #define FILTER_VBZ_INTEGER_SIZE_OPTION              1
 #define FILTER_VBZ_USE_DELTA_ZIG_ZAG_COMPRESSION    2
 #define FILTER_VBZ_ZSTD_COMPRESSION_LEVEL_OPTION    3
+// Unused, writers before the error bound option existed stored arbitrary values here, so it is ignored.
+#define FILTER_VBZ_RESERVED_OPTION                  4
+// Optional, zero (the default) for lossless compression, otherwise the largest error allowed in decompressed integers.
+#define FILTER_VBZ_MAX_ABSOLUTE_ERROR_OPTION        5
+
+// Value of FILTER_VBZ_VERSION_OPTION compressing 4 byte floats, see VBZ_FLOAT32_VERSION.
+#define FILTER_VBZ_FLOAT32_VERSION                  0x100
+
+/// \brief Per core data cache sizes of a host, in bytes.
+/// A level is zero if the host doesn't have it, or its size could not be determined.
+typedef struct vbz_cache_sizes
+{
+    size_t l1d;
+    size_t l2;
+    size_t l3;
+} vbz_cache_sizes;
+
+/// \brief Query the data cache sizes of the host running the plugin.
+vbz_cache_sizes vbz_host_cache_sizes(void);
+
+struct CompressionOptions;
+
+/// \brief Read the vbz options a dataset's filter [cd_values] hold, filling in defaults for missing values.
+/// \param max_absolute_error   Set to the error bound chunks are stored with, zero when they are lossless.
+/// \return False if there are too few values to describe the compression.
+bool vbz_filter_options(
+    size_t cd_nelmts,
+    const unsigned int cd_values[],
+    struct CompressionOptions* options,
+    unsigned int* max_absolute_error);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -3,6 +3,8 @@
 #include <hdf5.h>
 #include "vbz_plugin.h"
 
+#include <algorithm>
+
 #define FILTER_VBZ_VERSION 1
 
 extern "C" const void* vbz_plugin_info(void);
@@ -50,6 +52,73 @@ inline int vbz_filter_enable(
     );
 }
 
+/// \brief Call to enable the vbz filter on the specified creation properties, storing integers lossily.
+/// \note Every value read back is within [max_absolute_error] of the value written, see vbz_compress_bounded_error.
+/// \param integer_size             Size of integer type to be compressed.
+/// \param is_signed                True if the integer type is signed.
+/// \param zstd_compression_level   Control the level of compression used to filter the dataset.
+/// \param max_absolute_error       Largest error allowed in values read back, at least 1.
+inline int vbz_filter_enable_bounded_error(
+    hid_t creation_properties,
+    unsigned int integer_size,
+    bool is_signed,
+    unsigned int zstd_compression_level,
+    unsigned int max_absolute_error)
+{
+    unsigned int values[6] = {
+        (unsigned int)FILTER_VBZ_VERSION,
+        integer_size,
+        is_signed,
+        zstd_compression_level,
+        0,
+        max_absolute_error
+    };
+
+    return H5Pset_filter(creation_properties, FILTER_VBZ_ID, 0, 6, values);
+}
+
+/// \brief Call to enable the vbz filter on the specified creation properties, for a 32 bit float dataset.
+/// \param zstd_compression_level   Control the level of compression used to filter the dataset.
+inline int vbz_filter_enable_float32(
+    hid_t creation_properties,
+    unsigned int zstd_compression_level)
+{
+    return vbz_filter_enable_versioned(
+        creation_properties,
+        4,
+        false,
+        zstd_compression_level,
+        FILTER_VBZ_FLOAT32_VERSION
+    );
+}
+
+/// \brief Call to enable the vbz filter on the specified creation properties, choosing options for the hdf [datatype].
+/// \details 32 bit floats use the float32 encoding, integers are packed at their size with zig zag encoding
+///          when signed. Other types can't be filtered, and return a negative value.
+/// \param zstd_compression_level   Control the level of compression used to filter the dataset.
+inline int vbz_filter_enable_for_type(
+    hid_t creation_properties,
+    hid_t datatype,
+    unsigned int zstd_compression_level)
+{
+    auto const type_class = H5Tget_class(datatype);
+    auto const size = H5Tget_size(datatype);
+    if (type_class == H5T_FLOAT && size == 4)
+    {
+        return vbz_filter_enable_float32(creation_properties, zstd_compression_level);
+    }
+    if (type_class == H5T_INTEGER && (size == 1 || size == 2 || size == 4))
+    {
+        return vbz_filter_enable(
+            creation_properties,
+            (unsigned int)size,
+            H5Tget_sign(datatype) == H5T_SGN_2,
+            zstd_compression_level
+        );
+    }
+    return -1;
+}
+
 inline bool vbz_register()
 {
     int retval = H5Zregister(vbz_plugin_info());
@@ -60,3 +129,52 @@ inline bool vbz_register()
 
     return 1;
 }
+
+/// \brief Recommend a dataset chunk size, in elements, for vbz compressed integers.
+/// \details Decoding a chunk touches the compressed chunk, the intermediate streamvbyte buffer and the
+///          decoded output at once, so the chunk is sized to keep that working set (around three times
+///          the raw chunk) inside half of the L2 cache. The L3 cache is used if no L2 size is known,
+///          and 1MB is assumed if neither is. The result is rounded down to a power of two and clamped
+///          to between 4KB and 4MB of raw data, the range measured by the chunk sweep benchmarks.
+/// \param integer_size     Size in bytes of the integer type stored in the dataset.
+/// \param caches           Cache sizes to fit chunks to, see vbz_host_cache_sizes().
+/// \param dataset_length   Element count of the dataset if known, otherwise 0. Datasets that fit in the
+///                         recommended size are stored as a single chunk.
+inline hsize_t vbz_recommend_chunk_size(
+    unsigned int integer_size,
+    vbz_cache_sizes const& caches,
+    hsize_t dataset_length = 0)
+{
+    const hsize_t min_chunk_bytes = 4 * 1024;
+    const hsize_t max_chunk_bytes = 4 * 1024 * 1024;
+    const hsize_t working_set_factor = 3;
+
+    hsize_t cache_bytes = caches.l2 ? caches.l2 : caches.l3;
+    if (cache_bytes == 0)
+    {
+        cache_bytes = 1024 * 1024;
+    }
+
+    hsize_t chunk_bytes = min_chunk_bytes;
+    while (chunk_bytes * 2 <= max_chunk_bytes
+        && chunk_bytes * 2 * working_set_factor <= cache_bytes / 2)
+    {
+        chunk_bytes *= 2;
+    }
+
+    hsize_t chunk_elements = chunk_bytes / std::max(integer_size, 1u);
+    if (dataset_length != 0)
+    {
+        chunk_elements = std::min(chunk_elements, dataset_length);
+    }
+    return chunk_elements;
+}
+
+/// \brief Recommend a dataset chunk size, in elements, using the cache sizes of this host.
+/// \see vbz_recommend_chunk_size(unsigned int, vbz_cache_sizes const&, hsize_t)
+inline hsize_t vbz_recommend_chunk_size(
+    unsigned int integer_size,
+    hsize_t dataset_length = 0)
+{
+    return vbz_recommend_chunk_size(integer_size, vbz_host_cache_sizes(), dataset_length);
+}
@@ -0,0 +1,481 @@
+#include "vbz.h"
+#include "vbz_plugin.h"
+#include "vbz_plugin_user_utils.h"
+
+#include <hdf5.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// vbz_fast5_verify proves every vbz compressed signal dataset in fast5 files decodes.
+//
+// HDF5 isn't thread safe, so the main thread enumerates the Raw signal datasets and reads their
+// compressed chunks directly (H5Dread_chunk, bypassing the filter), while a pool of workers decodes
+// them into buffers reused for the life of each thread. With --source, each chunk is also compared
+// with the same samples read (through the gzip filter) from the original file.
+
+namespace {
+
+// Closes an HDF5 identifier with [Close] when it goes out of scope.
+template <herr_t (*Close)(hid_t)>
+class Handle
+{
+public:
+    explicit Handle(hid_t id) : m_id(id) {}
+    ~Handle()
+    {
+        if (m_id >= 0)
+        {
+            Close(m_id);
+        }
+    }
+    Handle(Handle const&) = delete;
+    Handle& operator=(Handle const&) = delete;
+
+    hid_t get() const { return m_id; }
+    explicit operator bool() const { return m_id >= 0; }
+
+private:
+    hid_t m_id;
+};
+
+using FileHandle = Handle<H5Fclose>;
+using DatasetHandle = Handle<H5Dclose>;
+using PropertiesHandle = Handle<H5Pclose>;
+using SpaceHandle = Handle<H5Sclose>;
+using TypeHandle = Handle<H5Tclose>;
+
+struct Arguments
+{
+    std::vector<std::string> files;
+    std::string source;
+    std::size_t thread_count = 0;
+};
+
+struct FileTotals;
+
+// A chunk read from a dataset, decoded by a worker.
+struct ChunkTask
+{
+    FileTotals* totals;
+    std::string const* dataset;
+    hsize_t offset;
+    CompressionOptions options;
+    vbz_size_t max_absolute_error;
+    std::vector<char> compressed;
+    // The chunk's samples in the source file, empty if not compared.
+    std::vector<char> expected;
+};
+
+struct FileTotals
+{
+    std::uint64_t dataset_count = 0;
+    std::uint64_t skipped_dataset_count = 0;
+    std::uint64_t chunk_count = 0;
+    std::uint64_t compressed_bytes = 0;
+    std::atomic<std::uint64_t> decoded_bytes{ 0 };
+    std::atomic<std::uint64_t> failure_count{ 0 };
+};
+
+// Workers decoding chunks, with a bounded queue so reading never runs far ahead of decoding.
+class ChunkVerifier
+{
+public:
+    explicit ChunkVerifier(std::size_t thread_count)
+    {
+        if (thread_count == 0)
+        {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        m_max_queued = 4 * thread_count;
+        for (std::size_t i = 0; i < thread_count; ++i)
+        {
+            m_workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ChunkVerifier()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_changed.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void push(ChunkTask task)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_queue.size() < m_max_queued; });
+        m_queue.push_back(std::move(task));
+        ++m_pending;
+        m_changed.notify_all();
+    }
+
+    // Wait for every chunk pushed to be decoded.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_pending == 0; });
+    }
+
+private:
+    void run()
+    {
+        // Reused for every chunk this thread decodes.
+        std::vector<char> decoded;
+        for (;;)
+        {
+            ChunkTask task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&] { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                task = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_changed.notify_all();
+            }
+
+            verify(task, decoded, *task.totals);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_pending;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    void verify(ChunkTask const& task, std::vector<char>& decoded, FileTotals& totals)
+    {
+        auto const source_size = vbz_size_t(task.compressed.size());
+        auto const decoded_size = vbz_decompressed_size(task.compressed.data(), source_size, &task.options);
+        auto result = decoded_size;
+        if (!vbz_is_error(decoded_size))
+        {
+            decoded.resize(std::max<std::size_t>(decoded.size(), decoded_size));
+            auto const decompress = task.max_absolute_error != 0 ? vbz_decompress_bounded_error : vbz_decompress_sized;
+            result = decompress(task.compressed.data(), source_size, decoded.data(), decoded_size, &task.options);
+        }
+
+        char const* failure = nullptr;
+        if (vbz_is_error(result))
+        {
+            failure = vbz_error_string(result);
+        }
+        else if (result != decoded_size)
+        {
+            failure = "decoded size mismatch";
+        }
+        else if (!task.expected.empty() && !matches_source(task, decoded.data(), result))
+        {
+            failure = "differs from the source file";
+        }
+
+        if (failure)
+        {
+            ++totals.failure_count;
+            std::lock_guard<std::mutex> lock(m_report_mutex);
+            std::cerr << "FAILED " << *task.dataset << " chunk at " << task.offset << ": " << failure << std::endl;
+            return;
+        }
+        totals.decoded_bytes += result;
+    }
+
+    // Chunks at the end of a dataset hold padding past its extent, which isn't compared.
+    static bool matches_source(ChunkTask const& task, char const* decoded, std::size_t decoded_size)
+    {
+        if (decoded_size < task.expected.size())
+        {
+            return false;
+        }
+        return std::memcmp(decoded, task.expected.data(), task.expected.size()) == 0;
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<ChunkTask> m_queue;
+    std::size_t m_max_queued;
+    std::size_t m_pending = 0;
+    bool m_stopping = false;
+    std::vector<std::thread> m_workers;
+    std::mutex m_report_mutex;
+};
+
+bool parse_arguments(int argc, char** argv, Arguments& arguments)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const argument = argv[i];
+        if (argument == "-t" && i + 1 < argc)
+        {
+            arguments.thread_count = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--source" && i + 1 < argc)
+        {
+            arguments.source = argv[++i];
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            arguments.files.push_back(argument);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !arguments.files.empty();
+}
+
+// The source file to compare [file] with: [source] itself, or the file of the same name in it if
+// it's a directory.
+std::string source_path(std::string const& source, std::string const& file)
+{
+    if (source.empty())
+    {
+        return source;
+    }
+    if (H5Fis_hdf5(source.c_str()) > 0)
+    {
+        return source;
+    }
+    auto const name_start = file.find_last_of("/\\");
+    return source + "/" + (name_start == std::string::npos ? file : file.substr(name_start + 1));
+}
+
+// Signal datasets sit under a Raw group: read_<id>/Raw/Signal in multi read files, and
+// Raw/Reads/Read_<n>/Signal in single read files.
+herr_t collect_signal_dataset(hid_t, char const* name, H5O_info_t const* info, void* data)
+{
+    std::string const path = name;
+    auto const is_signal = path == "Signal" || (path.size() > 7 && path.compare(path.size() - 7, 7, "/Signal") == 0);
+    if (info->type == H5O_TYPE_DATASET && is_signal
+        && (path.compare(0, 4, "Raw/") == 0 || path.find("/Raw/") != std::string::npos))
+    {
+        static_cast<std::vector<std::string>*>(data)->push_back(path);
+    }
+    return 0;
+}
+
+// Find the options the vbz filter was applied with, false if the dataset isn't vbz compressed.
+bool find_vbz_options(hid_t dataset, CompressionOptions& options, vbz_size_t& max_absolute_error, unsigned& filter_index)
+{
+    PropertiesHandle properties(H5Dget_create_plist(dataset));
+    auto const filter_count = H5Pget_nfilters(properties.get());
+    for (int i = 0; i < filter_count; ++i)
+    {
+        unsigned int flags = 0;
+        std::size_t value_count = 8;
+        unsigned int values[8] = {};
+        unsigned int filter_config = 0;
+        auto const filter = H5Pget_filter2(properties.get(), unsigned(i), &flags, &value_count, values, 0, nullptr,
+                                           &filter_config);
+        if (filter != FILTER_VBZ_ID)
+        {
+            continue;
+        }
+        if (!vbz_filter_options(value_count, values, &options, &max_absolute_error))
+        {
+            return false;
+        }
+        filter_index = unsigned(i);
+        return true;
+    }
+    return false;
+}
+
+// Read the samples of the chunk at [offset] from the same dataset in [source].
+bool read_source_chunk(hid_t source, std::string const& path, hsize_t offset, hsize_t chunk_length, std::vector<char>& data)
+{
+    DatasetHandle dataset(H5Dopen2(source, path.c_str(), H5P_DEFAULT));
+    if (!dataset)
+    {
+        return false;
+    }
+    SpaceHandle space(H5Dget_space(dataset.get()));
+    TypeHandle type(H5Dget_type(dataset.get()));
+    hsize_t extent = 0;
+    if (H5Sget_simple_extent_ndims(space.get()) != 1 || H5Sget_simple_extent_dims(space.get(), &extent, nullptr) != 1
+        || offset >= extent)
+    {
+        return false;
+    }
+
+    hsize_t const count = std::min(chunk_length, extent - offset);
+    data.resize(count * H5Tget_size(type.get()));
+    H5Sselect_hyperslab(space.get(), H5S_SELECT_SET, &offset, nullptr, &count, nullptr);
+    SpaceHandle memory_space(H5Screate_simple(1, &count, nullptr));
+    return H5Dread(dataset.get(), type.get(), memory_space.get(), space.get(), H5P_DEFAULT, data.data()) >= 0;
+}
+
+// Queue every chunk of [path] in [file] for verification, false if it couldn't be read.
+bool verify_dataset(
+    hid_t file,
+    hid_t source,
+    std::string const& path,
+    std::string const& name,
+    ChunkVerifier& verifier,
+    FileTotals& totals)
+{
+    DatasetHandle dataset(H5Dopen2(file, path.c_str(), H5P_DEFAULT));
+    if (!dataset)
+    {
+        return false;
+    }
+
+    CompressionOptions options;
+    vbz_size_t max_absolute_error = 0;
+    unsigned filter_index = 0;
+    if (!find_vbz_options(dataset.get(), options, max_absolute_error, filter_index))
+    {
+        ++totals.skipped_dataset_count;
+        return true;
+    }
+    ++totals.dataset_count;
+
+    PropertiesHandle properties(H5Dget_create_plist(dataset.get()));
+    SpaceHandle space(H5Dget_space(dataset.get()));
+    hsize_t chunk_length = 0;
+    hsize_t chunk_count = 0;
+    if (H5Pget_chunk(properties.get(), 1, &chunk_length) != 1
+        || H5Dget_num_chunks(dataset.get(), space.get(), &chunk_count) < 0)
+    {
+        return false;
+    }
+
+    for (hsize_t i = 0; i < chunk_count; ++i)
+    {
+        hsize_t offset = 0;
+        unsigned filter_mask = 0;
+        haddr_t address = 0;
+        hsize_t size = 0;
+        if (H5Dget_chunk_info(dataset.get(), space.get(), i, &offset, &filter_mask, &address, &size) < 0)
+        {
+            return false;
+        }
+
+        ChunkTask task{ &totals, &name, offset, options, max_absolute_error, std::vector<char>(size), {} };
+        if (H5Dread_chunk(dataset.get(), H5P_DEFAULT, &offset, &filter_mask, task.compressed.data()) < 0)
+        {
+            return false;
+        }
+        // The filter was skipped for this chunk (it failed when writing, the filter is optional), so it's stored raw.
+        if (filter_mask & (1u << filter_index))
+        {
+            continue;
+        }
+        if (source >= 0 && !read_source_chunk(source, path, offset, chunk_length, task.expected))
+        {
+            ++totals.failure_count;
+            std::cerr << "FAILED " << name << " chunk at " << offset << ": missing from the source file" << std::endl;
+            continue;
+        }
+
+        ++totals.chunk_count;
+        totals.compressed_bytes += size;
+        verifier.push(std::move(task));
+    }
+    return true;
+}
+
+// Verify every signal dataset in [path], reporting the file's totals, false if anything failed.
+bool verify_file(std::string const& path, std::string const& source_file, ChunkVerifier& verifier)
+{
+    auto const start = std::chrono::steady_clock::now();
+    FileHandle file(H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+    if (!file)
+    {
+        std::cerr << "FAILED " << path << ": can't be opened" << std::endl;
+        return false;
+    }
+    FileHandle source(source_file.empty() ? -1 : H5Fopen(source_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+    if (!source_file.empty() && !source)
+    {
+        std::cerr << "FAILED " << path << ": source " << source_file << " can't be opened" << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> datasets;
+    if (H5Ovisit(file.get(), H5_INDEX_NAME, H5_ITER_NATIVE, &collect_signal_dataset, &datasets) < 0)
+    {
+        std::cerr << "FAILED " << path << ": can't be enumerated" << std::endl;
+        return false;
+    }
+
+    FileTotals totals;
+    std::vector<std::string> names;
+    names.reserve(datasets.size());
+    for (auto const& dataset : datasets)
+    {
+        names.push_back(path + ":" + dataset);
+        if (!verify_dataset(file.get(), source.get(), dataset, names.back(), verifier, totals))
+        {
+            ++totals.failure_count;
+            std::cerr << "FAILED " << names.back() << ": can't be read" << std::endl;
+        }
+    }
+    verifier.wait();
+
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << path << ": " << (totals.failure_count == 0 ? "OK" : "FAILED")
+              << ", " << totals.dataset_count << " datasets (" << totals.skipped_dataset_count << " not vbz), "
+              << totals.chunk_count << " chunks, " << totals.failure_count << " failures, "
+              << totals.compressed_bytes << " -> " << totals.decoded_bytes << " bytes in " << seconds << " s, "
+              << double(totals.decoded_bytes) / 1e6 / std::max(seconds, 1e-9) << " MB/s" << std::endl;
+    return totals.failure_count == 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Arguments arguments;
+    if (!parse_arguments(argc, argv, arguments))
+    {
+        std::cerr << "Usage: " << argv[0] << " [-t <threads>] [--source <gzip fast5 file or directory>] <fast5 file>...\n"
+                  << "\n"
+                  << "Decodes every chunk of the vbz compressed Raw signal datasets in each file. With --source, each\n"
+                  << "chunk is compared with the original file (the file itself, or the one of the same name in a\n"
+                  << "directory)." << std::endl;
+        return 2;
+    }
+
+    // Failures are reported per chunk, HDF5's own error stack would only repeat them.
+    H5Eset_auto2(H5E_DEFAULT, nullptr, nullptr);
+
+    // Sources are read through the filters, and may be vbz compressed too.
+    vbz_register();
+
+    auto const start = std::chrono::steady_clock::now();
+    ChunkVerifier verifier(arguments.thread_count);
+    std::size_t failed_files = 0;
+    for (auto const& file : arguments.files)
+    {
+        if (!verify_file(file, source_path(arguments.source, file), verifier))
+        {
+            ++failed_files;
+        }
+    }
+
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << arguments.files.size() << " files, " << failed_files << " failed, " << seconds << " s" << std::endl;
+    return failed_files == 0 ? 0 : 1;
+}